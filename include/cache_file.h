@@ -0,0 +1,101 @@
+#ifndef CACHE_FILE_H
+#define CACHE_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Little-endian binary snapshots kept in FileManager::CACHE_DIR. Strings
+// are a u32 length followed by the bytes.
+
+class CacheWriter {
+public:
+    std::string data;
+    
+    void put_u8(uint8_t value) {
+        data.push_back(static_cast<char>(value));
+    }
+    
+    void put_u32(uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            data.push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+        }
+    }
+    
+    void put_u64(uint64_t value) {
+        put_u32(static_cast<uint32_t>(value));
+        put_u32(static_cast<uint32_t>(value >> 32));
+    }
+    
+    void put_string(const std::string& value) {
+        put_u32(static_cast<uint32_t>(value.size()));
+        data.append(value);
+    }
+};
+
+class CacheReader {
+public:
+    CacheReader(const std::vector<char>& buffer) : data(buffer), pos(0), ok(true) {}
+    
+    bool good() const { return ok; }
+    bool at_end() const { return pos == data.size(); }
+    
+    uint8_t get_u8() {
+        if (!require(1)) return 0;
+        return static_cast<uint8_t>(data[pos++]);
+    }
+    
+    uint32_t get_u32() {
+        if (!require(4)) return 0;
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) {
+            value |= static_cast<uint32_t>(static_cast<uint8_t>(data[pos++])) << (i * 8);
+        }
+        return value;
+    }
+    
+    uint64_t get_u64() {
+        uint64_t low = get_u32();
+        uint64_t high = get_u32();
+        return low | (high << 32);
+    }
+    
+    void get_string(std::string& value) {
+        uint32_t length = get_u32();
+        if (!require(length)) return;
+        value.assign(&data[0] + pos, length);
+        pos += length;
+    }
+    
+    // Upper bound for element counts so a corrupt file cannot trigger huge reserves
+    bool plausible_count(uint32_t count, size_t min_element_size) const {
+        return ok && count <= (data.size() - pos) / min_element_size;
+    }
+    
+private:
+    const std::vector<char>& data;
+    size_t pos;
+    bool ok;
+    
+    bool require(size_t bytes) {
+        if (!ok || data.size() - pos < bytes) {
+            ok = false;
+            return false;
+        }
+        return true;
+    }
+};
+
+// FNV-1a; keeps cache file names short and stable
+uint64_t cache_hash(const char* data, size_t length, uint64_t hash = 14695981039346656037ull);
+
+// "<CACHE_DIR>/<16 hex digits><extension>"
+std::string cache_file_path(uint64_t hash, const char* extension);
+
+// Reads the whole file in one go; there is no mmap on the Vita
+bool read_cache_file(const std::string& path, std::vector<char>& buffer);
+
+// Writes to a temporary file first so a crash never leaves a torn snapshot
+bool write_cache_file(const std::string& path, const std::string& data);
+
+#endif // CACHE_FILE_H
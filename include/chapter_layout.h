@@ -0,0 +1,69 @@
+#ifndef CHAPTER_LAYOUT_H
+#define CHAPTER_LAYOUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Everything that moves line or page breaks; a layout, a page map or a
+// prepared chapter is only valid for the settings it was built with
+struct LayoutSettings {
+    int max_width;
+    int font_size;              // Body size; headings scale from it
+    int line_spacing;           // Added to the font size for the line height
+    int page_height;
+    bool justify;               // Optimal-fit breaks and even margins for paragraphs
+    bool hyphenate;             // Paragraphs break inside words at hyphenation points
+    
+    LayoutSettings()
+        : max_width(860), font_size(18), line_spacing(6), page_height(400), justify(true), hyphenate(true) {}
+    
+    bool operator==(const LayoutSettings& other) const {
+        return max_width == other.max_width && font_size == other.font_size &&
+               line_spacing == other.line_spacing && page_height == other.page_height &&
+               justify == other.justify && hyphenate == other.hyphenate;
+    }
+    bool operator!=(const LayoutSettings& other) const { return !(*this == other); }
+};
+
+// One laid-out line: a byte range of the chapter text plus where it goes
+struct TextLine {
+    uint32_t offset;            // First byte in the chapter text
+    uint32_t length;
+    int32_t y;                  // Top of the line, from the top of the chapter
+    int16_t x;                  // Indent from the left margin
+    int16_t slack;              // Width spread over the spaces when justified
+    uint8_t block_kind;         // TextBlockKind; selects font size
+    uint8_t height;
+    bool hyphen;                // Ends inside a word; a hyphen is drawn after it
+};
+
+// Wrapped chapter as span records over the chapter's StyledText, which must
+// outlive it. Lines are sorted by both offset and y, so finding the first
+// visible line or the line holding an offset is a binary search.
+class ChapterLayout {
+public:
+    std::vector<TextLine> lines;
+    int font_size;              // Body size the layout was built for
+    int height;                 // Total height of all lines and gaps
+    
+    ChapterLayout() : font_size(0), height(0) {}
+    
+    // First line whose bottom edge is below y
+    size_t line_at_y(int y) const;
+    
+    // Line holding the text offset, or the last line starting before it
+    size_t line_for_offset(uint32_t offset) const;
+    
+    // Index of the first line of every page. A page holds whole lines only;
+    // an empty layout still has one page.
+    void paginate(int page_height, std::vector<size_t>& page_first_lines) const;
+    
+    bool empty() const { return lines.empty(); }
+    void clear();
+    
+    // Size a block of this TextBlockKind is drawn at
+    static int block_font_size(uint8_t block_kind, int font_size);
+};
+
+#endif // CHAPTER_LAYOUT_H
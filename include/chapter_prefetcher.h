@@ -0,0 +1,71 @@
+#ifndef CHAPTER_PREFETCHER_H
+#define CHAPTER_PREFETCHER_H
+
+#include "content_model.h"
+#include "chapter_layout.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class GPURenderer;
+
+// Spine document that has been decompressed, stripped and laid out
+struct PreparedChapter {
+    int32_t spine_index;
+    ChapterLayout layout;
+    
+    PreparedChapter() : spine_index(-1) {}
+};
+
+// Prepares the spine neighbours of the open chapter on a worker thread, so
+// chapter turns can swap in a finished layout instead of building it inside
+// the frame. Only the most recent neighbours are kept; work for chapters
+// that are no longer adjacent is cancelled between stages.
+class ChapterPrefetcher {
+public:
+    static const size_t MAX_PREPARED = 2;
+    static const int32_t NO_CHAPTER = -1;
+    
+    ChapterPrefetcher(BookContent* content, GPURenderer* renderer, const LayoutSettings& settings);
+    ~ChapterPrefetcher();
+    
+    // Queue the previous and next spine items of spine_index, dropping
+    // anything queued or prepared for other chapters
+    void prefetch_around(int32_t spine_index);
+    
+    // Moves a prepared chapter into the caller's hands. If the worker is
+    // preparing that chapter right now, waits for it instead of redoing it.
+    bool take(int32_t spine_index, PreparedChapter& chapter);
+    
+    // Drops all queued and prepared work; returns once the worker is idle
+    void cancel_all();
+    
+    // Layouts prepared from now on use these; call after cancel_all
+    void set_settings(const LayoutSettings& settings);
+    
+private:
+    BookContent* content;
+    GPURenderer* renderer;
+    LayoutSettings settings;
+    
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;       // New work or shutdown
+    std::condition_variable idle;       // In-flight chapter finished
+    std::deque<int32_t> queue;
+    std::vector<PreparedChapter> ready;
+    int32_t in_flight;
+    std::atomic<bool> cancel_in_flight;
+    bool quit;
+    
+    ChapterPrefetcher(const ChapterPrefetcher&) = delete;
+    ChapterPrefetcher& operator=(const ChapterPrefetcher&) = delete;
+    
+    void run();
+    bool is_queued_or_ready(int32_t spine_index) const;
+};
+
+#endif // CHAPTER_PREFETCHER_H
@@ -0,0 +1,91 @@
+#ifndef CHAPTER_STREAM_H
+#define CHAPTER_STREAM_H
+
+#include "epub_parser.h"
+#include "html_text.h"
+#include "line_breaker.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+class GPURenderer;
+
+// Streaming inflate -> tokenize -> wrap pipeline for oversized chapters.
+// Only a sliding window of wrapped lines is kept; seeking behind the window
+// restarts the stream from the top of the chapter. Each paragraph is
+// broken by LineBreaker::break_lines once it has streamed in, so lines
+// match a laid-out chapter's ragged ones; hyphenated lines end with the
+// hyphen in their text. A paragraph longer than MAX_PARAGRAPH_BYTES is
+// broken up to its last space and carried on from its last line. Anchors
+// are collected as the text streams past and kept across restarts.
+class ChapterStream {
+public:
+    static const size_t CHUNK_SIZE = 16 * 1024;
+    static const size_t WINDOW_LINES = 1024;
+    static const size_t MAX_PARAGRAPH_BYTES = 64 * 1024;
+    static const size_t MAX_PUMP_LINES = WINDOW_LINES / 4;  // Lines a pump emits, so none it emits are dropped
+    
+    ChapterStream(EPUBParser* parser, GPURenderer* renderer);
+    
+    bool open(const std::string& href, int max_width, int font_size, bool hyphenate);
+    bool ensure_line(size_t line_index);
+    void close();
+    
+    bool finished() const { return input_done && pending_text.empty() && paragraph.empty(); }
+    size_t window_start() const { return first_line; }
+    size_t lines_produced() const { return first_line + lines.size(); }
+    const std::vector<std::string>& window() const { return lines; }
+    
+    // Where a line starts in the extracted chapter text. Unlike line
+    // indices, offsets do not depend on the font or line width.
+    uint32_t line_offset(size_t line_index) const;
+    
+    // Streams on to the line holding a text offset and returns its index
+    size_t seek_offset(uint32_t offset);
+    
+    // Text offset of an id or name anchor streamed past so far
+    bool find_anchor(const std::string& name, uint32_t& offset) const { return anchors.find(name, offset); }
+    bool find_anchor(const char* name, uint32_t& offset) const { return anchors.find(name, offset); }
+    size_t anchors_seen() const { return anchors.size(); }
+    
+    // Streams on until the anchor has been seen; false if the chapter has none
+    bool seek_anchor(const std::string& name, uint32_t& offset);
+    
+private:
+    EPUBParser* epub_parser;
+    GPURenderer* renderer;
+    std::unique_ptr<LineBreaker> breaker;
+    EPUBParser::EntryStream stream;
+    HtmlTextExtractor extractor;
+    AnchorIndex anchors;
+    bool anchors_complete;      // The whole chapter has streamed past once
+    
+    std::string href;
+    int max_width;
+    int font_size;
+    
+    std::vector<char> chunk;
+    std::string pending_text;
+    std::string paragraph;      // Text not yet in a line, whole codepoints only
+    uint32_t paragraph_offset;  // Where paragraph starts in the extracted text
+    
+    // Lines broken from paragraph and not yet emitted, then the bytes of
+    // paragraph they use up
+    std::vector<LineSpan> spans;
+    size_t next_span;
+    size_t broken_bytes;
+    bool input_done;
+    
+    std::vector<std::string> lines;
+    std::vector<uint32_t> line_offsets;     // Parallel to lines
+    size_t first_line;
+    
+    bool restart();
+    void pump();
+    void wrap_pending_text();
+    void break_paragraph(size_t length, bool keep_last_line);
+    void emit_spans();
+    void emit_line(const std::string& line, uint32_t offset);
+};
+
+#endif // CHAPTER_STREAM_H
@@ -0,0 +1,81 @@
+#ifndef CONTENT_MODEL_H
+#define CONTENT_MODEL_H
+
+#include "epub_parser.h"
+#include "html_text.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Reading-order view of an opened book. Documents are addressed by spine
+// index; TOC entries resolve to a spine index plus an offset into that
+// document's extracted text. Each document loaded for reading is inflated
+// and tokenized at most once per book session; read_document extracts one
+// without keeping it, for passes over the whole book. Loading is safe from
+// any thread, and documents are read and extracted outside the lock.
+class BookContent {
+public:
+    static const uint64_t MAX_DOCUMENT_SIZE = 1024 * 1024;
+    
+    struct Position {
+        int32_t spine_index;
+        uint32_t offset;            // Offset into the document's extracted text
+        const char* fragment;       // Anchor left for the reader's stream to find, or nullptr
+    };
+    
+    struct Document {
+        StyledText styled;
+        AnchorIndex anchors;
+    };
+    
+    // TOC indices of the entries into one spine document, in TOC order
+    struct TocEntries {
+        const uint32_t* first;
+        const uint32_t* last;
+        
+        const uint32_t* begin() const { return first; }
+        const uint32_t* end() const { return last; }
+    };
+    
+    explicit BookContent(EPUBParser* parser);
+    
+    // Drops every cached document and indexes the TOC by spine document;
+    // call after opening a new book
+    void reset();
+    
+    size_t spine_count() const;
+    const char* spine_href(size_t spine_index) const;
+    int32_t spine_index_for_href(const std::string& href) const;
+    
+    // Documents too large to hold in memory are streamed by the reader
+    // instead. They are never cached, so their fragments are not resolved
+    // here: the reader's ChapterStream collects their anchors.
+    bool is_oversized(size_t spine_index);
+    
+    // Loads and caches the document; nullptr if it cannot be read
+    const Document* load_document(size_t spine_index);
+    
+    // The cached document, or nullptr if it has not been loaded
+    const Document* cached_document(size_t spine_index);
+    
+    // Extracts the document into the caller's document without caching it;
+    // buffer holds the inflated bytes and may be reused across calls
+    bool read_document(size_t spine_index, std::vector<char>& buffer, Document& document);
+    bool resolve_toc_entry(size_t toc_index, Position& position);
+    TocEntries toc_entries(size_t spine_index) const;
+    
+    size_t documents_loaded() const { return load_count; }
+    
+private:
+    EPUBParser* epub_parser;
+    std::vector<std::unique_ptr<Document>> documents;   // Indexed by spine position
+    std::vector<int32_t> spine_by_manifest;
+    std::vector<int32_t> spine_by_toc;                  // Spine index per TOC entry, or -1
+    std::vector<uint32_t> toc_by_spine;                 // TOC indices grouped by spine index
+    std::vector<uint32_t> toc_by_spine_start;           // Each spine index's first in toc_by_spine
+    size_t load_count;
+    std::mutex mutex;                   // Guards documents and load_count
+};
+
+#endif // CONTENT_MODEL_H
@@ -0,0 +1,160 @@
+#ifndef DISPLAY_LIST_H
+#define DISPLAY_LIST_H
+
+#include "glyph_atlas.h"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Laid out as vita2d_color_vertex, as QuadVertex is as vita2d_texture_vertex
+struct ColorVertex {
+    float x, y, z;
+    uint32_t color;
+};
+
+// Where a display list's batches are drawn. Vertices are triangle lists,
+// or line lists for draw_lines, and only valid during the call.
+// Textures and fonts are the backend's own handles.
+class DisplayBackend {
+public:
+    virtual ~DisplayBackend() {}
+    
+    virtual void draw_triangles(const ColorVertex* vertices, size_t count) = 0;
+    virtual void draw_lines(const ColorVertex* vertices, size_t count) = 0;
+    virtual void draw_textured(const void* texture, const QuadVertex* vertices, size_t count, uint32_t tint) = 0;
+    virtual void draw_text(const void* font, int x, int y, uint32_t color, int size, const char* text) = 0;
+    virtual void set_clip(bool enabled, int x, int y, int width, int height) = 0;
+};
+
+// Records a frame's drawing and submits it in as few batches as it can.
+// A command joins the latest batch of its kind and state (solid fills,
+// lines, one texture and tint, one font) unless something recorded since
+// overlaps it; it is then drawn earlier than recorded, but never before
+// anything it covers or that covers it. Clip changes are barriers.
+//
+// Fonts draw a call per command, so text batches only group calls by font.
+class DisplayList {
+public:
+    struct Stats {
+        uint32_t commands;
+        uint32_t batches;
+        uint32_t draw_calls;        // Backend calls, clip changes aside
+    };
+    
+    static const size_t MAX_LOOKBACK = 16;     // Batches searched for one to join
+    
+    DisplayList();
+    
+    void fill_rect(int x, int y, int width, int height, uint32_t color);
+    void line(int x1, int y1, int x2, int y2, uint32_t color);
+    
+    // Draws a texture_width x texture_height texture's part at (x, y)
+    void texture_part(const void* texture, int texture_width, int texture_height, int x, int y,
+                      int texture_x, int texture_y, int width, int height, uint32_t tint = 0xFFFFFFFFu);
+    
+    // text is NUL-terminated and copied. width bounds it for reordering;
+    // pass what is left of the screen when it is not known.
+    void text(const void* font, int x, int y, uint32_t color, int size, const char* text, int width);
+    
+    void set_clip(int x, int y, int width, int height);
+    void clear_clip();
+    
+    // Draws everything recorded, in order, and starts over
+    void submit(DisplayBackend& backend);
+    
+    bool empty() const { return commands.empty(); }
+    
+    // Counts for the last submit
+    const Stats& stats() const { return last_stats; }
+    
+private:
+    enum Kind { KIND_FILL, KIND_LINE, KIND_TEXTURE, KIND_TEXT, KIND_CLIP };
+    
+    struct Rect {
+        int left, top, right, bottom;  // Half-open
+        
+        bool overlaps(const Rect& other) const {
+            return left < other.right && other.left < right && top < other.bottom && other.top < bottom;
+        }
+    };
+    
+    // A fill, line or quad's vertices, or one text
+    struct Command {
+        uint32_t first;             // First vertex, or index into texts
+        uint32_t count;             // Vertices
+        uint32_t next;              // Next command of the batch, or NO_COMMAND
+    };
+    
+    struct TextCommand {
+        const void* font;
+        int x, y;
+        uint32_t color;
+        int size;
+        uint32_t offset;            // Into text_bytes
+    };
+    
+    struct Batch {
+        Kind kind;
+        const void* handle;         // Texture or font
+        uint32_t tint;
+        Rect bounds;                // Of every command in it; the clip for clip changes
+        bool clip_enabled;
+        uint32_t first_command;
+        uint32_t last_command;
+    };
+    
+    static const uint32_t NO_COMMAND = 0xFFFFFFFFu;
+    
+    std::vector<Command> commands;
+    std::vector<Batch> batches;
+    std::vector<ColorVertex> color_vertices;
+    std::vector<QuadVertex> quad_vertices;
+    std::vector<TextCommand> texts;
+    std::string text_bytes;
+    
+    // Gathered batch vertices, kept between submits
+    std::vector<ColorVertex> color_scratch;
+    std::vector<QuadVertex> quad_scratch;
+    
+    Stats last_stats;
+    
+    // Adds a command for the newest vertices or text and files it in a batch
+    void add(Kind kind, const void* handle, uint32_t tint, const Rect& bounds, uint32_t first, uint32_t count);
+    void add_clip(bool enabled, const Rect& clip);
+    void clear();
+};
+
+// Counts what a display list would draw, for hosts and benchmarks;
+// nothing is drawn
+class RecordingBackend : public DisplayBackend {
+public:
+    struct Counts {
+        uint32_t fill_batches;
+        uint32_t line_batches;
+        uint32_t texture_batches;
+        uint32_t text_draws;
+        uint32_t clip_changes;
+        uint32_t vertices;
+    };
+    
+    RecordingBackend() { reset(); }
+    
+    void draw_triangles(const ColorVertex* vertices, size_t count);
+    void draw_lines(const ColorVertex* vertices, size_t count);
+    void draw_textured(const void* texture, const QuadVertex* vertices, size_t count, uint32_t tint);
+    void draw_text(const void* font, int x, int y, uint32_t color, int size, const char* text);
+    void set_clip(bool enabled, int x, int y, int width, int height);
+    
+    const Counts& counts() const { return totals; }
+    void reset();
+    
+    // One line per screen for a benchmark report, with the list's own stats
+    void report(std::ostream& out, const std::string& screen, const DisplayList::Stats& stats) const;
+    
+private:
+    Counts totals;
+};
+
+#endif // DISPLAY_LIST_H
@@ -2,52 +2,242 @@
 #define EPUB_PARSER_H
 
 #include <zip.h>
-#include <tinyxml2.h>
+#include <zlib.h>
+#include "string_pool.h"
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <unordered_map>
 
 class EPUBParser {
 public:
-    struct ManifestItem {
-        std::string id;
-        std::string href;
-        std::string media_type;
+    // Media types the reader cares about, resolved once while parsing the OPF
+    enum MediaType {
+        MEDIA_OTHER,
+        MEDIA_XHTML,
+        MEDIA_NCX,
+        MEDIA_CSS,
+        MEDIA_IMAGE,
+        MEDIA_FONT
+    };
+    
+    // Manifest in struct-of-arrays form over an interned string pool. The
+    // id and href lookup tables are indexed by pool symbol, so resolving a
+    // reference costs one intern-table probe and no string compares after it.
+    class Manifest {
+    public:
+        static const int32_t NO_ITEM = -1;
+        
+        Manifest() : ncx(NO_ITEM) {}
+        
+        size_t size() const { return ids.size(); }
+        const char* id(size_t index) const { return strings.c_str(ids[index]); }
+        const char* href(size_t index) const { return strings.c_str(hrefs[index]); }
+        const char* media_type(size_t index) const { return strings.c_str(media_types[index]); }
+        MediaType type(size_t index) const { return static_cast<MediaType>(types[index]); }
+        
+        int32_t find_by_id(const std::string& id) const;
+        int32_t find_by_href(const std::string& href) const;
+        int32_t ncx_item() const { return ncx; }
+        
+        static MediaType classify(const char* media_type, size_t length);
+        
+    private:
+        friend class EPUBParser;
+        
+        StringPool strings;
+        std::vector<StringPool::Symbol> ids;
+        std::vector<StringPool::Symbol> hrefs;
+        std::vector<StringPool::Symbol> media_types;
+        std::vector<uint8_t> types;
+        std::vector<int32_t> item_by_symbol_id;
+        std::vector<int32_t> item_by_symbol_href;
+        int32_t ncx;
+        
+        int32_t add(const std::string& id, const std::string& href, const std::string& media_type);
+        void rebuild_lookups();
+        void clear();
     };
     
     struct SpineItem {
-        std::string idref;
+        uint32_t manifest_index;    // Resolved from the itemref's idref
         bool linear;
     };
     
+    // TOC node stored in pre-order in one flat array. Strings are offsets of
+    // NUL-terminated slices in the table's shared string pool.
     struct TOCEntry {
-        std::string id;
-        std::string title;
-        std::string content_src;
-        int play_order;
-        std::vector<TOCEntry> children;
+        uint32_t id;
+        uint32_t title;
+        uint32_t content_src;
+        int32_t play_order;
+        int32_t parent;             // Indices into the entry array, or NO_ENTRY
+        int32_t first_child;
+        int32_t next_sibling;
     };
-
+    
+    // Read-only view over the flattened table of contents
+    class TableOfContents {
+    public:
+        static const int32_t NO_ENTRY = -1;
+        
+        size_t size() const { return entries.size(); }
+        bool empty() const { return entries.empty(); }
+        const TOCEntry& entry(size_t index) const { return entries[index]; }
+        const char* id(size_t index) const { return &strings[entries[index].id]; }
+        const char* title(size_t index) const { return &strings[entries[index].title]; }
+        const char* content_src(size_t index) const { return &strings[entries[index].content_src]; }
+        
+        // Top-level entries in document order, i.e. the book's chapters
+        size_t top_level_count() const { return roots.size(); }
+        size_t top_level(size_t position) const { return roots[position]; }
+        
+    private:
+        friend class EPUBParser;
+        
+        std::vector<TOCEntry> entries;
+        std::vector<uint32_t> roots;
+        std::string strings;
+        
+        void clear();
+        void rebuild_roots();
+    };
+    
+    // Central directory record for one archive member, built once per book
+    struct ZipEntry {
+        zip_uint64_t index;         // libzip index, used by the fallback path
+        uint64_t local_offset;      // Local header in the archive file, or LIBZIP_ONLY
+        uint64_t compressed_size;
+        uint64_t size;
+        uint16_t compression;       // ZIP_CM_STORE, ZIP_CM_DEFLATE, ...
+    };
+    
+    // Read-only view of a member's bytes in the caller's buffer
+    struct EntryView {
+        const char* data;
+        size_t size;
+        
+        EntryView() : data(nullptr), size(0) {}
+    };
+    
+    // How the last open_epub went
+    struct OpenStats {
+        bool index_cached;          // Container, OPF and NCX came from the index cache
+        float open_ms;
+    };
+    
+    // Members read through libzip: encrypted, ZIP64 or not stored or deflated
+    static const uint64_t LIBZIP_ONLY = ~static_cast<uint64_t>(0);
+    
+    // Largest member read whole; bigger ones must be streamed
+    static const uint64_t MAX_ENTRY_SIZE = 32 * 1024 * 1024;
+    
+    // Incremental reader over one member. Each read() decodes at most the
+    // requested number of bytes, so peak memory is bounded by the caller's
+    // chunk size rather than the member size. A stream reads through its
+    // own file handle, so it may be used on any thread.
+    class EntryStream {
+    public:
+        EntryStream();
+        ~EntryStream();
+        
+        size_t read(char* out, size_t capacity);
+        bool finished() const { return failed || produced >= total_size; }
+        bool has_error() const { return failed; }
+        uint64_t size() const { return total_size; }
+        void close();
+        
+    private:
+        friend class EPUBParser;
+        
+        EntryStream(const EntryStream&) = delete;
+        EntryStream& operator=(const EntryStream&) = delete;
+        
+        FILE* source;
+        uint64_t remaining_input;   // Member bytes not read from source yet
+        std::vector<uint8_t> input; // Compressed bytes waiting for the inflater
+        uint16_t compression;
+        zip_file_t* file;
+        z_stream inflater;
+        bool inflater_ready;
+        uint64_t total_size;
+        uint64_t produced;
+        bool failed;
+    };
+    
 private:
-    zip_t* archive;
+    zip_t* archive;                 // Opened only for members the direct path cannot read
     std::string container_root;
-    std::unordered_map<std::string, ManifestItem> manifest;
+    
+    // Only the central directory is kept in memory; member data is read
+    // from the file when asked for
+    std::string archive_path;
+    FILE* archive_file;
+    uint64_t archive_size;
+    bool direct_index;              // Indexed from the central directory, not by libzip
+    std::vector<ZipEntry> entries;
+    std::unordered_map<std::string, size_t> entry_index;
+    z_stream inflater;
+    bool inflater_ready;
+    std::vector<uint8_t> read_chunk;
+    std::string path_scratch;
+    std::vector<char> package_buffer;
+    
+    // Guards archive_file, archive, the shared inflater and path_scratch;
+    // content may be read from worker threads while the UI thread looks up
+    // entries
+    std::mutex content_mutex;
+    
+    OpenStats open_result;
+    
+    static const size_t READ_CHUNK_SIZE = 16 * 1024;
+    
+    Manifest manifest;
     std::vector<SpineItem> spine;
-    std::vector<TOCEntry> toc;
-
+    TableOfContents toc;
+    
 public:
+    EPUBParser();
+    ~EPUBParser();
+    
     bool open_epub(const std::string& path);
     bool parse_container();
     bool parse_opf(const std::string& opf_path);
     bool parse_ncx(const std::string& ncx_path);
     std::string get_content(const std::string& href);
-    const std::vector<TOCEntry>& get_table_of_contents() const;
+    bool get_content_view(const std::string& href, std::vector<char>& buffer, EntryView& view);
+    const ZipEntry* find_entry(const std::string& path) const;
+    const ZipEntry* find_content_entry(const std::string& href);
+    bool read_entry(const ZipEntry& entry, std::vector<char>& buffer, EntryView& view);
+    bool open_stream(const std::string& href, EntryStream& stream);
+    
+    // Whether worker threads may read members. Direct reads lock or use
+    // their own handles; a book only libzip could index shares its handle.
+    bool can_read_concurrently() const { return direct_index; }
+    
+    const OpenStats& open_stats() const { return open_result; }
+    
+    const TableOfContents& get_table_of_contents() const;
     const std::vector<SpineItem>& get_spine() const;
+    const Manifest& get_manifest() const;
     void close();
     
 private:
+    bool load_archive(const std::string& path);
+    bool index_central_directory();
+    bool index_with_libzip();
+    bool open_libzip();
+    bool read_with_libzip(const ZipEntry& entry, std::vector<char>& buffer, EntryView& view);
     std::string extract_file(const std::string& path);
-    TOCEntry parse_nav_point(tinyxml2::XMLElement* navPoint);
+    bool read_package_file(const std::string& path, EntryView& view);
+    
+    // Binary snapshot of the container root, manifest, spine and TOC kept in
+    // FileManager::CACHE_DIR (see index_cache.cpp)
+    static const uint32_t INDEX_CACHE_VERSION = 3;
+    bool load_index_cache(const std::string& book_path, uint64_t book_size, uint64_t book_mtime);
+    bool save_index_cache(const std::string& book_path, uint64_t book_size, uint64_t book_mtime) const;
 };
 
 #endif // EPUB_PARSER_H
\ No newline at end of file
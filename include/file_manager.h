@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 #include <psp2/io/fcntl.h>
 #include <psp2/io/devctl.h>
 #include <psp2/io/dirent.h>
@@ -20,6 +21,7 @@ public:
     static bool create_directory(const std::string& path);
     static bool file_exists(const std::string& path);
     static size_t get_file_size(const std::string& path);
+    static uint64_t get_file_mtime(const std::string& path);
     static bool delete_file(const std::string& path);
     static std::string get_epub_metadata(const std::string& path);
     
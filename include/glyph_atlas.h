@@ -0,0 +1,137 @@
+#ifndef GLYPH_ATLAS_H
+#define GLYPH_ATLAS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Where a glyph sits in the atlas. UVs are normalized, as vita2d's
+// textured vertices want them; an empty glyph has no size and no page.
+struct AtlasRegion {
+    uint16_t page;
+    uint16_t x, y;
+    uint16_t width, height;
+    float u0, v0, u1, v1;
+    
+    AtlasRegion() : page(0), x(0), y(0), width(0), height(0), u0(0), v0(0), u1(0), v1(0) {}
+};
+
+// Packs rectangles into rows ("shelves") of a fixed-size page. A rectangle
+// goes on the shelf it wastes the least height on, or opens a new shelf
+// when every fitting one is more than twice its height. Glyphs of one size
+// are nearly the same height, so shelves stay close to full.
+//
+// Released rectangles leave a slot on their shelf, which a later one no
+// wider and no taller than the shelf reuses; what it leaves over stays free.
+class ShelfPacker {
+public:
+    ShelfPacker(int width, int height);
+    
+    // Finds room for a width x height rectangle; false if the page is full
+    bool pack(int width, int height, int& x, int& y);
+    
+    // Frees a rectangle pack() returned, with the same width
+    void release(int x, int y, int width);
+    void clear();
+    
+    // Rows taken by shelves so far
+    int used_height() const { return top; }
+    
+    // Height of the shelf at row y, 0 if none starts there
+    int shelf_height(int y) const;
+    
+private:
+    struct Slot {
+        int x;
+        int width;
+    };
+    
+    struct Shelf {
+        int y;
+        int height;
+        int end;                    // First column never used
+        std::vector<Slot> free;     // Released columns before end
+    };
+    
+    std::vector<Shelf> shelves;     // In increasing y
+    int page_width;
+    int page_height;
+    int top;                        // First row below the last shelf
+    
+    // Takes the narrowest free slot on the lowest shelf from min_height to
+    // max_height that holds width
+    bool reuse(int width, int min_height, int max_height, int& x, int& y);
+};
+
+// 8-bit coverage bitmaps packed into square pages, kept in memory so any
+// backend can upload them. Rows written since the last upload are tracked
+// per page, so a new glyph costs one small texture copy, not a page.
+class GlyphAtlas {
+public:
+    static const int PAGE_SIZE = 512;       // 256 KB per page
+    static const size_t MAX_PAGES = 4;
+    static const int PADDING = 1;           // Clear pixels around each glyph
+    
+    // Copies a bitmap in; false when no page has room left. pitch is the
+    // byte distance between rows.
+    bool add(const uint8_t* bitmap, int width, int height, int pitch, AtlasRegion& region);
+    
+    // Gives a region's room back. Its pixels stay until a new glyph takes
+    // the room, so a draw already queued from it is still right.
+    void release(const AtlasRegion& region);
+    
+    // Tallest glyph the room of a region could take once released: its
+    // shelf's height, less the borders
+    int room_height(const AtlasRegion& region) const;
+    
+    // Forgets every glyph; pages stay allocated and are cleared
+    void clear();
+    
+    size_t page_count() const { return pages.size(); }
+    const uint8_t* page_pixels(size_t page) const { return pages[page].pixels.data(); }
+    
+    // Rows [first_row, end_row) written since the last call; false if none
+    bool take_dirty_rows(size_t page, int& first_row, int& end_row);
+    
+private:
+    struct Page {
+        ShelfPacker packer;
+        std::vector<uint8_t> pixels;
+        int dirty_first;
+        int dirty_end;
+        
+        Page() : packer(PAGE_SIZE, PAGE_SIZE), pixels(PAGE_SIZE * PAGE_SIZE, 0), dirty_first(PAGE_SIZE), dirty_end(0) {}
+    };
+    
+    std::vector<Page> pages;
+};
+
+// Same layout as vita2d_texture_vertex
+struct QuadVertex {
+    float x, y, z;
+    float u, v;
+};
+
+// Glyph quads for one color, gathered per atlas page so each page is drawn
+// with a single call. Every quad is two triangles of a triangle list.
+class QuadBatch {
+public:
+    static const size_t VERTICES_PER_QUAD = 6;
+    
+    // Queues region's glyph with its top left at (x, y); empty regions are skipped
+    void add(const AtlasRegion& region, float x, float y);
+    void clear();
+    
+    bool empty() const { return quads == 0; }
+    size_t quad_count() const { return quads; }
+    
+    // Pages up to the highest one queued; some may have no vertices
+    size_t page_count() const { return pages.size(); }
+    const std::vector<QuadVertex>& vertices(size_t page) const { return pages[page]; }
+    
+private:
+    std::vector<std::vector<QuadVertex>> pages;
+    size_t quads = 0;
+};
+
+#endif // GLYPH_ATLAS_H
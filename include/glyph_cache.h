@@ -0,0 +1,91 @@
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include "glyph_atlas.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A rendered glyph: where its bitmap sits in the atlas and how to place it
+struct CachedGlyph {
+    AtlasRegion region;     // No size for blank glyphs
+    int16_t left, top;      // Bitmap offset from the pen position
+    int16_t advance_x;
+    
+    CachedGlyph() : left(0), top(0), advance_x(0) {}
+};
+
+// Rendered glyphs keyed by (face, pixel size, codepoint), with bitmaps in a
+// GlyphAtlas and metrics in a fixed array of entries, so a glyph costs no
+// allocation of its own. Lookups go through an open-addressing table.
+//
+// The cache holds at most byte_budget bytes of bitmaps. Past that, or when
+// the atlas has no room, it evicts with CLOCK: a sweep over the entries
+// that spares, once, every glyph used since it last went by. Glyphs used
+// since begin_batch() are never evicted, so a batch being built never
+// points at room a later glyph took.
+class GlyphCache {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t glyphs;
+        size_t bytes;           // Bitmap bytes held, borders not counted
+        
+        Stats() : hits(0), misses(0), evictions(0), glyphs(0), bytes(0) {}
+    };
+    
+    static const size_t DEFAULT_BYTE_BUDGET = 768 * 1024;
+    static const size_t DEFAULT_MAX_GLYPHS = 4096;
+    
+    explicit GlyphCache(size_t byte_budget = DEFAULT_BYTE_BUDGET, size_t max_glyphs = DEFAULT_MAX_GLYPHS);
+    
+    // Null on a miss
+    const CachedGlyph* find(uint16_t face, uint16_t size, uint32_t codepoint);
+    
+    // Adds a glyph find() missed, evicting to make room. Null if even that
+    // finds none; the glyph is not cached then.
+    const CachedGlyph* insert(uint16_t face, uint16_t size, uint32_t codepoint, const uint8_t* bitmap,
+                              int width, int height, int pitch, int left, int top, int advance_x);
+    
+    // Starts a new batch; glyphs used by the last one may be evicted again
+    void begin_batch() { ++batch; }
+    
+    // Drops every glyph; the counters keep counting
+    void clear();
+    
+    const Stats& stats() const { return counters; }
+    GlyphAtlas& atlas() { return pages; }
+    
+private:
+    static const uint16_t NO_ENTRY = 0xFFFF;
+    
+    struct Entry {
+        uint64_t key;           // 0 when the entry is free
+        CachedGlyph glyph;
+        uint32_t batch;         // Last batch that used it
+        bool referenced;        // Used since the clock hand last passed
+    };
+    
+    GlyphAtlas pages;
+    std::vector<Entry> entries;
+    std::vector<uint16_t> slots;    // Open addressing over entries, power-of-two sized
+    std::vector<uint16_t> free_entries;
+    size_t byte_budget;
+    size_t hand;
+    uint32_t batch;
+    uint32_t pinned_batch;          // A batch in which every glyph is in use
+    Stats counters;
+    
+    static uint64_t make_key(uint16_t face, uint16_t size, uint32_t codepoint);
+    static uint32_t hash(uint64_t key);
+    size_t find_slot(uint64_t key) const;
+    
+    // Evicts the next glyph on the clock that is not in use by this batch
+    // and whose room can hold a glyph height tall
+    bool evict(int height);
+    void remove(uint16_t index);
+};
+
+#endif // GLYPH_CACHE_H
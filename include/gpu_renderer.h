@@ -2,19 +2,116 @@
 #define GPU_RENDERER_H
 
 #include <vita2d.h>
+#include "styled_text.h"
+#include "line_breaker.h"
+#include "chapter_layout.h"
+#include "hyphenator.h"
+#include "display_list.h"
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
 class GPURenderer {
+public:
+    struct FrameStats {
+        uint32_t frames;
+        uint32_t page_blits;        // Frames whose page came from the cache
+        uint32_t page_fills;        // Times the cache was redrawn
+        uint32_t commands;          // Recorded in the last frame, page cache fills included
+        uint32_t batches;
+        uint32_t draw_calls;        // vita2d calls in the last frame; a font call draws per glyph
+        float frame_ms;             // CPU time of the last frame, up to the buffer swap
+    };
+    
 private:
-    vita2d_texture* text_cache_texture;
+    // Screen dimensions
+    static const int SCREEN_WIDTH = 960;
+    static const int SCREEN_HEIGHT = 544;
+    
+    // Where chapter text starts on screen
+    static const int PAGE_MARGIN_X = 50;
+    static const int PAGE_MARGIN_Y = 50;
+    
+    // The page cache is a column of screen-sized render targets, since
+    // vita2d projects every scene onto the screen's size. Two strips keep
+    // a quarter screen above and below the view.
+    static const int PAGE_STRIPS = 2;
+    static const int CACHE_HEIGHT = PAGE_STRIPS * SCREEN_HEIGHT;
+    
+    // What the strips hold, in content coordinates: a page's rows are its
+    // scroll offset minus PAGE_MARGIN_Y onwards
+    struct PageCache {
+        const void* source;         // Layout or line window drawn; null when empty
+        int top;                    // Content row of the first strip's first row
+        int font_size;
+        int line_height;            // Streamed windows only
+        size_t first_line;          // Streamed window at the time, if any
+        size_t end_line;
+        int complete_top;           // Rows no missing window line could reach
+        int complete_bottom;
+    };
+    
+    // A page drawn directly this frame, to be cached after it
+    struct PageFill {
+        bool pending;
+        const StyledText* text;
+        const ChapterLayout* layout;
+        const std::vector<std::string>* lines;
+        PageCache cache;
+    };
+    
+    vita2d_texture* page_strips[PAGE_STRIPS];
+    PageCache page_cache;
+    PageFill page_fill;
+    bool page_dependency;           // The next scene samples strips drawn since the last
+    uint32_t clear_color;
+    
+    FrameStats stats;
+    std::chrono::steady_clock::time_point frame_start;
+    
+    // Drawing is recorded for the frame and submitted in batches when it ends
+    DisplayList display;
+    std::unique_ptr<DisplayBackend> vita2d_backend;
+    DisplayBackend* backend;
+    
     vita2d_font* default_font;
     vita2d_font* bold_font;
     vita2d_font* italic_font;
     
-    // Screen dimensions
-    static const int SCREEN_WIDTH = 960;
-    static const int SCREEN_HEIGHT = 544;
+    // vita2d fonts keep a shared glyph atlas; layout may run on the prefetch thread
+    std::mutex font_mutex;
+    
+    // Layout widths per (font, size); taken before font_mutex, never inside it
+    std::map<std::pair<vita2d_font*, int>, std::unique_ptr<AdvanceTable>> advance_tables;
+    std::mutex advance_mutex;
+    
+    // Read-only once loaded, so layout threads share it without locking
+    Hyphenator hyphenation;
+    
+    // Per-frame text copies for vita2d, which wants NUL-terminated strings
+    std::string segment_scratch;
+    std::string utf8_scratch;
+    
+    vita2d_font* font_for_style(const TextStyle& style) const;
+    
+    // Draw under font_mutex; each returns the x after what it drew
+    int draw_styled_span(const StyledText& text, uint32_t offset, uint32_t end, int x, int y, int size);
+    int draw_justified_line(const StyledText& text, const TextLine& line, int x, int y, int size);
+    
+    // Draw the content rows from top on, placed at the target's first row
+    void draw_layout_lines(const StyledText& text, const ChapterLayout& layout, int top, int height);
+    void draw_window_lines(const std::vector<std::string>& lines, size_t first_line, int top, int height,
+                           int font_size, int line_height);
+    
+    bool page_cached(const PageCache& page, int view_top) const;
+    void blit_page(int view_top);
+    void request_page_fill(const PageCache& page, int view_top);
+    void fill_page_cache();
+    void submit_display_list();
     
 public:
     bool initialize();
@@ -34,18 +131,47 @@ public:
     void render_line(int x1, int y1, int x2, int y2, uint32_t color);
     
     // Page rendering functions
-    void render_cached_page(const std::vector<std::string>& lines, int scroll_offset);
+    void render_cached_page(const std::vector<std::string>& lines, int scroll_offset, size_t first_line,
+                            int font_size, int line_height);
+    void render_chapter_layout(const StyledText& text, const ChapterLayout& layout, int scroll_offset);
     void render_menu_item(const std::string& text, int x, int y, bool selected, uint32_t color = RGBA8(0, 0, 0, 255));
     void render_progress_bar(int x, int y, int width, int height, float progress, uint32_t fg_color, uint32_t bg_color);
     
+    // Pages are drawn once into the page cache and blitted while the view
+    // stays within it; call this when the chapter or its layout changes
+    void invalidate_page_cache() { page_cache.source = nullptr; page_fill.pending = false; }
+    const FrameStats& frame_stats() const { return stats; }
+    
+    // For drawing outside GPURenderer in frame order
+    DisplayList& display_list() { return display; }
+    
+    // Submits to another backend, such as a RecordingBackend; null for vita2d
+    void set_display_backend(DisplayBackend* other) { backend = other ? other : vita2d_backend.get(); }
+    
     // Utility functions
     void set_clip_rect(int x, int y, int width, int height);
     void clear_clip_rect();
     
-    void cleanup();
+    // Text layout
+    AdvanceTable& advance_table(int size);
+    std::vector<std::string> wrap_text_to_width(const std::string& text, int max_width, int font_size,
+                                                std::vector<size_t>* line_offsets = nullptr);
     
-private:
-    std::vector<std::string> wrap_text_to_width(const std::string& text, int max_width, int font_size);
+    // Lays out block by block, with headings at their own size and one
+    // body line of space between blocks
+    void layout_styled_text(const StyledText& text, const LayoutSettings& settings, ChapterLayout& layout);
+    static int block_font_size(uint8_t block_kind, int font_size) {
+        return ChapterLayout::block_font_size(block_kind, font_size);
+    }
+    static int line_height(int font_size, int line_spacing) { return font_size + line_spacing; }
+    
+    // Identifies the body font for cache keys
+    uint64_t font_fingerprint(int size) { return advance_table(size).fingerprint(); }
+    
+    // Null when no patterns could be loaded
+    const Hyphenator* hyphenator() const { return hyphenation.ready() ? &hyphenation : nullptr; }
+    
+    void cleanup();
 };
 
 #endif // GPU_RENDERER_H
\ No newline at end of file
@@ -0,0 +1,124 @@
+#ifndef HTML_TEXT_H
+#define HTML_TEXT_H
+
+#include "string_pool.h"
+#include "styled_text.h"
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstring>
+
+// Fragment identifiers (id/name attributes) mapped to the offset of the
+// extracted text at the point the element starts
+class AnchorIndex {
+public:
+    void add(const char* name, size_t length, uint32_t offset);
+    bool find(const char* name, size_t length, uint32_t& offset) const;
+    bool find(const std::string& name, uint32_t& offset) const { return find(name.data(), name.size(), offset); }
+    bool find(const char* name, uint32_t& offset) const { return find(name, std::strlen(name), offset); }
+    size_t size() const { return offsets.size(); }
+    void clear();
+    
+private:
+    StringPool names;
+    std::vector<uint32_t> offsets;  // Indexed by symbol
+};
+
+// Incremental HTML to plain text converter. Input may be fed in arbitrary
+// chunks; block elements become '\n', other tags single spaces (inline
+// formatting tags and comments nothing), script/style bodies are dropped,
+// whitespace runs are collapsed and character references are decoded to UTF-8.
+// One pass, no allocation beyond growth of the output string.
+class HtmlTextExtractor {
+public:
+    HtmlTextExtractor();
+    
+    void reset();
+    void feed(const char* data, size_t length, std::string& out);
+    
+    // Call after the last feed(); emits a reference cut off by end of input
+    void finish(std::string& out);
+    
+    // Optional; receives every id/name anchor with its text offset
+    void set_anchor_index(AnchorIndex* index) { anchors = index; }
+    
+    // Optional; receives style runs and blocks for the text. Feed into
+    // output->text so offsets line up, and call after reset().
+    void set_styled_output(StyledText* output);
+    size_t text_offset() const { return emitted; }
+    
+private:
+    enum State {
+        STATE_TEXT,
+        STATE_ENTITY,
+        STATE_TAG_OPEN,
+        STATE_TAG_NAME,
+        STATE_TAG_BODY,
+        STATE_TAG_QUOTED,
+        STATE_DECLARATION,      // After "<!"; "--" makes it a comment
+        STATE_COMMENT           // Ends only at "-->", whatever '>' it holds
+    };
+    
+    static const size_t MAX_TAG_NAME = 15;
+    static const size_t MAX_ATTR_NAME = 7;
+    static const size_t MAX_ANCHOR = 63;
+    static const size_t MAX_ENTITY = 10;
+    
+    State state;
+    char tag_name[MAX_TAG_NAME + 1];
+    size_t tag_length;
+    bool closing_tag;
+    bool self_closing;
+    char quote_char;
+    size_t dashes;              // Run of '-' ending at the current byte
+    char skip_tag[MAX_TAG_NAME + 1];
+    bool skipping;
+    bool last_was_space;
+    bool space_pending;         // Collapsed space not written yet; a break replaces it
+    size_t emitted;
+    size_t last_break_offset;
+    
+    // Output cursor into the caller's string, valid during feed()
+    char* write_begin;
+    char* write_pos;
+    
+    // Reference name between '&' and ';', kept across feed() calls
+    char entity[MAX_ENTITY];
+    size_t entity_length;
+    
+    // Attribute tracking, only used to pick up anchors
+    AnchorIndex* anchors;
+    char attr_name[MAX_ATTR_NAME + 2];
+    size_t attr_length;
+    bool in_attr_name;
+    bool anchor_value_next;
+    bool capturing_anchor;
+    char anchor[MAX_ANCHOR + 1];
+    size_t anchor_length;
+    
+    // Formatting state, only recorded when a styled output is set
+    StyledText* styled;
+    int bold_depth;
+    int italic_depth;
+    uint8_t heading;
+    uint16_t run_style;
+    size_t run_start;
+    
+    const char* scan_text(const char* p, const char* end);
+    void begin_tag();
+    void end_entity();
+    void flush_entity();
+    void tag_body_char(char c);
+    void end_tag();
+    void append_text(char c);
+    void write_pending_space();
+    void append_break();
+    void block_break(uint8_t kind);
+    void update_style();
+    void close_run();
+    
+    // A pending space holds its offset: it is written there, or a break is
+    size_t current_offset() const { return emitted + (write_pos - write_begin) + (space_pending ? 1 : 0); }
+};
+
+#endif // HTML_TEXT_H
@@ -0,0 +1,71 @@
+#ifndef HYPHENATOR_H
+#define HYPHENATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class AdvanceTable;
+
+// Liang's hyphenation, as in TeX, over patterns compiled into a packed
+// trie: every node's children sit at fixed distances from its base in one
+// array of 32-bit entries. The compiled form holds offsets, not pointers,
+// so it is cached in CACHE_DIR as is and used in place after one read.
+//
+// A word costs at most MAX_WORD_LENGTH + 2 trie walks, none deeper than
+// the longest pattern, and never allocates. Only words of ASCII letters
+// are hyphenated, ignoring punctuation around them, which is what the
+// shipped English patterns cover.
+class Hyphenator {
+public:
+    static const size_t MAX_WORD_LENGTH = 48;   // Longer words are left whole
+    static const size_t LEFT_MIN = 2;           // Letters before the first hyphen
+    static const size_t RIGHT_MIN = 3;          // Letters after the last one
+    
+    Hyphenator();
+    
+    // Uses the compiled patterns cached for this file unless it changed;
+    // otherwise compiles it and refreshes the cache
+    bool load(const std::string& pattern_path);
+    
+    // Patterns (hy3ph) and exceptions (acad-e-mies), one per line; '#'
+    // starts a comment
+    bool compile(const char* source, size_t length);
+    
+    bool ready() const { return trie != nullptr; }
+    
+    // Changes whenever the compiled patterns do
+    uint64_t fingerprint() const { return patterns_fingerprint; }
+    
+    // Size of the compiled form, as cached
+    size_t compiled_bytes() const { return blob.size(); }
+    
+    // Writes the byte offsets in word after which a hyphen may go, in
+    // increasing order, and returns how many; at most MAX_WORD_LENGTH
+    size_t hyphenate(const char* word, size_t length, uint8_t* points) const;
+    
+    // Furthest hyphenation point after from such that word[from, point)
+    // followed by a hyphen fits in room, or 0 if none does. width gets the
+    // piece's width without the hyphen.
+    size_t fit(const char* word, size_t length, size_t from, AdvanceTable& advances, int room, int& width) const;
+    
+private:
+    std::vector<char> blob;         // The compiled file
+    const uint8_t* letter_classes;  // Per byte; 0 for anything but a pattern letter
+    const uint32_t* trie;
+    const uint8_t* weights;
+    uint32_t trie_size;
+    uint32_t weights_size;
+    uint32_t root;
+    uint32_t class_mask;
+    uint32_t link_shift;
+    uint32_t link_mask;
+    uint32_t weights_shift;
+    uint64_t patterns_fingerprint;
+    
+    bool attach();
+    void detach();
+};
+
+#endif // HYPHENATOR_H
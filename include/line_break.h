@@ -0,0 +1,93 @@
+#ifndef LINE_BREAK_H
+#define LINE_BREAK_H
+
+#include <cstddef>
+#include <cstdint>
+
+// UAX #14 line break classes after LB1 is applied. The pair table covers
+// the classes up to LB_PAIR_CLASSES; the rest are handled by the scanner
+// before it looks at a pair. The order is the generator's.
+enum LineBreakClass {
+    LB_OP, LB_CL, LB_CP, LB_QU, LB_GL, LB_NS, LB_EX, LB_SY, LB_IS, LB_PR, LB_PO, LB_NU, LB_AL, LB_HL,
+    LB_ID, LB_IN, LB_HY, LB_BA, LB_BB, LB_B2, LB_ZW, LB_CB, LB_WJ, LB_H2, LB_H3, LB_JL, LB_JV, LB_JT,
+    LB_RI, LB_EB, LB_EM,
+    LB_PAIR_CLASSES,
+    LB_CM = LB_PAIR_CLASSES, LB_ZWJ, LB_SP, LB_BK, LB_CR, LB_LF, LB_NL
+};
+
+// Finds line break opportunities in Unicode text, one codepoint at a time,
+// so text arriving in chunks breaks as if it came whole. A codepoint's
+// class is two table reads, and whether a line may end before it is one
+// more into the pair table of UAX #14's reference implementation; the
+// tables are generated from the UCD by tools/gen_line_break_tables.py.
+//
+// Beyond the pair table: hard breaks, spaces, combining marks, ZWJ,
+// hyphens at the start of a word or after a Hebrew letter, numbers and
+// regional indicator pairs. Not covered: LB30's East Asian width
+// exceptions, LB25's lookahead past an opening bracket, ICU's break before
+// IS after spaces when a digit follows, and dictionary breaks inside Thai
+// and other SA scripts, which break only at spaces here. Everything else
+// agrees with ICU for the tables' Unicode version; tests/test_line_break.cpp
+// holds it to that.
+class LineBreakScanner {
+public:
+    enum Opportunity { NO_BREAK, ALLOWED_BREAK, MANDATORY_BREAK };
+    
+    static const int BLOCK_SHIFT = 7;
+    static const uint32_t BLOCK_MASK = (1 << BLOCK_SHIFT) - 1;
+    
+    LineBreakScanner() { reset(); }
+    
+    // Starts over as at the beginning of a text
+    void reset();
+    
+    // Feeds the next codepoint; returns whether a line may, or must, end
+    // before it. Never a break before the first one.
+    Opportunity next(uint32_t codepoint) {
+        // Most codepoints need nothing but the pair table
+        uint8_t cls = classify(codepoint);
+        if (plain) {
+            if (cls == LB_SP) {
+                spaces = true;
+                last = cls;
+                return NO_BREAK;
+            }
+            if (cls < LB_PAIR_CLASSES && cls != LB_NU && cls != LB_HY && cls != LB_BA && cls != LB_RI) {
+                uint8_t action = PAIR_ACTIONS[before][cls];
+                bool allowed = action == DIRECT || (action == INDIRECT && spaces);
+                before = last = cls;
+                spaces = false;
+                return allowed ? ALLOWED_BREAK : NO_BREAK;
+            }
+        }
+        return next_rule(cls);
+    }
+    
+    static LineBreakClass classify(uint32_t codepoint) {
+        uint32_t block = CLASS_INDEX[codepoint >> BLOCK_SHIFT];
+        return static_cast<LineBreakClass>(CLASS_BLOCKS[(block << BLOCK_SHIFT) | (codepoint & BLOCK_MASK)]);
+    }
+    
+private:
+    static const uint8_t CLASS_INDEX[];     // Block per 128 codepoints
+    static const uint8_t CLASS_BLOCKS[];
+    static const uint8_t PAIR_ACTIONS[LB_PAIR_CLASSES][LB_PAIR_CLASSES];
+    
+    // PAIR_ACTIONS values besides 0, no break even with spaces between
+    static const uint8_t INDIRECT = 1;      // A break only after spaces
+    static const uint8_t DIRECT = 2;
+    
+    enum HyphenRule { HYPHEN_BREAKS, HYPHEN_JOINS_LETTER, HYPHEN_JOINS_ANY };
+    
+    uint8_t before;             // Class the next pair starts from; LB_PAIR_CLASSES at the start
+    uint8_t last;               // Class of the codepoint just fed
+    bool spaces;                // Spaces since before
+    bool odd_indicators;        // before ends an odd run of regional indicators
+    bool number;                // before ends a number, maybe closed by a bracket
+    HyphenRule hyphen_joins;    // What the hyphen before keeps on its line
+    bool plain;                 // No rule but the pair table applies to what comes next
+    
+    Opportunity next_rule(uint8_t cls);
+};
+
+#endif // LINE_BREAK_H
@@ -0,0 +1,121 @@
+#ifndef LINE_BREAKER_H
+#define LINE_BREAKER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class Hyphenator;
+
+// One wrapped line as a byte range of the text it was broken from
+struct LineSpan {
+    uint32_t offset;
+    uint32_t length;
+    int32_t width;              // Natural width, spaces at their normal size
+    bool hyphen;                // Ends inside a word; the hyphen drawn after it is in width
+};
+
+// Cached advance widths for one font at one size. Neither vita2d nor the
+// FreeType path kerns, so a line is exactly the sum of its advances.
+// Latin-1 is measured up front and read without locking; anything else is
+// measured on first use and kept in a map.
+class AdvanceTable {
+public:
+    typedef std::function<int(uint32_t codepoint)> MeasureFunction;
+    
+    static const uint32_t DIRECT_RANGE = 256;
+    
+    explicit AdvanceTable(const MeasureFunction& measure);
+    
+    int advance(uint32_t codepoint) {
+        if (codepoint < DIRECT_RANGE) return direct[codepoint];
+        return advance_slow(codepoint);
+    }
+    
+    // Width of a UTF-8 string
+    int measure(const char* text, size_t length);
+    
+    // Hash of the Latin-1 advances; changes when the font file does
+    uint64_t fingerprint() const;
+    
+private:
+    MeasureFunction measure_codepoint;
+    int16_t direct[DIRECT_RANGE];
+    std::unordered_map<uint32_t, int16_t> others;
+    std::mutex others_mutex;
+    
+    int advance_slow(uint32_t codepoint);
+};
+
+// Greedy line breaker keeping a running line width, so a paragraph is
+// wrapped in one pass with no per-word re-measuring or string building.
+// Lines end after '\n' and may end at UAX #14 break opportunities, which
+// are at spaces, after hyphens and between ideographs, among others; the
+// text between two of them is a word here. With a hyphenator lines may
+// also end inside words at hyphenation points: a word that does not fit is
+// hyphenated to fill the line. Words wider than a line are split at
+// hyphenation points while a piece fits, and between codepoints otherwise.
+// Spaces at a break belong to neither line.
+//
+// break_optimal is the optimal-fit (Knuth-Plass) breaker for justified
+// text: it picks the breaks of a whole paragraph that keep its spaces
+// closest to their natural width, where greedy filling leaves some lines
+// stretched far more than others. Its cost is bounded by work, not time,
+// so the same text always breaks the same way: a line is looked for only
+// among its last MAX_LINE_WORDS words, and paragraphs of more than
+// MAX_OPTIMAL_WORDS words, with a word wider than a line, or with room for
+// more than MAX_LINE_WORDS words on a line, as in CJK text, are broken
+// greedily instead. With a hyphenator, a paragraph that cannot be set
+// without a line looser than TeX's pretolerance is split into pieces at
+// hyphenation points; a break after a piece costs as in TeX, more so after
+// a line that was hyphenated already. Those word counts are in pieces.
+class LineBreaker {
+public:
+    static const size_t MAX_LINE_WORDS = 48;
+    static const size_t MAX_OPTIMAL_WORDS = 2048;
+    
+    LineBreaker(AdvanceTable& advances, int max_width, const Hyphenator* hyphenator = nullptr);
+    
+    // Appends one span per line; base_offset is added to every span offset
+    void break_lines(const char* text, size_t length, uint32_t base_offset, std::vector<LineSpan>& spans);
+    void break_optimal(const char* text, size_t length, uint32_t base_offset, std::vector<LineSpan>& spans);
+    
+    // Whether a span is the last line before a '\n' or the end of the text,
+    // which justified text leaves ragged. Span offsets index text directly.
+    static bool ends_paragraph(const char* text, size_t length, const LineSpan& span);
+    
+private:
+    struct Word {
+        uint32_t start;
+        uint32_t end;
+        int32_t width;
+        bool hyphen;            // Ends at a hyphenation point, not a break opportunity
+    };
+    
+    enum WordsResult { WORDS_COLLECTED, WORD_TOO_WIDE, TOO_MANY_WORDS };
+    
+    AdvanceTable& advances;
+    int max_width;
+    int space_width;
+    const Hyphenator* hyphenator;
+    int hyphen_width;
+    
+    // Per-paragraph scratch for break_optimal, reused across paragraphs
+    std::vector<Word> words;
+    std::vector<int64_t> word_widths;   // Prefix sums of word widths
+    std::vector<int32_t> gap_spaces;    // Spaces between the first word and each word
+    std::vector<double> demerits;       // Per break and fitness class
+    std::vector<int32_t> previous;      // Best earlier break, same indexing
+    
+    void break_paragraphs(const char* text, size_t length, uint32_t base_offset, std::vector<LineSpan>& spans,
+                          bool optimal);
+    void break_greedy(const char* text, size_t start, size_t end, uint32_t base_offset, std::vector<LineSpan>& spans);
+    void break_paragraph(const char* text, size_t start, size_t end, uint32_t base_offset, std::vector<LineSpan>& spans);
+    WordsResult collect_words(const char* text, size_t start, size_t end, bool hyphenate);
+    bool find_breaks(double max_ratio);
+};
+
+#endif // LINE_BREAKER_H
@@ -0,0 +1,99 @@
+#ifndef PAGINATOR_H
+#define PAGINATOR_H
+
+#include "content_model.h"
+#include "chapter_layout.h"
+#include "chapter_stream.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+class GPURenderer;
+
+// Screen pages of a whole book. Every spine item starts on a new page and
+// has at least one. A page start is a text offset, or a line index in
+// streamed (oversized) documents, whose lines have no offsets.
+struct PageMap {
+    std::vector<uint32_t> first_page;   // Per spine item, plus the page count at the end
+    std::vector<uint8_t> streamed;      // Per spine item
+    std::vector<uint32_t> starts;       // Per page
+    
+    size_t page_count() const { return starts.size(); }
+    void clear();
+};
+
+// Paginates the whole book after it opens and keeps the page map in
+// CACHE_DIR, keyed by book, font and layout settings, so reopening a book
+// costs one file read. Books are paginated on a worker thread, except
+// those only libzip could index: libzip handles are not shared across
+// threads, so those are paginated a slice per step() on the UI thread. A
+// slice is one held document, or STEP_LINES lines of an oversized one.
+class Paginator {
+public:
+    static const size_t STEP_LINES = 256;
+    
+    struct Stats {
+        bool from_cache;            // Page map read from CACHE_DIR
+        float elapsed_ms;           // From start() to complete()
+    };
+    
+    Paginator(EPUBParser* parser, BookContent* content, GPURenderer* renderer);
+    ~Paginator();
+    
+    // Call after BookContent::reset; stops any earlier run first
+    void start(const std::string& book_path, const LayoutSettings& settings);
+    
+    // Must run before the book closes
+    void stop();
+    
+    // Paginates the next slice unless a worker owns the job
+    void step();
+    
+    bool complete() const { return done; }
+    float progress() const;
+    
+    // Only valid once complete()
+    size_t page_count() const { return done ? map.page_count() : 0; }
+    size_t page_at(int32_t spine_index, uint32_t position) const;
+    bool locate(size_t page, int32_t& spine_index, uint32_t& position) const;
+    const Stats& stats() const { return run_stats; }
+    
+private:
+    EPUBParser* epub_parser;
+    BookContent* content;
+    GPURenderer* renderer;
+    LayoutSettings settings;
+    std::string book_path;
+    uint64_t font_fingerprint;
+    uint64_t hyphenation_fingerprint;   // 0 when not hyphenating
+    
+    // Written only by whoever paginates; read by others once done is set
+    PageMap map;
+    size_t next_item;
+    ChapterStream stream;       // Oversized item being paginated, open across slices
+    bool streaming;
+    BookContent::Document scratch_document;
+    std::vector<char> read_buffer;
+    std::chrono::steady_clock::time_point started;
+    Stats run_stats;
+    
+    std::thread worker;
+    std::atomic<bool> cancel;
+    std::atomic<bool> done;
+    std::atomic<size_t> items_done;
+    
+    Paginator(const Paginator&) = delete;
+    Paginator& operator=(const Paginator&) = delete;
+    
+    void run();
+    bool paginate_item(size_t spine_index, size_t max_lines);
+    void finish();
+    void release_scratch();
+    std::string cache_path() const;
+    bool load_cache();
+    bool save_cache() const;
+};
+
+#endif // PAGINATOR_H
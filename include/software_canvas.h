@@ -0,0 +1,60 @@
+#ifndef SOFTWARE_CANVAS_H
+#define SOFTWARE_CANVAS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// An RGBA8 framebuffer in memory. Pixels use vita2d's RGBA8 packing, red in
+// the low byte, so a canvas row can be copied into an A8B8G8R8 texture as
+// is. Everything drawn is clipped to the canvas and to the clip rectangle.
+//
+// Blending is "over" with straight alpha. Spans go through NEON on the
+// Vita, SSE2 on x86 hosts, and plain C++ elsewhere; all three give the
+// same bytes.
+class SoftwareCanvas {
+public:
+    SoftwareCanvas(int width, int height);
+    
+    int width() const { return canvas_width; }
+    int height() const { return canvas_height; }
+    uint32_t* row(int y) { return &pixels[static_cast<size_t>(y) * canvas_width]; }
+    const uint32_t* row(int y) const { return &pixels[static_cast<size_t>(y) * canvas_width]; }
+    
+    // Fills the clip rectangle, ignoring alpha
+    void clear(uint32_t color);
+    
+    void fill_rect(int x, int y, int width, int height, uint32_t color);
+    void draw_line(int x1, int y1, int x2, int y2, uint32_t color);
+    
+    // Blends color through an 8-bit coverage mask, such as a glyph in the
+    // atlas; pitch is the byte distance between mask rows
+    void blend_mask(const uint8_t* coverage, int pitch, int x, int y, int width, int height, uint32_t color);
+    
+    void set_clip_rect(int x, int y, int width, int height);
+    void clear_clip_rect();
+    
+    // Binary PPM of the colors, for golden images and eyeballing
+    bool write_ppm(const std::string& path) const;
+    
+    // FNV-1a over the pixels, for comparing frames without storing them
+    uint64_t checksum() const;
+    
+    // The span kernels. Weights are coverage scaled by the color's alpha.
+    static void blend_span(uint32_t* pixels, const uint8_t* coverage, size_t count, uint32_t color);
+    static void blend_span_scalar(uint32_t* pixels, const uint8_t* coverage, size_t count, uint32_t color);
+    
+private:
+    int canvas_width;
+    int canvas_height;
+    std::vector<uint32_t> pixels;
+    int clip_left, clip_top, clip_right, clip_bottom;  // Half-open
+    std::vector<uint8_t> solid;                         // Full coverage, one row long
+    
+    // Narrows a rectangle to the clip; false if nothing is left
+    bool clip(int& x, int& y, int& width, int& height) const;
+    void blend_pixel(int x, int y, uint32_t color);
+};
+
+#endif // SOFTWARE_CANVAS_H
@@ -0,0 +1,80 @@
+#ifndef SOFTWARE_RENDERER_H
+#define SOFTWARE_RENDERER_H
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include "software_canvas.h"
+#include "glyph_cache.h"
+#include "styled_text.h"
+#include "line_breaker.h"
+#include "chapter_layout.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// GPURenderer's drawing calls on a SoftwareCanvas instead of vita2d, with
+// text from FreeType through a GlyphCache. It needs nothing from the Vita
+// SDK, so pages can be drawn on a Linux host for golden images and timing,
+// and off the render thread on the Vita. Text is placed as vita2d_font
+// places it: y is the baseline.
+class SoftwareRenderer {
+public:
+    static const uint32_t BLACK = 0xFF000000u;     // vita2d's RGBA8(0, 0, 0, 255)
+    static const uint32_t WHITE = 0xFFFFFFFFu;
+    
+    SoftwareRenderer(int width = 960, int height = 544);
+    ~SoftwareRenderer();
+    
+    // Bold and italic are optional and fall back to the regular face
+    bool initialize(const std::string& font_path, const std::string& bold_path = "",
+                    const std::string& italic_path = "");
+    
+    void begin_frame() {}
+    void end_frame() {}
+    void clear_screen(uint32_t color = WHITE) { target.clear(color); }
+    
+    void render_text_gpu(const std::string& text, int x, int y, uint32_t color = BLACK, int size = 16);
+    int get_text_width(const std::string& text, int size = 16);
+    int get_text_height(int size = 16);
+    
+    void render_rectangle(int x, int y, int width, int height, uint32_t color) { target.fill_rect(x, y, width, height, color); }
+    void render_rectangle_outline(int x, int y, int width, int height, uint32_t color, int thickness = 1);
+    void render_line(int x1, int y1, int x2, int y2, uint32_t color) { target.draw_line(x1, y1, x2, y2, color); }
+    
+    // Same margins and placement as GPURenderer's
+    void render_cached_page(const std::vector<std::string>& lines, int scroll_offset, size_t first_line,
+                            int font_size, int line_height);
+    void render_chapter_layout(const StyledText& text, const ChapterLayout& layout, int scroll_offset);
+    void render_menu_item(const std::string& text, int x, int y, bool selected, uint32_t color = BLACK);
+    void render_progress_bar(int x, int y, int width, int height, float progress, uint32_t fg_color, uint32_t bg_color);
+    
+    void set_clip_rect(int x, int y, int width, int height) { target.set_clip_rect(x, y, width, height); }
+    void clear_clip_rect() { target.clear_clip_rect(); }
+    
+    AdvanceTable& advance_table(int size);
+    
+    SoftwareCanvas& canvas() { return target; }
+    const GlyphCache::Stats& cache_stats() const { return glyphs.stats(); }
+    
+private:
+    enum Face { REGULAR, BOLD, ITALIC, FACE_COUNT };
+    
+    SoftwareCanvas target;
+    FT_Library library;
+    FT_Face faces[FACE_COUNT];      // Missing styles point at the regular face
+    int face_sizes[FACE_COUNT];     // Pixel size each face is set to
+    GlyphCache glyphs;
+    std::map<int, std::unique_ptr<AdvanceTable>> advance_tables;
+    
+    Face face_for_style(const TextStyle& style) const;
+    const CachedGlyph* glyph(Face face, int size, uint32_t codepoint);
+    void set_size(Face face, int size);
+    
+    // Each returns the pen x after what it drew
+    int draw_text(Face face, const char* text, size_t length, int x, int y, uint32_t color, int size);
+    int draw_styled_span(const StyledText& text, uint32_t offset, uint32_t end, int x, int y, int size);
+    int draw_justified_line(const StyledText& text, const TextLine& line, int x, int y, int size);
+};
+
+#endif // SOFTWARE_RENDERER_H
@@ -0,0 +1,44 @@
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Interning string table. Each distinct string is stored once, NUL-terminated,
+// in a single buffer and identified by a dense symbol (0, 1, 2, ...), so
+// callers can key flat arrays by symbol instead of hashing strings again.
+class StringPool {
+public:
+    typedef uint32_t Symbol;
+    static const Symbol NO_SYMBOL = 0xFFFFFFFF;
+    
+    StringPool();
+    
+    Symbol intern(const char* data, size_t length);
+    Symbol intern(const std::string& value) { return intern(value.data(), value.size()); }
+    Symbol find(const char* data, size_t length) const;
+    Symbol find(const std::string& value) const { return find(value.data(), value.size()); }
+    
+    size_t size() const { return offsets.size() - 1; }
+    const char* c_str(Symbol symbol) const { return &strings[offsets[symbol]]; }
+    size_t length(Symbol symbol) const { return offsets[symbol + 1] - offsets[symbol] - 1; }
+    
+    // Raw storage for the index cache; load() rebuilds symbols and hashes
+    const std::string& storage() const { return strings; }
+    bool load(const std::string& storage);
+    void clear();
+    
+private:
+    std::string strings;
+    std::vector<uint32_t> offsets;  // size() + 1 entries, last one is the end
+    std::vector<uint32_t> hashes;
+    std::vector<Symbol> slots;      // Open addressing, power-of-two sized
+    
+    static uint32_t hash(const char* data, size_t length);
+    void insert_slot(Symbol symbol);
+    void grow();
+};
+
+#endif // STRING_POOL_H
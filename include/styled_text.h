@@ -0,0 +1,73 @@
+#ifndef STYLED_TEXT_H
+#define STYLED_TEXT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum TextStyleFlags {
+    STYLE_BOLD = 0x01,
+    STYLE_ITALIC = 0x02
+};
+
+// Block kinds; headings keep their level so BLOCK_HEADING + 1 is <h2>
+enum TextBlockKind {
+    BLOCK_PARAGRAPH = 0,
+    BLOCK_HEADING = 1
+};
+
+struct TextStyle {
+    uint8_t flags;              // TextStyleFlags
+    uint8_t heading;            // 0 for body text, 1-6 inside <hN>
+
+    bool operator==(const TextStyle& other) const {
+        return flags == other.flags && heading == other.heading;
+    }
+};
+
+// Chapter text as one UTF-8 buffer plus packed formatting. Runs cover the
+// text in order with no gaps; blocks mark where paragraphs and headings
+// start. Blocks are separated by a single '\n' in the text, and <br>
+// becomes a '\n' inside a block.
+class StyledText {
+public:
+    struct Run {
+        uint32_t offset;
+        uint16_t length;
+        uint16_t style;         // Index into the style table
+    };
+
+    struct Block {
+        uint32_t offset;        // First byte of the block's text
+        uint8_t kind;           // TextBlockKind, plus heading level
+    };
+
+    static const size_t MAX_RUN_LENGTH = 0xFFFF;
+
+    std::string text;
+    std::vector<Run> runs;
+    std::vector<Block> blocks;
+
+    uint16_t intern_style(const TextStyle& style);
+    const TextStyle& style(uint16_t index) const { return styles[index]; }
+    size_t style_count() const { return styles.size(); }
+
+    // Appends a run, merging with the previous one when the style matches
+    void add_run(uint32_t offset, uint32_t length, uint16_t style);
+    void add_block(uint32_t offset, uint8_t kind);
+
+    // Index of the run or block containing offset
+    size_t run_at(uint32_t offset) const;
+    size_t block_at(uint32_t offset) const;
+
+    // Bytes spent on formatting on top of the plain text
+    size_t overhead_bytes() const;
+
+    void clear();
+    void shrink_to_fit();
+
+private:
+    std::vector<TextStyle> styles;
+};
+
+#endif // STYLED_TEXT_H
@@ -3,22 +3,20 @@
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include "line_breaker.h"
+#include "glyph_cache.h"
+#include <memory>
 #include <unordered_map>
 #include <string>
 #include <vector>
 
+struct vita2d_texture;
+
+// Draws text through FreeType. Glyphs are cached per size in a GlyphCache,
+// whose atlas has one texture per page, and each call draws its glyphs as
+// textured quads, one draw per atlas page.
 class TextRenderer {
 public:
-    struct GlyphInfo {
-        uint8_t* bitmap;
-        int width, height;
-        int left, top;
-        int advance_x;
-        
-        GlyphInfo() : bitmap(nullptr), width(0), height(0), left(0), top(0), advance_x(0) {}
-        ~GlyphInfo() { delete[] bitmap; }
-    };
-    
     struct TextStyle {
         std::string font_family = "default";
         int font_size = 16;
@@ -30,12 +28,24 @@ public:
         int margin_top = 0;
         int margin_bottom = 0;
     };
-
+    
 private:
     FT_Library library;
     FT_Face face;
-    std::unordered_map<uint32_t, GlyphInfo*> glyph_cache;
-    static const size_t MAX_CACHE_SIZE = 512;
+    GlyphCache glyph_cache;
+    
+    int font_size = 16;
+    std::unordered_map<int, std::unique_ptr<AdvanceTable>> advance_tables;
+    
+    std::vector<vita2d_texture*> atlas_textures;   // One per atlas page, made on first use
+    QuadBatch batch;
+    
+    // Set when a glyph found no room even after evicting; the cache starts
+    // over on the next call rather than overwrite pages this call has
+    // queued draws from. Text drawn earlier in the same frame can show a
+    // stray glyph then, as it can when an evicted glyph's room is reused.
+    bool atlas_full = false;
+    CachedGlyph unplaced;       // Advance only, for a glyph that found no room
     
 public:
     bool initialize(const std::string& font_path);
@@ -45,12 +55,16 @@ public:
     int calculate_text_height(const std::string& text, int max_width);
     std::vector<std::string> wrap_text(const std::string& text, int max_width);
     void clear_cache();
+    const GlyphCache::Stats& cache_stats() const { return glyph_cache.stats(); }
     ~TextRenderer();
-
+    
 private:
-    const GlyphInfo* get_glyph(uint32_t charcode);
-    void render_glyph(const GlyphInfo* glyph, int x, int y, uint32_t color);
-    void evict_cache_entry();
+    const CachedGlyph* get_glyph(uint32_t charcode);
+    AdvanceTable& advance_table();
+    void reset_atlas();
+    
+    // Uploads new atlas rows and draws the batch, one call per page
+    void flush_batch(uint32_t color);
 };
 
 #endif // TEXT_RENDERER_H
\ No newline at end of file
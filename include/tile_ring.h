@@ -0,0 +1,104 @@
+#ifndef TILE_RING_H
+#define TILE_RING_H
+
+#include <vita2d.h>
+#include "software_renderer.h"
+#include "display_list.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Pre-rendered horizontal tiles of the open chapter, for smooth scrolling.
+// Tile t holds the rows a page scrolled to t * TILE_HEIGHT would show at
+// its top, so the view at any scroll offset is a handful of tile blits.
+// A worker draws the tiles with a SoftwareRenderer straight into texture
+// memory: first the ones in view, then ahead of the scroll direction. The
+// render thread never rasterizes text for them.
+//
+// Tiles live in a ring of slots, tile t in slot t mod TILE_COUNT. A slot
+// is only handed to another tile once it has not been drawn for a couple
+// of frames, so the GPU is done reading it.
+class TileRing {
+public:
+    static const int TILE_WIDTH = 960;
+    static const int TILE_HEIGHT = 136;     // A quarter of the screen
+    static const int TILE_COUNT = 12;       // The view and almost two screens more
+    
+    TileRing();
+    ~TileRing();
+    
+    // False if the fonts or textures could not be had; the ring then never draws
+    bool initialize(const std::string& font_path, const std::string& bold_path, const std::string& italic_path);
+    
+    // What the tiles show. The text and layout are read by the worker
+    // until the next set or clear, which wait for it.
+    void set_layout(const StyledText& text, const ChapterLayout& layout);
+    void set_stream(int font_size, int line_height);
+    
+    // Forgets every tile; returns once the worker is idle
+    void clear();
+    
+    // Queues the tiles around the view, once per frame. direction is the
+    // sign of the latest scroll. Streamed chapters pass their line window;
+    // the lines a tile needs are copied into its job, and tiles the window
+    // does not cover yet wait, unless no lines follow it.
+    void update(int scroll_offset, int direction);
+    void update(int scroll_offset, int direction, const std::vector<std::string>& window, size_t first_line,
+                bool window_final);
+    
+    // Records the view's blits if every tile it spans is ready
+    bool draw(int scroll_offset, DisplayList& list);
+    
+private:
+    static const int VIEW_HEIGHT = 544;
+    static const int RECYCLE_FRAMES = 2;    // Frames a slot stays unused before it is redrawn
+    
+    enum SlotState { SLOT_EMPTY, SLOT_QUEUED, SLOT_DRAWING, SLOT_READY };
+    
+    struct Slot {
+        vita2d_texture* texture;
+        int tile;
+        SlotState state;
+        uint32_t last_drawn;                // Frame it was last blitted in
+        size_t first_line;                  // Streamed jobs: lines[0]'s index
+        std::vector<std::string> lines;
+    };
+    
+    SoftwareRenderer renderer;              // The worker's alone once it runs
+    Slot slots[TILE_COUNT];
+    bool ready;
+    
+    // What to draw; changed only while the worker is idle
+    const StyledText* text;
+    const ChapterLayout* layout;
+    int font_size;
+    int line_height;
+    
+    uint32_t frame;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;           // New work or shutdown
+    std::condition_variable idle;           // In-flight tile finished
+    std::deque<int> queue;                  // Slot indices, most wanted first
+    int in_flight;                          // Slot being drawn, or -1
+    bool quit;
+    
+    TileRing(const TileRing&) = delete;
+    TileRing& operator=(const TileRing&) = delete;
+    
+    static int tile_at(int row);
+    static int slot_for(int tile) { return (tile % TILE_COUNT + TILE_COUNT) % TILE_COUNT; }
+    
+    // Queue order: the view outward, then mostly in the scroll direction
+    void wanted_tiles(int scroll_offset, int direction, std::vector<int>& tiles) const;
+    void queue_tiles(int scroll_offset, int direction, const std::vector<std::string>* window, size_t first_line,
+                     bool window_final);
+    void forget_tiles();
+    void run();
+    void draw_tile(Slot& slot);
+};
+
+#endif // TILE_RING_H
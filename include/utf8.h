@@ -0,0 +1,60 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Validating UTF-8 decoder shared by every text path. Malformed, overlong,
+// surrogate and out-of-range sequences decode to U+FFFD and consume one
+// byte, so a bad byte never swallows the text after it.
+class Utf8Decoder {
+public:
+    static const uint32_t REPLACEMENT_CHARACTER = 0xFFFD;
+    
+    Utf8Decoder(const char* data, size_t length) : cursor(data), limit(data + length) {}
+    explicit Utf8Decoder(const std::string& text) : cursor(text.data()), limit(text.data() + text.size()) {}
+    
+    bool done() const { return cursor >= limit; }
+    const char* position() const { return cursor; }
+    
+    uint32_t next() {
+        // ASCII needs no table walk
+        uint8_t lead = static_cast<uint8_t>(*cursor);
+        if (lead < 0x80) {
+            ++cursor;
+            return lead;
+        }
+        return next_multibyte();
+    }
+    
+    // Number of leading ASCII bytes, checked 16 (NEON) or 8 bytes at a time
+    static size_t ascii_prefix(const char* data, size_t length);
+    
+    // Bulk decode into out, which must have room for length codepoints;
+    // returns the number written
+    static size_t decode(const char* data, size_t length, uint32_t* out);
+    
+    static bool is_valid(const char* data, size_t length);
+    
+    // Copy of the input with every malformed sequence replaced by U+FFFD
+    static void sanitize(const char* data, size_t length, std::string& out);
+    
+    // Writes 1-4 bytes and returns the count; invalid codepoints become U+FFFD
+    static size_t encode(uint32_t codepoint, char* out);
+    
+    // Byte length of the well-formed sequence at data, or 0 if malformed
+    static size_t sequence_length(const char* data, size_t length);
+    
+    // Bytes at the end that start a sequence cut short, to be completed by
+    // more input; 0 if the data ends on a whole codepoint
+    static size_t incomplete_suffix(const char* data, size_t length);
+    
+private:
+    const char* cursor;
+    const char* limit;
+    
+    uint32_t next_multibyte();
+};
+
+#endif // UTF8_H
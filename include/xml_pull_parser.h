@@ -0,0 +1,62 @@
+#ifndef XML_PULL_PARSER_H
+#define XML_PULL_PARSER_H
+
+#include <string>
+#include <cstddef>
+
+// Minimal event-based XML reader for EPUB package documents (container.xml,
+// OPF, NCX). It walks the caller's buffer in place and never builds a tree;
+// element names and attribute spans point straight into the input, and only
+// values the caller asks for are decoded into its own strings.
+class XmlPullParser {
+public:
+    enum Event {
+        EVENT_START_ELEMENT,
+        EVENT_END_ELEMENT,
+        EVENT_TEXT,
+        EVENT_END_DOCUMENT,
+        EVENT_ERROR
+    };
+    
+    XmlPullParser(const char* data, size_t length);
+    
+    Event next();
+    
+    // Current element; namespace prefixes are stripped from the name
+    bool name_is(const char* local_name) const;
+    int depth() const { return current_depth; }
+    
+    // Attributes of the current start element, entity-decoded into value
+    bool attribute(const char* attr_name, std::string& value) const;
+    bool attribute_equals(const char* attr_name, const char* expected) const;
+    
+    // Text of the current text event, entity-decoded and appended to out
+    void append_text(std::string& out) const;
+    
+    static void append_decoded(const char* begin, const char* end, std::string& out);
+    
+private:
+    struct Span {
+        const char* begin;
+        const char* end;
+    };
+    
+    static const int MAX_ATTRIBUTES = 16;
+    
+    const char* cursor;
+    const char* limit;
+    int current_depth;
+    bool pending_end;
+    bool text_is_cdata;
+    
+    Span element_name;
+    Span text;
+    Span attr_names[MAX_ATTRIBUTES];
+    Span attr_values[MAX_ATTRIBUTES];
+    int attr_count;
+    
+    bool skip_past(const char* terminator);
+    Event parse_tag();
+};
+
+#endif // XML_PULL_PARSER_H
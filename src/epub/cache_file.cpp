@@ -0,0 +1,62 @@
+#include "cache_file.h"
+#include "file_manager.h"
+#include <iostream>
+#include <cstdio>
+
+uint64_t cache_hash(const char* data, size_t length, uint64_t hash) {
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string cache_file_path(uint64_t hash, const char* extension) {
+    char name[40];
+    std::snprintf(name, sizeof(name), "/%016llx%s", static_cast<unsigned long long>(hash), extension);
+    return FileManager::CACHE_DIR + name;
+}
+
+bool read_cache_file(const std::string& path, std::vector<char>& buffer) {
+    buffer.clear();
+    
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+    
+    if (std::fseek(file, 0, SEEK_END) == 0) {
+        long file_size = std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+        if (file_size > 0) {
+            buffer.resize(static_cast<size_t>(file_size));
+            if (std::fread(&buffer[0], 1, buffer.size(), file) != buffer.size()) {
+                buffer.clear();
+            }
+        }
+    }
+    std::fclose(file);
+    return !buffer.empty();
+}
+
+bool write_cache_file(const std::string& path, const std::string& data) {
+    std::string temp_path = path + ".tmp";
+    
+    FILE* file = std::fopen(temp_path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Failed to write cache file: " << temp_path << std::endl;
+        return false;
+    }
+    
+    size_t written = std::fwrite(data.data(), 1, data.size(), file);
+    bool success = (std::fclose(file) == 0) && written == data.size();
+    
+    if (success) {
+        std::remove(path.c_str());
+        success = std::rename(temp_path.c_str(), path.c_str()) == 0;
+    }
+    if (!success) {
+        std::remove(temp_path.c_str());
+        std::cerr << "Failed to write cache file: " << path << std::endl;
+    }
+    
+    return success;
+}
@@ -0,0 +1,42 @@
+#include "chapter_layout.h"
+#include "styled_text.h"
+#include <algorithm>
+
+size_t ChapterLayout::line_at_y(int y) const {
+    auto it = std::upper_bound(lines.begin(), lines.end(), y,
+                               [](int value, const TextLine& line) { return value < line.y + line.height; });
+    return static_cast<size_t>(it - lines.begin());
+}
+
+size_t ChapterLayout::line_for_offset(uint32_t offset) const {
+    auto it = std::upper_bound(lines.begin(), lines.end(), offset,
+                               [](uint32_t value, const TextLine& line) { return value < line.offset; });
+    return it == lines.begin() ? 0 : static_cast<size_t>(it - lines.begin()) - 1;
+}
+
+void ChapterLayout::paginate(int page_height, std::vector<size_t>& page_first_lines) const {
+    page_first_lines.assign(1, 0);
+    
+    int page_top = lines.empty() ? 0 : lines[0].y;
+    for (size_t i = 1; i < lines.size(); ++i) {
+        if (lines[i].y + lines[i].height - page_top > page_height) {
+            page_first_lines.push_back(i);
+            page_top = lines[i].y;
+        }
+    }
+}
+
+void ChapterLayout::clear() {
+    lines.clear();
+    font_size = 0;
+    height = 0;
+}
+
+int ChapterLayout::block_font_size(uint8_t block_kind, int font_size) {
+    switch (block_kind) {
+        case BLOCK_HEADING:     return font_size + 6;
+        case BLOCK_HEADING + 1: return font_size + 4;
+        case BLOCK_HEADING + 2: return font_size + 2;
+        default:                return font_size;
+    }
+}
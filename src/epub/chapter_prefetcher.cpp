@@ -0,0 +1,151 @@
+#include "chapter_prefetcher.h"
+#include "gpu_renderer.h"
+#include <algorithm>
+
+const size_t ChapterPrefetcher::MAX_PREPARED;
+const int32_t ChapterPrefetcher::NO_CHAPTER;
+
+ChapterPrefetcher::ChapterPrefetcher(BookContent* book_content, GPURenderer* gpu_renderer,
+                                     const LayoutSettings& layout_settings)
+    : content(book_content), renderer(gpu_renderer), settings(layout_settings),
+      in_flight(NO_CHAPTER), cancel_in_flight(false), quit(false) {
+}
+
+ChapterPrefetcher::~ChapterPrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+        queue.clear();
+        cancel_in_flight = true;
+    }
+    wake.notify_all();
+    
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void ChapterPrefetcher::prefetch_around(int32_t spine_index) {
+    // Next first: reading forward is far more common than going back
+    int32_t wanted[2] = { spine_index + 1, spine_index - 1 };
+    int32_t spine_count = static_cast<int32_t>(content->spine_count());
+    auto is_wanted = [&](int32_t index) {
+        return index == wanted[0] || index == wanted[1];
+    };
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        queue.erase(std::remove_if(queue.begin(), queue.end(),
+                                   [&](int32_t index) { return !is_wanted(index); }),
+                    queue.end());
+        ready.erase(std::remove_if(ready.begin(), ready.end(),
+                                   [&](const PreparedChapter& chapter) { return !is_wanted(chapter.spine_index); }),
+                    ready.end());
+        if (in_flight != NO_CHAPTER && !is_wanted(in_flight)) {
+            cancel_in_flight = true;
+        }
+        
+        for (int32_t index : wanted) {
+            if (index >= 0 && index < spine_count && index != in_flight && !is_queued_or_ready(index)) {
+                queue.push_back(index);
+            }
+        }
+        
+        if (queue.empty()) return;
+        
+        // Started lazily so books that are never turned cost no thread
+        if (!worker.joinable()) {
+            worker = std::thread(&ChapterPrefetcher::run, this);
+        }
+    }
+    wake.notify_one();
+}
+
+bool ChapterPrefetcher::take(int32_t spine_index, PreparedChapter& chapter) {
+    std::unique_lock<std::mutex> lock(mutex);
+    
+    while (in_flight == spine_index && !cancel_in_flight) {
+        idle.wait(lock);
+    }
+    
+    for (auto it = ready.begin(); it != ready.end(); ++it) {
+        if (it->spine_index == spine_index) {
+            chapter = std::move(*it);
+            ready.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ChapterPrefetcher::cancel_all() {
+    std::unique_lock<std::mutex> lock(mutex);
+    
+    queue.clear();
+    ready.clear();
+    if (in_flight != NO_CHAPTER) {
+        cancel_in_flight = true;
+    }
+    while (in_flight != NO_CHAPTER) {
+        idle.wait(lock);
+    }
+}
+
+void ChapterPrefetcher::set_settings(const LayoutSettings& layout_settings) {
+    std::lock_guard<std::mutex> lock(mutex);
+    settings = layout_settings;
+}
+
+bool ChapterPrefetcher::is_queued_or_ready(int32_t spine_index) const {
+    if (std::find(queue.begin(), queue.end(), spine_index) != queue.end()) {
+        return true;
+    }
+    for (const auto& chapter : ready) {
+        if (chapter.spine_index == spine_index) return true;
+    }
+    return false;
+}
+
+void ChapterPrefetcher::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    
+    for (;;) {
+        while (!quit && queue.empty()) {
+            wake.wait(lock);
+        }
+        if (quit) break;
+        
+        int32_t spine_index = queue.front();
+        queue.pop_front();
+        in_flight = spine_index;
+        cancel_in_flight = false;
+        lock.unlock();
+        
+        // Oversized documents are streamed by the reader, never prefetched
+        PreparedChapter chapter;
+        chapter.spine_index = spine_index;
+        bool prepared = false;
+        
+        if (!content->is_oversized(spine_index)) {
+            const BookContent::Document* document = content->load_document(spine_index);
+            
+            // Cancellation is checked between stages; layout is the expensive one
+            if (document && !cancel_in_flight) {
+                renderer->layout_styled_text(document->styled, settings, chapter.layout);
+                prepared = true;
+            }
+        }
+        
+        lock.lock();
+        if (prepared && !cancel_in_flight) {
+            if (ready.size() >= MAX_PREPARED) {
+                ready.erase(ready.begin());
+            }
+            ready.push_back(std::move(chapter));
+        }
+        in_flight = NO_CHAPTER;
+        cancel_in_flight = false;
+        idle.notify_all();
+    }
+}
@@ -0,0 +1,197 @@
+#include "chapter_stream.h"
+#include "gpu_renderer.h"
+#include "utf8.h"
+#include <algorithm>
+#include <iostream>
+
+ChapterStream::ChapterStream(EPUBParser* parser, GPURenderer* gpu_renderer)
+    : epub_parser(parser), renderer(gpu_renderer), anchors_complete(false), max_width(0), font_size(0),
+      paragraph_offset(0), next_span(0), broken_bytes(0), input_done(true), first_line(0) {
+    extractor.set_anchor_index(&anchors);
+}
+
+bool ChapterStream::open(const std::string& chapter_href, int width, int size, bool hyphenate) {
+    href = chapter_href;
+    max_width = width;
+    font_size = size;
+    breaker.reset(new LineBreaker(renderer->advance_table(size), width, hyphenate ? renderer->hyphenator() : nullptr));
+    chunk.resize(CHUNK_SIZE);
+    anchors.clear();
+    anchors_complete = false;
+    return restart();
+}
+
+bool ChapterStream::restart() {
+    extractor.reset();
+    pending_text.clear();
+    paragraph.clear();
+    paragraph_offset = 0;
+    spans.clear();
+    next_span = 0;
+    broken_bytes = 0;
+    lines.clear();
+    line_offsets.clear();
+    first_line = 0;
+    input_done = false;
+    
+    if (!epub_parser->open_stream(href, stream)) {
+        std::cerr << "Failed to open chapter stream: " << href << std::endl;
+        input_done = true;
+        return false;
+    }
+    return true;
+}
+
+bool ChapterStream::ensure_line(size_t line_index) {
+    // Lines behind the window were dropped; replay from the start
+    if (line_index < first_line) {
+        if (!restart()) return false;
+    }
+    
+    while (line_index >= lines_produced() && !finished()) {
+        pump();
+    }
+    
+    return line_index < lines_produced();
+}
+
+uint32_t ChapterStream::line_offset(size_t line_index) const {
+    if (line_offsets.empty()) return 0;
+    size_t index = line_index < first_line ? 0 : std::min(line_index - first_line, line_offsets.size() - 1);
+    return line_offsets[index];
+}
+
+size_t ChapterStream::seek_offset(uint32_t offset) {
+    if (!line_offsets.empty() && offset < line_offsets.front() && first_line > 0) {
+        if (!restart()) return 0;
+    }
+    
+    // The line holding the offset is known once the line after it exists
+    while (!finished() && (line_offsets.empty() || line_offsets.back() <= offset)) {
+        pump();
+    }
+    
+    size_t after = static_cast<size_t>(std::upper_bound(line_offsets.begin(), line_offsets.end(), offset) -
+                                       line_offsets.begin());
+    return first_line + after > 0 ? first_line + after - 1 : 0;
+}
+
+bool ChapterStream::seek_anchor(const std::string& name, uint32_t& offset) {
+    // Anchors already streamed past are known; only the rest is read
+    while (!anchors.find(name, offset)) {
+        if (anchors_complete || finished()) return false;
+        pump();
+    }
+    return true;
+}
+
+void ChapterStream::pump() {
+    // Lines broken earlier go out first
+    if (next_span < spans.size()) {
+        emit_spans();
+        return;
+    }
+    
+    if (!input_done) {
+        size_t got = stream.read(&chunk[0], chunk.size());
+        if (got > 0) {
+            extractor.feed(&chunk[0], got, pending_text);
+        }
+        if (stream.finished()) {
+            extractor.finish(pending_text);
+            if (stream.has_error()) {
+                std::cerr << "Chapter stream ended early: " << href << std::endl;
+            } else {
+                anchors_complete = true;
+            }
+            stream.close();
+            input_done = true;
+        }
+    }
+    
+    wrap_pending_text();
+}
+
+void ChapterStream::wrap_pending_text() {
+    // A chunk can end inside a UTF-8 sequence; its tail waits for the next
+    size_t complete = pending_text.length();
+    if (!input_done) {
+        complete -= Utf8Decoder::incomplete_suffix(pending_text.data(), pending_text.length());
+    }
+    paragraph.append(pending_text, 0, complete);
+    pending_text.erase(0, complete);
+    
+    size_t newline = paragraph.rfind('\n');
+    if (input_done) {
+        break_paragraph(paragraph.size(), false);
+    } else if (newline != std::string::npos) {
+        break_paragraph(newline + 1, false);
+    } else if (paragraph.size() > MAX_PARAGRAPH_BYTES) {
+        // Up to the last space the words are whole, so their breaks and
+        // hyphens are final except in the line still open
+        size_t space = paragraph.rfind(' ');
+        break_paragraph(space != std::string::npos && space > 0 ? space : paragraph.size(), true);
+    }
+}
+
+// Breaks the first length bytes of paragraph into lines; an open last line
+// is left to be broken again with the text after it
+void ChapterStream::break_paragraph(size_t length, bool keep_last_line) {
+    spans.clear();
+    breaker->break_lines(paragraph.data(), length, paragraph_offset, spans);
+    if (keep_last_line && !spans.empty()) {
+        broken_bytes = spans.back().offset - paragraph_offset;
+        spans.pop_back();
+    } else {
+        broken_bytes = length;
+    }
+    next_span = 0;
+    emit_spans();
+}
+
+void ChapterStream::emit_spans() {
+    size_t end = std::min(spans.size(), next_span + MAX_PUMP_LINES);
+    for (; next_span < end; ++next_span) {
+        const LineSpan& span = spans[next_span];
+        std::string line(paragraph, span.offset - paragraph_offset, span.length);
+        if (span.hyphen) line += '-';
+        emit_line(line, span.offset);
+    }
+    if (next_span < spans.size()) return;
+    
+    paragraph.erase(0, broken_bytes);
+    paragraph_offset += static_cast<uint32_t>(broken_bytes);
+    spans.clear();
+    next_span = 0;
+    broken_bytes = 0;
+}
+
+void ChapterStream::emit_line(const std::string& line, uint32_t offset) {
+    lines.push_back(line);
+    line_offsets.push_back(offset);
+    
+    // Drop the older half of the window in one go to keep erase amortized
+    if (lines.size() > WINDOW_LINES) {
+        size_t drop = lines.size() - WINDOW_LINES / 2;
+        lines.erase(lines.begin(), lines.begin() + drop);
+        line_offsets.erase(line_offsets.begin(), line_offsets.begin() + drop);
+        first_line += drop;
+    }
+}
+
+void ChapterStream::close() {
+    stream.close();
+    extractor.reset();
+    anchors.clear();
+    anchors_complete = false;
+    pending_text.clear();
+    paragraph.clear();
+    paragraph_offset = 0;
+    spans.clear();
+    next_span = 0;
+    broken_bytes = 0;
+    lines.clear();
+    line_offsets.clear();
+    first_line = 0;
+    input_done = true;
+}
@@ -0,0 +1,152 @@
+#include "content_model.h"
+#include <cstring>
+#include <iostream>
+
+const uint64_t BookContent::MAX_DOCUMENT_SIZE;
+
+BookContent::BookContent(EPUBParser* parser) : epub_parser(parser), load_count(0) {
+}
+
+void BookContent::reset() {
+    const auto& spine = epub_parser->get_spine();
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    documents.clear();
+    documents.resize(spine.size());
+    load_count = 0;
+    
+    // First spine position for every manifest item, for href lookups
+    spine_by_manifest.assign(epub_parser->get_manifest().size(), EPUBParser::Manifest::NO_ITEM);
+    for (size_t i = spine.size(); i-- > 0;) {
+        spine_by_manifest[spine[i].manifest_index] = static_cast<int32_t>(i);
+    }
+    
+    // TOC entries by the document they point into, counted then placed
+    const auto& toc = epub_parser->get_table_of_contents();
+    spine_by_toc.resize(toc.size());
+    toc_by_spine_start.assign(spine.size() + 1, 0);
+    for (size_t i = 0; i < toc.size(); ++i) {
+        spine_by_toc[i] = spine_index_for_href(toc.content_src(i));
+        if (spine_by_toc[i] >= 0) ++toc_by_spine_start[spine_by_toc[i] + 1];
+    }
+    for (size_t i = 0; i < spine.size(); ++i) {
+        toc_by_spine_start[i + 1] += toc_by_spine_start[i];
+    }
+    toc_by_spine.resize(toc_by_spine_start.back());
+    std::vector<uint32_t> placed(toc_by_spine_start.begin(), toc_by_spine_start.end() - 1);
+    for (size_t i = 0; i < toc.size(); ++i) {
+        if (spine_by_toc[i] >= 0) toc_by_spine[placed[spine_by_toc[i]]++] = static_cast<uint32_t>(i);
+    }
+}
+
+size_t BookContent::spine_count() const {
+    return documents.size();
+}
+
+const char* BookContent::spine_href(size_t spine_index) const {
+    return epub_parser->get_manifest().href(epub_parser->get_spine()[spine_index].manifest_index);
+}
+
+int32_t BookContent::spine_index_for_href(const std::string& href) const {
+    size_t hash = href.find('#');
+    int32_t item = epub_parser->get_manifest().find_by_href(hash == std::string::npos ? href : href.substr(0, hash));
+    if (item == EPUBParser::Manifest::NO_ITEM || item >= static_cast<int32_t>(spine_by_manifest.size())) {
+        return -1;
+    }
+    return spine_by_manifest[item];
+}
+
+bool BookContent::is_oversized(size_t spine_index) {
+    const EPUBParser::ZipEntry* entry = epub_parser->find_content_entry(spine_href(spine_index));
+    return entry && entry->size > MAX_DOCUMENT_SIZE;
+}
+
+const BookContent::Document* BookContent::load_document(size_t spine_index) {
+    const Document* cached = cached_document(spine_index);
+    if (cached || spine_index >= documents.size()) return cached;
+    
+    // Read and extracted unlocked, so other threads' loads and lookups do
+    // not wait on this one
+    std::vector<char> buffer;
+    std::unique_ptr<Document> document(new Document());
+    if (!read_document(spine_index, buffer, *document)) return nullptr;
+    
+    // The extractor sizes for the worst case; cached text keeps only what it needs
+    document->styled.shrink_to_fit();
+    
+    // Another thread may have loaded it meanwhile; the first one is kept
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!documents[spine_index]) {
+        documents[spine_index] = std::move(document);
+        ++load_count;
+    }
+    return documents[spine_index].get();
+}
+
+const BookContent::Document* BookContent::cached_document(size_t spine_index) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return spine_index < documents.size() ? documents[spine_index].get() : nullptr;
+}
+
+bool BookContent::read_document(size_t spine_index, std::vector<char>& buffer, Document& document) {
+    if (spine_index >= documents.size() || is_oversized(spine_index)) return false;
+    
+    EPUBParser::EntryView view;
+    if (!epub_parser->get_content_view(spine_href(spine_index), buffer, view)) {
+        std::cerr << "Failed to read spine document: " << spine_href(spine_index) << std::endl;
+        return false;
+    }
+    
+    // Anchors and style runs are collected in the same pass that extracts the text
+    StyledText& styled = document.styled;
+    styled.clear();
+    document.anchors.clear();
+    HtmlTextExtractor extractor;
+    extractor.set_anchor_index(&document.anchors);
+    extractor.set_styled_output(&styled);
+    extractor.feed(view.data, view.size, styled.text);
+    extractor.finish(styled.text);
+    return true;
+}
+
+bool BookContent::resolve_toc_entry(size_t toc_index, Position& position) {
+    const auto& toc = epub_parser->get_table_of_contents();
+    if (toc_index >= spine_by_toc.size()) return false;
+    
+    const char* content_src = toc.content_src(toc_index);
+    int32_t spine_index = spine_by_toc[toc_index];
+    if (spine_index < 0) {
+        std::cerr << "TOC entry not in spine: " << content_src << std::endl;
+        return false;
+    }
+    
+    position.spine_index = spine_index;
+    position.offset = 0;
+    position.fragment = nullptr;
+    
+    const char* hash = std::strchr(content_src, '#');
+    if (!hash || hash[1] == '\0') {
+        return true;
+    }
+    if (is_oversized(spine_index)) {
+        position.fragment = hash + 1;
+        return true;
+    }
+    
+    // Fragment targets need the document's anchor index; an unknown
+    // fragment falls back to the top of the document
+    const Document* document = load_document(spine_index);
+    if (document) {
+        document->anchors.find(hash + 1, position.offset);
+    }
+    return true;
+}
+
+BookContent::TocEntries BookContent::toc_entries(size_t spine_index) const {
+    TocEntries entries = { nullptr, nullptr };
+    if (spine_index + 1 < toc_by_spine_start.size()) {
+        entries.first = toc_by_spine.data() + toc_by_spine_start[spine_index];
+        entries.last = toc_by_spine.data() + toc_by_spine_start[spine_index + 1];
+    }
+    return entries;
+}
@@ -0,0 +1,623 @@
+#include "html_text.h"
+#include "utf8.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    
+// Character classes for the scanner, one table lookup per input byte
+enum {
+    CC_SPACE = 0x01,        // Collapsible whitespace
+    CC_MARKUP = 0x02,       // '<' and '&' end a plain text run
+    CC_ENTITY = 0x04,       // Letters, digits and '#' inside a reference
+    CC_UPPER = 0x08,
+    CC_TEXT_STOP = CC_SPACE | CC_MARKUP
+};
+    
+const uint8_t CHAR_CLASS[256] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x01, 0x00, 0x01, 0x01, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x01, 0x00, 0x00, 0x04, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00,
+    0x00, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C,
+    0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
+    0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+    
+inline bool has_class(char c, uint8_t mask) {
+    return (CHAR_CLASS[static_cast<uint8_t>(c)] & mask) != 0;
+}
+    
+inline char to_lower(char c) {
+    return has_class(c, CC_UPPER) ? c + ('a' - 'A') : c;
+}
+    
+struct Entity {
+    const char* name;
+    uint32_t codepoint;
+};
+    
+// Named character references seen in e-books. The tables below form a
+// hash-and-displace perfect hash over FNV-1a: the low bits pick a
+// displacement, the high bits plus the displacement pick a unique slot,
+// so a lookup is one hash, two table reads and one compare.
+const uint8_t ENTITY_DISPLACEMENT[64] = {
+      1,   0,   0,   0,   1,   0,   0,   0,   0,   1,   0,   0,   0,   2,   0,   2,
+      0,   1,   0,  10,   0,   2,   0,   0,   0,   0,   0,   0,   0,  15,   1,   0,
+      0,   1,   0,   0,   4,   0,   5,   0,   6,   0,   0,   2,   1,   5,   0,   0,
+      2,   0,   2,   0,   0,   2,   1,   1,   0,   0,   5,   1,   0,   2,   1,   0,
+};
+    
+const uint8_t ENTITY_SLOTS[256] = {
+    255,   5,  12,  65, 255,  75,  39, 255,  83, 255, 255, 255,  99, 255, 255,  32,
+    255, 255, 255, 255, 255,  61,  33,   4,  15, 255,  30,   0, 255, 255, 255, 255,
+    255, 255, 255, 255,  77,  78,  89, 255, 255, 255, 106,  34, 255, 255, 255, 255,
+     43, 100, 255,  58, 105, 255, 255, 255, 255, 255,  70,  59, 255, 255, 255, 255,
+     86, 255,  63,  76, 255,  11, 255, 255, 255, 255, 255, 255, 255, 103,   7, 255,
+    255, 255,   6, 104, 255, 255,  97, 255, 255,   9, 255, 255, 255,  56,  41, 255,
+     35,  57,  80,  36,  27, 255, 255,  71, 255, 255, 255,  48,  90, 255,  21, 101,
+     88, 255, 255,  52,  54, 255, 255, 255,  47, 255,  28, 255, 255, 255,  50, 255,
+     25,  55,  40, 255, 255, 255,   3,  20, 255, 110,  85, 255, 255, 255, 255, 255,
+    255,  46, 255, 255, 255, 255, 255, 255, 255, 109,   1,  94,  49,  87,  84,  45,
+    255, 255, 255, 255, 255, 255,  18, 255, 255, 255, 255, 255,  79,   8, 255, 255,
+    255, 255, 255, 255,  16,  66, 255, 255,  42, 255,  98,  53,  93,  74,  38, 255,
+     68, 255, 255,  67, 255, 255, 255, 255, 255, 255, 255,  14,  73,  44, 255, 255,
+    255, 255, 255,  31,  64,  60, 255, 255, 255, 255,  22,  91, 255, 255, 255, 255,
+     17, 255,  51,  69, 102,  81,  10,  37,  29,  95,  23,  19,  96,  24,  82,   2,
+     26,  13, 107,  92, 108, 255, 255,  62,  72, 255, 255, 255, 255, 255, 255, 255,
+};
+    
+const Entity ENTITIES[] = {
+    { "nbsp", 160 }, { "amp", 38 }, { "lt", 60 }, { "gt", 62 }, { "quot", 34 }, { "apos", 39 },
+    { "mdash", 8212 }, { "ndash", 8211 }, { "hellip", 8230 }, { "lsquo", 8216 }, { "rsquo", 8217 },
+    { "ldquo", 8220 }, { "rdquo", 8221 }, { "sbquo", 8218 }, { "bdquo", 8222 }, { "laquo", 171 },
+    { "raquo", 187 }, { "lsaquo", 8249 }, { "rsaquo", 8250 }, { "copy", 169 }, { "reg", 174 },
+    { "trade", 8482 }, { "shy", 173 }, { "middot", 183 }, { "bull", 8226 }, { "deg", 176 },
+    { "times", 215 }, { "divide", 247 }, { "plusmn", 177 }, { "sect", 167 }, { "para", 182 },
+    { "dagger", 8224 }, { "Dagger", 8225 }, { "prime", 8242 }, { "Prime", 8243 }, { "frac12", 189 },
+    { "frac14", 188 }, { "frac34", 190 }, { "iexcl", 161 }, { "iquest", 191 }, { "cent", 162 },
+    { "pound", 163 }, { "euro", 8364 }, { "yen", 165 }, { "ensp", 8194 }, { "emsp", 8195 },
+    { "thinsp", 8201 }, { "zwnj", 8204 }, { "zwj", 8205 }, { "agrave", 224 }, { "aacute", 225 },
+    { "acirc", 226 }, { "atilde", 227 }, { "auml", 228 }, { "aring", 229 }, { "aelig", 230 },
+    { "ccedil", 231 }, { "egrave", 232 }, { "eacute", 233 }, { "ecirc", 234 }, { "euml", 235 },
+    { "igrave", 236 }, { "iacute", 237 }, { "icirc", 238 }, { "iuml", 239 }, { "ntilde", 241 },
+    { "ograve", 242 }, { "oacute", 243 }, { "ocirc", 244 }, { "otilde", 245 }, { "ouml", 246 },
+    { "oslash", 248 }, { "ugrave", 249 }, { "uacute", 250 }, { "ucirc", 251 }, { "uuml", 252 },
+    { "yacute", 253 }, { "yuml", 255 }, { "szlig", 223 }, { "Agrave", 192 }, { "Aacute", 193 },
+    { "Acirc", 194 }, { "Atilde", 195 }, { "Auml", 196 }, { "Aring", 197 }, { "AElig", 198 },
+    { "Ccedil", 199 }, { "Egrave", 200 }, { "Eacute", 201 }, { "Ecirc", 202 }, { "Euml", 203 },
+    { "Iacute", 205 }, { "Ntilde", 209 }, { "Oacute", 211 }, { "Ocirc", 212 }, { "Ouml", 214 },
+    { "Oslash", 216 }, { "Uacute", 218 }, { "Uuml", 220 }, { "oelig", 339 }, { "OElig", 338 },
+    { "alpha", 945 }, { "beta", 946 }, { "pi", 960 }, { "micro", 181 }, { "ordm", 186 },
+    { "ordf", 170 }, { "sup2", 178 }, { "sup3", 179 }, { "larr", 8592 }, { "rarr", 8594 },
+};
+    
+const uint8_t NO_ENTITY_SLOT = 255;
+    
+uint32_t entity_hash(const char* name, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<uint8_t>(name[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+    
+bool lookup_entity(const char* name, size_t length, uint32_t& codepoint) {
+    uint32_t hash = entity_hash(name, length);
+    uint8_t slot = static_cast<uint8_t>((hash >> 8) + ENTITY_DISPLACEMENT[hash & 63]);
+    uint8_t index = ENTITY_SLOTS[slot];
+    if (index == NO_ENTITY_SLOT) return false;
+        
+    const Entity& entity = ENTITIES[index];
+    if (std::strncmp(entity.name, name, length) != 0 || entity.name[length] != '\0') return false;
+        
+    codepoint = entity.codepoint;
+    return true;
+}
+    
+// Element handling beyond "tag becomes a space"
+enum TagAction {
+    TAG_OTHER,
+    TAG_BLOCK,
+    TAG_LINE_BREAK,
+    TAG_BOLD,
+    TAG_ITALIC,
+    TAG_INLINE              // Formatting that must not split words
+};
+    
+struct TagInfo {
+    const char* name;
+    TagAction action;
+};
+    
+const TagInfo TAG_TABLE[] = {
+    { "p", TAG_BLOCK }, { "div", TAG_BLOCK }, { "li", TAG_BLOCK }, { "blockquote", TAG_BLOCK },
+    { "pre", TAG_BLOCK }, { "hr", TAG_BLOCK }, { "tr", TAG_BLOCK }, { "dt", TAG_BLOCK },
+    { "dd", TAG_BLOCK }, { "ul", TAG_BLOCK }, { "ol", TAG_BLOCK }, { "table", TAG_BLOCK },
+    { "section", TAG_BLOCK }, { "figcaption", TAG_BLOCK }, { "body", TAG_BLOCK },
+    { "br", TAG_LINE_BREAK },
+    { "b", TAG_BOLD }, { "strong", TAG_BOLD },
+    { "i", TAG_ITALIC }, { "em", TAG_ITALIC }, { "cite", TAG_ITALIC }, { "dfn", TAG_ITALIC },
+    { "span", TAG_INLINE }, { "a", TAG_INLINE }, { "u", TAG_INLINE }, { "small", TAG_INLINE },
+    { "sup", TAG_INLINE }, { "sub", TAG_INLINE }, { "abbr", TAG_INLINE }, { "code", TAG_INLINE },
+};
+    
+TagAction classify_tag(const char* name) {
+    for (const TagInfo& info : TAG_TABLE) {
+        if (std::strcmp(info.name, name) == 0) return info.action;
+    }
+    return TAG_OTHER;
+}
+    
+} // namespace
+
+void AnchorIndex::add(const char* name, size_t length, uint32_t offset) {
+    StringPool::Symbol symbol = names.intern(name, length);
+    
+    // First definition wins, as in a browser
+    if (symbol >= offsets.size()) {
+        offsets.resize(symbol + 1, offset);
+    }
+}
+
+bool AnchorIndex::find(const char* name, size_t length, uint32_t& offset) const {
+    StringPool::Symbol symbol = names.find(name, length);
+    if (symbol == StringPool::NO_SYMBOL) return false;
+    
+    offset = offsets[symbol];
+    return true;
+}
+
+void AnchorIndex::clear() {
+    names.clear();
+    offsets.clear();
+}
+
+HtmlTextExtractor::HtmlTextExtractor() : write_begin(nullptr), write_pos(nullptr), anchors(nullptr), styled(nullptr) {
+    reset();
+}
+
+void HtmlTextExtractor::reset() {
+    state = STATE_TEXT;
+    tag_name[0] = '\0';
+    tag_length = 0;
+    closing_tag = false;
+    self_closing = false;
+    quote_char = '\0';
+    dashes = 0;
+    skip_tag[0] = '\0';
+    skipping = false;
+    last_was_space = true;      // Never emit leading whitespace
+    space_pending = false;
+    emitted = 0;
+    last_break_offset = 0;
+    write_begin = write_pos = nullptr;
+    entity_length = 0;
+    attr_length = 0;
+    in_attr_name = false;
+    anchor_value_next = false;
+    capturing_anchor = false;
+    anchor_length = 0;
+    styled = nullptr;
+    bold_depth = 0;
+    italic_depth = 0;
+    heading = 0;
+    run_style = 0;
+    run_start = 0;
+}
+
+void HtmlTextExtractor::feed(const char* data, size_t length, std::string& out) {
+    // Output never outgrows the input by more than a held-over space and
+    // reference, so size the buffer once and write through a raw cursor
+    size_t base = out.size();
+    out.resize(base + length + MAX_ENTITY + 2);
+    write_begin = write_pos = &out[base];
+    
+    const char* p = data;
+    const char* end = data + length;
+    
+    while (p < end) {
+        if (state == STATE_TEXT) {
+            if (skipping) {
+                // Script and style bodies: jump straight to the next tag
+                const char* next = static_cast<const char*>(std::memchr(p, '<', end - p));
+                if (!next) break;
+                p = next + 1;
+                begin_tag();
+            } else {
+                p = scan_text(p, end);
+            }
+            continue;
+        }
+        
+        char c = *p++;
+        
+        switch (state) {
+            case STATE_TEXT:
+                break;
+            
+            case STATE_ENTITY:
+                if (c == ';') {
+                    end_entity();
+                } else if (has_class(c, CC_ENTITY) && (c != '#' || entity_length == 0) &&
+                           entity_length < MAX_ENTITY) {
+                    entity[entity_length++] = c;
+                } else {
+                    // Not a reference after all; keep the text and rescan this byte
+                    flush_entity();
+                    --p;
+                }
+                break;
+            
+            case STATE_TAG_OPEN:
+                if (skipping && c != '/') {
+                    // Inside script/style only a close tag matters
+                    if (c != '<') state = STATE_TEXT;
+                } else if (c == '/') {
+                    closing_tag = true;
+                    state = STATE_TAG_NAME;
+                } else if (c == '>') {
+                    end_tag();
+                } else if (c == '!') {
+                    state = STATE_DECLARATION;
+                    dashes = 0;
+                } else if (c == '?') {
+                    // Processing instructions
+                    state = STATE_TAG_BODY;
+                } else {
+                    state = STATE_TAG_NAME;
+                    tag_name[tag_length++] = to_lower(c);
+                }
+                break;
+            
+            case STATE_TAG_NAME:
+                if (c == '>') {
+                    end_tag();
+                } else if (skipping && c == '<') {
+                    begin_tag();
+                } else if (has_class(c, CC_SPACE) || c == '/') {
+                    state = STATE_TAG_BODY;
+                    self_closing = (c == '/');
+                    in_attr_name = false;
+                    anchor_value_next = false;
+                } else if (tag_length < MAX_TAG_NAME) {
+                    tag_name[tag_length++] = to_lower(c);
+                }
+                break;
+            
+            case STATE_TAG_BODY:
+                if (c == '>') {
+                    end_tag();
+                } else {
+                    tag_body_char(c);
+                }
+                break;
+            
+            case STATE_DECLARATION:
+                if (c == '-' && dashes < 2) {
+                    if (++dashes == 2) {
+                        state = STATE_COMMENT;
+                        dashes = 0;
+                    }
+                } else if (c == '>') {
+                    end_tag();
+                } else {
+                    // Doctypes and the like end at the first '>' outside quotes
+                    state = STATE_TAG_BODY;
+                    tag_body_char(c);
+                }
+                break;
+            
+            case STATE_COMMENT:
+                if (c == '>' && dashes >= 2) {
+                    // Leaves the text as if the comment was not there
+                    state = STATE_TEXT;
+                } else {
+                    dashes = c == '-' ? dashes + 1 : 0;
+                }
+                break;
+            
+            case STATE_TAG_QUOTED:
+                if (c == quote_char) {
+                    state = STATE_TAG_BODY;
+                    if (capturing_anchor && anchors && !skipping) {
+                        anchors->add(anchor, anchor_length, static_cast<uint32_t>(current_offset()));
+                    }
+                    capturing_anchor = false;
+                } else if (capturing_anchor && anchor_length < MAX_ANCHOR) {
+                    anchor[anchor_length++] = c;
+                }
+                break;
+        }
+    }
+    
+    emitted += write_pos - write_begin;
+    out.resize(base + (write_pos - write_begin));
+    write_begin = write_pos = nullptr;
+}
+
+void HtmlTextExtractor::finish(std::string& out) {
+    size_t base = out.size();
+    out.resize(base + MAX_ENTITY + 2);
+    write_begin = write_pos = &out[base];
+    
+    // A reference cut off by the end of the document is kept as text
+    if (state == STATE_ENTITY) {
+        flush_entity();
+    }
+    write_pending_space();
+    close_run();
+    
+    emitted += write_pos - write_begin;
+    out.resize(base + (write_pos - write_begin));
+    write_begin = write_pos = nullptr;
+}
+
+const char* HtmlTextExtractor::scan_text(const char* p, const char* end) {
+    char* dst = write_pos;
+    
+    while (p < end) {
+        // Plain text is copied straight through up to the next space or markup byte
+        const char* run = p;
+        if (space_pending && !has_class(*p, CC_TEXT_STOP)) {
+            *dst++ = ' ';
+            space_pending = false;
+        }
+        while (p < end && !has_class(*p, CC_TEXT_STOP)) {
+            *dst++ = *p++;
+        }
+        if (p != run) last_was_space = false;
+        if (p == end) break;
+        
+        char c = *p++;
+        if (c == '<') {
+            write_pos = dst;
+            begin_tag();
+            return p;
+        }
+        if (c == '&') {
+            state = STATE_ENTITY;
+            entity_length = 0;
+            break;
+        }
+        if (!last_was_space) {
+            space_pending = true;
+            last_was_space = true;
+        }
+    }
+    
+    write_pos = dst;
+    return p;
+}
+
+void HtmlTextExtractor::begin_tag() {
+    state = STATE_TAG_OPEN;
+    tag_length = 0;
+    closing_tag = false;
+    self_closing = false;
+    in_attr_name = false;
+    anchor_value_next = false;
+}
+
+void HtmlTextExtractor::end_entity() {
+    state = STATE_TEXT;
+    
+    uint32_t codepoint = 0;
+    bool valid = false;
+    if (entity_length > 1 && entity[0] == '#') {
+        bool hex = entity[1] == 'x' || entity[1] == 'X';
+        valid = entity_length > (hex ? 2u : 1u);
+        for (size_t i = hex ? 2 : 1; i < entity_length && valid; ++i) {
+            char c = entity[i];
+            uint32_t digit;
+            if (c >= '0' && c <= '9') digit = c - '0';
+            else if (hex && c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+            else if (hex && c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+            else {
+                valid = false;
+                break;
+            }
+            codepoint = codepoint * (hex ? 16 : 10) + digit;
+        }
+        valid = valid && codepoint > 0 && codepoint < 0x110000;
+    } else if (entity_length > 0) {
+        valid = lookup_entity(entity, entity_length, codepoint);
+    }
+    
+    if (!valid) {
+        flush_entity();
+        append_text(';');
+        return;
+    }
+    
+    if (codepoint < 0x80) {
+        append_text(static_cast<char>(codepoint));
+        return;
+    }
+    
+    write_pending_space();
+    write_pos += Utf8Decoder::encode(codepoint, write_pos);
+    last_was_space = false;
+}
+
+void HtmlTextExtractor::flush_entity() {
+    state = STATE_TEXT;
+    append_text('&');
+    for (size_t i = 0; i < entity_length; ++i) {
+        append_text(entity[i]);
+    }
+}
+
+void HtmlTextExtractor::tag_body_char(char c) {
+    if (c == '"' || c == '\'') {
+        quote_char = c;
+        state = STATE_TAG_QUOTED;
+        capturing_anchor = anchor_value_next;
+        anchor_length = 0;
+        anchor_value_next = false;
+        in_attr_name = false;
+    } else if (c == '=') {
+        // Only id="..." and name="..." values are worth keeping
+        attr_name[attr_length < MAX_ATTR_NAME ? attr_length : MAX_ATTR_NAME] = '\0';
+        anchor_value_next = attr_length <= MAX_ATTR_NAME &&
+                            (std::strcmp(attr_name, "id") == 0 || std::strcmp(attr_name, "name") == 0);
+        in_attr_name = false;
+    } else if (has_class(c, CC_SPACE)) {
+        in_attr_name = false;
+    } else {
+        self_closing = (c == '/');
+        if (!in_attr_name) {
+            in_attr_name = true;
+            attr_length = 0;
+            anchor_value_next = false;
+        }
+        if (attr_length <= MAX_ATTR_NAME) {
+            attr_name[attr_length < MAX_ATTR_NAME ? attr_length : MAX_ATTR_NAME] = c;
+            ++attr_length;
+        }
+    }
+}
+
+void HtmlTextExtractor::end_tag() {
+    tag_name[tag_length] = '\0';
+    state = STATE_TEXT;
+    
+    if (skipping) {
+        // Only the matching close tag ends a script/style body
+        if (closing_tag && std::strcmp(tag_name, skip_tag) == 0) {
+            skipping = false;
+            append_text(' ');
+        }
+        return;
+    }
+    
+    if (!closing_tag && !self_closing && (std::strcmp(tag_name, "script") == 0 || std::strcmp(tag_name, "style") == 0)) {
+        std::strcpy(skip_tag, tag_name);
+        skipping = true;
+        return;
+    }
+    
+    // <h1> .. <h6>
+    if (tag_length == 2 && tag_name[0] == 'h' && tag_name[1] >= '1' && tag_name[1] <= '6') {
+        uint8_t level = static_cast<uint8_t>(tag_name[1] - '0');
+        bool opening = !closing_tag && !self_closing;
+        block_break(opening ? static_cast<uint8_t>(BLOCK_HEADING + level - 1) : static_cast<uint8_t>(BLOCK_PARAGRAPH));
+        heading = opening ? level : 0;
+        update_style();
+        return;
+    }
+    
+    switch (classify_tag(tag_name)) {
+        case TAG_BLOCK:
+            block_break(BLOCK_PARAGRAPH);
+            return;
+        
+        case TAG_LINE_BREAK:
+            append_break();
+            return;
+        
+        case TAG_BOLD:
+            if (!self_closing) {
+                bold_depth = closing_tag ? std::max(0, bold_depth - 1) : bold_depth + 1;
+                update_style();
+            }
+            return;
+        
+        case TAG_ITALIC:
+            if (!self_closing) {
+                italic_depth = closing_tag ? std::max(0, italic_depth - 1) : italic_depth + 1;
+                update_style();
+            }
+            return;
+        
+        case TAG_INLINE:
+            return;
+        
+        default:
+            break;
+    }
+    
+    append_text(' '); // Add space between tags
+}
+
+void HtmlTextExtractor::append_text(char c) {
+    if (has_class(c, CC_SPACE)) {
+        if (!last_was_space) {
+            space_pending = true;
+            last_was_space = true;
+        }
+    } else {
+        write_pending_space();
+        *write_pos++ = c;
+        last_was_space = false;
+    }
+}
+
+void HtmlTextExtractor::write_pending_space() {
+    if (space_pending) {
+        *write_pos++ = ' ';
+        space_pending = false;
+    }
+}
+
+void HtmlTextExtractor::append_break() {
+    // Nothing to break at the very start of the text
+    if (current_offset() == 0) return;
+    
+    // A collapsed space right before the break is replaced rather than kept
+    space_pending = false;
+    *write_pos++ = '\n';
+    last_was_space = true;
+    last_break_offset = current_offset();
+}
+
+void HtmlTextExtractor::block_break(uint8_t kind) {
+    if (current_offset() != last_break_offset) {
+        append_break();
+    }
+    if (styled) {
+        styled->add_block(static_cast<uint32_t>(current_offset()), kind);
+    }
+}
+
+void HtmlTextExtractor::set_styled_output(StyledText* output) {
+    styled = output;
+    if (styled) {
+        TextStyle plain = { 0, 0 };
+        run_style = styled->intern_style(plain);
+        run_start = current_offset();
+        styled->add_block(static_cast<uint32_t>(run_start), BLOCK_PARAGRAPH);
+    }
+}
+
+void HtmlTextExtractor::update_style() {
+    if (!styled) return;
+    
+    TextStyle style = { 0, heading };
+    if (bold_depth > 0) style.flags |= STYLE_BOLD;
+    if (italic_depth > 0) style.flags |= STYLE_ITALIC;
+    
+    uint16_t id = styled->intern_style(style);
+    if (id != run_style) {
+        close_run();
+        run_style = id;
+    }
+}
+
+void HtmlTextExtractor::close_run() {
+    size_t now = current_offset();
+    if (styled && now > run_start) {
+        styled->add_run(static_cast<uint32_t>(run_start), static_cast<uint32_t>(now - run_start), run_style);
+    }
+    run_start = now;
+}
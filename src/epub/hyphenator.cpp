@@ -0,0 +1,427 @@
+#include "hyphenator.h"
+#include "cache_file.h"
+#include "file_manager.h"
+#include "line_breaker.h"
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+
+const size_t Hyphenator::MAX_WORD_LENGTH;
+const size_t Hyphenator::LEFT_MIN;
+const size_t Hyphenator::RIGHT_MIN;
+
+// Layout of a compiled pattern file, in little-endian u32 words:
+//   magic "EPHY", version, pattern file size (2 words), pattern file mtime
+//   (2 words), trie entries, weight bytes, root base, class bits, link
+//   bits, highest class; then 256 letter classes as bytes, the trie
+//   entries and the weight records.
+//
+// A trie entry is class | child base << class bits | weights << (class
+// plus link bits). The entry for class c of the node based at b is at
+// b + c and only belongs to that node if its class is c. Leaves have base
+// 0, and slots 0 through the highest class are never used, so a walk from
+// a leaf stops at once. A weight record is the first gap it applies to,
+// counted from the start of the pattern, the number of gaps, then one
+// weight per gap.
+
+namespace {
+    
+const char HYPHENATION_MAGIC[4] = { 'E', 'P', 'H', 'Y' };
+const uint32_t HYPHENATION_VERSION = 1;
+const size_t HEADER_WORDS = 12;
+const size_t HEADER_BYTES = HEADER_WORDS * 4;
+const size_t LETTER_CLASS_BYTES = 256;
+const uint8_t BOUNDARY_CLASS = 1;   // '.' in patterns, the edges of a word
+    
+// Exceptions outweigh every pattern weight, odd where they allow a break
+const uint8_t EXCEPTION_BREAK = 11;
+const uint8_t EXCEPTION_NO_BREAK = 10;
+    
+uint32_t bits_for(uint32_t value) {
+    uint32_t bits = 0;
+    while (bits < 32 && (value >> bits) != 0) ++bits;
+    return bits;
+}
+    
+} // namespace
+
+Hyphenator::Hyphenator() {
+    detach();
+}
+
+void Hyphenator::detach() {
+    letter_classes = nullptr;
+    trie = nullptr;
+    weights = nullptr;
+    trie_size = weights_size = root = 0;
+    class_mask = link_shift = link_mask = weights_shift = 0;
+    patterns_fingerprint = 0;
+}
+
+bool Hyphenator::load(const std::string& pattern_path) {
+    detach();
+    
+    uint64_t source_size = FileManager::get_file_size(pattern_path);
+    uint64_t source_mtime = FileManager::get_file_mtime(pattern_path);
+    std::string cache_path = cache_file_path(cache_hash(pattern_path.data(), pattern_path.size()), ".hyph");
+    
+    if (read_cache_file(cache_path, blob) && attach()) {
+        const uint32_t* header = reinterpret_cast<const uint32_t*>(&blob[0]);
+        if (header[2] == static_cast<uint32_t>(source_size) && header[3] == static_cast<uint32_t>(source_size >> 32) &&
+            header[4] == static_cast<uint32_t>(source_mtime) && header[5] == static_cast<uint32_t>(source_mtime >> 32)) {
+            return true;
+        }
+        detach();
+    }
+    
+    std::vector<char> source;
+    if (!read_cache_file(pattern_path, source)) {
+        std::cerr << "Failed to read hyphenation patterns: " << pattern_path << std::endl;
+        return false;
+    }
+    if (!compile(&source[0], source.size())) return false;
+    
+    uint32_t* header = reinterpret_cast<uint32_t*>(&blob[0]);
+    header[2] = static_cast<uint32_t>(source_size);
+    header[3] = static_cast<uint32_t>(source_size >> 32);
+    header[4] = static_cast<uint32_t>(source_mtime);
+    header[5] = static_cast<uint32_t>(source_mtime >> 32);
+    write_cache_file(cache_path, std::string(blob.begin(), blob.end()));
+    return true;
+}
+
+bool Hyphenator::compile(const char* source, size_t length) {
+    detach();
+    
+    // Weights per pattern, one per gap around its characters, merged
+    // where the same letters appear twice
+    std::map<std::string, std::vector<uint8_t>> patterns;
+    uint8_t classes[LETTER_CLASS_BYTES] = {};
+    uint32_t highest_class = BOUNDARY_CLASS;
+    size_t line_number = 0;
+    
+    size_t pos = 0;
+    while (pos < length) {
+        const void* newline = std::memchr(source + pos, '\n', length - pos);
+        size_t line_end = newline ? static_cast<size_t>(static_cast<const char*>(newline) - source) : length;
+        const char* line = source + pos;
+        size_t line_length = line_end - pos;
+        pos = line_end + 1;
+        ++line_number;
+        
+        while (line_length > 0 && (line[line_length - 1] == '\r' || line[line_length - 1] == ' ')) --line_length;
+        if (line_length == 0 || line[0] == '#') continue;
+        
+        bool exception = std::find_if(line, line + line_length, [](char c) { return c >= '0' && c <= '9'; }) ==
+                         line + line_length;
+        std::string letters;
+        std::vector<uint8_t> gaps(1, 0);
+        if (exception) {
+            letters += '.';
+            gaps.push_back(0);
+        }
+        
+        bool valid = true;
+        for (size_t i = 0; i < line_length && valid; ++i) {
+            char c = line[i];
+            if (c >= '0' && c <= '9') {
+                gaps.back() = static_cast<uint8_t>(c - '0');
+            } else if (c == '-' && exception && letters.size() > 1) {
+                gaps.back() = EXCEPTION_BREAK;
+            } else if (c == '.' || (c >= 'a' && c <= 'z')) {
+                if (exception && letters.size() > 1) {
+                    gaps.back() = std::max(gaps.back(), EXCEPTION_NO_BREAK);
+                }
+                if (c != '.' && classes[static_cast<uint8_t>(c)] == 0) {
+                    classes[static_cast<uint8_t>(c)] = static_cast<uint8_t>(++highest_class);
+                }
+                letters += c;
+                gaps.push_back(0);
+            } else {
+                valid = false;
+            }
+        }
+        if (exception) {
+            letters += '.';
+            gaps.push_back(0);
+        }
+        
+        if (!valid || letters.empty() || letters.size() > MAX_WORD_LENGTH + 2) {
+            std::cerr << "Bad hyphenation pattern on line " << line_number << std::endl;
+            return false;
+        }
+        
+        std::vector<uint8_t>& merged = patterns[letters];
+        merged.resize(gaps.size(), 0);
+        for (size_t i = 0; i < gaps.size(); ++i) {
+            merged[i] = std::max(merged[i], gaps[i]);
+        }
+    }
+    
+    if (patterns.empty()) {
+        std::cerr << "No hyphenation patterns found" << std::endl;
+        return false;
+    }
+    for (char c = 'a'; c <= 'z'; ++c) {
+        classes[static_cast<uint8_t>(c - 'a' + 'A')] = classes[static_cast<uint8_t>(c)];
+    }
+    
+    // Plain trie first; a node's weights are the record of the pattern
+    // ending there
+    struct Node {
+        std::map<uint8_t, uint32_t> children;
+        uint32_t record;
+    };
+    std::vector<Node> nodes(1);
+    nodes[0].record = 0;
+    std::map<std::vector<uint8_t>, uint32_t> records;
+    std::string weight_data(1, '\0');    // Record 0 means none
+    
+    for (const auto& pattern : patterns) {
+        uint32_t node = 0;
+        for (char c : pattern.first) {
+            uint8_t letter_class = c == '.' ? BOUNDARY_CLASS : classes[static_cast<uint8_t>(c)];
+            auto it = nodes[node].children.find(letter_class);
+            if (it == nodes[node].children.end()) {
+                Node child;
+                child.record = 0;
+                nodes.push_back(child);
+                it = nodes[node].children.insert(std::make_pair(letter_class, static_cast<uint32_t>(nodes.size() - 1))).first;
+            }
+            node = it->second;
+        }
+        
+        const std::vector<uint8_t>& gaps = pattern.second;
+        size_t first = 0;
+        size_t last = gaps.size();
+        while (first < last && gaps[first] == 0) ++first;
+        while (last > first && gaps[last - 1] == 0) --last;
+        if (first == last) continue;
+        
+        std::vector<uint8_t> record(1, static_cast<uint8_t>(first));
+        record.push_back(static_cast<uint8_t>(last - first));
+        record.insert(record.end(), gaps.begin() + first, gaps.begin() + last);
+        auto inserted = records.insert(std::make_pair(record, static_cast<uint32_t>(weight_data.size())));
+        if (inserted.second) {
+            weight_data.append(record.begin(), record.end());
+        }
+        nodes[node].record = inserted.first->second;
+    }
+    
+    // Pack breadth first, each node at the lowest base where all its
+    // children find free slots. Bases are unique, so no two nodes share a
+    // slot for the same class. Candidates are tried only where the lowest
+    // child lands on a free slot, found through skip links over used ones.
+    std::vector<uint32_t> bases(nodes.size(), 0);
+    std::vector<bool> base_used;
+    std::vector<uint32_t> skip;     // A used slot links to a later one; a free slot to itself
+    auto next_free = [&skip](uint32_t slot) {
+        while (slot < skip.size() && skip[slot] != slot) {
+            uint32_t next = skip[slot];
+            if (next < skip.size()) skip[slot] = skip[next];
+            slot = next;
+        }
+        return slot;
+    };
+    auto use_slot = [&skip](uint32_t slot) {
+        while (skip.size() <= slot) skip.push_back(static_cast<uint32_t>(skip.size()));
+        skip[slot] = slot + 1;
+    };
+    
+    uint32_t size = highest_class + 1;
+    std::deque<uint32_t> queue(1, 0);
+    while (!queue.empty()) {
+        const Node& node = nodes[queue.front()];
+        uint32_t index = queue.front();
+        queue.pop_front();
+        if (node.children.empty()) continue;
+        
+        uint32_t lowest_class = node.children.begin()->first;
+        uint32_t base = 0;
+        for (uint32_t slot = next_free(highest_class + 1 + lowest_class);; slot = next_free(slot + 1)) {
+            base = slot - lowest_class;
+            if (base < base_used.size() && base_used[base]) continue;
+            bool fits = true;
+            for (const auto& child : node.children) {
+                if (next_free(base + child.first) != base + child.first) {
+                    fits = false;
+                    break;
+                }
+            }
+            if (fits) break;
+        }
+        
+        bases[index] = base;
+        if (base >= base_used.size()) base_used.resize(base + 1, false);
+        base_used[base] = true;
+        for (const auto& child : node.children) {
+            use_slot(base + child.first);
+            queue.push_back(child.second);
+        }
+        size = std::max<uint32_t>(size, base + highest_class + 1);
+    }
+    
+    uint32_t class_bits = bits_for(highest_class);
+    uint32_t link_bits = bits_for(size);
+    uint32_t record_bits = bits_for(static_cast<uint32_t>(weight_data.size()));
+    if (class_bits + link_bits + record_bits > 32) {
+        std::cerr << "Hyphenation patterns too large to pack" << std::endl;
+        return false;
+    }
+    
+    std::vector<uint32_t> entries(size, 0);
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        for (const auto& child : nodes[i].children) {
+            entries[bases[i] + child.first] = child.first | bases[child.second] << class_bits |
+                                              nodes[child.second].record << (class_bits + link_bits);
+        }
+    }
+    
+    CacheWriter writer;
+    writer.data.append(HYPHENATION_MAGIC, sizeof(HYPHENATION_MAGIC));
+    writer.put_u32(HYPHENATION_VERSION);
+    writer.put_u64(0);  // Pattern file stamp, filled in by load
+    writer.put_u64(0);
+    writer.put_u32(size);
+    writer.put_u32(static_cast<uint32_t>(weight_data.size()));
+    writer.put_u32(bases[0]);
+    writer.put_u32(class_bits);
+    writer.put_u32(link_bits);
+    writer.put_u32(highest_class);
+    writer.data.append(reinterpret_cast<const char*>(classes), sizeof(classes));
+    for (uint32_t entry : entries) {
+        writer.put_u32(entry);
+    }
+    writer.data += weight_data;
+    
+    blob.assign(writer.data.begin(), writer.data.end());
+    return attach();
+}
+
+bool Hyphenator::attach() {
+    // The blob comes from a plain allocation, which is aligned for u32
+    if (blob.size() < HEADER_BYTES + LETTER_CLASS_BYTES ||
+        std::memcmp(&blob[0], HYPHENATION_MAGIC, sizeof(HYPHENATION_MAGIC)) != 0) {
+        return false;
+    }
+    
+    const uint32_t* header = reinterpret_cast<const uint32_t*>(&blob[0]);
+    uint32_t entries = header[6];
+    uint32_t weight_bytes = header[7];
+    uint32_t root_base = header[8];
+    uint32_t class_bits = header[9];
+    uint32_t link_bits = header[10];
+    uint32_t highest_class = header[11];
+    
+    size_t room = blob.size() - HEADER_BYTES - LETTER_CLASS_BYTES;
+    if (header[1] != HYPHENATION_VERSION || class_bits == 0 || class_bits + link_bits >= 32 ||
+        highest_class >= (1u << class_bits) || entries > room / 4 || room - entries * 4 != weight_bytes ||
+        root_base + highest_class >= entries) {
+        return false;
+    }
+    
+    const uint8_t* classes = reinterpret_cast<const uint8_t*>(&blob[HEADER_BYTES]);
+    const uint32_t* packed = reinterpret_cast<const uint32_t*>(&blob[HEADER_BYTES + LETTER_CLASS_BYTES]);
+    const uint8_t* records = reinterpret_cast<const uint8_t*>(&blob[HEADER_BYTES + LETTER_CLASS_BYTES + entries * 4]);
+    uint32_t mask = (1u << link_bits) - 1;
+    
+    // Every walk must stay inside the arrays, whatever the file holds
+    for (size_t i = 0; i < LETTER_CLASS_BYTES; ++i) {
+        if (classes[i] > highest_class) return false;
+    }
+    for (uint32_t i = 0; i < entries; ++i) {
+        uint32_t link = (packed[i] >> class_bits) & mask;
+        uint32_t record = packed[i] >> (class_bits + link_bits);
+        if (link + highest_class >= entries) return false;
+        if (record && (record + 2 > weight_bytes || record + 2 + records[record + 1] > weight_bytes)) return false;
+    }
+    
+    letter_classes = classes;
+    trie = packed;
+    weights = records;
+    trie_size = entries;
+    weights_size = weight_bytes;
+    root = root_base;
+    class_mask = (1u << class_bits) - 1;
+    link_shift = class_bits;
+    link_mask = mask;
+    weights_shift = class_bits + link_bits;
+    patterns_fingerprint = cache_hash(&blob[HEADER_BYTES], blob.size() - HEADER_BYTES);
+    return true;
+}
+
+size_t Hyphenator::hyphenate(const char* word, size_t length, uint8_t* points) const {
+    if (!trie || length > 255) return 0;
+    
+    // Punctuation around the word is not part of it
+    size_t start = 0;
+    size_t end = length;
+    while (start < end && !letter_classes[static_cast<uint8_t>(word[start])]) ++start;
+    while (end > start && !letter_classes[static_cast<uint8_t>(word[end - 1])]) --end;
+    size_t letters = end - start;
+    if (letters < LEFT_MIN + RIGHT_MIN || letters > MAX_WORD_LENGTH) return 0;
+    
+    uint8_t classes[MAX_WORD_LENGTH + 2];
+    classes[0] = BOUNDARY_CLASS;
+    for (size_t i = 0; i < letters; ++i) {
+        classes[i + 1] = letter_classes[static_cast<uint8_t>(word[start + i])];
+        if (classes[i + 1] == 0) return 0;
+    }
+    classes[letters + 1] = BOUNDARY_CLASS;
+    
+    // Every pattern matching anywhere in the word raises the weights of
+    // the gaps it covers; values[k] is the gap before classes[k]
+    size_t count = letters + 2;
+    uint8_t values[MAX_WORD_LENGTH + 3];
+    std::memset(values, 0, count + 1);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t node = root;
+        for (size_t j = i; j < count; ++j) {
+            uint32_t entry = trie[node + classes[j]];
+            if ((entry & class_mask) != classes[j]) break;
+            
+            uint32_t record = entry >> weights_shift;
+            if (record) {
+                const uint8_t* weight = weights + record;
+                size_t at = i + weight[0];
+                size_t stop = std::min(at + weight[1], count + 1);
+                for (const uint8_t* value = weight + 2; at < stop; ++at, ++value) {
+                    if (*value > values[at]) values[at] = *value;
+                }
+            }
+            node = (entry >> link_shift) & link_mask;
+        }
+    }
+    
+    // A hyphen after k letters sits in the gap before classes[k + 1]
+    size_t found = 0;
+    for (size_t k = LEFT_MIN; k + RIGHT_MIN <= letters; ++k) {
+        if (values[k + 1] & 1) {
+            points[found++] = static_cast<uint8_t>(start + k);
+        }
+    }
+    return found;
+}
+
+size_t Hyphenator::fit(const char* word, size_t length, size_t from, AdvanceTable& advances, int room,
+                       int& width) const {
+    uint8_t points[MAX_WORD_LENGTH];
+    size_t count = hyphenate(word, length, points);
+    int hyphen_width = advances.advance('-');
+    
+    // Pieces only grow, so the first one too wide ends the search
+    size_t best = 0;
+    size_t measured = from;
+    int piece_width = 0;
+    for (size_t p = 0; p < count; ++p) {
+        if (points[p] <= from) continue;
+        piece_width += advances.measure(word + measured, points[p] - measured);
+        measured = points[p];
+        if (piece_width + hyphen_width > room) break;
+        best = points[p];
+        width = piece_width;
+    }
+    return best;
+}
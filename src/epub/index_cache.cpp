@@ -0,0 +1,169 @@
+#include "epub_parser.h"
+#include "cache_file.h"
+#include <iostream>
+#include <cstring>
+
+// Layout of a cache file (all integers little-endian, strings are u32 length + bytes):
+//   magic "EPIX", version, book size, book mtime, book path,
+//   container root, manifest string pool and columns, spine items,
+//   TOC string pool, flat TOC entries
+
+namespace {
+    
+const char INDEX_CACHE_MAGIC[4] = { 'E', 'P', 'I', 'X' };
+    
+std::string index_cache_path(const std::string& book_path) {
+    return cache_file_path(cache_hash(book_path.data(), book_path.size()), ".idx");
+}
+    
+} // namespace
+
+bool EPUBParser::load_index_cache(const std::string& book_path, uint64_t book_size, uint64_t book_mtime) {
+    std::vector<char> buffer;
+    if (!read_cache_file(index_cache_path(book_path), buffer)) return false;
+    
+    if (buffer.size() < sizeof(INDEX_CACHE_MAGIC) ||
+        std::memcmp(&buffer[0], INDEX_CACHE_MAGIC, sizeof(INDEX_CACHE_MAGIC)) != 0) {
+        return false;
+    }
+    
+    CacheReader reader(buffer);
+    reader.get_u32(); // magic
+    
+    std::string cached_path;
+    uint32_t version = reader.get_u32();
+    uint64_t cached_size = reader.get_u64();
+    uint64_t cached_mtime = reader.get_u64();
+    reader.get_string(cached_path);
+    
+    if (!reader.good() || version != INDEX_CACHE_VERSION || cached_size != book_size ||
+        cached_mtime != book_mtime || cached_path != book_path) {
+        return false;
+    }
+    
+    reader.get_string(container_root);
+    
+    // Manifest columns are stored as symbols into the interned pool
+    std::string manifest_strings;
+    reader.get_string(manifest_strings);
+    bool valid = reader.good() && manifest.strings.load(manifest_strings);
+    
+    uint32_t manifest_count = valid ? reader.get_u32() : 0;
+    if (valid && reader.plausible_count(manifest_count, 13)) {
+        uint32_t symbol_count = static_cast<uint32_t>(manifest.strings.size());
+        manifest.ids.resize(manifest_count);
+        manifest.hrefs.resize(manifest_count);
+        manifest.media_types.resize(manifest_count);
+        manifest.types.resize(manifest_count);
+        for (uint32_t i = 0; i < manifest_count && valid; ++i) {
+            manifest.ids[i] = reader.get_u32();
+            manifest.hrefs[i] = reader.get_u32();
+            manifest.media_types[i] = reader.get_u32();
+            manifest.types[i] = reader.get_u8();
+            valid = manifest.ids[i] < symbol_count && manifest.hrefs[i] < symbol_count &&
+                    manifest.media_types[i] < symbol_count && manifest.types[i] <= MEDIA_FONT;
+        }
+        if (valid) {
+            manifest.rebuild_lookups();
+        }
+    } else {
+        valid = false;
+    }
+    
+    uint32_t spine_count = valid ? reader.get_u32() : 0;
+    if (valid && reader.plausible_count(spine_count, 5)) {
+        spine.resize(spine_count);
+        for (auto& item : spine) {
+            item.manifest_index = reader.get_u32();
+            item.linear = reader.get_u8() != 0;
+            if (item.manifest_index >= manifest_count) {
+                valid = false;
+            }
+        }
+    } else {
+        valid = false;
+    }
+    
+    uint32_t toc_count = 0;
+    if (valid) {
+        reader.get_string(toc.strings);
+        toc_count = reader.get_u32();
+        valid = reader.plausible_count(toc_count, 28) && !toc.strings.empty() &&
+                toc.strings[toc.strings.size() - 1] == '\0';
+    }
+    if (valid) {
+        // Reject offsets or links that would point outside the tables
+        toc.entries.resize(toc_count);
+        int32_t count = static_cast<int32_t>(toc_count);
+        for (auto& entry : toc.entries) {
+            entry.id = reader.get_u32();
+            entry.title = reader.get_u32();
+            entry.content_src = reader.get_u32();
+            entry.play_order = static_cast<int32_t>(reader.get_u32());
+            entry.parent = static_cast<int32_t>(reader.get_u32());
+            entry.first_child = static_cast<int32_t>(reader.get_u32());
+            entry.next_sibling = static_cast<int32_t>(reader.get_u32());
+            
+            if (entry.id >= toc.strings.size() || entry.title >= toc.strings.size() ||
+                entry.content_src >= toc.strings.size() ||
+                entry.parent < TableOfContents::NO_ENTRY || entry.parent >= count ||
+                entry.first_child < TableOfContents::NO_ENTRY || entry.first_child >= count ||
+                entry.next_sibling < TableOfContents::NO_ENTRY || entry.next_sibling >= count) {
+                valid = false;
+                break;
+            }
+        }
+        toc.rebuild_roots();
+    }
+    
+    if (!valid || !reader.good() || !reader.at_end()) {
+        std::cerr << "Discarding corrupt index cache for " << book_path << std::endl;
+        container_root.clear();
+        manifest.clear();
+        spine.clear();
+        toc.clear();
+        return false;
+    }
+    
+    return true;
+}
+
+bool EPUBParser::save_index_cache(const std::string& book_path, uint64_t book_size, uint64_t book_mtime) const {
+    CacheWriter writer;
+    writer.data.append(INDEX_CACHE_MAGIC, sizeof(INDEX_CACHE_MAGIC));
+    writer.put_u32(INDEX_CACHE_VERSION);
+    writer.put_u64(book_size);
+    writer.put_u64(book_mtime);
+    writer.put_string(book_path);
+    
+    writer.put_string(container_root);
+    
+    writer.put_string(manifest.strings.storage());
+    writer.put_u32(static_cast<uint32_t>(manifest.size()));
+    for (size_t i = 0; i < manifest.size(); ++i) {
+        writer.put_u32(manifest.ids[i]);
+        writer.put_u32(manifest.hrefs[i]);
+        writer.put_u32(manifest.media_types[i]);
+        writer.put_u8(manifest.types[i]);
+    }
+    
+    writer.put_u32(static_cast<uint32_t>(spine.size()));
+    for (const auto& item : spine) {
+        writer.put_u32(item.manifest_index);
+        writer.put_u8(item.linear ? 1 : 0);
+    }
+    
+    writer.put_string(toc.strings);
+    writer.put_u32(static_cast<uint32_t>(toc.entries.size()));
+    for (const auto& entry : toc.entries) {
+        writer.put_u32(entry.id);
+        writer.put_u32(entry.title);
+        writer.put_u32(entry.content_src);
+        writer.put_u32(static_cast<uint32_t>(entry.play_order));
+        writer.put_u32(static_cast<uint32_t>(entry.parent));
+        writer.put_u32(static_cast<uint32_t>(entry.first_child));
+        writer.put_u32(static_cast<uint32_t>(entry.next_sibling));
+    }
+    
+    return write_cache_file(index_cache_path(book_path), writer.data);
+}
@@ -0,0 +1,94 @@
+#include "line_break.h"
+
+const int LineBreakScanner::BLOCK_SHIFT;
+const uint32_t LineBreakScanner::BLOCK_MASK;
+const uint8_t LineBreakScanner::INDIRECT;
+const uint8_t LineBreakScanner::DIRECT;
+
+void LineBreakScanner::reset() {
+    before = LB_PAIR_CLASSES;
+    last = LB_PAIR_CLASSES;
+    spaces = false;
+    odd_indicators = false;
+    number = false;
+    hyphen_joins = HYPHEN_BREAKS;
+    plain = false;
+}
+
+LineBreakScanner::Opportunity LineBreakScanner::next_rule(uint8_t cls) {
+    uint8_t previous = last;
+    last = cls;
+    
+    // LB4, LB5: a line ends after a hard break, and CR LF is one
+    Opportunity result = NO_BREAK;
+    if (previous >= LB_BK && !(previous == LB_CR && cls == LB_LF)) {
+        reset();
+        last = cls;
+        result = MANDATORY_BREAK;
+    }
+    
+    // LB6, LB7: never before a hard break or a space
+    if (cls >= LB_BK) {
+        plain = false;
+        return result;
+    }
+    if (cls == LB_SP) {
+        spaces = true;
+        return result;
+    }
+    
+    // LB9: marks take the class of what they follow; LB10: alone they are
+    // letters
+    if (cls == LB_CM || cls == LB_ZWJ) {
+        if (before != LB_PAIR_CLASSES && before != LB_ZW && !spaces) {
+            plain = false;
+            return result;
+        }
+        cls = LB_AL;
+    }
+    
+    if (result == NO_BREAK && before == LB_PAIR_CLASSES) {
+        // LB18 after leading spaces, except where LB7 to LB13 hold across them
+        if (spaces && PAIR_ACTIONS[LB_AL][cls] != 0) result = ALLOWED_BREAK;
+    } else if (result == NO_BREAK) {
+        bool allowed;
+        if (previous == LB_ZWJ) {
+            allowed = false;                                    // LB8a
+        } else if (!spaces && cls != LB_CB && (hyphen_joins == HYPHEN_JOINS_ANY ||
+                                               (hyphen_joins == HYPHEN_JOINS_LETTER && cls == LB_AL))) {
+            allowed = false;                                    // LB20a, LB21a
+        } else if (!spaces && number && (cls == LB_PO || cls == LB_PR)) {
+            allowed = false;                                    // LB25
+        } else if (!number && cls == LB_NU && before == LB_SY) {
+            allowed = true;                                     // LB25 joins SY NU only inside a number
+        } else if (cls == LB_RI && before == LB_RI && !spaces) {
+            allowed = !odd_indicators;                          // LB30a
+        } else {
+            uint8_t action = PAIR_ACTIONS[before][cls];
+            allowed = action == DIRECT || (action == INDIRECT && spaces);
+        }
+        if (allowed) result = ALLOWED_BREAK;
+    }
+    
+    bool joined = before == cls && !spaces;
+    odd_indicators = cls == LB_RI && !(joined && odd_indicators);
+    
+    // A number runs NU (NU | SY | IS)* and may end in a closing bracket
+    bool in_number = number && !spaces && before != LB_CL && before != LB_CP;
+    number = cls == LB_NU || (in_number && (cls == LB_SY || cls == LB_IS || cls == LB_CL || cls == LB_CP));
+    
+    // A hyphen starting a word stays with a letter after it, and one after
+    // a Hebrew letter with anything
+    bool word_start = before == LB_PAIR_CLASSES || spaces || before == LB_ZW || before == LB_CB;
+    if ((cls == LB_HY || cls == LB_BA) && before == LB_HL && !spaces) {
+        hyphen_joins = HYPHEN_JOINS_ANY;
+    } else if (cls == LB_HY && word_start) {
+        hyphen_joins = HYPHEN_JOINS_LETTER;
+    } else {
+        hyphen_joins = HYPHEN_BREAKS;
+    }
+    before = cls;
+    spaces = false;
+    plain = !number && hyphen_joins == HYPHEN_BREAKS && !odd_indicators && last != LB_ZWJ;
+    return result;
+}
@@ -0,0 +1,448 @@
+#include "line_breaker.h"
+#include "hyphenator.h"
+#include "line_break.h"
+#include "utf8.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+const uint32_t AdvanceTable::DIRECT_RANGE;
+const size_t LineBreaker::MAX_LINE_WORDS;
+const size_t LineBreaker::MAX_OPTIMAL_WORDS;
+
+namespace {
+    
+// Knuth-Plass weights as in TeX. Spaces stretch by half and shrink by a
+// third of their width; badness grows with the cube of how far they are
+// pushed, and a very tight line next to a loose one costs extra. Badness is
+// not capped as in TeX, which has a tolerance pass to keep the capped
+// lines out; here a line twice as loose always costs more.
+const double LINE_PENALTY = 10;
+const double ADJACENT_FITNESS_DEMERITS = 3000;
+const int FITNESS_CLASSES = 4;      // Tight, decent, loose, very loose
+const double NO_DEMERITS = std::numeric_limits<double>::infinity();
+const double FIRST_PASS_RATIO = 3;  // Spaces at two and a half times their width
+const double PRETOLERANCE_RATIO = 1; // Badness 100, TeX's \pretolerance
+    
+// A hyphenated line costs as much as TeX's \hyphenpenalty of 50, and a
+// second one in a row as much again as its \doublehyphendemerits
+const double HYPHEN_DEMERITS = 50 * 50;
+const double CONSECUTIVE_HYPHEN_DEMERITS = 10000;
+    
+int fitness_class(double ratio) {
+    if (ratio < -0.5) return 0;
+    if (ratio <= 0.5) return 1;
+    if (ratio <= 1.0) return 2;
+    return 3;
+}
+    
+// Splits a paragraph into words at its line break opportunities, measuring
+// them as they are decoded. A word runs up to the next opportunity, less
+// the spaces before it; spaces inside it, as in "wait !", are kept.
+// Opportunities are known one codepoint late, so that codepoint is carried
+// into the next word.
+class WordScanner {
+public:
+    WordScanner(const char* paragraph, size_t start, size_t end, AdvanceTable& advance_table)
+        : text(paragraph), decoder(paragraph + start, end - start), advances(advance_table), open(false),
+          word_start(0), word_end(0), word_width(0), running_width(0) {}
+        
+    bool next(size_t& start, size_t& end, int& width) {
+        while (!decoder.done()) {
+            size_t at = static_cast<size_t>(decoder.position() - text);
+            uint32_t codepoint = decoder.next();
+            size_t after = static_cast<size_t>(decoder.position() - text);
+            int advance = advances.advance(codepoint);
+                
+            // Never a break before a space, so the carried codepoint is not one
+            if (scanner.next(codepoint) != LineBreakScanner::NO_BREAK && open) {
+                start = word_start;
+                end = word_end;
+                width = word_width;
+                word_start = at;
+                word_end = after;
+                word_width = running_width = advance;
+                return true;
+            }
+                
+            if (codepoint == ' ') {
+                running_width += advance;
+                continue;
+            }
+            if (!open) {
+                open = true;
+                word_start = at;
+                running_width = 0;
+            }
+            running_width += advance;
+            word_end = after;
+            word_width = running_width;
+        }
+            
+        if (!open) return false;
+        start = word_start;
+        end = word_end;
+        width = word_width;
+        open = false;
+        return true;
+    }
+        
+private:
+    const char* text;
+    Utf8Decoder decoder;
+    LineBreakScanner scanner;
+    AdvanceTable& advances;
+    bool open;                  // A word has started
+    size_t word_start;
+    size_t word_end;            // After its last codepoint that is not a space
+    int word_width;             // Up to word_end
+    int running_width;          // With the spaces since
+};
+    
+} // namespace
+
+AdvanceTable::AdvanceTable(const MeasureFunction& measure) : measure_codepoint(measure) {
+    // Control characters have no glyph and never reach the font
+    for (uint32_t codepoint = 0; codepoint < DIRECT_RANGE; ++codepoint) {
+        bool control = codepoint < 0x20 || (codepoint >= 0x7F && codepoint < 0xA0);
+        direct[codepoint] = control ? 0 : static_cast<int16_t>(measure_codepoint(codepoint));
+    }
+}
+
+int AdvanceTable::advance_slow(uint32_t codepoint) {
+    {
+        std::lock_guard<std::mutex> lock(others_mutex);
+        auto it = others.find(codepoint);
+        if (it != others.end()) return it->second;
+    }
+    
+    // Measured unlocked; two threads racing here store the same width
+    int16_t width = static_cast<int16_t>(measure_codepoint(codepoint));
+    std::lock_guard<std::mutex> lock(others_mutex);
+    others[codepoint] = width;
+    return width;
+}
+
+uint64_t AdvanceTable::fingerprint() const {
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t codepoint = 0; codepoint < DIRECT_RANGE; ++codepoint) {
+        hash ^= static_cast<uint16_t>(direct[codepoint]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+int AdvanceTable::measure(const char* text, size_t length) {
+    int width = 0;
+    Utf8Decoder decoder(text, length);
+    while (!decoder.done()) {
+        width += advance(decoder.next());
+    }
+    return width;
+}
+
+LineBreaker::LineBreaker(AdvanceTable& advance_table, int width, const Hyphenator* word_hyphenator)
+    : advances(advance_table), max_width(width), space_width(advance_table.advance(' ')),
+      hyphenator(word_hyphenator && word_hyphenator->ready() ? word_hyphenator : nullptr),
+      hyphen_width(advance_table.advance('-')) {
+}
+
+void LineBreaker::break_lines(const char* text, size_t length, uint32_t base_offset, std::vector<LineSpan>& spans) {
+    break_paragraphs(text, length, base_offset, spans, false);
+}
+
+void LineBreaker::break_optimal(const char* text, size_t length, uint32_t base_offset, std::vector<LineSpan>& spans) {
+    break_paragraphs(text, length, base_offset, spans, true);
+}
+
+void LineBreaker::break_paragraphs(const char* text, size_t length, uint32_t base_offset, std::vector<LineSpan>& spans,
+                                   bool optimal) {
+    size_t start = 0;
+    while (start <= length) {
+        const void* newline = std::memchr(text + start, '\n', length - start);
+        size_t end = newline ? static_cast<size_t>(static_cast<const char*>(newline) - text) : length;
+        
+        size_t before = spans.size();
+        if (optimal) {
+            break_paragraph(text, start, end, base_offset, spans);
+        } else {
+            break_greedy(text, start, end, base_offset, spans);
+        }
+        
+        // A hard break always ends a line, even an empty one
+        if (newline && spans.size() == before) {
+            LineSpan span = { base_offset + static_cast<uint32_t>(end), 0, 0, false };
+            spans.push_back(span);
+        }
+        start = end + 1;
+    }
+}
+
+void LineBreaker::break_greedy(const char* text, size_t start, size_t end, uint32_t base_offset,
+                               std::vector<LineSpan>& spans) {
+    // The open line is [line_start, line_end); line_end stops after its last word
+    size_t line_start = 0;
+    size_t line_end = 0;
+    int line_width = 0;
+    bool line_open = false;
+    
+    auto emit = [&](size_t first, size_t last, int width, bool hyphen) {
+        LineSpan span = { base_offset + static_cast<uint32_t>(first), static_cast<uint32_t>(last - first), width, hyphen };
+        spans.push_back(span);
+    };
+    
+    WordScanner scanner(text, start, end, advances);
+    size_t word_start;
+    size_t word_end;
+    int word_width;
+    while (scanner.next(word_start, word_end, word_width)) {
+        // Words between break opportunities need not have spaces between them
+        int gap = line_open ? space_width * static_cast<int>(word_start - line_end) : 0;
+        if (line_open && line_width + gap + word_width <= max_width) {
+            line_end = word_end;
+            line_width += gap + word_width;
+            continue;
+        }
+        
+        // Hyphenate the word to fill what is left of the open line
+        size_t piece_start = word_start;
+        if (line_open && hyphenator) {
+            int piece_width = 0;
+            size_t piece = hyphenator->fit(text + word_start, word_end - word_start, 0, advances,
+                                           max_width - line_width - gap, piece_width);
+            if (piece > 0) {
+                emit(line_start, word_start + piece, line_width + gap + piece_width + hyphen_width, true);
+                line_open = false;
+                piece_start = word_start + piece;
+                word_width -= piece_width;
+            }
+        }
+        
+        if (line_open) {
+            emit(line_start, line_end, line_width, false);
+        }
+        line_start = piece_start;
+        line_end = word_end;
+        line_width = word_width;
+        line_open = true;
+        if (word_width <= max_width) continue;
+        
+        // Too wide for any line: split at hyphenation points while a piece
+        // fits, then between codepoints, keeping the last piece open so
+        // following words can join it
+        if (hyphenator) {
+            int piece_width = 0;
+            size_t piece = 0;
+            while (line_width > max_width &&
+                   (piece = hyphenator->fit(text + word_start, word_end - word_start, line_start - word_start,
+                                            advances, max_width, piece_width)) > 0) {
+                emit(line_start, word_start + piece, piece_width + hyphen_width, true);
+                line_start = word_start + piece;
+                line_width -= piece_width;
+            }
+            if (line_width <= max_width) continue;
+        }
+        
+        line_width = 0;
+        Utf8Decoder pieces(text + line_start, word_end - line_start);
+        while (!pieces.done()) {
+            size_t at = static_cast<size_t>(pieces.position() - text);
+            int width = advances.advance(pieces.next());
+            if (line_width + width > max_width && at > line_start) {
+                emit(line_start, at, line_width, false);
+                line_start = at;
+                line_width = 0;
+            }
+            line_width += width;
+        }
+    }
+    
+    if (line_open) {
+        emit(line_start, line_end, line_width, false);
+    }
+}
+
+void LineBreaker::break_paragraph(const char* text, size_t start, size_t end, uint32_t base_offset,
+                                  std::vector<LineSpan>& spans) {
+    // Over budget, or a word that has to be split: greedy handles those.
+    // A word wider than a line may still fit once hyphenated.
+    bool hyphenated = false;
+    WordsResult collected = collect_words(text, start, end, false);
+    if (collected == WORD_TOO_WIDE && hyphenator) {
+        hyphenated = true;
+        collected = collect_words(text, start, end, true);
+    }
+    if (collected != WORDS_COLLECTED) {
+        break_greedy(text, start, end, base_offset, spans);
+        return;
+    }
+    if (words.empty()) return;
+    
+    // As in TeX, a paragraph that sets well enough as it is is not
+    // hyphenated at all, which also spares most paragraphs the lookups
+    bool found = false;
+    if (hyphenator && !hyphenated) {
+        found = find_breaks(PRETOLERANCE_RATIO);
+        if (!found && collect_words(text, start, end, true) != WORDS_COLLECTED) {
+            break_greedy(text, start, end, base_offset, spans);
+            return;
+        }
+    }
+    
+    // Most paragraphs can be set without any very loose line, and the
+    // first pass skips those candidates before costing them
+    if (!found && !find_breaks(FIRST_PASS_RATIO)) {
+        find_breaks(NO_DEMERITS);
+    }
+    
+    // Walk back from the cheapest way to end the paragraph
+    size_t count = words.size();
+    size_t node = count * FITNESS_CLASSES;
+    for (int fitness = 1; fitness < FITNESS_CLASSES; ++fitness) {
+        if (demerits[count * FITNESS_CLASSES + fitness] < demerits[node]) {
+            node = count * FITNESS_CLASSES + fitness;
+        }
+    }
+    
+    size_t first_span = spans.size();
+    while (previous[node] >= 0) {
+        size_t from = static_cast<size_t>(previous[node]);
+        size_t first = from / FITNESS_CLASSES;
+        size_t last = node / FITNESS_CLASSES - 1;
+        int64_t natural = word_widths[last + 1] - word_widths[first] +
+                          static_cast<int64_t>(space_width) * (gap_spaces[last] - gap_spaces[first]) +
+                          (words[last].hyphen ? hyphen_width : 0);
+        LineSpan span = { base_offset + words[first].start, words[last].end - words[first].start,
+                          static_cast<int32_t>(natural), words[last].hyphen };
+        spans.push_back(span);
+        node = from;
+    }
+    std::reverse(spans.begin() + first_span, spans.end());
+}
+
+LineBreaker::WordsResult LineBreaker::collect_words(const char* text, size_t start, size_t end, bool hyphenate) {
+    words.clear();
+    WordScanner scanner(text, start, end, advances);
+    size_t word_start;
+    size_t word_end;
+    int word_width;
+    while (scanner.next(word_start, word_end, word_width)) {
+        // One piece per hyphenation point, plus the rest of the word
+        uint8_t points[Hyphenator::MAX_WORD_LENGTH];
+        size_t point_count = hyphenate ? hyphenator->hyphenate(text + word_start, word_end - word_start, points) : 0;
+        size_t piece_start = word_start;
+        for (size_t p = 0; p <= point_count; ++p) {
+            size_t piece_end = p < point_count ? word_start + points[p] : word_end;
+            int width = point_count == 0 ? word_width : advances.measure(text + piece_start, piece_end - piece_start);
+            Word piece = { static_cast<uint32_t>(piece_start), static_cast<uint32_t>(piece_end), width, p < point_count };
+            if (piece.width + (piece.hyphen ? hyphen_width : 0) > max_width) return WORD_TOO_WIDE;
+            if (words.size() >= MAX_OPTIMAL_WORDS) return TOO_MANY_WORDS;
+            words.push_back(piece);
+            piece_start = piece_end;
+        }
+    }
+    
+    size_t count = words.size();
+    word_widths.assign(count + 1, 0);
+    gap_spaces.assign(count, 0);
+    for (size_t w = 0; w < count; ++w) {
+        word_widths[w + 1] = word_widths[w] + words[w].width;
+        if (w > 0) gap_spaces[w] = gap_spaces[w - 1] + static_cast<int32_t>(words[w].start - words[w - 1].end);
+    }
+    
+    // Lines are looked for among their last MAX_LINE_WORDS words only; text
+    // that fits more on a line, as CJK does with a word per ideograph, would
+    // come out short
+    for (size_t first = 0; first + MAX_LINE_WORDS <= count; ++first) {
+        size_t last = first + MAX_LINE_WORDS - 1;
+        int64_t natural = word_widths[last + 1] - word_widths[first] +
+                          static_cast<int64_t>(space_width) * (gap_spaces[last] - gap_spaces[first]);
+        if (natural <= max_width) return TOO_MANY_WORDS;
+    }
+    return WORDS_COLLECTED;
+}
+
+bool LineBreaker::find_breaks(double max_ratio) {
+    // Break k falls before word k; break 0 starts the paragraph, decent
+    size_t count = words.size();
+    demerits.assign((count + 1) * FITNESS_CLASSES, NO_DEMERITS);
+    previous.assign((count + 1) * FITNESS_CLASSES, -1);
+    demerits[1] = 0;
+    
+    // Lines only get longer as their first word moves back. Those starting
+    // at loose_edge or later stretch past max_ratio, and the edge only moves
+    // forward as the line end does, so they are skipped without a scan.
+    size_t loose_edge = 0;
+    auto too_loose = [&](size_t first, size_t last) {
+        int32_t gaps = gap_spaces[last] - gap_spaces[first];
+        int64_t room = max_width - (word_widths[last + 1] - word_widths[first]) - static_cast<int64_t>(space_width) * gaps -
+                       (words[last].hyphen ? hyphen_width : 0);
+        return room > 0 && static_cast<double>(room) * 2 > max_ratio * space_width * (gaps > 0 ? gaps : 1);
+    };
+    
+    for (size_t last = 0; last < count; ++last) {
+        bool final_line = last + 1 == count;
+        bool hyphenated = words[last].hyphen;
+        while (loose_edge <= last && !too_loose(loose_edge, last)) ++loose_edge;
+        
+        // The search stops at the first line that cannot shrink enough.
+        // Without a stretch limit every break is reachable, by a one-word
+        // line if need be.
+        size_t scan_from = final_line ? last + 1 : loose_edge;
+        for (size_t first = scan_from; first-- > 0 && last - first < MAX_LINE_WORDS;) {
+            int32_t gaps = gap_spaces[last] - gap_spaces[first];
+            int64_t natural = word_widths[last + 1] - word_widths[first] + static_cast<int64_t>(space_width) * gaps +
+                              (hyphenated ? hyphen_width : 0);
+            int64_t room = max_width - natural;
+            
+            // A one-word line has no spaces to stretch; it is costed as if
+            // it had one, which keeps it the last resort it should be
+            double spaces = static_cast<double>(space_width) * (gaps > 0 ? gaps : 1);
+            double ratio;
+            if (room < 0) {
+                if (gaps == 0) break;
+                ratio = static_cast<double>(room) * 3 / spaces;
+                if (ratio < -1) break;
+            } else if (final_line) {
+                ratio = 0;  // The last line is set ragged
+            } else {
+                ratio = static_cast<double>(room) * 2 / spaces;
+            }
+            
+            double scaled = ratio < 0 ? -ratio : ratio;
+            double badness = 100 * scaled * scaled * scaled;
+            double line_demerits = (LINE_PENALTY + badness) * (LINE_PENALTY + badness);
+            if (hyphenated) {
+                line_demerits += HYPHEN_DEMERITS;
+                if (first > 0 && words[first - 1].hyphen) line_demerits += CONSECUTIVE_HYPHEN_DEMERITS;
+            }
+            int line_class = fitness_class(ratio);
+            
+            size_t to = (last + 1) * FITNESS_CLASSES + line_class;
+            for (int from_class = 0; from_class < FITNESS_CLASSES; ++from_class) {
+                size_t from = first * FITNESS_CLASSES + from_class;
+                if (demerits[from] == NO_DEMERITS) continue;
+                
+                double total = demerits[from] + line_demerits;
+                if (from_class - line_class > 1 || line_class - from_class > 1) {
+                    total += ADJACENT_FITNESS_DEMERITS;
+                }
+                if (total < demerits[to]) {
+                    demerits[to] = total;
+                    previous[to] = static_cast<int32_t>(from);
+                }
+            }
+        }
+    }
+    
+    for (int fitness = 0; fitness < FITNESS_CLASSES; ++fitness) {
+        if (demerits[count * FITNESS_CLASSES + fitness] != NO_DEMERITS) return true;
+    }
+    return false;
+}
+
+bool LineBreaker::ends_paragraph(const char* text, size_t length, const LineSpan& span) {
+    size_t i = span.offset + span.length;
+    while (i < length && text[i] == ' ') ++i;
+    return i >= length || text[i] == '\n';
+}
@@ -11,6 +11,7 @@ private:
     std::vector<std::string> book_titles;
     GPURenderer* renderer;
     int scroll_offset;
+    bool dirty;                         // Changed since the last render
     
 public:
     enum BookListResult {
@@ -19,7 +20,7 @@ public:
         BOOKLIST_OPEN_BOOK
     };
     
-    BookList(GPURenderer* gpu_renderer) : selected_book(0), renderer(gpu_renderer), scroll_offset(0) {
+    BookList(GPURenderer* gpu_renderer) : selected_book(0), renderer(gpu_renderer), scroll_offset(0), dirty(true) {
         refresh_book_list();
     }
     
@@ -34,6 +35,7 @@ public:
         if (selected_book >= static_cast<int>(book_files.size())) {
             selected_book = std::max(0, static_cast<int>(book_files.size()) - 1);
         }
+        dirty = true;
     }
     
     BookListResult update(const SceCtrlData& ctrl, uint32_t last_buttons) {
@@ -47,10 +49,12 @@ public:
         // Navigation
         if ((ctrl.buttons & SCE_CTRL_UP) && !(last_buttons & SCE_CTRL_UP)) {
             selected_book = (selected_book - 1 + book_files.size()) % book_files.size();
+            dirty = true;
             adjust_scroll();
         }
         if ((ctrl.buttons & SCE_CTRL_DOWN) && !(last_buttons & SCE_CTRL_DOWN)) {
             selected_book = (selected_book + 1) % book_files.size();
+            dirty = true;
             adjust_scroll();
         }
         
@@ -67,7 +71,11 @@ public:
         return BOOKLIST_CONTINUE;
     }
     
+    bool needs_render() const { return dirty; }
+    
     void render() {
+        dirty = false;
+        
         // Render title
         renderer->render_text_gpu("Book Library", 100, 80, RGBA8(0, 0, 0, 255), 32);
         
@@ -0,0 +1,308 @@
+#include "paginator.h"
+#include "cache_file.h"
+#include "chapter_stream.h"
+#include "file_manager.h"
+#include "gpu_renderer.h"
+#include "hyphenator.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Layout of a page map file (see cache_file.h for encoding):
+//   magic "EPPG", version, book size, book mtime, book path,
+//   layout settings, font and hyphenation fingerprints, spine count, first page per spine
+//   item plus the total, streamed flags, page starts
+
+namespace {
+    
+const char PAGE_MAP_MAGIC[4] = { 'E', 'P', 'P', 'G' };
+const uint32_t PAGE_MAP_VERSION = 4;
+    
+} // namespace
+
+void PageMap::clear() {
+    first_page.clear();
+    streamed.clear();
+    starts.clear();
+}
+
+Paginator::Paginator(EPUBParser* parser, BookContent* book_content, GPURenderer* gpu_renderer)
+    : epub_parser(parser), content(book_content), renderer(gpu_renderer), font_fingerprint(0), hyphenation_fingerprint(0),
+      next_item(0), stream(parser, gpu_renderer), streaming(false), run_stats(),
+      cancel(false), done(false), items_done(0) {
+}
+
+Paginator::~Paginator() {
+    stop();
+}
+
+void Paginator::start(const std::string& path, const LayoutSettings& layout_settings) {
+    stop();
+    
+    book_path = path;
+    settings = layout_settings;
+    font_fingerprint = renderer->font_fingerprint(settings.font_size);
+    const Hyphenator* hyphenator = renderer->hyphenator();
+    hyphenation_fingerprint = settings.hyphenate && hyphenator ? hyphenator->fingerprint() : 0;
+    map.clear();
+    next_item = 0;
+    items_done = 0;
+    done = false;
+    cancel = false;
+    started = std::chrono::steady_clock::now();
+    run_stats = Stats();
+    
+    if (load_cache()) {
+        items_done = content->spine_count();
+        run_stats.from_cache = true;
+        run_stats.elapsed_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - started).count();
+        done = true;
+        return;
+    }
+    
+    map.first_page.reserve(content->spine_count() + 1);
+    map.streamed.reserve(content->spine_count());
+    if (epub_parser->can_read_concurrently()) {
+        worker = std::thread(&Paginator::run, this);
+    }
+}
+
+void Paginator::stop() {
+    cancel = true;
+    if (worker.joinable()) {
+        worker.join();
+    }
+    stream.close();
+    streaming = false;
+    release_scratch();
+}
+
+void Paginator::step() {
+    if (done || cancel || worker.joinable()) return;
+    
+    if (next_item < content->spine_count() && paginate_item(next_item, STEP_LINES)) {
+        ++next_item;
+        ++items_done;
+    }
+    if (next_item == content->spine_count()) {
+        finish();
+    }
+}
+
+float Paginator::progress() const {
+    size_t total = content->spine_count();
+    return total ? static_cast<float>(items_done) / total : 1.0f;
+}
+
+size_t Paginator::page_at(int32_t spine_index, uint32_t position) const {
+    if (!done || spine_index < 0 || static_cast<size_t>(spine_index) + 1 >= map.first_page.size()) return 0;
+    
+    auto first = map.starts.begin() + map.first_page[spine_index];
+    auto last = map.starts.begin() + map.first_page[spine_index + 1];
+    auto it = std::upper_bound(first, last, position);
+    return static_cast<size_t>((it == first ? first : it - 1) - map.starts.begin());
+}
+
+bool Paginator::locate(size_t page, int32_t& spine_index, uint32_t& position) const {
+    if (!done || page >= map.page_count()) return false;
+    
+    auto it = std::upper_bound(map.first_page.begin(), map.first_page.end(), static_cast<uint32_t>(page));
+    spine_index = static_cast<int32_t>(it - map.first_page.begin()) - 1;
+    position = map.starts[page];
+    return true;
+}
+
+void Paginator::run() {
+    for (size_t i = 0; i < content->spine_count() && !cancel;) {
+        if (paginate_item(i, STEP_LINES)) {
+            ++i;
+            ++items_done;
+        }
+    }
+    if (!cancel) {
+        finish();
+    }
+}
+
+bool Paginator::paginate_item(size_t spine_index, size_t max_lines) {
+    // Streamed documents lay out in even lines, so only their length is needed
+    if (content->is_oversized(spine_index)) {
+        if (!streaming) {
+            stream.open(content->spine_href(spine_index), settings.max_width, settings.font_size, settings.hyphenate);
+            streaming = true;
+        }
+        
+        // The stream stays open for the next slice
+        size_t slice_end = stream.lines_produced() + max_lines;
+        while (!cancel && stream.ensure_line(stream.lines_produced())) {
+            if (stream.lines_produced() >= slice_end) return false;
+        }
+        if (cancel) return false;
+        
+        map.first_page.push_back(static_cast<uint32_t>(map.starts.size()));
+        map.streamed.push_back(1);
+        size_t lines_per_page = std::max(1, settings.page_height /
+                                                GPURenderer::line_height(settings.font_size, settings.line_spacing));
+        size_t line = 0;
+        do {
+            map.starts.push_back(static_cast<uint32_t>(line));
+            line += lines_per_page;
+        } while (line < stream.lines_produced());
+        
+        stream.close();
+        streaming = false;
+        return true;
+    }
+    
+    map.first_page.push_back(static_cast<uint32_t>(map.starts.size()));
+    map.streamed.push_back(0);
+    
+    // Documents not held for reading are extracted into the scratch one and
+    // dropped, so paginating a book does not keep all of it in memory
+    ChapterLayout layout;
+    std::vector<size_t> page_first_lines;
+    const BookContent::Document* document = content->cached_document(spine_index);
+    if (!document && content->read_document(spine_index, read_buffer, scratch_document)) {
+        document = &scratch_document;
+    }
+    if (document) {
+        renderer->layout_styled_text(document->styled, settings, layout);
+    }
+    layout.paginate(settings.page_height, page_first_lines);
+    
+    for (size_t line : page_first_lines) {
+        map.starts.push_back(layout.empty() ? 0 : layout.lines[line].offset);
+    }
+    return true;
+}
+
+void Paginator::finish() {
+    map.first_page.push_back(static_cast<uint32_t>(map.starts.size()));
+    save_cache();
+    release_scratch();
+    
+    run_stats.elapsed_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - started).count();
+    done = true;
+}
+
+void Paginator::release_scratch() {
+    scratch_document = BookContent::Document();
+    std::vector<char>().swap(read_buffer);
+}
+
+std::string Paginator::cache_path() const {
+    // One file per book and layout, so switching settings back is free too
+    uint32_t key[8] = {
+        static_cast<uint32_t>(settings.max_width), static_cast<uint32_t>(settings.font_size),
+        static_cast<uint32_t>(settings.line_spacing), static_cast<uint32_t>(settings.page_height),
+        static_cast<uint32_t>(settings.justify), static_cast<uint32_t>(settings.hyphenate),
+        static_cast<uint32_t>(font_fingerprint), static_cast<uint32_t>(hyphenation_fingerprint)
+    };
+    uint64_t hash = cache_hash(book_path.data(), book_path.size());
+    hash = cache_hash(reinterpret_cast<const char*>(key), sizeof(key), hash);
+    return cache_file_path(hash, ".pages");
+}
+
+bool Paginator::load_cache() {
+    std::vector<char> buffer;
+    if (!read_cache_file(cache_path(), buffer)) return false;
+    
+    if (buffer.size() < sizeof(PAGE_MAP_MAGIC) ||
+        std::memcmp(&buffer[0], PAGE_MAP_MAGIC, sizeof(PAGE_MAP_MAGIC)) != 0) {
+        return false;
+    }
+    
+    CacheReader reader(buffer);
+    reader.get_u32(); // magic
+    
+    std::string cached_path;
+    uint32_t version = reader.get_u32();
+    uint64_t cached_size = reader.get_u64();
+    uint64_t cached_mtime = reader.get_u64();
+    reader.get_string(cached_path);
+    
+    LayoutSettings cached_settings;
+    cached_settings.max_width = static_cast<int>(reader.get_u32());
+    cached_settings.font_size = static_cast<int>(reader.get_u32());
+    cached_settings.line_spacing = static_cast<int>(reader.get_u32());
+    cached_settings.page_height = static_cast<int>(reader.get_u32());
+    cached_settings.justify = reader.get_u8() != 0;
+    cached_settings.hyphenate = reader.get_u8() != 0;
+    uint64_t cached_fingerprint = reader.get_u64();
+    uint64_t cached_hyphenation = reader.get_u64();
+    uint32_t spine_count = reader.get_u32();
+    
+    if (!reader.good() || version != PAGE_MAP_VERSION || cached_path != book_path ||
+        cached_size != FileManager::get_file_size(book_path) ||
+        cached_mtime != FileManager::get_file_mtime(book_path) ||
+        cached_settings != settings || cached_fingerprint != font_fingerprint ||
+        cached_hyphenation != hyphenation_fingerprint ||
+        spine_count != content->spine_count()) {
+        return false;
+    }
+    
+    if (!reader.plausible_count(spine_count + 1, 5)) return false;
+    map.first_page.resize(spine_count + 1);
+    map.streamed.resize(spine_count);
+    for (uint32_t i = 0; i <= spine_count; ++i) {
+        map.first_page[i] = reader.get_u32();
+    }
+    for (uint32_t i = 0; i < spine_count; ++i) {
+        map.streamed[i] = reader.get_u8();
+    }
+    
+    uint32_t page_count = reader.get_u32();
+    if (!reader.plausible_count(page_count, 4)) {
+        map.clear();
+        return false;
+    }
+    map.starts.resize(page_count);
+    for (uint32_t i = 0; i < page_count; ++i) {
+        map.starts[i] = reader.get_u32();
+    }
+    
+    // Every spine item owns at least one page, in order, ending at the total
+    bool valid = reader.good() && reader.at_end() && map.first_page[spine_count] == page_count;
+    for (uint32_t i = 0; i < spine_count && valid; ++i) {
+        valid = map.first_page[i] < map.first_page[i + 1];
+    }
+    if (!valid) {
+        std::cerr << "Discarding corrupt page map for " << book_path << std::endl;
+        map.clear();
+        return false;
+    }
+    return true;
+}
+
+bool Paginator::save_cache() const {
+    CacheWriter writer;
+    writer.data.append(PAGE_MAP_MAGIC, sizeof(PAGE_MAP_MAGIC));
+    writer.put_u32(PAGE_MAP_VERSION);
+    writer.put_u64(FileManager::get_file_size(book_path));
+    writer.put_u64(FileManager::get_file_mtime(book_path));
+    writer.put_string(book_path);
+    
+    writer.put_u32(static_cast<uint32_t>(settings.max_width));
+    writer.put_u32(static_cast<uint32_t>(settings.font_size));
+    writer.put_u32(static_cast<uint32_t>(settings.line_spacing));
+    writer.put_u32(static_cast<uint32_t>(settings.page_height));
+    writer.put_u8(settings.justify ? 1 : 0);
+    writer.put_u8(settings.hyphenate ? 1 : 0);
+    writer.put_u64(font_fingerprint);
+    writer.put_u64(hyphenation_fingerprint);
+    
+    writer.put_u32(static_cast<uint32_t>(map.streamed.size()));
+    for (uint32_t first : map.first_page) {
+        writer.put_u32(first);
+    }
+    for (uint8_t streamed : map.streamed) {
+        writer.put_u8(streamed);
+    }
+    
+    writer.put_u32(static_cast<uint32_t>(map.starts.size()));
+    for (uint32_t start : map.starts) {
+        writer.put_u32(start);
+    }
+    
+    return write_cache_file(cache_path(), writer.data);
+}
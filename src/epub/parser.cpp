@@ -1,38 +1,266 @@
 #include "epub_parser.h"
+#include "file_manager.h"
+#include "xml_pull_parser.h"
 #include <iostream>
+#include <algorithm>
+#include <chrono>
 #include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+namespace {
+    
+// Little-endian field readers for ZIP records
+inline uint16_t read_u16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+    
+inline uint32_t read_u32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+    
+const uint32_t ZIP_LOCAL_HEADER_SIG = 0x04034b50;
+const uint32_t ZIP_CENTRAL_HEADER_SIG = 0x02014b50;
+const uint32_t ZIP_END_OF_CENTRAL_DIR_SIG = 0x06054b50;
+const size_t ZIP_LOCAL_HEADER_SIZE = 30;
+const size_t ZIP_CENTRAL_HEADER_SIZE = 46;
+const size_t ZIP_END_OF_CENTRAL_DIR_SIZE = 22;
+    
+// fseek takes a long, 32 bits on the Vita; offsets past it are refused
+// rather than truncated to somewhere else in the file
+bool seek_to(FILE* file, uint64_t offset) {
+    if (offset > static_cast<uint64_t>(std::numeric_limits<long>::max())) return false;
+    return std::fseek(file, static_cast<long>(offset), SEEK_SET) == 0;
+}
+    
+bool read_at(FILE* file, uint64_t offset, void* out, size_t size) {
+    return seek_to(file, offset) && std::fread(out, 1, size, file) == size;
+}
+    
+// Positions file at a member's data. The local header's name and extra
+// field may differ in length from the central copy, so it is read first.
+bool seek_member_data(FILE* file, const EPUBParser::ZipEntry& entry, uint64_t archive_size) {
+    uint8_t header[ZIP_LOCAL_HEADER_SIZE];
+    if (entry.local_offset + ZIP_LOCAL_HEADER_SIZE > archive_size ||
+        !read_at(file, entry.local_offset, header, sizeof(header)) ||
+        read_u32(header) != ZIP_LOCAL_HEADER_SIG) {
+        return false;
+    }
+        
+    uint64_t data_offset = entry.local_offset + ZIP_LOCAL_HEADER_SIZE + read_u16(header + 26) + read_u16(header + 28);
+    if (data_offset + entry.compressed_size > archive_size) return false;
+    return seek_to(file, data_offset);
+}
+    
+// The central directory's size is only believed if the member could hold
+// it: stored data is its own size and deflate expands at most 1032:1.
+// Whole-entry reads allocate it, so it is capped as well.
+bool plausible_size(const EPUBParser::ZipEntry& entry) {
+    if (entry.size > EPUBParser::MAX_ENTRY_SIZE) return false;
+    if (entry.compression == ZIP_CM_STORE) return entry.size == entry.compressed_size;
+    if (entry.compression == ZIP_CM_DEFLATE) return entry.size <= entry.compressed_size * 1032;
+    return true;
+}
+    
+} // namespace
+
+const uint64_t EPUBParser::LIBZIP_ONLY;
+const uint64_t EPUBParser::MAX_ENTRY_SIZE;
+const int32_t EPUBParser::TableOfContents::NO_ENTRY;
+const int32_t EPUBParser::Manifest::NO_ITEM;
+
+EPUBParser::EPUBParser()
+    : archive(nullptr), archive_file(nullptr), archive_size(0), direct_index(false), inflater_ready(false),
+      open_result() {
+    std::memset(&inflater, 0, sizeof(inflater));
+}
+
+EPUBParser::~EPUBParser() {
+    close();
+    if (inflater_ready) {
+        inflateEnd(&inflater);
+    }
+}
 
 bool EPUBParser::open_epub(const std::string& path) {
-    archive = zip_open(path.c_str(), ZIP_RDONLY, nullptr);
-    if (!archive) {
+    close();
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+    if (!load_archive(path)) {
         std::cerr << "Failed to open EPUB file: " << path << std::endl;
         return false;
     }
     
-    return parse_container();
+    // Raw deflate stream, reused for every member of the book
+    if (!inflater_ready) {
+        if (inflateInit2(&inflater, -MAX_WBITS) != Z_OK) {
+            std::cerr << "Failed to initialize inflater" << std::endl;
+            return false;
+        }
+        inflater_ready = true;
+    }
+    read_chunk.resize(READ_CHUNK_SIZE);
+    
+    // Reopened books skip container/OPF/NCX parsing entirely
+    uint64_t book_size = FileManager::get_file_size(path);
+    uint64_t book_mtime = FileManager::get_file_mtime(path);
+    bool cache_hit = load_index_cache(path, book_size, book_mtime);
+    
+    if (!cache_hit) {
+        if (!parse_container()) return false;
+        save_index_cache(path, book_size, book_mtime);
+    }
+    
+    open_result.index_cached = cache_hit;
+    open_result.open_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
 }
 
-bool EPUBParser::parse_container() {
-    // First, read META-INF/container.xml to find OPF location
-    std::string container_xml = extract_file("META-INF/container.xml");
-    if (container_xml.empty()) return false;
-    
-    tinyxml2::XMLDocument doc;
-    if (doc.Parse(container_xml.c_str()) != tinyxml2::XML_SUCCESS) return false;
+bool EPUBParser::load_archive(const std::string& path) {
+    archive_path = path;
+    archive_file = std::fopen(path.c_str(), "rb");
+    if (archive_file && std::fseek(archive_file, 0, SEEK_END) == 0) {
+        long file_size = std::ftell(archive_file);
+        archive_size = file_size > 0 ? static_cast<uint64_t>(file_size) : 0;
+    }
     
-    auto container = doc.FirstChildElement("container");
-    if (!container) return false;
+    // Only the central directory is read up front; members are read from
+    // the file as they are asked for
+    if (archive_file && index_central_directory()) {
+        direct_index = true;
+        return true;
+    }
     
-    auto rootfiles = container->FirstChildElement("rootfiles");
-    if (!rootfiles) return false;
+    // ZIP64 or damaged directory: let libzip index and read the book
+    return open_libzip() && index_with_libzip();
+}
+
+bool EPUBParser::index_central_directory() {
+    if (archive_size < ZIP_END_OF_CENTRAL_DIR_SIZE) return false;
+    
+    // The end record sits in the last 64KB + 22 bytes (comment may follow it)
+    size_t tail_size = static_cast<size_t>(std::min<uint64_t>(archive_size, ZIP_END_OF_CENTRAL_DIR_SIZE + 0xFFFF));
+    std::vector<uint8_t> tail(tail_size);
+    if (!read_at(archive_file, archive_size - tail_size, &tail[0], tail_size)) return false;
+    
+    size_t eocd = tail_size - ZIP_END_OF_CENTRAL_DIR_SIZE;
+    while (read_u32(&tail[eocd]) != ZIP_END_OF_CENTRAL_DIR_SIG) {
+        if (eocd == 0) return false;
+        --eocd;
+    }
     
-    auto rootfile = rootfiles->FirstChildElement("rootfile");
-    if (!rootfile) return false;
+    uint16_t entry_count = read_u16(&tail[eocd + 10]);
+    uint32_t cd_size = read_u32(&tail[eocd + 12]);
+    uint32_t cd_offset = read_u32(&tail[eocd + 16]);
+    
+    // ZIP64 archives are left to libzip
+    if (entry_count == 0xFFFF || cd_offset == 0xFFFFFFFF) return false;
+    if (static_cast<uint64_t>(cd_offset) + cd_size > archive_size) return false;
+    
+    std::vector<uint8_t> directory(cd_size);
+    if (cd_size > 0 && !read_at(archive_file, cd_offset, &directory[0], cd_size)) return false;
+    const uint8_t* data = directory.data();
+    
+    entries.clear();
+    entry_index.clear();
+    entries.reserve(entry_count);
+    entry_index.reserve(entry_count);
+    
+    // Offsets are checked in 64 bits: size_t is 32 bits on the Vita, and a
+    // crafted offset near 4GB would wrap past the bounds checks
+    uint64_t pos = 0;
+    for (uint16_t i = 0; i < entry_count; ++i) {
+        if (pos + ZIP_CENTRAL_HEADER_SIZE > cd_size || read_u32(data + pos) != ZIP_CENTRAL_HEADER_SIG) {
+            return false;
+        }
+        
+        uint16_t flags = read_u16(data + pos + 8);
+        uint16_t name_length = read_u16(data + pos + 28);
+        uint16_t extra_length = read_u16(data + pos + 30);
+        uint16_t comment_length = read_u16(data + pos + 32);
+        uint64_t local_offset = read_u32(data + pos + 42);
+        if (pos + ZIP_CENTRAL_HEADER_SIZE + name_length > cd_size) return false;
+        
+        ZipEntry entry;
+        entry.index = i;
+        entry.compression = read_u16(data + pos + 10);
+        entry.compressed_size = read_u32(data + pos + 20);
+        entry.size = read_u32(data + pos + 24);
+        entry.local_offset = LIBZIP_ONLY;
+        
+        // Read directly only what can be: unencrypted, stored or deflated,
+        // and inside the file. The local header is checked when read.
+        bool direct = !(flags & 0x1) &&
+                      (entry.compression == ZIP_CM_STORE || entry.compression == ZIP_CM_DEFLATE);
+        if (direct && local_offset + ZIP_LOCAL_HEADER_SIZE + entry.compressed_size <= archive_size) {
+            entry.local_offset = local_offset;
+        }
+        
+        std::string name(reinterpret_cast<const char*>(data + pos + ZIP_CENTRAL_HEADER_SIZE), name_length);
+        entry_index[name] = entries.size();
+        entries.push_back(entry);
+        
+        pos += ZIP_CENTRAL_HEADER_SIZE + name_length + extra_length + comment_length;
+    }
     
-    const char* opf_path_attr = rootfile->Attribute("full-path");
-    if (!opf_path_attr) return false;
+    return true;
+}
+
+bool EPUBParser::open_libzip() {
+    if (!archive) {
+        archive = zip_open(archive_path.c_str(), ZIP_RDONLY, nullptr);
+    }
+    return archive != nullptr;
+}
+
+bool EPUBParser::index_with_libzip() {
+    zip_int64_t count = zip_get_num_entries(archive, 0);
+    if (count < 0) return false;
+    
+    entries.clear();
+    entry_index.clear();
+    entries.reserve(static_cast<size_t>(count));
+    entry_index.reserve(static_cast<size_t>(count));
+    
+    for (zip_int64_t i = 0; i < count; ++i) {
+        zip_stat_t stat;
+        if (zip_stat_index(archive, i, 0, &stat) != 0 || !(stat.valid & ZIP_STAT_NAME)) {
+            continue;
+        }
+        
+        ZipEntry entry;
+        entry.index = static_cast<zip_uint64_t>(i);
+        entry.local_offset = LIBZIP_ONLY;
+        entry.compressed_size = stat.comp_size;
+        entry.size = stat.size;
+        entry.compression = stat.comp_method;
+        
+        entry_index[stat.name] = entries.size();
+        entries.push_back(entry);
+    }
     
-    std::string opf_path = opf_path_attr;
+    return true;
+}
+
+bool EPUBParser::parse_container() {
+    // First, read META-INF/container.xml to find OPF location
+    EntryView container_xml;
+    if (!read_package_file("META-INF/container.xml", container_xml)) return false;
+    
+    std::string opf_path;
+    XmlPullParser xml(container_xml.data, container_xml.size);
+    for (XmlPullParser::Event event = xml.next();
+         event != XmlPullParser::EVENT_END_DOCUMENT && event != XmlPullParser::EVENT_ERROR;
+         event = xml.next()) {
+        if (event == XmlPullParser::EVENT_START_ELEMENT && xml.name_is("rootfile") &&
+            xml.attribute("full-path", opf_path)) {
+            break;
+        }
+    }
+    if (opf_path.empty()) return false;
     
     // Extract directory path for relative file resolution
     size_t last_slash = opf_path.find_last_of('/');
@@ -43,162 +271,424 @@ bool EPUBParser::parse_container() {
     return parse_opf(opf_path);
 }
 
-std::string EPUBParser::extract_file(const std::string& path) {
-    zip_file_t* file = zip_fopen(archive, path.c_str(), 0);
-    if (!file) return "";
+bool EPUBParser::read_package_file(const std::string& path, EntryView& view) {
+    const ZipEntry* entry = find_entry(path);
+    if (!entry) return false;
     
-    // Get file size
-    zip_stat_t stat;
-    if (zip_stat(archive, path.c_str(), 0, &stat) != 0) {
-        zip_fclose(file);
-        return "";
-    }
-    
-    // Read file content
-    std::string content(stat.size, '\0');
-    zip_int64_t bytes_read = zip_fread(file, &content[0], stat.size);
-    zip_fclose(file);
-    
-    if (bytes_read != static_cast<zip_int64_t>(stat.size)) {
-        return "";
-    }
-    
-    return content;
+    // Package documents are parsed in place, straight from the entry view
+    return read_entry(*entry, package_buffer, view) && view.size > 0;
 }
 
-bool EPUBParser::parse_opf(const std::string& opf_path) {
-    std::string opf_content = extract_file(opf_path);
-    if (opf_content.empty()) return false;
+const EPUBParser::ZipEntry* EPUBParser::find_entry(const std::string& path) const {
+    auto it = entry_index.find(path);
+    if (it == entry_index.end()) return nullptr;
+    return &entries[it->second];
+}
+
+bool EPUBParser::read_entry(const ZipEntry& entry, std::vector<char>& buffer, EntryView& view) {
+    if (entry.size == 0) {
+        view.data = "";
+        view.size = 0;
+        return true;
+    }
+    if (!plausible_size(entry)) return false;
     
-    tinyxml2::XMLDocument doc;
-    if (doc.Parse(opf_content.c_str()) != tinyxml2::XML_SUCCESS) return false;
+    if (entry.local_offset == LIBZIP_ONLY) {
+        return read_with_libzip(entry, buffer, view);
+    }
     
-    auto package = doc.FirstChildElement("package");
-    if (!package) return false;
+    std::lock_guard<std::mutex> lock(content_mutex);
+    if (!seek_member_data(archive_file, entry, archive_size)) return false;
     
-    // Parse manifest
-    auto manifest_elem = package->FirstChildElement("manifest");
-    if (manifest_elem) {
-        for (auto item = manifest_elem->FirstChildElement("item");
-             item; item = item->NextSiblingElement("item")) {
-            
-            const char* id_attr = item->Attribute("id");
-            const char* href_attr = item->Attribute("href");
-            const char* media_type_attr = item->Attribute("media-type");
-            
-            if (id_attr && href_attr && media_type_attr) {
-                ManifestItem manifest_item;
-                manifest_item.id = id_attr;
-                manifest_item.href = href_attr;
-                manifest_item.media_type = media_type_attr;
-                
-                manifest[manifest_item.id] = manifest_item;
-            }
-        }
+    // Buffer only grows, so steady-state reads do not allocate
+    if (buffer.size() < entry.size) {
+        buffer.resize(static_cast<size_t>(entry.size));
     }
     
-    // Parse spine (reading order)
-    auto spine_elem = package->FirstChildElement("spine");
-    if (spine_elem) {
-        for (auto itemref = spine_elem->FirstChildElement("itemref");
-             itemref; itemref = itemref->NextSiblingElement("itemref")) {
-            
-            const char* idref_attr = itemref->Attribute("idref");
-            if (idref_attr) {
-                SpineItem spine_item;
-                spine_item.idref = idref_attr;
-                spine_item.linear = true; // Default value
-                
-                const char* linear_attr = itemref->Attribute("linear");
-                if (linear_attr && std::string(linear_attr) == "no") {
-                    spine_item.linear = false;
-                }
-                
-                spine.push_back(spine_item);
+    if (entry.compression == ZIP_CM_STORE) {
+        if (std::fread(&buffer[0], 1, static_cast<size_t>(entry.size), archive_file) != entry.size) {
+            return false;
+        }
+    } else {
+        // Inflate straight into the buffer, a chunk of compressed input at a time
+        inflateReset(&inflater);
+        inflater.next_out = reinterpret_cast<Bytef*>(&buffer[0]);
+        inflater.avail_out = static_cast<uInt>(entry.size);
+        
+        uint64_t remaining = entry.compressed_size;
+        int ret = Z_OK;
+        while (ret == Z_OK) {
+            if (inflater.avail_in == 0) {
+                if (remaining == 0) break;
+                size_t chunk = static_cast<size_t>(std::min<uint64_t>(remaining, read_chunk.size()));
+                if (std::fread(&read_chunk[0], 1, chunk, archive_file) != chunk) return false;
+                remaining -= chunk;
+                inflater.next_in = &read_chunk[0];
+                inflater.avail_in = static_cast<uInt>(chunk);
             }
+            ret = inflate(&inflater, Z_NO_FLUSH);
+        }
+        if (ret != Z_STREAM_END || inflater.total_out != entry.size) {
+            return false;
         }
     }
     
-    // Find and parse NCX file for table of contents
-    std::string ncx_path;
-    for (const auto& item : manifest) {
-        if (item.second.media_type == "application/x-dtbncx+xml") {
-            ncx_path = container_root + item.second.href;
-            break;
-        }
+    view.data = &buffer[0];
+    view.size = static_cast<size_t>(entry.size);
+    return true;
+}
+
+bool EPUBParser::read_with_libzip(const ZipEntry& entry, std::vector<char>& buffer, EntryView& view) {
+    std::lock_guard<std::mutex> lock(content_mutex);
+    if (!open_libzip()) return false;
+    zip_file_t* file = zip_fopen_index(archive, entry.index, 0);
+    if (!file) return false;
+    
+    if (buffer.size() < entry.size) {
+        buffer.resize(static_cast<size_t>(entry.size));
     }
+    zip_int64_t bytes_read = zip_fread(file, &buffer[0], entry.size);
+    zip_fclose(file);
     
-    if (!ncx_path.empty()) {
-        parse_ncx(ncx_path);
+    if (bytes_read != static_cast<zip_int64_t>(entry.size)) {
+        return false;
     }
     
+    view.data = &buffer[0];
+    view.size = static_cast<size_t>(entry.size);
     return true;
 }
 
-bool EPUBParser::parse_ncx(const std::string& ncx_path) {
-    std::string ncx_content = extract_file(ncx_path);
-    if (ncx_content.empty()) return false;
-    
-    tinyxml2::XMLDocument doc;
-    if (doc.Parse(ncx_content.c_str()) != tinyxml2::XML_SUCCESS) return false;
-    
-    auto ncx = doc.FirstChildElement("ncx");
-    if (!ncx) return false;
-    
-    auto navMap = ncx->FirstChildElement("navMap");
-    if (!navMap) return false;
-    
-    toc.clear();
-    for (auto navPoint = navMap->FirstChildElement("navPoint");
-         navPoint; navPoint = navPoint->NextSiblingElement("navPoint")) {
+bool EPUBParser::open_stream(const std::string& href, EntryStream& stream) {
+    stream.close();
+    
+    const ZipEntry* entry = find_content_entry(href);
+    if (!entry) return false;
+    
+    if (entry->local_offset == LIBZIP_ONLY) {
+        // The shared libzip handle is only used from one thread, which holds
+        // for books libzip indexed and not for members of any other book
+        if (direct_index) return false;
+        stream.file = zip_fopen_index(archive, entry->index, 0);
+        if (!stream.file) return false;
+    } else {
+        stream.source = std::fopen(archive_path.c_str(), "rb");
+        if (!stream.source || !seek_member_data(stream.source, *entry, archive_size)) {
+            stream.close();
+            return false;
+        }
+        stream.remaining_input = entry->compressed_size;
         
-        TOCEntry entry = parse_nav_point(navPoint);
-        if (!entry.title.empty()) {
-            toc.push_back(entry);
+        if (entry->compression == ZIP_CM_DEFLATE) {
+            if (inflateInit2(&stream.inflater, -MAX_WBITS) != Z_OK) {
+                stream.close();
+                return false;
+            }
+            stream.inflater_ready = true;
+            stream.input.resize(READ_CHUNK_SIZE);
         }
     }
     
+    stream.total_size = entry->size;
+    stream.compression = entry->compression;
     return true;
 }
 
-EPUBParser::TOCEntry EPUBParser::parse_nav_point(tinyxml2::XMLElement* navPoint) {
-    TOCEntry entry;
+EPUBParser::EntryStream::EntryStream()
+    : source(nullptr), remaining_input(0), compression(ZIP_CM_STORE), file(nullptr), inflater_ready(false),
+      total_size(0), produced(0), failed(false) {
+    std::memset(&inflater, 0, sizeof(inflater));
+}
+
+EPUBParser::EntryStream::~EntryStream() {
+    close();
+}
+
+size_t EPUBParser::EntryStream::read(char* out, size_t capacity) {
+    if (finished() || capacity == 0) return 0;
+    
+    uint64_t remaining = total_size - produced;
+    size_t wanted = remaining < capacity ? static_cast<size_t>(remaining) : capacity;
+    size_t got = 0;
+    
+    if (file) {
+        zip_int64_t bytes_read = zip_fread(file, out, wanted);
+        if (bytes_read <= 0) {
+            failed = true;
+            return 0;
+        }
+        got = static_cast<size_t>(bytes_read);
+    } else if (inflater_ready) {
+        inflater.next_out = reinterpret_cast<Bytef*>(out);
+        inflater.avail_out = static_cast<uInt>(wanted);
+        
+        // Fill the caller's chunk, refilling the input as it runs out
+        int ret = Z_OK;
+        while (ret == Z_OK && inflater.avail_out > 0) {
+            if (inflater.avail_in == 0) {
+                if (remaining_input == 0) break;
+                size_t chunk = static_cast<size_t>(std::min<uint64_t>(remaining_input, input.size()));
+                if (std::fread(&input[0], 1, chunk, source) != chunk) break;
+                remaining_input -= chunk;
+                inflater.next_in = &input[0];
+                inflater.avail_in = static_cast<uInt>(chunk);
+            }
+            ret = inflate(&inflater, Z_NO_FLUSH);
+        }
+        got = wanted - inflater.avail_out;
+        if ((ret != Z_OK && ret != Z_STREAM_END) || got == 0) {
+            failed = true;
+            return 0;
+        }
+    } else if (source) {
+        if (std::fread(out, 1, wanted, source) != wanted) {
+            failed = true;
+            return 0;
+        }
+        got = wanted;
+    } else {
+        failed = true;
+        return 0;
+    }
     
-    const char* id_attr = navPoint->Attribute("id");
-    const char* playOrder_attr = navPoint->Attribute("playOrder");
+    produced += got;
+    return got;
+}
+
+void EPUBParser::EntryStream::close() {
+    if (file) {
+        zip_fclose(file);
+        file = nullptr;
+    }
+    if (source) {
+        std::fclose(source);
+        source = nullptr;
+    }
+    if (inflater_ready) {
+        inflateEnd(&inflater);
+        inflater_ready = false;
+    }
     
-    if (id_attr) entry.id = id_attr;
-    if (playOrder_attr) entry.play_order = std::stoi(playOrder_attr);
+    // inflateInit2 keeps next_in and avail_in, so a reopened stream would
+    // resume on this one's leftover input
+    std::memset(&inflater, 0, sizeof(inflater));
+    remaining_input = 0;
+    total_size = 0;
+    produced = 0;
+    failed = false;
+}
+
+std::string EPUBParser::extract_file(const std::string& path) {
+    const ZipEntry* entry = find_entry(path);
+    if (!entry) return "";
     
-    // Extract title
-    auto navLabel = navPoint->FirstChildElement("navLabel");
-    if (navLabel) {
-        auto text = navLabel->FirstChildElement("text");
-        if (text && text->GetText()) {
-            entry.title = text->GetText();
+    EntryView view;
+    if (!read_entry(*entry, package_buffer, view)) {
+        return "";
+    }
+    
+    return std::string(view.data, view.size);
+}
+
+bool EPUBParser::parse_opf(const std::string& opf_path) {
+    EntryView opf_content;
+    if (!read_package_file(opf_path, opf_content)) return false;
+    
+    enum Section { SECTION_NONE, SECTION_MANIFEST, SECTION_SPINE } section = SECTION_NONE;
+    bool found_package = false;
+    std::string id;
+    std::string href;
+    std::string media_type;
+    std::string linear;
+    
+    // idrefs are interned as they are read and resolved once the manifest is complete
+    std::vector<std::pair<StringPool::Symbol, bool> > spine_refs;
+    
+    XmlPullParser xml(opf_content.data, opf_content.size);
+    XmlPullParser::Event event;
+    while ((event = xml.next()) != XmlPullParser::EVENT_END_DOCUMENT) {
+        if (event == XmlPullParser::EVENT_ERROR) return false;
+        
+        if (event == XmlPullParser::EVENT_END_ELEMENT) {
+            if (xml.name_is("manifest") || xml.name_is("spine")) {
+                section = SECTION_NONE;
+            }
+            continue;
+        }
+        if (event != XmlPullParser::EVENT_START_ELEMENT) continue;
+        
+        if (xml.name_is("package")) {
+            found_package = true;
+        } else if (xml.name_is("manifest")) {
+            section = SECTION_MANIFEST;
+        } else if (xml.name_is("spine")) {
+            section = SECTION_SPINE;
+        } else if (section == SECTION_MANIFEST && xml.name_is("item")) {
+            // Scratch strings are reused, so steady-state interning does not allocate
+            if (xml.attribute("id", id) && xml.attribute("href", href) &&
+                xml.attribute("media-type", media_type)) {
+                manifest.add(id, href, media_type);
+            }
+        } else if (section == SECTION_SPINE && xml.name_is("itemref")) {
+            if (xml.attribute("idref", id)) {
+                bool is_linear = !(xml.attribute("linear", linear) && linear == "no");
+                spine_refs.push_back(std::make_pair(manifest.strings.intern(id), is_linear));
+            }
         }
     }
     
-    // Extract content source
-    auto content = navPoint->FirstChildElement("content");
-    if (content) {
-        const char* src_attr = content->Attribute("src");
-        if (src_attr) {
-            entry.content_src = src_attr;
+    if (!found_package) return false;
+    
+    manifest.rebuild_lookups();
+    spine.reserve(spine_refs.size());
+    for (const auto& ref : spine_refs) {
+        int32_t item = manifest.item_by_symbol_id[ref.first];
+        if (item == Manifest::NO_ITEM) {
+            std::cerr << "Spine references unknown item: " << manifest.strings.c_str(ref.first) << std::endl;
+            continue;
         }
+        
+        SpineItem spine_item;
+        spine_item.manifest_index = static_cast<uint32_t>(item);
+        spine_item.linear = ref.second;
+        spine.push_back(spine_item);
+    }
+    
+    // Parse NCX file for table of contents
+    if (manifest.ncx_item() != Manifest::NO_ITEM) {
+        parse_ncx(container_root + manifest.href(manifest.ncx_item()));
     }
     
-    // Parse child nav points
-    for (auto childNavPoint = navPoint->FirstChildElement("navPoint");
-         childNavPoint; childNavPoint = childNavPoint->NextSiblingElement("navPoint")) {
+    return true;
+}
+
+bool EPUBParser::parse_ncx(const std::string& ncx_path) {
+    EntryView ncx_content;
+    if (!read_package_file(ncx_path, ncx_content)) return false;
+    
+    toc.clear();
+    std::vector<TOCEntry>& entries = toc.entries;
+    std::string& strings = toc.strings;
+    
+    // navPoints still open, innermost last, with the last child linked so far
+    struct OpenEntry {
+        int32_t index;
+        int32_t last_child;
+        int32_t previous_sibling;
+    };
+    std::vector<OpenEntry> open_entries;
+    int32_t last_root = TableOfContents::NO_ENTRY;
+    
+    bool in_nav_map = false;
+    bool found_nav_map = false;
+    bool in_label_text = false;
+    std::string value;
+    
+    XmlPullParser xml(ncx_content.data, ncx_content.size);
+    XmlPullParser::Event event;
+    while ((event = xml.next()) != XmlPullParser::EVENT_END_DOCUMENT) {
+        if (event == XmlPullParser::EVENT_ERROR) return false;
         
-        TOCEntry child_entry = parse_nav_point(childNavPoint);
-        if (!child_entry.title.empty()) {
-            entry.children.push_back(child_entry);
+        switch (event) {
+            case XmlPullParser::EVENT_START_ELEMENT:
+                if (xml.name_is("navMap")) {
+                    in_nav_map = true;
+                    found_nav_map = true;
+                } else if (in_nav_map && xml.name_is("navPoint")) {
+                    int32_t index = static_cast<int32_t>(entries.size());
+                    int32_t& last_sibling = open_entries.empty() ? last_root : open_entries.back().last_child;
+                
+                    TOCEntry entry;
+                    entry.parent = open_entries.empty() ? TableOfContents::NO_ENTRY : open_entries.back().index;
+                    entry.first_child = TableOfContents::NO_ENTRY;
+                    entry.next_sibling = TableOfContents::NO_ENTRY;
+                    entry.play_order = 0;
+                    if (xml.attribute("playOrder", value)) {
+                        entry.play_order = static_cast<int32_t>(std::strtol(value.c_str(), nullptr, 10));
+                    }
+                
+                    // Every string is appended to the pool, NUL-terminated
+                    entry.id = static_cast<uint32_t>(strings.size());
+                    if (xml.attribute("id", value)) {
+                        strings.append(value);
+                    }
+                    strings += '\0';
+                    entry.title = 0;
+                    entry.content_src = 0;
+                
+                    if (last_sibling != TableOfContents::NO_ENTRY) {
+                        entries[last_sibling].next_sibling = index;
+                    } else if (entry.parent != TableOfContents::NO_ENTRY) {
+                        entries[entry.parent].first_child = index;
+                    }
+                
+                    OpenEntry open_entry = { index, TableOfContents::NO_ENTRY, last_sibling };
+                    last_sibling = index;
+                    entries.push_back(entry);
+                    open_entries.push_back(open_entry);
+                } else if (!open_entries.empty() && xml.name_is("text")) {
+                    TOCEntry& entry = entries[open_entries.back().index];
+                    in_label_text = entry.title == 0;
+                    if (in_label_text) {
+                        entry.title = static_cast<uint32_t>(strings.size());
+                    }
+                } else if (!open_entries.empty() && xml.name_is("content")) {
+                    TOCEntry& entry = entries[open_entries.back().index];
+                    if (entry.content_src == 0 && xml.attribute("src", value)) {
+                        entry.content_src = static_cast<uint32_t>(strings.size());
+                        strings.append(value);
+                        strings += '\0';
+                    }
+                }
+                break;
+            
+            case XmlPullParser::EVENT_TEXT:
+                if (in_label_text) {
+                    xml.append_text(strings);
+                }
+                break;
+            
+            case XmlPullParser::EVENT_END_ELEMENT:
+                if (xml.name_is("text")) {
+                    if (in_label_text) {
+                        TOCEntry& entry = entries[open_entries.back().index];
+                        if (strings.size() == entry.title) {
+                            entry.title = 0; // Empty label
+                        } else {
+                            strings += '\0';
+                        }
+                        in_label_text = false;
+                    }
+                } else if (xml.name_is("navPoint") && !open_entries.empty()) {
+                    OpenEntry closed = open_entries.back();
+                    open_entries.pop_back();
+                
+                    // Untitled entries are dropped along with their subtree,
+                    // which always sits at the tail of both arrays
+                    const TOCEntry& entry = entries[closed.index];
+                    if (entry.title == 0) {
+                        int32_t& last_sibling = open_entries.empty() ? last_root : open_entries.back().last_child;
+                        last_sibling = closed.previous_sibling;
+                        if (closed.previous_sibling != TableOfContents::NO_ENTRY) {
+                            entries[closed.previous_sibling].next_sibling = TableOfContents::NO_ENTRY;
+                        } else if (entry.parent != TableOfContents::NO_ENTRY) {
+                            entries[entry.parent].first_child = TableOfContents::NO_ENTRY;
+                        }
+                        strings.resize(entry.id);
+                        entries.resize(closed.index);
+                    }
+                } else if (xml.name_is("navMap")) {
+                    in_nav_map = false;
+                }
+                break;
+            
+            default:
+                break;
         }
     }
     
-    return entry;
+    toc.rebuild_roots();
+    return found_nav_map;
 }
 
 std::string EPUBParser::get_content(const std::string& href) {
@@ -206,20 +696,169 @@ std::string EPUBParser::get_content(const std::string& href) {
     return extract_file(full_path);
 }
 
-const std::vector<EPUBParser::TOCEntry>& EPUBParser::get_table_of_contents() const {
+const EPUBParser::ZipEntry* EPUBParser::find_content_entry(const std::string& href) {
+    // Reuse the scratch path so repeated lookups do not allocate
+    std::lock_guard<std::mutex> lock(content_mutex);
+    path_scratch.assign(container_root);
+    path_scratch.append(href);
+    return find_entry(path_scratch);
+}
+
+bool EPUBParser::get_content_view(const std::string& href, std::vector<char>& buffer, EntryView& view) {
+    const ZipEntry* entry = find_content_entry(href);
+    if (!entry) return false;
+    
+    return read_entry(*entry, buffer, view);
+}
+
+const EPUBParser::TableOfContents& EPUBParser::get_table_of_contents() const {
     return toc;
 }
 
+void EPUBParser::TableOfContents::clear() {
+    entries.clear();
+    roots.clear();
+    strings.clear();
+    
+    // Offset 0 is the empty string, so unset fields read as ""
+    strings += '\0';
+}
+
+void EPUBParser::TableOfContents::rebuild_roots() {
+    roots.clear();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].parent == NO_ENTRY) {
+            roots.push_back(static_cast<uint32_t>(i));
+        }
+    }
+}
+
 const std::vector<EPUBParser::SpineItem>& EPUBParser::get_spine() const {
     return spine;
 }
 
+const EPUBParser::Manifest& EPUBParser::get_manifest() const {
+    return manifest;
+}
+
+EPUBParser::MediaType EPUBParser::Manifest::classify(const char* media_type, size_t length) {
+    struct Known {
+        const char* prefix;
+        MediaType type;
+        bool exact;
+    };
+    static const Known known[] = {
+        { "application/xhtml+xml", MEDIA_XHTML, true },
+        { "text/html", MEDIA_XHTML, true },
+        { "application/x-dtbncx+xml", MEDIA_NCX, true },
+        { "text/css", MEDIA_CSS, true },
+        { "image/", MEDIA_IMAGE, false },
+        { "font/", MEDIA_FONT, false },
+        { "application/font-", MEDIA_FONT, false },
+        { "application/x-font-", MEDIA_FONT, false },
+        { "application/vnd.ms-opentype", MEDIA_FONT, true },
+    };
+    
+    for (const auto& entry : known) {
+        size_t prefix_length = std::strlen(entry.prefix);
+        if ((entry.exact ? length == prefix_length : length > prefix_length) &&
+            std::memcmp(entry.prefix, media_type, prefix_length) == 0) {
+            return entry.type;
+        }
+    }
+    return MEDIA_OTHER;
+}
+
+int32_t EPUBParser::Manifest::add(const std::string& id, const std::string& href, const std::string& media_type) {
+    StringPool::Symbol id_symbol = strings.intern(id);
+    StringPool::Symbol href_symbol = strings.intern(href);
+    StringPool::Symbol media_symbol = strings.intern(media_type);
+    
+    if (item_by_symbol_id.size() < strings.size()) {
+        item_by_symbol_id.resize(strings.size(), NO_ITEM);
+    }
+    
+    // A repeated id replaces the earlier item, as the old map did
+    int32_t index = item_by_symbol_id[id_symbol];
+    if (index == NO_ITEM) {
+        index = static_cast<int32_t>(ids.size());
+        ids.push_back(id_symbol);
+        hrefs.push_back(href_symbol);
+        media_types.push_back(media_symbol);
+        types.push_back(0);
+        item_by_symbol_id[id_symbol] = index;
+    } else {
+        hrefs[index] = href_symbol;
+        media_types[index] = media_symbol;
+    }
+    
+    MediaType type = classify(media_type.data(), media_type.size());
+    types[index] = static_cast<uint8_t>(type);
+    if (type == MEDIA_NCX && ncx == NO_ITEM) {
+        ncx = index;
+    }
+    return index;
+}
+
+void EPUBParser::Manifest::rebuild_lookups() {
+    item_by_symbol_id.assign(strings.size(), NO_ITEM);
+    item_by_symbol_href.assign(strings.size(), NO_ITEM);
+    ncx = NO_ITEM;
+    
+    for (size_t i = 0; i < ids.size(); ++i) {
+        item_by_symbol_id[ids[i]] = static_cast<int32_t>(i);
+        if (item_by_symbol_href[hrefs[i]] == NO_ITEM) {
+            item_by_symbol_href[hrefs[i]] = static_cast<int32_t>(i);
+        }
+        if (types[i] == MEDIA_NCX && ncx == NO_ITEM) {
+            ncx = static_cast<int32_t>(i);
+        }
+    }
+}
+
+int32_t EPUBParser::Manifest::find_by_id(const std::string& id) const {
+    StringPool::Symbol symbol = strings.find(id);
+    if (symbol == StringPool::NO_SYMBOL || symbol >= item_by_symbol_id.size()) return NO_ITEM;
+    return item_by_symbol_id[symbol];
+}
+
+int32_t EPUBParser::Manifest::find_by_href(const std::string& href) const {
+    StringPool::Symbol symbol = strings.find(href);
+    if (symbol == StringPool::NO_SYMBOL || symbol >= item_by_symbol_href.size()) return NO_ITEM;
+    return item_by_symbol_href[symbol];
+}
+
+void EPUBParser::Manifest::clear() {
+    strings.clear();
+    ids.clear();
+    hrefs.clear();
+    media_types.clear();
+    types.clear();
+    item_by_symbol_id.clear();
+    item_by_symbol_href.clear();
+    ncx = NO_ITEM;
+}
+
 void EPUBParser::close() {
     if (archive) {
         zip_close(archive);
         archive = nullptr;
     }
     
+    if (archive_file) {
+        std::fclose(archive_file);
+        archive_file = nullptr;
+    }
+    archive_path.clear();
+    archive_size = 0;
+    direct_index = false;
+    
+    // Swapped rather than cleared so a closed book gives its memory back
+    std::vector<ZipEntry>().swap(entries);
+    std::unordered_map<std::string, size_t>().swap(entry_index);
+    std::vector<uint8_t>().swap(read_chunk);
+    std::vector<char>().swap(package_buffer);
+    
     manifest.clear();
     spine.clear();
     toc.clear();
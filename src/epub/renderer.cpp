@@ -1,4 +1,5 @@
 #include "text_renderer.h"
+#include "utf8.h"
 #include <vita2d.h>
 #include <algorithm>
 #include <cstring>
@@ -18,18 +19,30 @@ bool TextRenderer::initialize(const std::string& font_path) {
 }
 
 void TextRenderer::set_font_size(int size) {
+    font_size = size;
     FT_Set_Pixel_Sizes(face, 0, size);
 }
 
-const TextRenderer::GlyphInfo* TextRenderer::get_glyph(uint32_t charcode) {
-    auto it = glyph_cache.find(charcode);
-    if (it != glyph_cache.end()) {
-        return it->second;
+AdvanceTable& TextRenderer::advance_table() {
+    std::unique_ptr<AdvanceTable>& table = advance_tables[font_size];
+    if (!table) {
+        int size = font_size;
+        table.reset(new AdvanceTable([this, size](uint32_t codepoint) {
+            // Advances only; rendering the bitmap here would churn the glyph cache
+            if (size != font_size) FT_Set_Pixel_Sizes(face, 0, size);
+            int advance = FT_Load_Char(face, codepoint, FT_LOAD_DEFAULT) ? 0 : static_cast<int>(face->glyph->advance.x >> 6);
+            if (size != font_size) FT_Set_Pixel_Sizes(face, 0, font_size);
+            return advance;
+        }));
     }
-    
-    // Cache size management
-    if (glyph_cache.size() >= MAX_CACHE_SIZE) {
-        evict_cache_entry();
+    return *table;
+}
+
+const CachedGlyph* TextRenderer::get_glyph(uint32_t charcode) {
+    // One face for now, so face 0
+    const CachedGlyph* cached = glyph_cache.find(0, static_cast<uint16_t>(font_size), charcode);
+    if (cached) {
+        return cached;
     }
     
     // Load glyph from FreeType
@@ -38,113 +51,92 @@ const TextRenderer::GlyphInfo* TextRenderer::get_glyph(uint32_t charcode) {
     }
     
     FT_GlyphSlot slot = face->glyph;
-    
-    // Create cache entry
-    GlyphInfo* glyph_info = new GlyphInfo();
-    glyph_info->width = slot->bitmap.width;
-    glyph_info->height = slot->bitmap.rows;
-    glyph_info->left = slot->bitmap_left;
-    glyph_info->top = slot->bitmap_top;
-    glyph_info->advance_x = slot->advance.x >> 6;
-    
-    // Copy bitmap data
-    size_t bitmap_size = glyph_info->width * glyph_info->height;
-    if (bitmap_size > 0) {
-        glyph_info->bitmap = new uint8_t[bitmap_size];
-        std::memcpy(glyph_info->bitmap, slot->bitmap.buffer, bitmap_size);
+    const CachedGlyph* glyph = glyph_cache.insert(0, static_cast<uint16_t>(font_size), charcode, slot->bitmap.buffer,
+                                                  slot->bitmap.width, slot->bitmap.rows, slot->bitmap.pitch,
+                                                  slot->bitmap_left, slot->bitmap_top, slot->advance.x >> 6);
+    if (!glyph) {
+        // Drawn blank this time, still taking its width on the line
+        atlas_full = true;
+        unplaced.advance_x = static_cast<int16_t>(slot->advance.x >> 6);
+        return &unplaced;
     }
-    
-    // Store in cache
-    glyph_cache[charcode] = glyph_info;
-    return glyph_info;
+    return glyph;
 }
 
 void TextRenderer::render_text(const std::string& text, int x, int y, int max_width, const TextStyle& style) {
+    if (atlas_full) {
+        reset_atlas();
+    }
+    glyph_cache.begin_batch();
     set_font_size(style.font_size);
     
-    std::vector<std::string> lines = wrap_text(text, max_width);
+    bool justify = style.align == TextStyle::JUSTIFY;
+    std::vector<LineSpan> spans;
+    LineBreaker breaker(advance_table(), max_width);
+    if (justify) {
+        breaker.break_optimal(text.data(), text.size(), 0, spans);
+    } else {
+        breaker.break_lines(text.data(), text.size(), 0, spans);
+    }
     int current_y = y;
     
-    for (const auto& line : lines) {
+    for (const LineSpan& span : spans) {
         int current_x = x;
         
         // Apply text alignment
         if (style.align == TextStyle::CENTER) {
-            int line_width = calculate_text_width(line);
-            current_x = x + (max_width - line_width) / 2;
+            current_x = x + (max_width - span.width) / 2;
         } else if (style.align == TextStyle::RIGHT) {
-            int line_width = calculate_text_width(line);
-            current_x = x + max_width - line_width;
+            current_x = x + max_width - span.width;
         }
         
-        // Render each character
-        for (size_t i = 0; i < line.length(); ++i) {
-            uint32_t charcode = static_cast<uint32_t>(line[i]);
-            const GlyphInfo* glyph = get_glyph(charcode);
+        // Justified lines spread their slack over their spaces, except the
+        // last line of each paragraph
+        int slack = 0;
+        int gaps = 0;
+        if (justify && !LineBreaker::ends_paragraph(text.data(), text.size(), span)) {
+            slack = max_width - span.width;
+            gaps = static_cast<int>(std::count(text.begin() + span.offset, text.begin() + span.offset + span.length, ' '));
+        }
+        int gap = 0;
+        
+        // Render each codepoint
+        Utf8Decoder decoder(text.data() + span.offset, span.length);
+        while (!decoder.done()) {
+            uint32_t codepoint = decoder.next();
+            const CachedGlyph* glyph = get_glyph(codepoint);
             if (glyph) {
-                render_glyph(glyph, current_x + glyph->left, current_y - glyph->top, style.color);
+                batch.add(glyph->region, static_cast<float>(current_x + glyph->left),
+                          static_cast<float>(current_y - glyph->top));
                 current_x += glyph->advance_x;
             }
+            if (codepoint == ' ' && gaps > 0) {
+                ++gap;
+                current_x += slack * gap / gaps - slack * (gap - 1) / gaps;
+            }
         }
         
         current_y += style.line_height;
     }
+    
+    flush_batch(style.color);
 }
 
 std::vector<std::string> TextRenderer::wrap_text(const std::string& text, int max_width) {
-    std::vector<std::string> lines;
-    std::string current_line;
-    std::string current_word;
+    std::vector<LineSpan> spans;
+    LineBreaker breaker(advance_table(), max_width);
+    breaker.break_lines(text.data(), text.size(), 0, spans);
     
-    for (size_t i = 0; i < text.length(); ++i) {
-        char c = text[i];
-        
-        if (c == ' ' || c == '\n' || i == text.length() - 1) {
-            if (i == text.length() - 1 && c != ' ' && c != '\n') {
-                current_word += c;
-            }
-            
-            std::string test_line = current_line.empty() ? current_word : current_line + " " + current_word;
-            int test_width = calculate_text_width(test_line);
-            
-            if (test_width <= max_width) {
-                current_line = test_line;
-            } else {
-                if (!current_line.empty()) {
-                    lines.push_back(current_line);
-                    current_line = current_word;
-                } else {
-                    lines.push_back(current_word); // Handle very long words
-                }
-            }
-            
-            current_word.clear();
-            
-            if (c == '\n') {
-                lines.push_back(current_line);
-                current_line.clear();
-            }
-        } else {
-            current_word += c;
-        }
-    }
-    
-    if (!current_line.empty()) {
-        lines.push_back(current_line);
+    std::vector<std::string> lines;
+    lines.reserve(spans.size());
+    for (const LineSpan& span : spans) {
+        lines.push_back(text.substr(span.offset, span.length));
     }
-    
     return lines;
 }
 
 int TextRenderer::calculate_text_width(const std::string& text) {
-    int width = 0;
-    for (char c : text) {
-        const GlyphInfo* glyph = get_glyph(static_cast<uint32_t>(c));
-        if (glyph) {
-            width += glyph->advance_x;
-        }
-    }
-    return width;
+    return advance_table().measure(text.data(), text.size());
 }
 
 int TextRenderer::calculate_text_height(const std::string& text, int max_width) {
@@ -152,43 +144,59 @@ int TextRenderer::calculate_text_height(const std::string& text, int max_width)
     return static_cast<int>(lines.size()) * 20; // Default line height
 }
 
-void TextRenderer::render_glyph(const GlyphInfo* glyph, int x, int y, uint32_t color) {
-    if (!glyph || !glyph->bitmap) return;
-    
-    // Convert RGBA color to components
-    uint8_t r = (color >> 24) & 0xFF;
-    uint8_t g = (color >> 16) & 0xFF;
-    uint8_t b = (color >> 8) & 0xFF;
-    uint8_t a = color & 0xFF;
-    
-    // Render glyph bitmap using vita2d
-    for (int py = 0; py < glyph->height; ++py) {
-        for (int px = 0; px < glyph->width; ++px) {
-            uint8_t alpha = glyph->bitmap[py * glyph->width + px];
-            if (alpha > 0) {
-                // Alpha blending
-                uint8_t final_alpha = (alpha * a) / 255;
-                uint32_t pixel_color = RGBA8(r, g, b, final_alpha);
-                vita2d_draw_pixel(x + px, y + py, pixel_color);
-            }
+void TextRenderer::flush_batch(uint32_t color) {
+    static_assert(sizeof(QuadVertex) == sizeof(vita2d_texture_vertex), "QuadVertex must match vita2d's vertex");
+    
+    // New glyphs first, so no page is drawn before its pixels are there
+    GlyphAtlas& atlas = glyph_cache.atlas();
+    for (size_t page = 0; page < atlas.page_count(); ++page) {
+        if (page == atlas_textures.size()) {
+            vita2d_texture* texture = vita2d_create_empty_texture_format(GlyphAtlas::PAGE_SIZE, GlyphAtlas::PAGE_SIZE,
+                                                                         SCE_GXM_TEXTURE_FORMAT_U8_R111);
+            if (!texture) break;
+            atlas_textures.push_back(texture);
+        }
+        int first_row, end_row;
+        if (!atlas.take_dirty_rows(page, first_row, end_row)) continue;
+        
+        uint8_t* data = static_cast<uint8_t*>(vita2d_texture_get_datap(atlas_textures[page]));
+        unsigned int stride = vita2d_texture_get_stride(atlas_textures[page]);
+        const uint8_t* pixels = atlas.page_pixels(page);
+        for (int row = first_row; row < end_row; ++row) {
+            std::memcpy(data + row * stride, pixels + row * GlyphAtlas::PAGE_SIZE, GlyphAtlas::PAGE_SIZE);
         }
     }
+    
+    // vita2d draws from GPU-visible memory, so the vertices go to its
+    // per-frame pool
+    for (size_t page = 0; page < batch.page_count() && page < atlas_textures.size(); ++page) {
+        const std::vector<QuadVertex>& vertices = batch.vertices(page);
+        if (vertices.empty()) continue;
+        void* pool = vita2d_pool_memalign(vertices.size() * sizeof(vita2d_texture_vertex), sizeof(vita2d_texture_vertex));
+        if (!pool) break;
+        std::memcpy(pool, vertices.data(), vertices.size() * sizeof(vita2d_texture_vertex));
+        vita2d_draw_array_textured(atlas_textures[page], SCE_GXM_PRIMITIVE_TRIANGLES,
+                                   static_cast<const vita2d_texture_vertex*>(pool), vertices.size(), color);
+    }
+    batch.clear();
 }
 
-void TextRenderer::evict_cache_entry() {
-    if (glyph_cache.empty()) return;
+void TextRenderer::reset_atlas() {
+    // Regions are about to be reused, so every glyph placed in them goes too
+    glyph_cache.clear();
+    atlas_full = false;
     
-    // Simple eviction: remove first entry
-    auto it = glyph_cache.begin();
-    delete it->second;
-    glyph_cache.erase(it);
+    // The previous frame may still be drawing from the pages
+    vita2d_wait_rendering_done();
 }
 
 void TextRenderer::clear_cache() {
-    for (auto& pair : glyph_cache) {
-        delete pair.second;
-    }
     glyph_cache.clear();
+    atlas_full = false;
+    for (vita2d_texture* texture : atlas_textures) {
+        vita2d_free_texture(texture);
+    }
+    atlas_textures.clear();
 }
 
 TextRenderer::~TextRenderer() {
@@ -0,0 +1,95 @@
+#include "string_pool.h"
+#include <cstring>
+
+const StringPool::Symbol StringPool::NO_SYMBOL;
+
+StringPool::StringPool() {
+    clear();
+}
+
+void StringPool::clear() {
+    strings.clear();
+    offsets.assign(1, 0);
+    hashes.clear();
+    slots.assign(16, NO_SYMBOL);
+}
+
+uint32_t StringPool::hash(const char* data, size_t length) {
+    // FNV-1a
+    uint32_t value = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        value ^= static_cast<uint8_t>(data[i]);
+        value *= 16777619u;
+    }
+    return value;
+}
+
+StringPool::Symbol StringPool::find(const char* data, size_t length) const {
+    uint32_t value = hash(data, length);
+    size_t mask = slots.size() - 1;
+    
+    for (size_t slot = value & mask; slots[slot] != NO_SYMBOL; slot = (slot + 1) & mask) {
+        Symbol symbol = slots[slot];
+        if (hashes[symbol] == value && this->length(symbol) == length &&
+            std::memcmp(c_str(symbol), data, length) == 0) {
+            return symbol;
+        }
+    }
+    return NO_SYMBOL;
+}
+
+StringPool::Symbol StringPool::intern(const char* data, size_t length) {
+    Symbol existing = find(data, length);
+    if (existing != NO_SYMBOL) return existing;
+    
+    Symbol symbol = static_cast<Symbol>(size());
+    strings.append(data, length);
+    strings += '\0';
+    offsets.push_back(static_cast<uint32_t>(strings.size()));
+    hashes.push_back(hash(data, length));
+    
+    // Keep the load factor under one half
+    if ((size() + 1) * 2 > slots.size()) {
+        grow();
+    } else {
+        insert_slot(symbol);
+    }
+    return symbol;
+}
+
+bool StringPool::load(const std::string& storage) {
+    clear();
+    if (!storage.empty() && storage[storage.size() - 1] != '\0') return false;
+    
+    strings = storage;
+    size_t start = 0;
+    while (start < strings.size()) {
+        size_t end = strings.find('\0', start);
+        hashes.push_back(hash(&strings[start], end - start));
+        offsets.push_back(static_cast<uint32_t>(end + 1));
+        start = end + 1;
+    }
+    grow();
+    return true;
+}
+
+void StringPool::insert_slot(Symbol symbol) {
+    size_t mask = slots.size() - 1;
+    size_t slot = hashes[symbol] & mask;
+    while (slots[slot] != NO_SYMBOL) {
+        slot = (slot + 1) & mask;
+    }
+    slots[slot] = symbol;
+}
+
+void StringPool::grow() {
+    size_t capacity = slots.size();
+    while ((size() + 1) * 2 > capacity) {
+        capacity *= 2;
+    }
+    
+    slots.assign(capacity, NO_SYMBOL);
+    for (Symbol symbol = 0; symbol < size(); ++symbol) {
+        insert_slot(symbol);
+    }
+}
@@ -0,0 +1,74 @@
+#include "styled_text.h"
+#include <algorithm>
+
+const size_t StyledText::MAX_RUN_LENGTH;
+
+uint16_t StyledText::intern_style(const TextStyle& style) {
+    // A chapter only ever uses a handful of styles, so a linear scan wins
+    for (size_t i = 0; i < styles.size(); ++i) {
+        if (styles[i] == style) return static_cast<uint16_t>(i);
+    }
+    styles.push_back(style);
+    return static_cast<uint16_t>(styles.size() - 1);
+}
+
+void StyledText::add_run(uint32_t offset, uint32_t length, uint16_t style) {
+    while (length > 0) {
+        if (!runs.empty()) {
+            Run& last = runs.back();
+            if (last.style == style && last.offset + last.length == offset && last.length < MAX_RUN_LENGTH) {
+                uint32_t grow = std::min<uint32_t>(length, MAX_RUN_LENGTH - last.length);
+                last.length = static_cast<uint16_t>(last.length + grow);
+                offset += grow;
+                length -= grow;
+                continue;
+            }
+        }
+
+        uint32_t piece = std::min<uint32_t>(length, MAX_RUN_LENGTH);
+        Run run = { offset, static_cast<uint16_t>(piece), style };
+        runs.push_back(run);
+        offset += piece;
+        length -= piece;
+    }
+}
+
+void StyledText::add_block(uint32_t offset, uint8_t kind) {
+    // An empty block is replaced by whatever starts at the same offset
+    if (!blocks.empty() && blocks.back().offset == offset) {
+        blocks.back().kind = kind;
+        return;
+    }
+    Block block = { offset, kind };
+    blocks.push_back(block);
+}
+
+size_t StyledText::run_at(uint32_t offset) const {
+    auto it = std::upper_bound(runs.begin(), runs.end(), offset,
+                               [](uint32_t value, const Run& run) { return value < run.offset; });
+    return it == runs.begin() ? 0 : static_cast<size_t>(it - runs.begin()) - 1;
+}
+
+size_t StyledText::block_at(uint32_t offset) const {
+    auto it = std::upper_bound(blocks.begin(), blocks.end(), offset,
+                               [](uint32_t value, const Block& block) { return value < block.offset; });
+    return it == blocks.begin() ? 0 : static_cast<size_t>(it - blocks.begin()) - 1;
+}
+
+size_t StyledText::overhead_bytes() const {
+    return runs.size() * sizeof(Run) + blocks.size() * sizeof(Block) + styles.size() * sizeof(TextStyle);
+}
+
+void StyledText::clear() {
+    text.clear();
+    runs.clear();
+    blocks.clear();
+    styles.clear();
+}
+
+void StyledText::shrink_to_fit() {
+    text.shrink_to_fit();
+    runs.shrink_to_fit();
+    blocks.shrink_to_fit();
+    styles.shrink_to_fit();
+}
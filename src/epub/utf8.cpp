@@ -0,0 +1,218 @@
+#include "utf8.h"
+#include <cstring>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+const uint32_t Utf8Decoder::REPLACEMENT_CHARACTER;
+
+namespace {
+    
+const uint64_t HIGH_BITS = 0x8080808080808080ull;
+    
+inline bool in_range(uint8_t byte, uint8_t low, uint8_t high) {
+    return byte >= low && byte <= high;
+}
+    
+// Decodes one multi-byte sequence per Unicode table 3-7; returns the byte
+// count, or 0 if the sequence is malformed
+size_t decode_sequence(const uint8_t* p, size_t available, uint32_t& codepoint) {
+    uint8_t lead = p[0];
+    size_t length;
+    uint8_t second_low = 0x80;
+    uint8_t second_high = 0xBF;
+        
+    if (in_range(lead, 0xC2, 0xDF)) {
+        length = 2;
+        codepoint = lead & 0x1F;
+    } else if (in_range(lead, 0xE0, 0xEF)) {
+        length = 3;
+        codepoint = lead & 0x0F;
+        if (lead == 0xE0) second_low = 0xA0;        // Overlong
+        if (lead == 0xED) second_high = 0x9F;       // Surrogates
+    } else if (in_range(lead, 0xF0, 0xF4)) {
+        length = 4;
+        codepoint = lead & 0x07;
+        if (lead == 0xF0) second_low = 0x90;        // Overlong
+        if (lead == 0xF4) second_high = 0x8F;       // Above U+10FFFF
+    } else {
+        return 0;
+    }
+        
+    if (available < length || !in_range(p[1], second_low, second_high)) return 0;
+    codepoint = (codepoint << 6) | (p[1] & 0x3F);
+        
+    for (size_t i = 2; i < length; ++i) {
+        if (!in_range(p[i], 0x80, 0xBF)) return 0;
+        codepoint = (codepoint << 6) | (p[i] & 0x3F);
+    }
+    return length;
+}
+    
+} // namespace
+
+uint32_t Utf8Decoder::next_multibyte() {
+    uint32_t codepoint;
+    size_t length = decode_sequence(reinterpret_cast<const uint8_t*>(cursor), limit - cursor, codepoint);
+    if (length == 0) {
+        ++cursor;
+        return REPLACEMENT_CHARACTER;
+    }
+    cursor += length;
+    return codepoint;
+}
+
+size_t Utf8Decoder::ascii_prefix(const char* data, size_t length) {
+    size_t i = 0;
+    
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    while (i + 16 <= length) {
+        uint8x16_t block = vld1q_u8(bytes + i);
+        uint8x8_t folded = vorr_u8(vget_low_u8(block), vget_high_u8(block));
+        if (vget_lane_u64(vreinterpret_u64_u8(folded), 0) & HIGH_BITS) break;
+        i += 16;
+    }
+#endif
+    
+    // Eight bytes per step; memcpy keeps unaligned loads well-defined
+    while (i + 8 <= length) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        if (word & HIGH_BITS) break;
+        i += 8;
+    }
+    
+    while (i < length && static_cast<uint8_t>(data[i]) < 0x80) {
+        ++i;
+    }
+    return i;
+}
+
+size_t Utf8Decoder::decode(const char* data, size_t length, uint32_t* out) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    uint32_t* start = out;
+    size_t i = 0;
+    
+    while (i < length) {
+        // Widen ASCII a word at a time; the lowest set high bit marks where
+        // the first multi-byte sequence starts (both targets are little-endian).
+        // A lead byte goes straight to the sequence decoder.
+        if (p[i] < 0x80 && i + 8 <= length) {
+            uint64_t word;
+            std::memcpy(&word, p + i, sizeof(word));
+            uint64_t high = word & HIGH_BITS;
+            if (!high) {
+                for (int k = 0; k < 8; ++k) {
+                    out[k] = p[i + k];
+                }
+                out += 8;
+                i += 8;
+                continue;
+            }
+            size_t ascii = static_cast<size_t>(__builtin_ctzll(high)) / 8;
+            for (size_t k = 0; k < ascii; ++k) {
+                out[k] = p[i + k];
+            }
+            out += ascii;
+            i += ascii;
+        } else if (p[i] < 0x80) {
+            *out++ = p[i++];
+            continue;
+        }
+        
+        uint32_t codepoint;
+        size_t sequence = decode_sequence(p + i, length - i, codepoint);
+        *out++ = sequence ? codepoint : REPLACEMENT_CHARACTER;
+        i += sequence ? sequence : 1;
+    }
+    return static_cast<size_t>(out - start);
+}
+
+bool Utf8Decoder::is_valid(const char* data, size_t length) {
+    size_t i = 0;
+    while (i < length) {
+        if (static_cast<uint8_t>(data[i]) < 0x80) {
+            i += ascii_prefix(data + i, length - i);
+            continue;
+        }
+        
+        size_t sequence = sequence_length(data + i, length - i);
+        if (sequence == 0) return false;
+        i += sequence;
+    }
+    return true;
+}
+
+void Utf8Decoder::sanitize(const char* data, size_t length, std::string& out) {
+    out.clear();
+    out.reserve(length);
+    
+    // Well-formed stretches are copied in one go, up to each bad byte
+    size_t copied = 0;
+    size_t i = 0;
+    while (i < length) {
+        if (static_cast<uint8_t>(data[i]) < 0x80) {
+            i += ascii_prefix(data + i, length - i);
+            continue;
+        }
+        
+        size_t sequence = sequence_length(data + i, length - i);
+        if (sequence) {
+            i += sequence;
+            continue;
+        }
+        out.append(data + copied, i - copied);
+        char replacement[4];
+        out.append(replacement, encode(REPLACEMENT_CHARACTER, replacement));
+        copied = ++i;
+    }
+    out.append(data + copied, length - copied);
+}
+
+size_t Utf8Decoder::encode(uint32_t codepoint, char* out) {
+    if (codepoint < 0x80) {
+        out[0] = static_cast<char>(codepoint);
+        return 1;
+    }
+    if (codepoint < 0x800) {
+        out[0] = static_cast<char>(0xC0 | (codepoint >> 6));
+        out[1] = static_cast<char>(0x80 | (codepoint & 0x3F));
+        return 2;
+    }
+    if ((codepoint >= 0xD800 && codepoint <= 0xDFFF) || codepoint > 0x10FFFF) {
+        codepoint = REPLACEMENT_CHARACTER;
+    }
+    if (codepoint < 0x10000) {
+        out[0] = static_cast<char>(0xE0 | (codepoint >> 12));
+        out[1] = static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out[2] = static_cast<char>(0x80 | (codepoint & 0x3F));
+        return 3;
+    }
+    out[0] = static_cast<char>(0xF0 | (codepoint >> 18));
+    out[1] = static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+    out[2] = static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+    out[3] = static_cast<char>(0x80 | (codepoint & 0x3F));
+    return 4;
+}
+
+size_t Utf8Decoder::sequence_length(const char* data, size_t length) {
+    if (length == 0) return 0;
+    if (static_cast<uint8_t>(data[0]) < 0x80) return 1;
+    
+    uint32_t codepoint;
+    return decode_sequence(reinterpret_cast<const uint8_t*>(data), length, codepoint);
+}
+
+size_t Utf8Decoder::incomplete_suffix(const char* data, size_t length) {
+    // Look back past continuation bytes for the lead byte of the last sequence
+    for (size_t tail = 1; tail <= 3 && tail <= length; ++tail) {
+        uint8_t byte = static_cast<uint8_t>(data[length - tail]);
+        if ((byte & 0xC0) == 0x80) continue;
+        
+        size_t expected = byte >= 0xF0 ? 4 : byte >= 0xE0 ? 3 : byte >= 0xC0 ? 2 : 1;
+        return expected > tail ? tail : 0;
+    }
+    return 0;
+}
@@ -0,0 +1,263 @@
+#include "xml_pull_parser.h"
+#include "utf8.h"
+#include <cstring>
+
+namespace {
+    
+inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+    
+inline bool is_name_end(char c) {
+    return is_space(c) || c == '>' || c == '/' || c == '=';
+}
+    
+void append_utf8(unsigned long codepoint, std::string& out) {
+    if (codepoint >= 0x110000) return;
+    char bytes[4];
+    out.append(bytes, Utf8Decoder::encode(static_cast<uint32_t>(codepoint), bytes));
+}
+    
+} // namespace
+
+XmlPullParser::XmlPullParser(const char* data, size_t length)
+    : cursor(data), limit(data + length), current_depth(0), pending_end(false),
+      text_is_cdata(false), attr_count(0) {
+    element_name.begin = element_name.end = data;
+    text.begin = text.end = data;
+}
+
+XmlPullParser::Event XmlPullParser::next() {
+    // A self-closing element reports its end right after its start
+    if (pending_end) {
+        pending_end = false;
+        attr_count = 0;
+        --current_depth;
+        return EVENT_END_ELEMENT;
+    }
+    
+    while (cursor < limit) {
+        if (*cursor != '<') {
+            text.begin = cursor;
+            const char* tag = static_cast<const char*>(std::memchr(cursor, '<', limit - cursor));
+            cursor = tag ? tag : limit;
+            text.end = cursor;
+            text_is_cdata = false;
+            return EVENT_TEXT;
+        }
+        
+        if (limit - cursor >= 4 && std::memcmp(cursor, "<!--", 4) == 0) {
+            if (!skip_past("-->")) return EVENT_ERROR;
+            continue;
+        }
+        
+        if (limit - cursor >= 9 && std::memcmp(cursor, "<![CDATA[", 9) == 0) {
+            text.begin = cursor + 9;
+            if (!skip_past("]]>")) return EVENT_ERROR;
+            text.end = cursor - 3;
+            text_is_cdata = true;
+            return EVENT_TEXT;
+        }
+        
+        if (limit - cursor >= 2 && (cursor[1] == '?' || cursor[1] == '!')) {
+            // Declarations and doctypes carry nothing the reader needs
+            const char* close = cursor[1] == '?' ? "?>" : ">";
+            if (!skip_past(close)) return EVENT_ERROR;
+            continue;
+        }
+        
+        return parse_tag();
+    }
+    
+    return EVENT_END_DOCUMENT;
+}
+
+XmlPullParser::Event XmlPullParser::parse_tag() {
+    const char* p = cursor + 1;
+    bool closing = false;
+    if (p < limit && *p == '/') {
+        closing = true;
+        ++p;
+    }
+    
+    element_name.begin = p;
+    while (p < limit && !is_name_end(*p)) ++p;
+    element_name.end = p;
+    if (element_name.begin == element_name.end) return EVENT_ERROR;
+    
+    attr_count = 0;
+    bool self_closing = false;
+    
+    while (p < limit) {
+        while (p < limit && is_space(*p)) ++p;
+        if (p >= limit) break;
+        
+        if (*p == '>') {
+            ++p;
+            break;
+        }
+        if (*p == '/') {
+            self_closing = true;
+            ++p;
+            continue;
+        }
+        
+        Span attr_name;
+        attr_name.begin = p;
+        while (p < limit && !is_name_end(*p)) ++p;
+        attr_name.end = p;
+        if (attr_name.begin == attr_name.end) return EVENT_ERROR;
+        
+        while (p < limit && is_space(*p)) ++p;
+        if (p >= limit || *p != '=') return EVENT_ERROR;
+        ++p;
+        while (p < limit && is_space(*p)) ++p;
+        if (p >= limit || (*p != '"' && *p != '\'')) return EVENT_ERROR;
+        
+        char quote = *p++;
+        const char* value_end = static_cast<const char*>(std::memchr(p, quote, limit - p));
+        if (!value_end) return EVENT_ERROR;
+        
+        // Attributes past the fixed table are ignored; package documents never get close
+        if (attr_count < MAX_ATTRIBUTES) {
+            attr_names[attr_count] = attr_name;
+            attr_values[attr_count].begin = p;
+            attr_values[attr_count].end = value_end;
+            ++attr_count;
+        }
+        p = value_end + 1;
+    }
+    
+    cursor = p;
+    
+    if (closing) {
+        attr_count = 0;
+        --current_depth;
+        return EVENT_END_ELEMENT;
+    }
+    
+    ++current_depth;
+    pending_end = self_closing;
+    return EVENT_START_ELEMENT;
+}
+
+bool XmlPullParser::skip_past(const char* terminator) {
+    size_t length = std::strlen(terminator);
+    const char* p = cursor;
+    while (p + length <= limit) {
+        const char* candidate = static_cast<const char*>(std::memchr(p, terminator[0], limit - p));
+        if (!candidate || candidate + length > limit) break;
+        if (std::memcmp(candidate, terminator, length) == 0) {
+            cursor = candidate + length;
+            return true;
+        }
+        p = candidate + 1;
+    }
+    cursor = limit;
+    return false;
+}
+
+bool XmlPullParser::name_is(const char* local_name) const {
+    const char* begin = element_name.begin;
+    const char* colon = static_cast<const char*>(std::memchr(begin, ':', element_name.end - begin));
+    if (colon) begin = colon + 1;
+    
+    size_t length = element_name.end - begin;
+    return std::strlen(local_name) == length && std::memcmp(begin, local_name, length) == 0;
+}
+
+bool XmlPullParser::attribute(const char* attr_name, std::string& value) const {
+    size_t name_length = std::strlen(attr_name);
+    for (int i = 0; i < attr_count; ++i) {
+        const Span& candidate = attr_names[i];
+        if (static_cast<size_t>(candidate.end - candidate.begin) == name_length &&
+            std::memcmp(candidate.begin, attr_name, name_length) == 0) {
+            value.clear();
+            append_decoded(attr_values[i].begin, attr_values[i].end, value);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool XmlPullParser::attribute_equals(const char* attr_name, const char* expected) const {
+    size_t name_length = std::strlen(attr_name);
+    size_t expected_length = std::strlen(expected);
+    for (int i = 0; i < attr_count; ++i) {
+        const Span& candidate = attr_names[i];
+        if (static_cast<size_t>(candidate.end - candidate.begin) == name_length &&
+            std::memcmp(candidate.begin, attr_name, name_length) == 0) {
+            const Span& value = attr_values[i];
+            return static_cast<size_t>(value.end - value.begin) == expected_length &&
+                   std::memcmp(value.begin, expected, expected_length) == 0;
+        }
+    }
+    return false;
+}
+
+void XmlPullParser::append_text(std::string& out) const {
+    if (text_is_cdata) {
+        out.append(text.begin, text.end - text.begin);
+    } else {
+        append_decoded(text.begin, text.end, out);
+    }
+}
+
+void XmlPullParser::append_decoded(const char* begin, const char* end, std::string& out) {
+    const char* p = begin;
+    while (p < end) {
+        const char* amp = static_cast<const char*>(std::memchr(p, '&', end - p));
+        if (!amp) {
+            out.append(p, end - p);
+            return;
+        }
+        out.append(p, amp - p);
+        
+        const char* semi = static_cast<const char*>(std::memchr(amp, ';', end - amp));
+        if (!semi || semi - amp > 10) {
+            // Not a well-formed reference; keep it verbatim
+            out += '&';
+            p = amp + 1;
+            continue;
+        }
+        
+        const char* name = amp + 1;
+        size_t length = semi - name;
+        if (length > 1 && name[0] == '#') {
+            bool hex = name[1] == 'x' || name[1] == 'X';
+            const char* digits = name + (hex ? 2 : 1);
+            const char* d = digits;
+            unsigned long codepoint = 0;
+            for (; d < semi; ++d) {
+                char c = *d;
+                int digit;
+                if (c >= '0' && c <= '9') digit = c - '0';
+                else if (hex && c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+                else if (hex && c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+                else break;
+                codepoint = codepoint * (hex ? 16 : 10) + digit;
+            }
+            
+            // "&#x;", "&#12ab;" and "&#0;" are not characters, and a NUL would
+            // cut the string short once pooled; keep such references verbatim
+            if (d == digits || d != semi || codepoint == 0 || codepoint >= 0x110000) {
+                out.append(amp, semi + 1 - amp);
+            } else {
+                append_utf8(codepoint, out);
+            }
+        } else if (length == 2 && std::memcmp(name, "lt", 2) == 0) {
+            out += '<';
+        } else if (length == 2 && std::memcmp(name, "gt", 2) == 0) {
+            out += '>';
+        } else if (length == 3 && std::memcmp(name, "amp", 3) == 0) {
+            out += '&';
+        } else if (length == 4 && std::memcmp(name, "quot", 4) == 0) {
+            out += '"';
+        } else if (length == 4 && std::memcmp(name, "apos", 4) == 0) {
+            out += '\'';
+        } else {
+            out.append(amp, semi + 1 - amp);
+        }
+        p = semi + 1;
+    }
+}
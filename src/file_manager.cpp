@@ -100,6 +100,26 @@ size_t FileManager::get_file_size(const std::string& path) {
     return 0;
 }
 
+uint64_t FileManager::get_file_mtime(const std::string& path) {
+    SceIoStat stat;
+    int result = sceIoGetstat(path.c_str(), &stat);
+    
+    if (result < 0) {
+        return 0;
+    }
+    
+    // Pack the calendar time into a single monotonically ordered value
+    const SceDateTime& t = stat.sce_st_mtime;
+    uint64_t packed = t.year;
+    packed = packed * 13 + t.month;
+    packed = packed * 32 + t.day;
+    packed = packed * 24 + t.hour;
+    packed = packed * 60 + t.minute;
+    packed = packed * 60 + t.second;
+    packed = packed * 1000000 + t.microsecond;
+    return packed;
+}
+
 bool FileManager::delete_file(const std::string& path) {
     int result = sceIoRemove(path.c_str());
     return result >= 0;
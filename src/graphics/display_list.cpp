@@ -0,0 +1,215 @@
+#include "display_list.h"
+#include <algorithm>
+
+const size_t DisplayList::MAX_LOOKBACK;
+const uint32_t DisplayList::NO_COMMAND;
+
+namespace {
+    
+const float DEPTH = 0.5f;
+    
+} // namespace
+
+DisplayList::DisplayList() {
+    last_stats = Stats();
+}
+
+void DisplayList::fill_rect(int x, int y, int width, int height, uint32_t color) {
+    if (width <= 0 || height <= 0) return;
+    
+    float left = static_cast<float>(x);
+    float top = static_cast<float>(y);
+    float right = static_cast<float>(x + width);
+    float bottom = static_cast<float>(y + height);
+    uint32_t first = static_cast<uint32_t>(color_vertices.size());
+    ColorVertex corners[6] = {
+        {left, top, DEPTH, color}, {right, top, DEPTH, color}, {left, bottom, DEPTH, color},
+        {right, top, DEPTH, color}, {right, bottom, DEPTH, color}, {left, bottom, DEPTH, color}
+    };
+    color_vertices.insert(color_vertices.end(), corners, corners + 6);
+    
+    Rect bounds = {x, y, x + width, y + height};
+    add(KIND_FILL, nullptr, 0, bounds, first, 6);
+}
+
+void DisplayList::line(int x1, int y1, int x2, int y2, uint32_t color) {
+    uint32_t first = static_cast<uint32_t>(color_vertices.size());
+    ColorVertex ends[2] = {
+        {static_cast<float>(x1), static_cast<float>(y1), DEPTH, color},
+        {static_cast<float>(x2), static_cast<float>(y2), DEPTH, color}
+    };
+    color_vertices.insert(color_vertices.end(), ends, ends + 2);
+    
+    Rect bounds = {std::min(x1, x2), std::min(y1, y2), std::max(x1, x2) + 1, std::max(y1, y2) + 1};
+    add(KIND_LINE, nullptr, 0, bounds, first, 2);
+}
+
+void DisplayList::texture_part(const void* texture, int texture_width, int texture_height, int x, int y,
+                               int texture_x, int texture_y, int width, int height, uint32_t tint) {
+    if (!texture || width <= 0 || height <= 0 || texture_width <= 0 || texture_height <= 0) return;
+    
+    float left = static_cast<float>(x);
+    float top = static_cast<float>(y);
+    float right = static_cast<float>(x + width);
+    float bottom = static_cast<float>(y + height);
+    float u0 = static_cast<float>(texture_x) / texture_width;
+    float v0 = static_cast<float>(texture_y) / texture_height;
+    float u1 = static_cast<float>(texture_x + width) / texture_width;
+    float v1 = static_cast<float>(texture_y + height) / texture_height;
+    uint32_t first = static_cast<uint32_t>(quad_vertices.size());
+    QuadVertex corners[6] = {
+        {left, top, DEPTH, u0, v0}, {right, top, DEPTH, u1, v0}, {left, bottom, DEPTH, u0, v1},
+        {right, top, DEPTH, u1, v0}, {right, bottom, DEPTH, u1, v1}, {left, bottom, DEPTH, u0, v1}
+    };
+    quad_vertices.insert(quad_vertices.end(), corners, corners + 6);
+    
+    Rect bounds = {x, y, x + width, y + height};
+    add(KIND_TEXTURE, texture, tint, bounds, first, 6);
+}
+
+void DisplayList::text(const void* font, int x, int y, uint32_t color, int size, const char* text, int width) {
+    if (!font || !text || !*text) return;
+    
+    TextCommand command = {font, x, y, color, size, static_cast<uint32_t>(text_bytes.size())};
+    text_bytes.append(text);
+    text_bytes += '\0';
+    texts.push_back(command);
+    
+    // Generous vertically: glyphs sit on y as a baseline, with room for
+    // fonts that hang below it
+    Rect bounds = {x, y - size, x + std::max(width, 0) + size, y + 2 * size};
+    add(KIND_TEXT, font, 0, bounds, static_cast<uint32_t>(texts.size() - 1), 0);
+}
+
+void DisplayList::set_clip(int x, int y, int width, int height) {
+    Rect clip = {x, y, x + width, y + height};
+    add_clip(true, clip);
+}
+
+void DisplayList::clear_clip() {
+    Rect clip = {0, 0, 0, 0};
+    add_clip(false, clip);
+}
+
+void DisplayList::add(Kind kind, const void* handle, uint32_t tint, const Rect& bounds, uint32_t first,
+                      uint32_t count) {
+    uint32_t index = static_cast<uint32_t>(commands.size());
+    Command command = {first, count, NO_COMMAND};
+    commands.push_back(command);
+    
+    // Newest first: join a batch of the same state, unless a batch in
+    // between overlaps the command, which must then stay after it
+    size_t searched = 0;
+    for (size_t b = batches.size(); b > 0 && searched < MAX_LOOKBACK; --b, ++searched) {
+        Batch& batch = batches[b - 1];
+        if (batch.kind == kind && batch.handle == handle && batch.tint == tint) {
+            commands[batch.last_command].next = index;
+            batch.last_command = index;
+            batch.bounds.left = std::min(batch.bounds.left, bounds.left);
+            batch.bounds.top = std::min(batch.bounds.top, bounds.top);
+            batch.bounds.right = std::max(batch.bounds.right, bounds.right);
+            batch.bounds.bottom = std::max(batch.bounds.bottom, bounds.bottom);
+            return;
+        }
+        if (batch.kind == KIND_CLIP || batch.bounds.overlaps(bounds)) break;
+    }
+    
+    Batch batch = {kind, handle, tint, bounds, false, index, index};
+    batches.push_back(batch);
+}
+
+void DisplayList::add_clip(bool enabled, const Rect& clip) {
+    Batch batch = {KIND_CLIP, nullptr, 0, clip, enabled, NO_COMMAND, NO_COMMAND};
+    batches.push_back(batch);
+}
+
+void DisplayList::submit(DisplayBackend& backend) {
+    Stats stats = Stats();
+    stats.commands = static_cast<uint32_t>(commands.size());
+    
+    for (const Batch& batch : batches) {
+        if (batch.kind == KIND_CLIP) {
+            backend.set_clip(batch.clip_enabled, batch.bounds.left, batch.bounds.top,
+                             batch.bounds.right - batch.bounds.left, batch.bounds.bottom - batch.bounds.top);
+            continue;
+        }
+        ++stats.batches;
+        
+        if (batch.kind == KIND_TEXT) {
+            for (uint32_t c = batch.first_command; c != NO_COMMAND; c = commands[c].next) {
+                const TextCommand& text = texts[commands[c].first];
+                backend.draw_text(text.font, text.x, text.y, text.color, text.size, text_bytes.c_str() + text.offset);
+                ++stats.draw_calls;
+            }
+            continue;
+        }
+        
+        // A batch's vertices are scattered where other batches came between
+        if (batch.kind == KIND_TEXTURE) {
+            quad_scratch.clear();
+            for (uint32_t c = batch.first_command; c != NO_COMMAND; c = commands[c].next) {
+                const QuadVertex* first = quad_vertices.data() + commands[c].first;
+                quad_scratch.insert(quad_scratch.end(), first, first + commands[c].count);
+            }
+            backend.draw_textured(batch.handle, quad_scratch.data(), quad_scratch.size(), batch.tint);
+        } else {
+            color_scratch.clear();
+            for (uint32_t c = batch.first_command; c != NO_COMMAND; c = commands[c].next) {
+                const ColorVertex* first = color_vertices.data() + commands[c].first;
+                color_scratch.insert(color_scratch.end(), first, first + commands[c].count);
+            }
+            if (batch.kind == KIND_FILL) {
+                backend.draw_triangles(color_scratch.data(), color_scratch.size());
+            } else {
+                backend.draw_lines(color_scratch.data(), color_scratch.size());
+            }
+        }
+        ++stats.draw_calls;
+    }
+    
+    last_stats = stats;
+    clear();
+}
+
+void DisplayList::clear() {
+    commands.clear();
+    batches.clear();
+    color_vertices.clear();
+    quad_vertices.clear();
+    texts.clear();
+    text_bytes.clear();
+}
+
+void RecordingBackend::draw_triangles(const ColorVertex*, size_t count) {
+    ++totals.fill_batches;
+    totals.vertices += static_cast<uint32_t>(count);
+}
+
+void RecordingBackend::draw_lines(const ColorVertex*, size_t count) {
+    ++totals.line_batches;
+    totals.vertices += static_cast<uint32_t>(count);
+}
+
+void RecordingBackend::draw_textured(const void*, const QuadVertex*, size_t count, uint32_t) {
+    ++totals.texture_batches;
+    totals.vertices += static_cast<uint32_t>(count);
+}
+
+void RecordingBackend::draw_text(const void*, int, int, uint32_t, int, const char*) {
+    ++totals.text_draws;
+}
+
+void RecordingBackend::set_clip(bool, int, int, int, int) {
+    ++totals.clip_changes;
+}
+
+void RecordingBackend::reset() {
+    totals = Counts();
+}
+
+void RecordingBackend::report(std::ostream& out, const std::string& screen, const DisplayList::Stats& stats) const {
+    out << screen << ": " << stats.commands << " commands, " << stats.batches << " batches, "
+        << stats.draw_calls << " draw calls (" << totals.fill_batches << " fill, " << totals.line_batches
+        << " line, " << totals.texture_batches << " texture, " << totals.text_draws << " text; "
+        << totals.clip_changes << " clip changes, " << totals.vertices << " vertices)" << std::endl;
+}
@@ -0,0 +1,218 @@
+#include "glyph_atlas.h"
+#include <algorithm>
+#include <cstring>
+
+const int GlyphAtlas::PAGE_SIZE;
+const size_t GlyphAtlas::MAX_PAGES;
+const int GlyphAtlas::PADDING;
+const size_t QuadBatch::VERTICES_PER_QUAD;
+
+ShelfPacker::ShelfPacker(int width, int height) : page_width(width), page_height(height), top(0) {}
+
+bool ShelfPacker::pack(int width, int height, int& x, int& y) {
+    if (width > page_width || height > page_height) return false;
+    
+    // A slot on a shelf of about the right height beats opening a new one
+    if (reuse(width, height, 2 * height, x, y)) return true;
+    
+    Shelf* best = nullptr;
+    for (Shelf& shelf : shelves) {
+        if (shelf.height >= height && shelf.end + width <= page_width &&
+            (!best || shelf.height < best->height)) {
+            best = &shelf;
+        }
+    }
+    
+    // A shelf much taller than the rectangle is only worth it when the
+    // page has no rows left for a new one
+    if (!best || (best->height > 2 * height && top + height <= page_height)) {
+        if (top + height > page_height) {
+            // Last, a slot on any taller shelf
+            return reuse(width, height, page_height, x, y);
+        }
+        Shelf shelf = {top, height, 0, std::vector<Slot>()};
+        shelves.push_back(shelf);
+        top += height;
+        best = &shelves.back();
+    }
+    
+    x = best->end;
+    y = best->y;
+    best->end += width;
+    return true;
+}
+
+bool ShelfPacker::reuse(int width, int min_height, int max_height, int& x, int& y) {
+    Shelf* best_shelf = nullptr;
+    size_t best_slot = 0;
+    for (Shelf& shelf : shelves) {
+        if (shelf.height < min_height || shelf.height > max_height) continue;
+        if (best_shelf && shelf.height > best_shelf->height) continue;
+        for (size_t i = 0; i < shelf.free.size(); ++i) {
+            const Slot& slot = shelf.free[i];
+            if (slot.width < width) continue;
+            if (!best_shelf || shelf.height < best_shelf->height || slot.width < best_shelf->free[best_slot].width) {
+                best_shelf = &shelf;
+                best_slot = i;
+            }
+        }
+    }
+    if (!best_shelf) return false;
+    
+    Slot& slot = best_shelf->free[best_slot];
+    x = slot.x;
+    y = best_shelf->y;
+    slot.x += width;
+    slot.width -= width;
+    if (slot.width == 0) {
+        best_shelf->free.erase(best_shelf->free.begin() + best_slot);
+    }
+    return true;
+}
+
+void ShelfPacker::release(int x, int y, int width) {
+    auto it = std::lower_bound(shelves.begin(), shelves.end(), y,
+                               [](const Shelf& shelf, int value) { return shelf.y < value; });
+    if (it == shelves.end() || it->y != y) return;
+    
+    // Slots stay sorted by x and merge with their neighbours
+    std::vector<Slot>& free = it->free;
+    auto next = std::lower_bound(free.begin(), free.end(), x,
+                                 [](const Slot& slot, int value) { return slot.x < value; });
+    if (next != free.end() && x + width == next->x) {
+        width += next->width;
+        next = free.erase(next);
+    }
+    if (next != free.begin() && (next - 1)->x + (next - 1)->width == x) {
+        (next - 1)->width += width;
+        --next;
+    } else {
+        Slot slot = {x, width};
+        next = free.insert(next, slot);
+    }
+    
+    // A slot reaching the end goes back to the shelf, and empty shelves at
+    // the bottom go back to the page
+    if (next + 1 == free.end() && next->x + next->width == it->end) {
+        it->end = next->x;
+        free.erase(next);
+    }
+    while (!shelves.empty() && shelves.back().end == 0) {
+        top = shelves.back().y;
+        shelves.pop_back();
+    }
+}
+
+int ShelfPacker::shelf_height(int y) const {
+    auto it = std::lower_bound(shelves.begin(), shelves.end(), y,
+                               [](const Shelf& shelf, int value) { return shelf.y < value; });
+    return it != shelves.end() && it->y == y ? it->height : 0;
+}
+
+void ShelfPacker::clear() {
+    shelves.clear();
+    top = 0;
+}
+
+bool GlyphAtlas::add(const uint8_t* bitmap, int width, int height, int pitch, AtlasRegion& region) {
+    region = AtlasRegion();
+    if (width <= 0 || height <= 0) return true;
+    
+    // Newest page first; older ones only have released room left
+    int padded_width = width + 2 * PADDING;
+    int padded_height = height + 2 * PADDING;
+    int x = 0;
+    int y = 0;
+    size_t index = pages.size();
+    while (index > 0 && !pages[index - 1].packer.pack(padded_width, padded_height, x, y)) {
+        --index;
+    }
+    if (index == 0) {
+        if (pages.size() >= MAX_PAGES) return false;
+        if (pages.empty()) pages.reserve(MAX_PAGES);
+        pages.push_back(Page());
+        if (!pages.back().packer.pack(padded_width, padded_height, x, y)) return false;
+        index = pages.size();
+    }
+    
+    // Reused room still holds an old glyph, border included
+    Page& page = pages[index - 1];
+    for (int row = 0; row < padded_height; ++row) {
+        std::memset(&page.pixels[(y + row) * PAGE_SIZE + x], 0, padded_width);
+    }
+    for (int row = 0; row < height; ++row) {
+        std::memcpy(&page.pixels[(y + PADDING + row) * PAGE_SIZE + x + PADDING], bitmap + row * pitch, width);
+    }
+    page.dirty_first = std::min(page.dirty_first, y);
+    page.dirty_end = std::max(page.dirty_end, y + padded_height);
+    x += PADDING;
+    y += PADDING;
+    
+    const float scale = 1.0f / PAGE_SIZE;
+    region.page = static_cast<uint16_t>(index - 1);
+    region.x = static_cast<uint16_t>(x);
+    region.y = static_cast<uint16_t>(y);
+    region.width = static_cast<uint16_t>(width);
+    region.height = static_cast<uint16_t>(height);
+    region.u0 = x * scale;
+    region.v0 = y * scale;
+    region.u1 = (x + width) * scale;
+    region.v1 = (y + height) * scale;
+    return true;
+}
+
+void GlyphAtlas::release(const AtlasRegion& region) {
+    if (region.width == 0 || region.page >= pages.size()) return;
+    pages[region.page].packer.release(region.x - PADDING, region.y - PADDING, region.width + 2 * PADDING);
+}
+
+int GlyphAtlas::room_height(const AtlasRegion& region) const {
+    if (region.width == 0 || region.page >= pages.size()) return 0;
+    return pages[region.page].packer.shelf_height(region.y - PADDING) - 2 * PADDING;
+}
+
+void GlyphAtlas::clear() {
+    for (Page& page : pages) {
+        page.packer.clear();
+        std::fill(page.pixels.begin(), page.pixels.end(), 0);
+        page.dirty_first = 0;
+        page.dirty_end = PAGE_SIZE;
+    }
+}
+
+bool GlyphAtlas::take_dirty_rows(size_t page, int& first_row, int& end_row) {
+    Page& entry = pages[page];
+    if (entry.dirty_first >= entry.dirty_end) return false;
+    first_row = entry.dirty_first;
+    end_row = entry.dirty_end;
+    entry.dirty_first = PAGE_SIZE;
+    entry.dirty_end = 0;
+    return true;
+}
+
+void QuadBatch::add(const AtlasRegion& region, float x, float y) {
+    if (region.width == 0) return;
+    if (region.page >= pages.size()) pages.resize(region.page + 1);
+    
+    float right = x + region.width;
+    float bottom = y + region.height;
+    const QuadVertex corners[VERTICES_PER_QUAD] = {
+        {x, y, 0.5f, region.u0, region.v0},
+        {right, y, 0.5f, region.u1, region.v0},
+        {x, bottom, 0.5f, region.u0, region.v1},
+        {right, y, 0.5f, region.u1, region.v0},
+        {right, bottom, 0.5f, region.u1, region.v1},
+        {x, bottom, 0.5f, region.u0, region.v1},
+    };
+    std::vector<QuadVertex>& vertices = pages[region.page];
+    vertices.insert(vertices.end(), corners, corners + VERTICES_PER_QUAD);
+    ++quads;
+}
+
+void QuadBatch::clear() {
+    // Keeps each page's capacity for the next batch
+    for (std::vector<QuadVertex>& vertices : pages) {
+        vertices.clear();
+    }
+    quads = 0;
+}
@@ -0,0 +1,165 @@
+#include "glyph_cache.h"
+#include <algorithm>
+
+const size_t GlyphCache::DEFAULT_BYTE_BUDGET;
+const size_t GlyphCache::DEFAULT_MAX_GLYPHS;
+const uint16_t GlyphCache::NO_ENTRY;
+
+GlyphCache::GlyphCache(size_t byte_budget, size_t max_glyphs)
+    : byte_budget(byte_budget), hand(0), batch(0), pinned_batch(0) {
+    if (max_glyphs > NO_ENTRY) max_glyphs = NO_ENTRY;
+    entries.resize(max_glyphs);
+    
+    // Keep the load factor under one half
+    size_t slot_count = 16;
+    while (slot_count < max_glyphs * 2) slot_count *= 2;
+    slots.resize(slot_count);
+    clear();
+}
+
+uint64_t GlyphCache::make_key(uint16_t face, uint16_t size, uint32_t codepoint) {
+    // Sizes are never 0, so no key is
+    return (static_cast<uint64_t>(face) << 48) | (static_cast<uint64_t>(size) << 32) | codepoint;
+}
+
+uint32_t GlyphCache::hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDull;
+    key ^= key >> 33;
+    return static_cast<uint32_t>(key);
+}
+
+size_t GlyphCache::find_slot(uint64_t key) const {
+    size_t mask = slots.size() - 1;
+    size_t slot = hash(key) & mask;
+    while (slots[slot] != NO_ENTRY && entries[slots[slot]].key != key) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+const CachedGlyph* GlyphCache::find(uint16_t face, uint16_t size, uint32_t codepoint) {
+    uint16_t index = slots[find_slot(make_key(face, size, codepoint))];
+    if (index == NO_ENTRY) {
+        ++counters.misses;
+        return nullptr;
+    }
+    
+    Entry& entry = entries[index];
+    entry.referenced = true;
+    entry.batch = batch;
+    ++counters.hits;
+    return &entry.glyph;
+}
+
+const CachedGlyph* GlyphCache::insert(uint16_t face, uint16_t size, uint32_t codepoint, const uint8_t* bitmap,
+                                      int width, int height, int pitch, int left, int top, int advance_x) {
+    uint64_t key = make_key(face, size, codepoint);
+    size_t bytes = width > 0 && height > 0 ? static_cast<size_t>(width) * height : 0;
+    
+    // Stay within the budget and keep an entry free
+    while ((counters.bytes + bytes > byte_budget || free_entries.empty()) && evict(0)) {
+    }
+    if (free_entries.empty()) return nullptr;
+    
+    uint16_t index = free_entries.back();
+    free_entries.pop_back();
+    Entry& entry = entries[index];
+    entry.key = key;
+    entry.batch = batch;
+    entry.referenced = true;
+    entry.glyph.left = static_cast<int16_t>(left);
+    entry.glyph.top = static_cast<int16_t>(top);
+    entry.glyph.advance_x = static_cast<int16_t>(advance_x);
+    
+    // A full atlas needs room on a shelf at least this tall; neighbours
+    // evicted from one shelf merge into a wider slot
+    bool placed = pages.add(bitmap, width, height, pitch, entry.glyph.region);
+    while (!placed && evict(height)) {
+        placed = pages.add(bitmap, width, height, pitch, entry.glyph.region);
+    }
+    if (!placed) {
+        entry.key = 0;
+        entry.glyph = CachedGlyph();
+        free_entries.push_back(index);
+        return nullptr;
+    }
+    counters.bytes += bytes;
+    
+    slots[find_slot(key)] = index;
+    ++counters.glyphs;
+    return &entry.glyph;
+}
+
+bool GlyphCache::evict(int height) {
+    // Glyphs only get pinned during a batch, so once a sweep for any glyph
+    // fails the rest of the batch's would too
+    if (height == 0 && pinned_batch == batch) return false;
+    
+    // Two turns clear every referenced bit, so a third finds no victim only
+    // when none can go
+    for (size_t step = 0; step < entries.size() * 2; ++step) {
+        uint16_t index = static_cast<uint16_t>(hand);
+        hand = (hand + 1) % entries.size();
+        
+        Entry& entry = entries[index];
+        if (entry.key == 0 || entry.batch == batch) continue;
+        if (height > 0 && pages.room_height(entry.glyph.region) < height) continue;
+        if (entry.referenced) {
+            entry.referenced = false;
+            continue;
+        }
+        remove(index);
+        ++counters.evictions;
+        return true;
+    }
+    if (height == 0) pinned_batch = batch;
+    return false;
+}
+
+void GlyphCache::remove(uint16_t index) {
+    Entry& entry = entries[index];
+    size_t mask = slots.size() - 1;
+    size_t hole = find_slot(entry.key);
+    
+    // Backward-shift deletion: move up any later entry of the run whose
+    // home slot is not between the hole and itself
+    for (size_t slot = (hole + 1) & mask; slots[slot] != NO_ENTRY; slot = (slot + 1) & mask) {
+        size_t home = hash(entries[slots[slot]].key) & mask;
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            slots[hole] = slots[slot];
+            hole = slot;
+        }
+    }
+    slots[hole] = NO_ENTRY;
+    
+    if (entry.glyph.region.width != 0) {
+        counters.bytes -= static_cast<size_t>(entry.glyph.region.width) * entry.glyph.region.height;
+        pages.release(entry.glyph.region);
+    }
+    entry.key = 0;
+    entry.glyph = CachedGlyph();
+    free_entries.push_back(index);
+    --counters.glyphs;
+}
+
+void GlyphCache::clear() {
+    for (Entry& entry : entries) {
+        entry.key = 0;
+        entry.glyph = CachedGlyph();
+        entry.batch = 0;
+        entry.referenced = false;
+    }
+    std::fill(slots.begin(), slots.end(), NO_ENTRY);
+    
+    // Handed out from the back, lowest index first
+    free_entries.clear();
+    for (size_t i = entries.size(); i > 0; --i) {
+        free_entries.push_back(static_cast<uint16_t>(i - 1));
+    }
+    pages.clear();
+    hand = 0;
+    pinned_batch = batch - 1;
+    counters.glyphs = 0;
+    counters.bytes = 0;
+}
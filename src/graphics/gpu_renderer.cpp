@@ -1,10 +1,95 @@
 #include "gpu_renderer.h"
+#include "utf8.h"
 #include <iostream>
 #include <algorithm>
+#include <climits>
+#include <cstring>
+
+const int GPURenderer::SCREEN_WIDTH;
+const int GPURenderer::SCREEN_HEIGHT;
+const int GPURenderer::PAGE_MARGIN_X;
+const int GPURenderer::PAGE_MARGIN_Y;
+const int GPURenderer::PAGE_STRIPS;
+const int GPURenderer::CACHE_HEIGHT;
+
+namespace {
+    
+// vita2d walks the string with its own decoder, which misreads malformed
+// UTF-8; valid text is passed through untouched and only bad text is copied
+const char* drawable_text(const std::string& text, std::string& scratch) {
+    if (Utf8Decoder::is_valid(text.data(), text.size())) {
+        return text.c_str();
+    }
+    Utf8Decoder::sanitize(text.data(), text.size(), scratch);
+    return scratch.c_str();
+}
+    
+// Draws display list batches with vita2d. Vertices are copied to vita2d's
+// pool, which lives until the GPU is done with the frame.
+class Vita2dBackend : public DisplayBackend {
+public:
+    explicit Vita2dBackend(std::mutex& mutex) : font_mutex(mutex) {}
+        
+    void draw_triangles(const ColorVertex* vertices, size_t count) {
+        vita2d_color_vertex* pooled = pool_copy<vita2d_color_vertex>(vertices, count);
+        if (pooled) vita2d_draw_array(SCE_GXM_PRIMITIVE_TRIANGLES, pooled, count);
+    }
+        
+    void draw_lines(const ColorVertex* vertices, size_t count) {
+        vita2d_color_vertex* pooled = pool_copy<vita2d_color_vertex>(vertices, count);
+        if (pooled) vita2d_draw_array(SCE_GXM_PRIMITIVE_LINES, pooled, count);
+    }
+        
+    void draw_textured(const void* texture, const QuadVertex* vertices, size_t count, uint32_t tint) {
+        vita2d_texture_vertex* pooled = pool_copy<vita2d_texture_vertex>(vertices, count);
+        if (pooled) {
+            vita2d_draw_array_textured(static_cast<const vita2d_texture*>(texture), SCE_GXM_PRIMITIVE_TRIANGLES,
+                                       pooled, count, tint);
+        }
+    }
+        
+    void draw_text(const void* font, int x, int y, uint32_t color, int size, const char* text) {
+        std::lock_guard<std::mutex> lock(font_mutex);
+        vita2d_font_draw_text(static_cast<vita2d_font*>(const_cast<void*>(font)), x, y, color, size, text);
+    }
+        
+    void set_clip(bool enabled, int x, int y, int width, int height) {
+        if (enabled) {
+            vita2d_enable_clipping();
+            vita2d_set_clip_rectangle(x, y, x + width, y + height);
+        } else {
+            vita2d_disable_clipping();
+        }
+    }
+        
+private:
+    std::mutex& font_mutex;
+        
+    template <typename Vertex, typename Source>
+    static Vertex* pool_copy(const Source* vertices, size_t count) {
+        static_assert(sizeof(Vertex) == sizeof(Source), "display list vertices must be laid out as vita2d's");
+        Vertex* pooled = static_cast<Vertex*>(vita2d_pool_memalign(count * sizeof(Vertex), sizeof(Vertex)));
+        if (pooled) std::memcpy(pooled, vertices, count * sizeof(Vertex));
+        return pooled;
+    }
+};
+    
+} // namespace
 
 bool GPURenderer::initialize() {
+    for (int i = 0; i < PAGE_STRIPS; ++i) {
+        page_strips[i] = nullptr;
+    }
+    page_cache = PageCache();
+    page_fill = PageFill();
+    page_dependency = false;
+    stats = FrameStats();
+    vita2d_backend.reset(new Vita2dBackend(font_mutex));
+    backend = vita2d_backend.get();
+    
     vita2d_init();
-    vita2d_set_clear_color(RGBA8(255, 255, 255, 255)); // White background
+    clear_color = RGBA8(255, 255, 255, 255); // White background
+    vita2d_set_clear_color(clear_color);
     
     // Load default font for text rendering
     default_font = vita2d_load_font_file("assets/fonts/default.ttf");
@@ -17,10 +102,21 @@ bool GPURenderer::initialize() {
         }
     }
     
-    // Create texture cache for pre-rendered text
-    text_cache_texture = vita2d_create_empty_texture(1024, 1024);
-    if (!text_cache_texture) {
-        std::cerr << "Failed to create text cache texture" << std::endl;
+    // Optional variants; styled text falls back to the default font
+    bold_font = vita2d_load_font_file("assets/fonts/bold.ttf");
+    italic_font = vita2d_load_font_file("assets/fonts/italic.ttf");
+    
+    // Layout works without hyphenation; the loader reports why it failed
+    hyphenation.load("assets/hyphenation/en-us.pat");
+    
+    // Render targets for the page cache; without them pages are drawn every frame
+    for (int i = 0; i < PAGE_STRIPS; ++i) {
+        page_strips[i] = vita2d_create_empty_texture_rendertarget(SCREEN_WIDTH, SCREEN_HEIGHT,
+                                                                  SCE_GXM_TEXTURE_FORMAT_A8B8G8R8);
+        if (!page_strips[i]) {
+            std::cerr << "Failed to create page cache texture" << std::endl;
+            break;
+        }
     }
     
     std::cout << "GPU renderer initialized successfully" << std::endl;
@@ -28,16 +124,40 @@ bool GPURenderer::initialize() {
 }
 
 void GPURenderer::begin_frame() {
-    vita2d_start_drawing();
+    frame_start = std::chrono::steady_clock::now();
+    stats.commands = 0;
+    stats.batches = 0;
+    stats.draw_calls = 0;
+    page_fill.pending = false;
+    
+    // Strips drawn after the last frame must be finished before they are sampled
+    if (page_dependency) {
+        vita2d_start_drawing_advanced(NULL, SCE_GXM_SCENE_VERTEX_WAIT_FOR_DEPENDENCY);
+        page_dependency = false;
+    } else {
+        vita2d_start_drawing();
+    }
     vita2d_clear_screen();
 }
 
 void GPURenderer::end_frame() {
+    submit_display_list();
     vita2d_end_drawing();
+    
+    // Scenes cannot nest, so a page missed this frame is cached between frames
+    if (page_fill.pending) {
+        fill_page_cache();
+    }
+    
+    ++stats.frames;
+    stats.frame_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frame_start).count();
     vita2d_swap_buffers();
 }
 
 void GPURenderer::clear_screen(uint32_t color) {
+    // What was recorded so far goes under the clear
+    submit_display_list();
+    clear_color = color;
     vita2d_set_clear_color(color);
     vita2d_clear_screen();
 }
@@ -46,7 +166,8 @@ void GPURenderer::render_text_gpu(const std::string& text, int x, int y, uint32_
     if (!default_font) return;
     
     // Use GPU-accelerated text rendering
-    vita2d_font_draw_text(default_font, x, y, color, size, text.c_str());
+    std::string scratch;
+    display.text(default_font, x, y, color, size, drawable_text(text, scratch), SCREEN_WIDTH - x);
 }
 
 void GPURenderer::render_text_wrapped(const std::string& text, int x, int y, int max_width, uint32_t color, int size) {
@@ -62,49 +183,240 @@ void GPURenderer::render_text_wrapped(const std::string& text, int x, int y, int
 
 int GPURenderer::get_text_width(const std::string& text, int size) {
     if (!default_font) return 0;
-    return vita2d_font_text_width(default_font, size, text.c_str());
+    std::string scratch;
+    const char* drawable = drawable_text(text, scratch);
+    std::lock_guard<std::mutex> lock(font_mutex);
+    return vita2d_font_text_width(default_font, size, drawable);
 }
 
 int GPURenderer::get_text_height(int size) {
     if (!default_font) return size;
+    std::lock_guard<std::mutex> lock(font_mutex);
     return vita2d_font_text_height(default_font, size, "Ay"); // Use text with ascender and descender
 }
 
 void GPURenderer::render_rectangle(int x, int y, int width, int height, uint32_t color) {
-    vita2d_draw_rectangle(x, y, width, height, color);
+    display.fill_rect(x, y, width, height, color);
 }
 
 void GPURenderer::render_rectangle_outline(int x, int y, int width, int height, uint32_t color, int thickness) {
     // Draw four rectangles to form an outline
-    vita2d_draw_rectangle(x, y, width, thickness, color); // Top
-    vita2d_draw_rectangle(x, y + height - thickness, width, thickness, color); // Bottom
-    vita2d_draw_rectangle(x, y, thickness, height, color); // Left
-    vita2d_draw_rectangle(x + width - thickness, y, thickness, height, color); // Right
+    display.fill_rect(x, y, width, thickness, color); // Top
+    display.fill_rect(x, y + height - thickness, width, thickness, color); // Bottom
+    display.fill_rect(x, y, thickness, height, color); // Left
+    display.fill_rect(x + width - thickness, y, thickness, height, color); // Right
 }
 
 void GPURenderer::render_line(int x1, int y1, int x2, int y2, uint32_t color) {
-    vita2d_draw_line(x1, y1, x2, y2, color);
+    display.line(x1, y1, x2, y2, color);
 }
 
-void GPURenderer::render_cached_page(const std::vector<std::string>& lines, int scroll_offset) {
-    int y_pos = 50 - scroll_offset; // Start position with margin
-    int line_height = 24;
-    int margin_x = 50;
+void GPURenderer::render_cached_page(const std::vector<std::string>& lines, int scroll_offset, size_t first_line,
+                                     int font_size, int line_height) {
+    int view_top = scroll_offset - PAGE_MARGIN_Y;
     
-    for (const auto& line : lines) {
+    // Rows within a line of a window edge may still gain glyphs as the
+    // window moves, unless the edge is the start of the chapter
+    PageCache page = PageCache();
+    page.source = &lines;
+    page.font_size = font_size;
+    page.line_height = line_height;
+    page.first_line = first_line;
+    page.end_line = first_line + lines.size();
+    page.complete_top = first_line == 0 ? INT_MIN : static_cast<int>(first_line + 1) * line_height;
+    page.complete_bottom = static_cast<int>(page.end_line) * line_height - line_height;
+    
+    if (page_cached(page, view_top)) {
+        blit_page(view_top);
+        return;
+    }
+    draw_window_lines(lines, first_line, view_top, SCREEN_HEIGHT, font_size, line_height);
+    request_page_fill(page, view_top);
+    page_fill.lines = &lines;
+}
+
+void GPURenderer::draw_window_lines(const std::vector<std::string>& lines, size_t first_line, int top, int height,
+                                    int font_size, int line_height) {
+    // Lines are evenly spaced, so the first visible one is computed directly
+    int first_y = static_cast<int>(first_line) * line_height - top;
+    size_t skip = first_y < -line_height ? static_cast<size_t>((-line_height - first_y) / line_height) : 0;
+    int y_pos = first_y + static_cast<int>(skip) * line_height;
+    
+    for (size_t i = skip; i < lines.size(); ++i) {
         // Only render visible lines to improve performance
-        if (y_pos > -line_height && y_pos < SCREEN_HEIGHT + line_height) {
-            render_text_gpu(line, margin_x, y_pos, RGBA8(0, 0, 0, 255), 18);
+        if (y_pos > -line_height && y_pos < height + line_height) {
+            render_text_gpu(lines[i], PAGE_MARGIN_X, y_pos, RGBA8(0, 0, 0, 255), font_size);
         }
         y_pos += line_height;
         
-        // Stop rendering if we're way below the screen
-        if (y_pos > SCREEN_HEIGHT + 100) {
+        // Stop rendering if we're way below the target
+        if (y_pos > height + 100) {
             break;
         }
     }
 }
 
+bool GPURenderer::page_cached(const PageCache& page, int view_top) const {
+    if (page_cache.source != page.source || page_cache.font_size != page.font_size ||
+        page_cache.line_height != page.line_height) {
+        return false;
+    }
+    if (view_top < page_cache.top || view_top + SCREEN_HEIGHT > page_cache.top + CACHE_HEIGHT) {
+        return false;
+    }
+    
+    // A streamed window that has moved since only vouches for rows it covered then
+    bool same_window = page.first_line == page_cache.first_line && page.end_line == page_cache.end_line;
+    return same_window || (view_top >= page_cache.complete_top &&
+                           view_top + SCREEN_HEIGHT <= page_cache.complete_bottom);
+}
+
+void GPURenderer::blit_page(int view_top) {
+    // The view spans at most two strips
+    for (int i = 0; i < PAGE_STRIPS; ++i) {
+        int strip_top = page_cache.top + i * SCREEN_HEIGHT;
+        int top = std::max(strip_top, view_top);
+        int bottom = std::min(strip_top + SCREEN_HEIGHT, view_top + SCREEN_HEIGHT);
+        if (bottom <= top) continue;
+        
+        display.texture_part(page_strips[i], vita2d_texture_get_width(page_strips[i]),
+                             vita2d_texture_get_height(page_strips[i]), 0, top - view_top, 0, top - strip_top,
+                             SCREEN_WIDTH, bottom - top);
+    }
+    ++stats.page_blits;
+}
+
+void GPURenderer::request_page_fill(const PageCache& page, int view_top) {
+    if (!page_strips[PAGE_STRIPS - 1]) return;
+    
+    // Centered on the view, but never above the first line
+    page_fill = PageFill();
+    page_fill.pending = true;
+    page_fill.cache = page;
+    page_fill.cache.top = std::max(-PAGE_MARGIN_Y, view_top - (CACHE_HEIGHT - SCREEN_HEIGHT) / 2);
+}
+
+void GPURenderer::fill_page_cache() {
+    page_fill.pending = false;
+    const PageCache& page = page_fill.cache;
+    
+    // vita2d draws from one vertex pool, which the frame may still be reading
+    vita2d_wait_rendering_done();
+    
+    for (int i = 0; i < PAGE_STRIPS; ++i) {
+        int strip_top = page.top + i * SCREEN_HEIGHT;
+        vita2d_start_drawing_advanced(page_strips[i], SCE_GXM_SCENE_FRAGMENT_SET_DEPENDENCY);
+        vita2d_set_clear_color(clear_color);
+        vita2d_clear_screen();
+        if (page_fill.layout) {
+            draw_layout_lines(*page_fill.text, *page_fill.layout, strip_top, SCREEN_HEIGHT);
+        } else {
+            draw_window_lines(*page_fill.lines, page.first_line, strip_top, SCREEN_HEIGHT, page.font_size,
+                              page.line_height);
+        }
+        submit_display_list();
+        vita2d_end_drawing();
+    }
+    page_cache = page;
+    page_dependency = true;
+    ++stats.page_fills;
+}
+
+vita2d_font* GPURenderer::font_for_style(const TextStyle& style) const {
+    if ((style.flags & STYLE_ITALIC) && italic_font) return italic_font;
+    if (((style.flags & STYLE_BOLD) || style.heading) && bold_font) return bold_font;
+    return default_font;
+}
+
+void GPURenderer::render_chapter_layout(const StyledText& text, const ChapterLayout& layout, int scroll_offset) {
+    if (!default_font) return;
+    
+    int view_top = scroll_offset - PAGE_MARGIN_Y;
+    PageCache page = PageCache();
+    page.source = &layout;
+    page.font_size = layout.font_size;
+    
+    if (page_cached(page, view_top)) {
+        blit_page(view_top);
+        return;
+    }
+    draw_layout_lines(text, layout, view_top, SCREEN_HEIGHT);
+    request_page_fill(page, view_top);
+    page_fill.text = &text;
+    page_fill.layout = &layout;
+}
+
+void GPURenderer::draw_layout_lines(const StyledText& text, const ChapterLayout& layout, int top, int height) {
+    std::lock_guard<std::mutex> lock(font_mutex);
+    for (size_t i = layout.line_at_y(top); i < layout.lines.size(); ++i) {
+        const TextLine& line = layout.lines[i];
+        int y_pos = line.y - top;
+        if (y_pos > height + line.height) break;
+        if (line.length == 0) continue;
+        
+        int size = block_font_size(line.block_kind, layout.font_size);
+        int x = PAGE_MARGIN_X + line.x;
+        if (line.slack != 0) {
+            x = draw_justified_line(text, line, x, y_pos, size);
+        } else {
+            x = draw_styled_span(text, line.offset, line.offset + line.length, x, y_pos, size);
+        }
+        if (line.hyphen) {
+            vita2d_font* font = text.runs.empty() ? default_font :
+                                font_for_style(text.style(text.runs[text.run_at(line.offset + line.length - 1)].style));
+            display.text(font, x, y_pos, RGBA8(0, 0, 0, 255), size, "-", size);
+        }
+    }
+}
+
+int GPURenderer::draw_styled_span(const StyledText& text, uint32_t offset, uint32_t end, int x, int y, int size) {
+    if (text.runs.empty()) {
+        segment_scratch.assign(text.text, offset, end - offset);
+        const char* drawable = drawable_text(segment_scratch, utf8_scratch);
+        int width = vita2d_font_text_width(default_font, size, drawable);
+        display.text(default_font, x, y, RGBA8(0, 0, 0, 255), size, drawable, width);
+        return x + width;
+    }
+    
+    // Draw one segment per style run crossing the span
+    for (size_t r = text.run_at(offset); r < text.runs.size() && offset < end; ++r) {
+        const StyledText::Run& run = text.runs[r];
+        uint32_t segment_end = std::min<uint32_t>(end, run.offset + run.length);
+        if (segment_end <= offset) continue;
+        
+        segment_scratch.assign(text.text, offset, segment_end - offset);
+        vita2d_font* font = font_for_style(text.style(run.style));
+        const char* drawable = drawable_text(segment_scratch, utf8_scratch);
+        int width = vita2d_font_text_width(font, size, drawable);
+        display.text(font, x, y, RGBA8(0, 0, 0, 255), size, drawable, width);
+        x += width;
+        offset = segment_end;
+    }
+    return x;
+}
+
+int GPURenderer::draw_justified_line(const StyledText& text, const TextLine& line, int x, int y, int size) {
+    const char* data = text.text.data();
+    uint32_t end = line.offset + line.length;
+    int gaps = static_cast<int>(std::count(data + line.offset, data + end, ' '));
+    
+    // Word by word, each space widened by its share of the slack; the
+    // shares telescope, so the last word ends exactly at the margin
+    int gap = 0;
+    uint32_t offset = line.offset;
+    while (offset < end) {
+        const void* space = std::memchr(data + offset, ' ', end - offset);
+        uint32_t word_end = space ? static_cast<uint32_t>(static_cast<const char*>(space) - data) + 1 : end;
+        x = draw_styled_span(text, offset, word_end, x, y, size);
+        if (space && gaps > 0) {
+            ++gap;
+            x += line.slack * gap / gaps - line.slack * (gap - 1) / gaps;
+        }
+        offset = word_end;
+    }
+    return x;
+}
+
 void GPURenderer::render_menu_item(const std::string& text, int x, int y, bool selected, uint32_t color) {
     if (selected) {
         // Draw selection background
@@ -134,83 +446,124 @@ void GPURenderer::render_progress_bar(int x, int y, int width, int height, float
 }
 
 void GPURenderer::set_clip_rect(int x, int y, int width, int height) {
-    vita2d_enable_clipping();
-    vita2d_set_clip_rectangle(x, y, x + width, y + height);
+    display.set_clip(x, y, width, height);
 }
 
 void GPURenderer::clear_clip_rect() {
-    vita2d_disable_clipping();
+    display.clear_clip();
+}
+
+void GPURenderer::submit_display_list() {
+    if (display.empty()) return;
+    display.submit(*backend);
+    const DisplayList::Stats& submitted = display.stats();
+    stats.commands += submitted.commands;
+    stats.batches += submitted.batches;
+    stats.draw_calls += submitted.draw_calls;
+}
+
+AdvanceTable& GPURenderer::advance_table(int size) {
+    std::lock_guard<std::mutex> lock(advance_mutex);
+    
+    std::unique_ptr<AdvanceTable>& table = advance_tables[std::make_pair(default_font, size)];
+    if (!table) {
+        vita2d_font* font = default_font;
+        table.reset(new AdvanceTable([this, font, size](uint32_t codepoint) {
+            if (!font) return 0;
+            char bytes[5];
+            bytes[Utf8Decoder::encode(codepoint, bytes)] = '\0';
+            std::lock_guard<std::mutex> font_lock(font_mutex);
+            return vita2d_font_text_width(font, size, bytes);
+        }));
+    }
+    return *table;
 }
 
-std::vector<std::string> GPURenderer::wrap_text_to_width(const std::string& text, int max_width, int font_size) {
+std::vector<std::string> GPURenderer::wrap_text_to_width(const std::string& text, int max_width, int font_size,
+                                                        std::vector<size_t>* line_offsets) {
+    std::vector<LineSpan> spans;
+    LineBreaker breaker(advance_table(font_size), max_width, hyphenator());
+    breaker.break_lines(text.data(), text.size(), 0, spans);
+    
     std::vector<std::string> lines;
-    std::string current_line;
-    std::string current_word;
+    lines.reserve(spans.size());
+    for (const LineSpan& span : spans) {
+        lines.push_back(text.substr(span.offset, span.length));
+        if (span.hyphen) lines.back() += '-';
+        if (line_offsets) line_offsets->push_back(span.offset);
+    }
+    return lines;
+}
+
+void GPURenderer::layout_styled_text(const StyledText& text, const LayoutSettings& settings, ChapterLayout& layout) {
+    int max_width = settings.max_width;
+    int font_size = settings.font_size;
+    
+    layout.clear();
+    layout.font_size = font_size;
+    
+    // Estimate the line count so the records usually take one allocation
+    int average_advance = std::max(1, advance_table(font_size).advance('n'));
+    layout.lines.reserve(text.text.size() * average_advance / std::max(1, max_width) + text.blocks.size());
     
-    for (size_t i = 0; i < text.length(); ++i) {
-        char c = text[i];
+    std::vector<LineSpan> spans;
+    int y = 0;
+    for (size_t b = 0; b < text.blocks.size(); ++b) {
+        size_t start = text.blocks[b].offset;
+        size_t end = b + 1 < text.blocks.size() ? text.blocks[b + 1].offset : text.text.size();
         
-        if (c == ' ' || c == '\n' || i == text.length() - 1) {
-            if (i == text.length() - 1 && c != ' ' && c != '\n') {
-                current_word += c;
-            }
-            
-            std::string test_line = current_line.empty() ? current_word : current_line + " " + current_word;
-            int test_width = get_text_width(test_line, font_size);
-            
-            if (test_width <= max_width) {
-                current_line = test_line;
-            } else {
-                if (!current_line.empty()) {
-                    lines.push_back(current_line);
-                    current_line = current_word;
-                } else {
-                    // Handle very long words by breaking them
-                    if (get_text_width(current_word, font_size) > max_width) {
-                        // Break the word character by character
-                        std::string partial_word;
-                        for (char wc : current_word) {
-                            std::string test_partial = partial_word + wc;
-                            if (get_text_width(test_partial, font_size) > max_width) {
-                                if (!partial_word.empty()) {
-                                    lines.push_back(partial_word);
-                                }
-                                partial_word = wc;
-                            } else {
-                                partial_word = test_partial;
-                            }
-                        }
-                        current_line = partial_word;
-                    } else {
-                        lines.push_back(current_word);
-                        current_line.clear();
-                    }
-                }
-            }
-            
-            current_word.clear();
-            
-            if (c == '\n') {
-                lines.push_back(current_line);
-                current_line.clear();
-            }
+        // The '\n' separating blocks is implied by the block boundary
+        while (end > start && (text.text[end - 1] == '\n' || text.text[end - 1] == ' ')) --end;
+        if (end <= start) continue;
+        
+        if (!layout.lines.empty()) {
+            y += line_height(font_size, settings.line_spacing);
+        }
+        
+        uint8_t kind = text.blocks[b].kind;
+        int size = block_font_size(kind, font_size);
+        int height = line_height(size, settings.line_spacing);
+        
+        // Headings stay ragged and whole; a paragraph's last line is never stretched
+        bool justify = settings.justify && kind == BLOCK_PARAGRAPH;
+        bool hyphenate = settings.hyphenate && kind == BLOCK_PARAGRAPH;
+        spans.clear();
+        LineBreaker breaker(advance_table(size), max_width, hyphenate ? hyphenator() : nullptr);
+        if (justify) {
+            breaker.break_optimal(text.text.data() + start, end - start, static_cast<uint32_t>(start), spans);
         } else {
-            current_word += c;
+            breaker.break_lines(text.text.data() + start, end - start, static_cast<uint32_t>(start), spans);
+        }
+        for (const LineSpan& span : spans) {
+            bool stretch = justify && !LineBreaker::ends_paragraph(text.text.data(), end, span);
+            int16_t slack = stretch ? static_cast<int16_t>(max_width - span.width) : 0;
+            TextLine line = { span.offset, span.length, y, 0, slack, kind, static_cast<uint8_t>(height), span.hyphen };
+            layout.lines.push_back(line);
+            y += height;
         }
     }
-    
-    if (!current_line.empty()) {
-        lines.push_back(current_line);
-    }
-    
-    return lines;
+    layout.height = y;
 }
 
 void GPURenderer::cleanup() {
-    if (text_cache_texture) {
-        vita2d_free_texture(text_cache_texture);
-        text_cache_texture = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(advance_mutex);
+        advance_tables.clear();
+    }
+    if (stats.frames > 0) {
+        std::cout << "Page cache: " << stats.page_blits << " blits, " << stats.page_fills << " fills in "
+                  << stats.frames << " frames" << std::endl;
+    }
+    
+    // The GPU may still be sampling the strips
+    vita2d_wait_rendering_done();
+    for (int i = 0; i < PAGE_STRIPS; ++i) {
+        if (page_strips[i]) {
+            vita2d_free_texture(page_strips[i]);
+            page_strips[i] = nullptr;
+        }
     }
+    page_cache.source = nullptr;
     if (default_font) {
         vita2d_free_font(default_font);
         default_font = nullptr;
@@ -0,0 +1,225 @@
+#include "software_canvas.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+    
+// x / 255 rounded, exact for x up to 255 * 255
+inline uint32_t div255(uint32_t x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+    
+// Lerps one pixel toward color, whose alpha byte is taken as 255 so that
+// the alpha channel composites "over" like the others
+inline uint32_t blend(uint32_t pixel, uint32_t color, uint32_t weight) {
+    uint32_t inverse = 255 - weight;
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t source = shift == 24 ? 255 : (color >> shift) & 0xFF;
+        uint32_t target = (pixel >> shift) & 0xFF;
+        result |= div255(source * weight + target * inverse) << shift;
+    }
+    return result;
+}
+    
+} // namespace
+
+SoftwareCanvas::SoftwareCanvas(int width, int height)
+    : canvas_width(width), canvas_height(height), pixels(static_cast<size_t>(width) * height, 0),
+      solid(width, 255) {
+    clear_clip_rect();
+}
+
+void SoftwareCanvas::set_clip_rect(int x, int y, int width, int height) {
+    clip_left = std::max(0, x);
+    clip_top = std::max(0, y);
+    clip_right = std::min(canvas_width, x + width);
+    clip_bottom = std::min(canvas_height, y + height);
+}
+
+void SoftwareCanvas::clear_clip_rect() {
+    clip_left = 0;
+    clip_top = 0;
+    clip_right = canvas_width;
+    clip_bottom = canvas_height;
+}
+
+bool SoftwareCanvas::clip(int& x, int& y, int& width, int& height) const {
+    int right = std::min(clip_right, x + width);
+    int bottom = std::min(clip_bottom, y + height);
+    x = std::max(clip_left, x);
+    y = std::max(clip_top, y);
+    width = right - x;
+    height = bottom - y;
+    return width > 0 && height > 0;
+}
+
+void SoftwareCanvas::clear(uint32_t color) {
+    for (int y = clip_top; y < clip_bottom; ++y) {
+        std::fill(row(y) + clip_left, row(y) + clip_right, color);
+    }
+}
+
+void SoftwareCanvas::fill_rect(int x, int y, int width, int height, uint32_t color) {
+    if (!clip(x, y, width, height)) return;
+    
+    bool opaque = (color >> 24) == 0xFF;
+    for (int line = y; line < y + height; ++line) {
+        if (opaque) {
+            std::fill(row(line) + x, row(line) + x + width, color);
+        } else {
+            blend_span(row(line) + x, solid.data(), width, color);
+        }
+    }
+}
+
+void SoftwareCanvas::draw_line(int x1, int y1, int x2, int y2, uint32_t color) {
+    // Bresenham, both ends included
+    int dx = std::abs(x2 - x1);
+    int dy = -std::abs(y2 - y1);
+    int step_x = x1 < x2 ? 1 : -1;
+    int step_y = y1 < y2 ? 1 : -1;
+    int error = dx + dy;
+    for (;;) {
+        blend_pixel(x1, y1, color);
+        if (x1 == x2 && y1 == y2) break;
+        int twice = 2 * error;
+        if (twice >= dy) {
+            error += dy;
+            x1 += step_x;
+        }
+        if (twice <= dx) {
+            error += dx;
+            y1 += step_y;
+        }
+    }
+}
+
+void SoftwareCanvas::blend_pixel(int x, int y, uint32_t color) {
+    if (x < clip_left || x >= clip_right || y < clip_top || y >= clip_bottom) return;
+    uint32_t& pixel = row(y)[x];
+    pixel = blend(pixel, color, color >> 24);
+}
+
+void SoftwareCanvas::blend_mask(const uint8_t* coverage, int pitch, int x, int y, int width, int height, uint32_t color) {
+    int left = x;
+    int top = y;
+    if (!clip(x, y, width, height)) return;
+    
+    coverage += (y - top) * pitch + (x - left);
+    for (int line = 0; line < height; ++line) {
+        blend_span(row(y + line) + x, coverage + line * pitch, width, color);
+    }
+}
+
+void SoftwareCanvas::blend_span_scalar(uint32_t* pixels, const uint8_t* coverage, size_t count, uint32_t color) {
+    uint32_t alpha = color >> 24;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t weight = div255(coverage[i] * alpha);
+        if (weight == 255) {
+            pixels[i] = color | 0xFF000000u;
+        } else if (weight != 0) {
+            pixels[i] = blend(pixels[i], color, weight);
+        }
+    }
+}
+
+void SoftwareCanvas::blend_span(uint32_t* pixels, const uint8_t* coverage, size_t count, uint32_t color) {
+    size_t i = 0;
+    
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    // Eight pixels per step, split into channel planes
+    uint8x8_t alpha = vdup_n_u8(static_cast<uint8_t>(color >> 24));
+    uint8x8_t source[4] = {vdup_n_u8(color & 0xFF), vdup_n_u8((color >> 8) & 0xFF),
+                           vdup_n_u8((color >> 16) & 0xFF), vdup_n_u8(0xFF)};
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t scaled = vmull_u8(vld1_u8(coverage + i), alpha);
+        uint8x8_t weight = vraddhn_u16(scaled, vrshrq_n_u16(scaled, 8));
+        uint8x8_t inverse = vmvn_u8(weight);
+        
+        uint8_t* bytes = reinterpret_cast<uint8_t*>(pixels + i);
+        uint8x8x4_t target = vld4_u8(bytes);
+        for (int c = 0; c < 4; ++c) {
+            uint16x8_t sum = vmlal_u8(vmull_u8(source[c], weight), target.val[c], inverse);
+            target.val[c] = vraddhn_u16(sum, vrshrq_n_u16(sum, 8));
+        }
+        vst4_u8(bytes, target);
+    }
+#elif defined(__SSE2__)
+    // Four pixels per step, as two pairs widened to 16 bits per channel
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i alpha = _mm_set1_epi16(static_cast<short>(color >> 24));
+    const __m128i source = _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(color | 0xFF000000u)), zero);
+    for (; i + 4 <= count; i += 4) {
+        uint32_t mask;
+        std::memcpy(&mask, coverage + i, sizeof(mask));
+        if (mask == 0) continue;
+        
+        // Each pixel's weight in all four of its 16-bit lanes
+        __m128i weights = _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(mask)), zero);
+        weights = _mm_add_epi16(_mm_mullo_epi16(weights, alpha), bias);
+        weights = _mm_srli_epi16(_mm_add_epi16(weights, _mm_srli_epi16(weights, 8)), 8);
+        weights = _mm_unpacklo_epi16(weights, weights);
+        __m128i low_weight = _mm_unpacklo_epi32(weights, weights);
+        __m128i high_weight = _mm_unpackhi_epi32(weights, weights);
+        
+        __m128i target = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+        __m128i halves[2] = {_mm_unpacklo_epi8(target, zero), _mm_unpackhi_epi8(target, zero)};
+        __m128i half_weights[2] = {low_weight, high_weight};
+        for (int h = 0; h < 2; ++h) {
+            __m128i sum = _mm_add_epi16(_mm_mullo_epi16(source, half_weights[h]),
+                                        _mm_mullo_epi16(halves[h], _mm_sub_epi16(full, half_weights[h])));
+            sum = _mm_add_epi16(sum, bias);
+            halves[h] = _mm_srli_epi16(_mm_add_epi16(sum, _mm_srli_epi16(sum, 8)), 8);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i), _mm_packus_epi16(halves[0], halves[1]));
+    }
+#endif
+    
+    blend_span_scalar(pixels + i, coverage + i, count - i, color);
+}
+
+bool SoftwareCanvas::write_ppm(const std::string& path) const {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+    
+    std::fprintf(file, "P6\n%d %d\n255\n", canvas_width, canvas_height);
+    std::vector<uint8_t> line(static_cast<size_t>(canvas_width) * 3);
+    for (int y = 0; y < canvas_height; ++y) {
+        const uint32_t* source = row(y);
+        for (int x = 0; x < canvas_width; ++x) {
+            line[x * 3] = source[x] & 0xFF;
+            line[x * 3 + 1] = (source[x] >> 8) & 0xFF;
+            line[x * 3 + 2] = (source[x] >> 16) & 0xFF;
+        }
+        std::fwrite(line.data(), 1, line.size(), file);
+    }
+    bool written = !std::ferror(file);
+    std::fclose(file);
+    return written;
+}
+
+uint64_t SoftwareCanvas::checksum() const {
+    uint64_t value = 14695981039346656037ull;
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(pixels.data());
+    for (size_t i = 0; i < pixels.size() * sizeof(uint32_t); ++i) {
+        value ^= bytes[i];
+        value *= 1099511628211ull;
+    }
+    return value;
+}
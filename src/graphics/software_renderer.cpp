@@ -0,0 +1,244 @@
+#include "software_renderer.h"
+#include "utf8.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+const uint32_t SoftwareRenderer::BLACK;
+const uint32_t SoftwareRenderer::WHITE;
+
+SoftwareRenderer::SoftwareRenderer(int width, int height) : target(width, height), library(nullptr) {
+    for (int i = 0; i < FACE_COUNT; ++i) {
+        faces[i] = nullptr;
+        face_sizes[i] = 0;
+    }
+}
+
+SoftwareRenderer::~SoftwareRenderer() {
+    for (int i = FACE_COUNT - 1; i >= 0; --i) {
+        if (faces[i] && (i == REGULAR || faces[i] != faces[REGULAR])) {
+            FT_Done_Face(faces[i]);
+        }
+    }
+    if (library) {
+        FT_Done_FreeType(library);
+    }
+}
+
+bool SoftwareRenderer::initialize(const std::string& font_path, const std::string& bold_path,
+                                  const std::string& italic_path) {
+    if (FT_Init_FreeType(&library)) {
+        library = nullptr;
+        return false;
+    }
+    if (FT_New_Face(library, font_path.c_str(), 0, &faces[REGULAR])) {
+        std::cerr << "Failed to load font " << font_path << std::endl;
+        faces[REGULAR] = nullptr;
+        return false;
+    }
+    
+    // Optional variants; styled text falls back to the regular face
+    const std::string* paths[FACE_COUNT] = {&font_path, &bold_path, &italic_path};
+    for (int i = BOLD; i < FACE_COUNT; ++i) {
+        if (paths[i]->empty() || FT_New_Face(library, paths[i]->c_str(), 0, &faces[i])) {
+            faces[i] = faces[REGULAR];
+        }
+    }
+    return true;
+}
+
+void SoftwareRenderer::set_size(Face face, int size) {
+    // A missing style shares the regular face, and its size
+    Face owner = faces[face] == faces[REGULAR] ? REGULAR : face;
+    if (face_sizes[owner] != size) {
+        FT_Set_Pixel_Sizes(faces[owner], 0, size);
+        face_sizes[owner] = size;
+    }
+}
+
+const CachedGlyph* SoftwareRenderer::glyph(Face face, int size, uint32_t codepoint) {
+    const CachedGlyph* cached = glyphs.find(static_cast<uint16_t>(face), static_cast<uint16_t>(size), codepoint);
+    if (cached) return cached;
+    
+    set_size(face, size);
+    if (FT_Load_Char(faces[face], codepoint, FT_LOAD_RENDER)) return nullptr;
+    FT_GlyphSlot slot = faces[face]->glyph;
+    auto insert = [&]() {
+        return glyphs.insert(static_cast<uint16_t>(face), static_cast<uint16_t>(size), codepoint, slot->bitmap.buffer,
+                             slot->bitmap.width, slot->bitmap.rows, slot->bitmap.pitch,
+                             slot->bitmap_left, slot->bitmap_top, slot->advance.x >> 6);
+    };
+    const CachedGlyph* inserted = insert();
+    if (!inserted) {
+        // Glyphs are blended as soon as they are found, so once this batch
+        // has pinned every glyph none of them needs its room any more
+        glyphs.begin_batch();
+        inserted = insert();
+    }
+    return inserted;
+}
+
+AdvanceTable& SoftwareRenderer::advance_table(int size) {
+    std::unique_ptr<AdvanceTable>& table = advance_tables[size];
+    if (!table) {
+        table.reset(new AdvanceTable([this, size](uint32_t codepoint) {
+            // Advances only; rendering the bitmap here would churn the glyph cache
+            if (!faces[REGULAR]) return 0;
+            set_size(REGULAR, size);
+            return FT_Load_Char(faces[REGULAR], codepoint, FT_LOAD_DEFAULT) ? 0 :
+                   static_cast<int>(faces[REGULAR]->glyph->advance.x >> 6);
+        }));
+    }
+    return *table;
+}
+
+int SoftwareRenderer::draw_text(Face face, const char* text, size_t length, int x, int y, uint32_t color, int size) {
+    // Glyphs drawn by this call may not be evicted for the ones after them
+    glyphs.begin_batch();
+    GlyphAtlas& atlas = glyphs.atlas();
+    Utf8Decoder decoder(text, length);
+    while (!decoder.done()) {
+        const CachedGlyph* cached = glyph(face, size, decoder.next());
+        if (!cached) continue;
+        const AtlasRegion& region = cached->region;
+        if (region.width != 0) {
+            const uint8_t* coverage = atlas.page_pixels(region.page) + region.y * GlyphAtlas::PAGE_SIZE + region.x;
+            target.blend_mask(coverage, GlyphAtlas::PAGE_SIZE, x + cached->left, y - cached->top,
+                              region.width, region.height, color);
+        }
+        x += cached->advance_x;
+    }
+    return x;
+}
+
+void SoftwareRenderer::render_text_gpu(const std::string& text, int x, int y, uint32_t color, int size) {
+    if (!faces[REGULAR]) return;
+    draw_text(REGULAR, text.data(), text.size(), x, y, color, size);
+}
+
+int SoftwareRenderer::get_text_width(const std::string& text, int size) {
+    if (!faces[REGULAR]) return 0;
+    return advance_table(size).measure(text.data(), text.size());
+}
+
+int SoftwareRenderer::get_text_height(int size) {
+    if (!faces[REGULAR]) return size;
+    set_size(REGULAR, size);
+    const FT_Size_Metrics& metrics = faces[REGULAR]->size->metrics;
+    return static_cast<int>((metrics.ascender - metrics.descender) >> 6);
+}
+
+void SoftwareRenderer::render_rectangle_outline(int x, int y, int width, int height, uint32_t color, int thickness) {
+    target.fill_rect(x, y, width, thickness, color);                       // Top
+    target.fill_rect(x, y + height - thickness, width, thickness, color);  // Bottom
+    target.fill_rect(x, y, thickness, height, color);                      // Left
+    target.fill_rect(x + width - thickness, y, thickness, height, color);  // Right
+}
+
+void SoftwareRenderer::render_menu_item(const std::string& text, int x, int y, bool selected, uint32_t color) {
+    if (selected) {
+        int text_width = get_text_width(text, 20);
+        int text_height = get_text_height(20);
+        target.fill_rect(x - 10, y - 5, text_width + 20, text_height + 10, 0x64FF9664u); // RGBA8(100, 150, 255, 100)
+    }
+    render_text_gpu(text, x, y, color, 20);
+}
+
+void SoftwareRenderer::render_progress_bar(int x, int y, int width, int height, float progress, uint32_t fg_color,
+                                           uint32_t bg_color) {
+    progress = std::max(0.0f, std::min(1.0f, progress));
+    target.fill_rect(x, y, width, height, bg_color);
+    int progress_width = static_cast<int>(width * progress);
+    if (progress_width > 0) {
+        target.fill_rect(x, y, progress_width, height, fg_color);
+    }
+    render_rectangle_outline(x, y, width, height, BLACK, 1);
+}
+
+void SoftwareRenderer::render_cached_page(const std::vector<std::string>& lines, int scroll_offset, size_t first_line,
+                                          int font_size, int line_height) {
+    if (!faces[REGULAR]) return;
+    
+    int margin_x = 50;
+    int margin_y = 50;
+    
+    int first_y = margin_y - scroll_offset + static_cast<int>(first_line) * line_height;
+    size_t skip = first_y < -line_height ? static_cast<size_t>((-line_height - first_y) / line_height) : 0;
+    int y_pos = first_y + static_cast<int>(skip) * line_height;
+    for (size_t i = skip; i < lines.size() && y_pos < target.height() + line_height; ++i) {
+        draw_text(REGULAR, lines[i].data(), lines[i].size(), margin_x, y_pos, BLACK, font_size);
+        y_pos += line_height;
+    }
+}
+
+SoftwareRenderer::Face SoftwareRenderer::face_for_style(const TextStyle& style) const {
+    if ((style.flags & STYLE_ITALIC) && faces[ITALIC] != faces[REGULAR]) return ITALIC;
+    if ((style.flags & STYLE_BOLD) || style.heading) return BOLD;
+    return REGULAR;
+}
+
+void SoftwareRenderer::render_chapter_layout(const StyledText& text, const ChapterLayout& layout, int scroll_offset) {
+    if (!faces[REGULAR]) return;
+    
+    int margin_x = 50;
+    int margin_y = 50;
+    
+    for (size_t i = layout.line_at_y(scroll_offset - margin_y); i < layout.lines.size(); ++i) {
+        const TextLine& line = layout.lines[i];
+        int y_pos = margin_y - scroll_offset + line.y;
+        if (y_pos > target.height() + line.height) break;
+        if (line.length == 0) continue;
+        
+        int size = ChapterLayout::block_font_size(line.block_kind, layout.font_size);
+        int x = margin_x + line.x;
+        if (line.slack != 0) {
+            x = draw_justified_line(text, line, x, y_pos, size);
+        } else {
+            x = draw_styled_span(text, line.offset, line.offset + line.length, x, y_pos, size);
+        }
+        if (line.hyphen) {
+            Face face = text.runs.empty() ? REGULAR :
+                        face_for_style(text.style(text.runs[text.run_at(line.offset + line.length - 1)].style));
+            draw_text(face, "-", 1, x, y_pos, BLACK, size);
+        }
+    }
+}
+
+int SoftwareRenderer::draw_styled_span(const StyledText& text, uint32_t offset, uint32_t end, int x, int y, int size) {
+    if (text.runs.empty()) {
+        return draw_text(REGULAR, text.text.data() + offset, end - offset, x, y, BLACK, size);
+    }
+    
+    // Draw one segment per style run crossing the span
+    for (size_t r = text.run_at(offset); r < text.runs.size() && offset < end; ++r) {
+        const StyledText::Run& run = text.runs[r];
+        uint32_t segment_end = std::min<uint32_t>(end, run.offset + run.length);
+        if (segment_end <= offset) continue;
+        
+        x = draw_text(face_for_style(text.style(run.style)), text.text.data() + offset, segment_end - offset,
+                      x, y, BLACK, size);
+        offset = segment_end;
+    }
+    return x;
+}
+
+int SoftwareRenderer::draw_justified_line(const StyledText& text, const TextLine& line, int x, int y, int size) {
+    const char* data = text.text.data();
+    uint32_t end = line.offset + line.length;
+    int gaps = static_cast<int>(std::count(data + line.offset, data + end, ' '));
+    
+    // Word by word, each space widened by its share of the slack
+    int gap = 0;
+    uint32_t offset = line.offset;
+    while (offset < end) {
+        const void* space = std::memchr(data + offset, ' ', end - offset);
+        uint32_t word_end = space ? static_cast<uint32_t>(static_cast<const char*>(space) - data) + 1 : end;
+        x = draw_styled_span(text, offset, word_end, x, y, size);
+        if (space && gaps > 0) {
+            ++gap;
+            x += line.slack * gap / gaps - line.slack * (gap - 1) / gaps;
+        }
+        offset = word_end;
+    }
+    return x;
+}
@@ -0,0 +1,270 @@
+#include "tile_ring.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iostream>
+
+const int TileRing::TILE_WIDTH;
+const int TileRing::TILE_HEIGHT;
+const int TileRing::TILE_COUNT;
+const int TileRing::VIEW_HEIGHT;
+const int TileRing::RECYCLE_FRAMES;
+
+TileRing::TileRing()
+    : renderer(TILE_WIDTH, TILE_HEIGHT), ready(false), text(nullptr), layout(nullptr), font_size(0), line_height(0),
+      frame(RECYCLE_FRAMES), in_flight(-1), quit(false) {
+    for (Slot& slot : slots) {
+        slot.texture = nullptr;
+        slot.tile = INT_MIN;
+        slot.state = SLOT_EMPTY;
+        slot.last_drawn = 0;
+        slot.first_line = 0;
+    }
+}
+
+TileRing::~TileRing() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+        queue.clear();
+    }
+    wake.notify_all();
+    
+    if (worker.joinable()) {
+        worker.join();
+    }
+    
+    // The GPU may still be sampling the tiles
+    if (ready) {
+        vita2d_wait_rendering_done();
+    }
+    for (Slot& slot : slots) {
+        if (slot.texture) {
+            vita2d_free_texture(slot.texture);
+        }
+    }
+}
+
+bool TileRing::initialize(const std::string& font_path, const std::string& bold_path, const std::string& italic_path) {
+    if (!renderer.initialize(font_path, bold_path, italic_path)) {
+        std::cerr << "Smooth scrolling tiles disabled: no font" << std::endl;
+        return false;
+    }
+    
+    for (Slot& slot : slots) {
+        slot.texture = vita2d_create_empty_texture_format(TILE_WIDTH, TILE_HEIGHT, SCE_GXM_TEXTURE_FORMAT_A8B8G8R8);
+        if (!slot.texture) {
+            std::cerr << "Smooth scrolling tiles disabled: failed to create tile texture" << std::endl;
+            return false;
+        }
+    }
+    ready = true;
+    return true;
+}
+
+void TileRing::set_layout(const StyledText& styled, const ChapterLayout& chapter) {
+    clear();
+    text = &styled;
+    layout = &chapter;
+    font_size = chapter.font_size;
+}
+
+void TileRing::set_stream(int size, int height) {
+    clear();
+    font_size = size;
+    line_height = height;
+}
+
+void TileRing::clear() {
+    std::unique_lock<std::mutex> lock(mutex);
+    
+    queue.clear();
+    while (in_flight != -1) {
+        idle.wait(lock);
+    }
+    forget_tiles();
+    text = nullptr;
+    layout = nullptr;
+    font_size = 0;
+    line_height = 0;
+}
+
+void TileRing::forget_tiles() {
+    for (Slot& slot : slots) {
+        slot.tile = INT_MIN;
+        slot.state = SLOT_EMPTY;
+        slot.lines.clear();
+    }
+}
+
+void TileRing::update(int scroll_offset, int direction) {
+    if (!layout) return;
+    queue_tiles(scroll_offset, direction, nullptr, 0, true);
+}
+
+void TileRing::update(int scroll_offset, int direction, const std::vector<std::string>& window, size_t first_line,
+                      bool window_final) {
+    if (layout || line_height <= 0) return;
+    queue_tiles(scroll_offset, direction, &window, first_line, window_final);
+}
+
+int TileRing::tile_at(int row) {
+    return row >= 0 ? row / TILE_HEIGHT : -((TILE_HEIGHT - 1 - row) / TILE_HEIGHT);
+}
+
+void TileRing::wanted_tiles(int scroll_offset, int direction, std::vector<int>& tiles) const {
+    int first = tile_at(scroll_offset);
+    int last = tile_at(scroll_offset + VIEW_HEIGHT - 1);
+    for (int tile = first; tile <= last; ++tile) {
+        tiles.push_back(tile);
+    }
+    
+    // One tile stays behind a scroll and the rest go ahead of it; a still
+    // view gets both sides alike. Nothing is kept above the chapter.
+    int spare = TILE_COUNT - (last - first + 1);
+    int above = direction > 0 ? 1 : direction < 0 ? spare - 1 : spare / 2;
+    above = std::max(0, std::min(above, first));
+    int below = spare - above;
+    
+    for (int distance = 1; distance <= std::max(above, below); ++distance) {
+        if (distance <= below) tiles.push_back(last + distance);
+        if (distance <= above) tiles.push_back(first - distance);
+    }
+    
+    // Nearest first, but everything ahead of a scroll before what is behind it
+    if (direction != 0) {
+        std::stable_partition(tiles.begin() + (last - first + 1), tiles.end(),
+                              [&](int tile) { return direction > 0 ? tile > last : tile < first; });
+    }
+}
+
+void TileRing::queue_tiles(int scroll_offset, int direction, const std::vector<std::string>* window,
+                           size_t first_line, bool window_final) {
+    if (!ready) return;
+    ++frame;
+    
+    std::vector<int> tiles;
+    tiles.reserve(TILE_COUNT);
+    wanted_tiles(scroll_offset, direction, tiles);
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        queue.clear();
+        for (int tile : tiles) {
+            int index = slot_for(tile);
+            Slot& slot = slots[index];
+            if (slot.tile == tile && slot.state != SLOT_EMPTY) {
+                if (slot.state == SLOT_QUEUED) queue.push_back(index);
+                continue;
+            }
+            
+            // The slot must finish its tile, and the GPU must be done with it
+            if (slot.state == SLOT_DRAWING || frame - slot.last_drawn < static_cast<uint32_t>(RECYCLE_FRAMES)) {
+                continue;
+            }
+            
+            if (window) {
+                // Every line that could reach into the tile: a line drawn at
+                // most a line above it, as far as one below, less the margin
+                int top = (tile - 1) * TILE_HEIGHT;
+                int bottom = (tile + 1) * TILE_HEIGHT;
+                size_t from = top > 0 ? static_cast<size_t>(top / line_height) : 0;
+                size_t to = bottom > 0 ? static_cast<size_t>(bottom / line_height) + 2 : 0;
+                size_t window_end = first_line + window->size();
+                if (from < first_line || (to > window_end && !window_final)) continue;
+                
+                to = std::min(to, window_end);
+                slot.first_line = from;
+                slot.lines.clear();
+                if (from < to) {
+                    slot.lines.assign(window->begin() + (from - first_line), window->begin() + (to - first_line));
+                }
+            }
+            slot.tile = tile;
+            slot.state = SLOT_QUEUED;
+            queue.push_back(index);
+        }
+        
+        if (queue.empty()) return;
+        
+        // Started lazily so books read page by page with no tiles cost no thread
+        if (!worker.joinable()) {
+            worker = std::thread(&TileRing::run, this);
+        }
+    }
+    wake.notify_one();
+}
+
+bool TileRing::draw(int scroll_offset, DisplayList& list) {
+    if (!ready) return false;
+    
+    int first = tile_at(scroll_offset);
+    int last = tile_at(scroll_offset + VIEW_HEIGHT - 1);
+    {
+        // The worker only changes the slot it draws, never a ready one
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int tile = first; tile <= last; ++tile) {
+            const Slot& slot = slots[slot_for(tile)];
+            if (slot.tile != tile || slot.state != SLOT_READY) return false;
+        }
+    }
+    
+    for (int tile = first; tile <= last; ++tile) {
+        Slot& slot = slots[slot_for(tile)];
+        int y = tile * TILE_HEIGHT - scroll_offset;
+        int skip = std::max(0, -y);
+        int height = std::min(TILE_HEIGHT, VIEW_HEIGHT - y) - skip;
+        list.texture_part(slot.texture, vita2d_texture_get_width(slot.texture), vita2d_texture_get_height(slot.texture),
+                          0, y + skip, 0, skip, TILE_WIDTH, height);
+        slot.last_drawn = frame;
+    }
+    return true;
+}
+
+void TileRing::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    
+    for (;;) {
+        while (!quit && queue.empty()) {
+            wake.wait(lock);
+        }
+        if (quit) break;
+        
+        int index = queue.front();
+        queue.pop_front();
+        Slot& slot = slots[index];
+        if (slot.state != SLOT_QUEUED) continue;
+        
+        // update() and clear() leave a drawing slot alone
+        slot.state = SLOT_DRAWING;
+        in_flight = index;
+        lock.unlock();
+        
+        draw_tile(slot);
+        
+        lock.lock();
+        slot.state = SLOT_READY;
+        in_flight = -1;
+        idle.notify_all();
+    }
+}
+
+void TileRing::draw_tile(Slot& slot) {
+    SoftwareCanvas& canvas = renderer.canvas();
+    canvas.clear(SoftwareRenderer::WHITE);
+    
+    int scroll_offset = slot.tile * TILE_HEIGHT;
+    if (layout) {
+        renderer.render_chapter_layout(*text, *layout, scroll_offset);
+    } else {
+        renderer.render_cached_page(slot.lines, scroll_offset, slot.first_line, font_size, line_height);
+    }
+    
+    // Canvas rows are in the texture's byte order already
+    uint8_t* pixels = static_cast<uint8_t*>(vita2d_texture_get_datap(slot.texture));
+    unsigned int stride = vita2d_texture_get_stride(slot.texture);
+    for (int y = 0; y < TILE_HEIGHT; ++y) {
+        std::memcpy(pixels + static_cast<size_t>(y) * stride, canvas.row(y), TILE_WIDTH * sizeof(uint32_t));
+    }
+}
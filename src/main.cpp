@@ -3,6 +3,7 @@
 #include <psp2/touch.h>
 #include <psp2/sysmodule.h>
 #include <vita2d.h>
+#include <chrono>
 #include <iostream>
 
 // Include all our components
@@ -41,15 +42,27 @@ private:
         DOWNLOADING,
         SETTINGS
     } current_state;
+    AppState settings_return_state;     // Settings opens from the menu or the reader
+    AppState drawn_state;               // State of the frame on screen
+    bool drawn_any;
     
     uint32_t last_buttons;
     
+    // Frames are only drawn when the screen would change; input is polled
+    // every period either way
+    struct LoopStats {
+        uint32_t rendered;
+        uint32_t skipped;
+        uint32_t inputs;                // Button changes answered with a frame
+        double latency_ms_total;        // From the poll that saw them to the buffer swap
+        double latency_ms_max;
+    } loop_stats;
+    
+    static const int FRAME_PERIOD_US = 16667;
+    
 public:
-    EPUBReaderApp() : current_state(MAIN_MENU), last_buttons(0) {
-        main_menu = nullptr;
-        book_list = nullptr;
-        book_reader = nullptr;
-        settings_menu = nullptr;
+    EPUBReaderApp() : current_state(MAIN_MENU), settings_return_state(MAIN_MENU), drawn_state(MAIN_MENU),
+                      drawn_any(false), last_buttons(0), loop_stats() {
     }
     
     bool initialize() {
@@ -70,6 +83,9 @@ public:
             return false;
         }
         
+        // The left stick scrolls the reader
+        sceCtrlSetSamplingMode(SCE_CTRL_MODE_ANALOG);
+        
         if (!gpu_renderer.initialize()) {
             std::cerr << "Failed to initialize GPU renderer" << std::endl;
             return false;
@@ -100,10 +116,13 @@ public:
     void main_loop() {
         std::cout << "Starting main loop..." << std::endl;
         
+        std::chrono::steady_clock::time_point next_frame = std::chrono::steady_clock::now();
         while (true) {
             // Read input
             SceCtrlData ctrl;
             sceCtrlPeekBufferPositive(0, &ctrl, 1);
+            std::chrono::steady_clock::time_point polled = std::chrono::steady_clock::now();
+            bool input = ctrl.buttons != last_buttons;
             
             // Check for global exit
             if (ctrl.buttons & SCE_CTRL_START) {
@@ -130,16 +149,40 @@ public:
                     break;
             }
             
-            // Render current state
-            gpu_renderer.begin_frame();
-            render_current_state();
-            gpu_renderer.end_frame();
+            // Render current state, unless the last frame still shows it
+            if (needs_render()) {
+                gpu_renderer.begin_frame();
+                render_current_state();
+                gpu_renderer.end_frame();
+                drawn_state = current_state;
+                drawn_any = true;
+                ++loop_stats.rendered;
+                
+                if (input) {
+                    double latency_ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - polled).count();
+                    ++loop_stats.inputs;
+                    loop_stats.latency_ms_total += latency_ms;
+                    loop_stats.latency_ms_max = std::max(loop_stats.latency_ms_max, latency_ms);
+                }
+            } else {
+                ++loop_stats.skipped;
+            }
             
             // Update last buttons state
             last_buttons = ctrl.buttons;
             
-            // ~60 FPS
-            sceKernelDelayThread(16667);
+            // ~60 FPS: sleep what is left of the period. A late frame starts
+            // the next one at once, and a frame more than a period late
+            // restarts the schedule instead of rushing to catch up.
+            next_frame += std::chrono::microseconds(FRAME_PERIOD_US);
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (next_frame > now) {
+                sceKernelDelayThread(static_cast<unsigned int>(
+                    std::chrono::duration_cast<std::chrono::microseconds>(next_frame - now).count()));
+            } else if (now - next_frame > std::chrono::microseconds(FRAME_PERIOD_US)) {
+                next_frame = now;
+            }
         }
     }
     
@@ -156,6 +199,7 @@ private:
                 current_state = DOWNLOADING;
                 break;
             case MainMenu::MENU_SETTINGS:
+                settings_return_state = MAIN_MENU;
                 current_state = SETTINGS;
                 break;
             case MainMenu::MENU_EXIT:
@@ -176,7 +220,9 @@ private:
             case BookList::BOOKLIST_OPEN_BOOK: {
                 std::string book_path = book_list->get_selected_book_path();
                 if (!book_path.empty() && epub_parser.open_epub(book_path)) {
-                    book_reader->load_chapter(0);
+                    book_reader->apply_settings(settings_menu->get_layout_settings());
+                    book_reader->set_scrolling(settings_menu->get_auto_scroll(), settings_menu->get_scroll_speed());
+                    book_reader->open_book(book_path);
                     current_state = READING;
                 } else {
                     std::cerr << "Failed to open EPUB file: " << book_path << std::endl;
@@ -193,9 +239,14 @@ private:
         
         switch (result) {
             case BookReader::READER_BACK_TO_MENU:
+                book_reader->close_book();
                 epub_parser.close();
                 current_state = BOOK_LIST;
                 break;
+            case BookReader::READER_OPEN_SETTINGS:
+                settings_return_state = READING;
+                current_state = SETTINGS;
+                break;
             case BookReader::READER_CONTINUE:
                 break;
             default:
@@ -215,13 +266,36 @@ private:
         
         switch (result) {
             case SettingsMenu::SETTINGS_BACK:
-                current_state = MAIN_MENU;
+                // The open book re-flows on the way back
+                if (settings_return_state == READING) {
+                    book_reader->apply_settings(settings_menu->get_layout_settings());
+                    book_reader->set_scrolling(settings_menu->get_auto_scroll(), settings_menu->get_scroll_speed());
+                }
+                current_state = settings_return_state;
                 break;
             case SettingsMenu::SETTINGS_CONTINUE:
                 break;
         }
     }
     
+    bool needs_render() const {
+        if (!drawn_any || current_state != drawn_state) return true;
+        
+        switch (current_state) {
+            case MAIN_MENU:
+                return main_menu->needs_render();
+            case BOOK_LIST:
+                return book_list->needs_render();
+            case READING:
+                return book_reader->needs_render();
+            case DOWNLOADING:
+                return false;
+            case SETTINGS:
+                return settings_menu->needs_render();
+        }
+        return true;
+    }
+    
     void render_current_state() {
         switch (current_state) {
             case MAIN_MENU:
@@ -251,23 +325,36 @@ private:
 public:
     void cleanup() {
         std::cout << "Cleaning up EPUB Reader..." << std::endl;
+        std::cout << "Frames: " << loop_stats.rendered << " rendered, " << loop_stats.skipped << " skipped; input to swap "
+                  << (loop_stats.inputs ? loop_stats.latency_ms_total / loop_stats.inputs : 0.0) << " ms avg, "
+                  << loop_stats.latency_ms_max << " ms max over " << loop_stats.inputs << " inputs" << std::endl;
         
+        if (book_reader) {
+            book_reader->close_book();
+        }
         epub_parser.close();
-        text_renderer.clear_cache();
-        downloader.cleanup();
-        gpu_renderer.cleanup();
-        memory_manager.cleanup();
         
-        // Clean up UI components
+        // UI components hold textures, so they go before the renderer
         delete main_menu;
         delete book_list;
         delete book_reader;
         delete settings_menu;
+        main_menu = nullptr;
+        book_list = nullptr;
+        book_reader = nullptr;
+        settings_menu = nullptr;
+        
+        text_renderer.clear_cache();
+        downloader.cleanup();
+        gpu_renderer.cleanup();
+        memory_manager.cleanup();
         
         std::cout << "Cleanup complete" << std::endl;
     }
 };
 
+const int EPUBReaderApp::FRAME_PERIOD_US;
+
 int main() {
     std::cout << "PlayStation Vita EPUB Reader starting..." << std::endl;
     
@@ -8,6 +8,7 @@ private:
     int selected_item;
     std::vector<std::string> menu_items;
     GPURenderer* renderer;
+    bool dirty;                         // Changed since the last render
     
 public:
     enum MenuResult {
@@ -18,7 +19,7 @@ public:
         MENU_EXIT
     };
     
-    MainMenu(GPURenderer* gpu_renderer) : selected_item(0), renderer(gpu_renderer) {
+    MainMenu(GPURenderer* gpu_renderer) : selected_item(0), renderer(gpu_renderer), dirty(true) {
         menu_items = {
             "Read Books",
             "Download Books",
@@ -31,9 +32,11 @@ public:
         // Menu navigation
         if ((ctrl.buttons & SCE_CTRL_UP) && !(last_buttons & SCE_CTRL_UP)) {
             selected_item = (selected_item - 1 + menu_items.size()) % menu_items.size();
+            dirty = true;
         }
         if ((ctrl.buttons & SCE_CTRL_DOWN) && !(last_buttons & SCE_CTRL_DOWN)) {
             selected_item = (selected_item + 1) % menu_items.size();
+            dirty = true;
         }
         
         // Menu selection
@@ -49,7 +52,11 @@ public:
         return MENU_CONTINUE;
     }
     
+    bool needs_render() const { return dirty; }
+    
     void render() {
+        dirty = false;
+        
         // Render title
         renderer->render_text_gpu("EPUB Reader", 100, 80, RGBA8(0, 0, 0, 255), 32);
         
@@ -1,54 +1,237 @@
 #include <psp2/ctrl.h>
 #include "gpu_renderer.h"
 #include "epub_parser.h"
+#include "chapter_stream.h"
+#include "content_model.h"
+#include "chapter_prefetcher.h"
+#include "paginator.h"
+#include "tile_ring.h"
+#include <chrono>
+#include <climits>
+#include <cstdlib>
 #include <vector>
 #include <string>
 #include <algorithm>
 
 class BookReader {
+public:
+    // Chapter switch latency, split by whether the prefetcher had it ready,
+    // and how long a settings change took to show its first page
+    struct Stats {
+        unsigned prefetch_hits;
+        unsigned prefetch_misses;
+        double hit_ms_total;
+        double miss_ms_total;
+        unsigned relayouts;
+        double relayout_ms_total;
+        double last_relayout_ms;
+    };
+    
 private:
     GPURenderer* renderer;
     EPUBParser* epub_parser;
-    std::vector<std::string> current_page_lines;
-    int current_chapter;
+    std::string book_path;                  // Empty while no book is open
+    LayoutSettings settings;
+    BookContent content;
+    ChapterPrefetcher prefetcher;
+    Paginator paginator;
+    ChapterStream chapter_stream;
+    ChapterLayout layout;                   // Spans over current_document's text
+    TileRing tiles;                         // Pre-rendered view for smooth scrolling
+    std::vector<size_t> page_first_lines;   // Pages of the current layout
+    const BookContent::Document* current_document;
+    int current_spine;
     int scroll_offset;
     int max_scroll;
     bool show_ui;
+    bool streaming;
+    
+    // Smooth scrolling, from the left stick and the auto-scroll setting
+    bool auto_scroll;
+    int scroll_speed;                       // 1 to 10, as in the settings menu
+    float scroll_remainder;                 // Sub-pixel part of the scroll
+    int scroll_direction;                   // Sign of the latest scroll, for the tiles
+    std::chrono::steady_clock::time_point last_update;
+    
+    // Text offset the view was last placed at, valid while scroll_offset is
+    // still anchor_scroll. Relayouts keep it, so repeated setting changes
+    // return to the same text instead of drifting to page starts.
+    uint32_t anchor_offset;
+    int anchor_scroll;
+    
+    // TOC entries that point into the current document, by text offset
+    struct SectionMark {
+        uint32_t offset;
+        size_t toc_index;
+    };
+    std::vector<SectionMark> section_marks;
+    size_t marked_anchors;                  // Streamed chapters: anchors the marks were resolved from
+    
+    Stats stats;
+    
+    // What the last frame showed; the next one is only drawn if it differs
+    struct View {
+        const BookContent::Document* document;
+        int spine;
+        int scroll;
+        bool ui;
+        bool seeking;
+        size_t window_start;                // Streamed chapters: lines the view draws from
+        size_t window_size;
+        int pagination;                     // Overlay's page count or progress; -1 while hidden
+        
+        bool operator==(const View& other) const {
+            return document == other.document && spine == other.spine && scroll == other.scroll && ui == other.ui &&
+                   seeking == other.seeking && window_start == other.window_start && window_size == other.window_size &&
+                   pagination == other.pagination;
+        }
+    };
+    View drawn_view;
+    bool dirty;                             // Changes View does not capture, such as a relayout
+    
+    // Streamed chapters open at the top; a line further in is streamed to
+    // a slice per update, and the view moves there once it is reached
+    size_t seek_line;                       // NO_SEEK, or STREAM_END for the last page
+    
+    static const int VISIBLE_HEIGHT = 400;
+    static const int STICK_DEAD_ZONE = 24;          // Of the stick's 128 either way
+    static const int STICK_MAX_SPEED = 1200;        // Pixels per second at full tilt
+    static const int AUTO_SCROLL_STEP = 12;         // Pixels per second per speed level
+    static const uint32_t END_OF_DOCUMENT = 0xFFFFFFFF;
+    static const size_t NO_SEEK = static_cast<size_t>(-1);
+    static const size_t STREAM_END = NO_SEEK - 1;
+    static const size_t SEEK_SLICE_LINES = Paginator::STEP_LINES;
     
 public:
     enum ReaderResult {
         READER_CONTINUE,
         READER_BACK_TO_MENU,
+        READER_OPEN_SETTINGS,
         READER_NEXT_CHAPTER,
         READER_PREV_CHAPTER
     };
     
     BookReader(GPURenderer* gpu_renderer, EPUBParser* parser) 
-        : renderer(gpu_renderer), epub_parser(parser), current_chapter(0), 
-          scroll_offset(0), max_scroll(0), show_ui(false) {}
-    
-    bool load_chapter(int chapter_index) {
-        const auto& toc = epub_parser->get_table_of_contents();
-        if (chapter_index >= 0 && chapter_index < static_cast<int>(toc.size())) {
-            current_chapter = chapter_index;
-            scroll_offset = 0;
-            
-            // Load chapter content
-            std::string content = epub_parser->get_content(toc[chapter_index].content_src);
-            
-            // Parse HTML and extract text (simplified)
-            std::string plain_text = extract_text_from_html(content);
-            
-            // Wrap text for display
-            current_page_lines = renderer->wrap_text_to_width(plain_text, 860, 18);
-            
-            // Calculate max scroll
-            int total_height = current_page_lines.size() * 24;
-            max_scroll = std::max(0, total_height - 400); // 400 is visible area height
-            
-            return true;
+        : renderer(gpu_renderer), epub_parser(parser), content(parser),
+          prefetcher(&content, gpu_renderer, settings), paginator(parser, &content, gpu_renderer),
+          chapter_stream(parser, gpu_renderer),
+          current_document(nullptr), current_spine(0), scroll_offset(0), max_scroll(0), show_ui(false), streaming(false),
+          auto_scroll(false), scroll_speed(2), scroll_remainder(0.0f), scroll_direction(0),
+          last_update(std::chrono::steady_clock::now()),
+          anchor_offset(0), anchor_scroll(-1), marked_anchors(0), stats(),
+          drawn_view(), dirty(true), seek_line(NO_SEEK) {
+        // Same faces as GPURenderer; without them pages are drawn as before
+        tiles.initialize("assets/fonts/default.ttf", "assets/fonts/bold.ttf", "assets/fonts/italic.ttf");
+    }
+    
+    // Call once after EPUBParser::open_epub succeeds
+    bool open_book(const std::string& path) {
+        tiles.clear();
+        prefetcher.cancel_all();
+        paginator.stop();
+        content.reset();
+        stats = Stats();
+        book_path = path;
+        paginator.start(book_path, settings);
+        return load_spine_item(0, 0);
+    }
+    
+    // Must run before EPUBParser::close, the workers read from the book
+    void close_book() {
+        tiles.clear();
+        paginator.stop();
+        prefetcher.cancel_all();
+        chapter_stream.close();
+        book_path.clear();
+        dirty = true;
+    }
+    
+    // Re-flows the open book, if any, keeping the text at the top of the
+    // view. Only the open chapter is laid out before this returns; its
+    // neighbours go to the prefetcher and the page map is rebuilt in the
+    // background, or read back if these settings were used before.
+    void apply_settings(const LayoutSettings& new_settings) {
+        if (new_settings == settings) return;
+        
+        if (book_path.empty()) {
+            settings = new_settings;
+            prefetcher.set_settings(settings);
+            return;
+        }
+        
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        uint32_t anchor = reading_anchor();
+        
+        paginator.stop();
+        prefetcher.cancel_all();
+        settings = new_settings;
+        prefetcher.set_settings(settings);
+        
+        bool prefetched;
+        if (streaming) {
+            show_spine_item(current_spine, 0, prefetched);
+            scroll_to_stream_line(chapter_stream.seek_offset(anchor));
+        } else {
+            show_spine_item(current_spine, anchor, prefetched);
+        }
+        anchor_offset = anchor;
+        anchor_scroll = scroll_offset;
+        
+        stats.last_relayout_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        stats.relayout_ms_total += stats.last_relayout_ms;
+        ++stats.relayouts;
+        
+        // Started after the first page so the worker does not compete with it
+        paginator.start(book_path, settings);
+    }
+    
+    // For streamed documents the position is a line index, as in the page map
+    bool load_spine_item(int spine_index, uint32_t text_offset) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        
+        bool hit;
+        if (!show_spine_item(spine_index, text_offset, hit)) return false;
+        if (streaming) return true;
+        
+        double elapsed_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        if (hit) {
+            ++stats.prefetch_hits;
+            stats.hit_ms_total += elapsed_ms;
+        } else {
+            ++stats.prefetch_misses;
+            stats.miss_ms_total += elapsed_ms;
+        }
+        return true;
+    }
+    
+    bool jump_to_toc_entry(size_t toc_index) {
+        BookContent::Position position;
+        if (!content.resolve_toc_entry(toc_index, position)) {
+            return false;
+        }
+        if (!load_spine_item(position.spine_index, position.offset)) return false;
+        
+        // Streamed chapters find the anchor by streaming to it
+        uint32_t offset;
+        if (streaming && position.fragment && chapter_stream.seek_anchor(position.fragment, offset)) {
+            scroll_to_stream_line(chapter_stream.seek_offset(offset));
+            anchor_offset = offset;
+            anchor_scroll = scroll_offset;
+            collect_section_marks();
         }
-        return false;
+        return true;
+    }
+    
+    bool jump_to_percentage(int percent) {
+        size_t page_count = paginator.page_count();
+        if (page_count == 0) return false;
+        
+        size_t page = std::min(page_count - 1, page_count * static_cast<size_t>(std::max(0, percent)) / 100);
+        int32_t spine_index;
+        uint32_t position;
+        return paginator.locate(page, spine_index, position) && load_spine_item(spine_index, position);
     }
     
     ReaderResult update(const SceCtrlData& ctrl, uint32_t last_buttons) {
@@ -57,25 +240,81 @@ public:
             show_ui = !show_ui;
         }
         
-        // Page navigation
+        // Books only libzip could index are paginated on this thread, a step per frame
+        paginator.step();
+        
+        // Page navigation; turning past either end of a chapter crosses into the next one
         if ((ctrl.buttons & SCE_CTRL_LEFT) && !(last_buttons & SCE_CTRL_LEFT)) {
-            scroll_offset = std::max(0, scroll_offset - 200); // Scroll up
+            scroll_direction = -1;
+            previous_page();
         }
         if ((ctrl.buttons & SCE_CTRL_RIGHT) && !(last_buttons & SCE_CTRL_RIGHT)) {
-            scroll_offset = std::min(max_scroll, scroll_offset + 200); // Scroll down
+            scroll_direction = 1;
+            next_page();
+        }
+        
+        // Jump through the book in tenths once it is paginated
+        if ((ctrl.buttons & SCE_CTRL_UP) && !(last_buttons & SCE_CTRL_UP)) {
+            jump_to_percentage(current_percentage() - 10);
+        }
+        if ((ctrl.buttons & SCE_CTRL_DOWN) && !(last_buttons & SCE_CTRL_DOWN)) {
+            jump_to_percentage(current_percentage() + 10);
         }
         
-        // Chapter navigation
+        // Chapter navigation follows the spine, i.e. the book's reading order
         if ((ctrl.buttons & SCE_CTRL_LTRIGGER) && !(last_buttons & SCE_CTRL_LTRIGGER)) {
-            if (current_chapter > 0) {
-                load_chapter(current_chapter - 1);
+            if (current_spine > 0) {
+                load_spine_item(current_spine - 1, 0);
             }
         }
         if ((ctrl.buttons & SCE_CTRL_RTRIGGER) && !(last_buttons & SCE_CTRL_RTRIGGER)) {
-            const auto& toc = epub_parser->get_table_of_contents();
-            if (current_chapter < static_cast<int>(toc.size()) - 1) {
-                load_chapter(current_chapter + 1);
+            if (current_spine < static_cast<int>(content.spine_count()) - 1) {
+                load_spine_item(current_spine + 1, 0);
+            }
+        }
+        
+        // Smooth scrolling is timed, so a slow frame does not slow it down
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        float seconds = std::min(0.1f, std::chrono::duration<float>(now - last_update).count());
+        last_update = now;
+        
+        float velocity = stick_velocity(ctrl.ly);
+        bool auto_scrolling = auto_scroll && !show_ui && velocity == 0.0f && seek_line == NO_SEEK;
+        if (auto_scrolling) {
+            velocity = static_cast<float>(scroll_speed * AUTO_SCROLL_STEP);
+        }
+        if (velocity != 0.0f && !scroll_by(velocity * seconds) && auto_scrolling && at_chapter_end()) {
+            // Auto-scroll reads on into the next chapter
+            if (current_spine + 1 < static_cast<int>(content.spine_count())) {
+                load_spine_item(current_spine + 1, 0);
+            }
+        }
+        
+        // The tiles for the view, and ahead of where it is going, draw in the background
+        if (streaming) {
+            // On the way to a seek the window has moved past the view; it is not drawn
+            if (seek_line != NO_SEEK) {
+                continue_seek();
+            }
+            if (seek_line == NO_SEEK) {
+                // Lines a view ahead, so tiles below the view can be drawn before it gets there
+                chapter_stream.ensure_line((scroll_offset + 2 * VISIBLE_HEIGHT) / stream_line_height() + 3);
+                update_stream_scroll();
+                tiles.update(scroll_offset, scroll_direction, chapter_stream.window(), chapter_stream.window_start(),
+                             chapter_stream.finished());
+            }
+            
+            // Sections further in are marked once the stream has read their anchors
+            if (chapter_stream.anchors_seen() != marked_anchors) {
+                collect_section_marks();
             }
+        } else if (current_document) {
+            tiles.update(scroll_offset, scroll_direction);
+        }
+        
+        // Font size and spacing can change with the book open
+        if ((ctrl.buttons & SCE_CTRL_SELECT) && !(last_buttons & SCE_CTRL_SELECT)) {
+            return READER_OPEN_SETTINGS;
         }
         
         // Return to menu
@@ -86,9 +325,43 @@ public:
         return READER_CONTINUE;
     }
     
+    // Auto-scroll speed comes from the settings menu
+    void set_scrolling(bool enabled, int speed) {
+        auto_scroll = enabled;
+        scroll_speed = speed;
+    }
+    
+    // Page-map page at the top of the view
+    size_t page() const { return current_page(); }
+    
+    // Streaming towards the line the view was sent to
+    bool seeking() const { return seek_line != NO_SEEK; }
+    
+    const Stats& reader_stats() const { return stats; }
+    const Paginator::Stats& pagination_stats() const { return paginator.stats(); }
+    
+    // True if the next frame would differ from the last one drawn. Tiles
+    // and the page cache show the same pixels as a direct draw, so their
+    // progress alone never needs a frame.
+    bool needs_render() const {
+        return dirty || !(current_view() == drawn_view);
+    }
+    
     void render() {
-        // Render page content
-        renderer->render_cached_page(current_page_lines, scroll_offset);
+        drawn_view = current_view();
+        dirty = false;
+        
+        // Render page content; pre-rendered tiles when they are ready
+        if (seeking()) {
+            renderer->render_text_gpu("Loading...", 430, 260, RGBA8(0, 0, 0, 255), 20);
+        } else if (!tiles.draw(scroll_offset, renderer->display_list())) {
+            if (streaming) {
+                renderer->render_cached_page(chapter_stream.window(), scroll_offset, chapter_stream.window_start(),
+                                             settings.font_size, stream_line_height());
+            } else if (current_document) {
+                renderer->render_chapter_layout(current_document->styled, layout, scroll_offset);
+            }
+        }
         
         if (show_ui) {
             // Render UI overlay with semi-transparent background
@@ -96,16 +369,29 @@ public:
             renderer->render_rectangle(0, 484, 960, 60, RGBA8(0, 0, 0, 180));
             
             // Render chapter info
-            const auto& toc = epub_parser->get_table_of_contents();
-            if (current_chapter < static_cast<int>(toc.size())) {
-                std::string chapter_title = "Chapter " + std::to_string(current_chapter + 1) + ": " + 
-                                          toc[current_chapter].title;
-                renderer->render_text_gpu(chapter_title, 20, 20, RGBA8(255, 255, 255, 255), 16);
+            std::string chapter_title = "Chapter " + std::to_string(current_spine + 1) + "/" +
+                                        std::to_string(content.spine_count());
+            const char* section = current_section_title();
+            if (section) {
+                chapter_title += ": ";
+                chapter_title += section;
+            }
+            renderer->render_text_gpu(chapter_title, 20, 20, RGBA8(255, 255, 255, 255), 16);
+            
+            // Global position, or how far pagination has got
+            std::string page_info;
+            if (paginator.complete()) {
+                page_info = "Page " + std::to_string(current_page() + 1) + " of " +
+                            std::to_string(paginator.page_count()) + " (" + std::to_string(current_percentage()) + "%)";
+            } else {
+                page_info = "Paginating " + std::to_string(static_cast<int>(paginator.progress() * 100)) + "%";
             }
+            renderer->render_text_gpu(page_info, 940 - renderer->get_text_width(page_info, 16), 20,
+                                      RGBA8(255, 255, 255, 255), 16);
             
             // Render scroll indicator
             if (max_scroll > 0) {
-                int indicator_height = 400 * 400 / (current_page_lines.size() * 24);
+                int indicator_height = VISIBLE_HEIGHT * VISIBLE_HEIGHT / content_height();
                 int indicator_pos = 80 + (scroll_offset * 300 / max_scroll);
                 
                 renderer->render_rectangle(940, 80, 10, 400, RGBA8(100, 100, 100, 100));
@@ -113,65 +399,322 @@ public:
             }
             
             // Render controls
-            renderer->render_text_gpu("L/R: Chapters  Left/Right: Scroll  △: UI  ○: Menu", 20, 500, RGBA8(255, 255, 255, 255), 14);
+            renderer->render_text_gpu("L/R: Chapters  Left/Right: Pages  Up/Down: 10%  SELECT: Settings  △: UI  ○: Menu", 20, 500, RGBA8(255, 255, 255, 255), 14);
         }
     }
     
 private:
-    std::string extract_text_from_html(const std::string& html_content) {
-        // Simplified HTML text extraction
-        std::string result;
-        bool in_tag = false;
-        bool in_script = false;
-        bool in_style = false;
-        
-        for (size_t i = 0; i < html_content.length(); ++i) {
-            char c = html_content[i];
-            
-            if (c == '<') {
-                in_tag = true;
-                
-                // Check for script or style tags
-                if (i + 6 < html_content.length() && 
-                    html_content.substr(i, 7) == "<script") {
-                    in_script = true;
-                } else if (i + 5 < html_content.length() && 
-                          html_content.substr(i, 6) == "<style") {
-                    in_style = true;
-                }
-            } else if (c == '>') {
-                in_tag = false;
-                
-                // Check for end of script or style tags
-                if (in_script && i >= 8 && html_content.substr(i - 8, 9) == "</script>") {
-                    in_script = false;
-                } else if (in_style && i >= 7 && html_content.substr(i - 7, 8) == "</style>") {
-                    in_style = false;
-                }
-                
-                if (!in_script && !in_style) {
-                    result += ' '; // Add space between tags
-                }
-            } else if (!in_tag && !in_script && !in_style) {
-                result += c;
+    // Lays out and shows a spine item without touching the chapter switch stats
+    bool show_spine_item(int spine_index, uint32_t text_offset, bool& prefetched) {
+        prefetched = false;
+        if (spine_index < 0 || spine_index >= static_cast<int>(content.spine_count())) {
+            return false;
+        }
+        
+        current_spine = spine_index;
+        scroll_offset = 0;
+        scroll_remainder = 0.0f;
+        seek_line = NO_SEEK;
+        dirty = true;
+        renderer->invalidate_page_cache();
+        tiles.clear();
+        chapter_stream.close();
+        streaming = false;
+        layout.clear();
+        current_document = nullptr;
+        page_first_lines.clear();
+        
+        // Oversized documents never get materialized in full
+        if (content.is_oversized(spine_index)) {
+            streaming = true;
+            chapter_stream.open(content.spine_href(spine_index), settings.max_width, settings.font_size,
+                                settings.hyphenate);
+            if (text_offset == END_OF_DOCUMENT) {
+                seek_line = STREAM_END;
+            } else if (text_offset > 0) {
+                seek_line = text_offset;
             }
+            sync_stream_window();
+            anchor_offset = 0;
+            anchor_scroll = scroll_offset;
+            collect_section_marks();
+            start_prefetch();
+            tiles.set_stream(settings.font_size, stream_line_height());
+            return true;
         }
         
-        // Clean up multiple spaces and newlines
-        std::string cleaned;
-        bool prev_space = false;
-        for (char c : result) {
-            if (c == ' ' || c == '\n' || c == '\t') {
-                if (!prev_space) {
-                    cleaned += ' ';
-                    prev_space = true;
-                }
-            } else {
-                cleaned += c;
-                prev_space = false;
+        // Each spine document is inflated and tokenized once per book
+        const BookContent::Document* document = content.load_document(spine_index);
+        if (!document) {
+            max_scroll = 0;
+            section_marks.clear();
+            return false;
+        }
+        current_document = document;
+        
+        // Swap in the layout the prefetcher prepared, if there is one
+        PreparedChapter prepared;
+        prefetched = prefetcher.take(spine_index, prepared);
+        if (prefetched) {
+            layout = std::move(prepared.layout);
+        } else {
+            renderer->layout_styled_text(document->styled, settings, layout);
+        }
+        layout.paginate(settings.page_height, page_first_lines);
+        tiles.set_layout(document->styled, layout);
+        
+        // Scrolling stops once the last page is at the top
+        max_scroll = std::max(0, layout.height - VISIBLE_HEIGHT);
+        if (!layout.empty()) {
+            max_scroll = std::max(max_scroll, static_cast<int>(layout.lines[page_first_lines.back()].y));
+        }
+        
+        // Start the view on the page holding the requested offset
+        if (!layout.empty()) {
+            size_t line = layout.line_for_offset(text_offset);
+            size_t page = static_cast<size_t>(std::upper_bound(page_first_lines.begin(), page_first_lines.end(), line) -
+                                              page_first_lines.begin()) - 1;
+            scroll_to_page(page);
+        }
+        anchor_offset = text_offset;
+        anchor_scroll = scroll_offset;
+        
+        collect_section_marks();
+        start_prefetch();
+        return true;
+    }
+    
+    // Pixels per second from the left stick's vertical axis; quadratic
+    // past the dead zone for fine control near the middle
+    static float stick_velocity(uint8_t axis) {
+        int offset = static_cast<int>(axis) - 128;
+        int magnitude = std::abs(offset) - STICK_DEAD_ZONE;
+        if (magnitude <= 0) return 0.0f;
+        
+        float tilt = std::min(1.0f, magnitude / static_cast<float>(127 - STICK_DEAD_ZONE));
+        float speed = tilt * tilt * STICK_MAX_SPEED;
+        return offset > 0 ? speed : -speed;
+    }
+    
+    // Moves the view by a fraction of a pixel or more; false if it was
+    // already at the end it was moved towards
+    bool scroll_by(float pixels) {
+        scroll_remainder += pixels;
+        int whole = static_cast<int>(scroll_remainder);
+        if (whole == 0) return true;
+        scroll_remainder -= whole;
+        seek_line = NO_SEEK;
+        scroll_direction = whole > 0 ? 1 : -1;
+        
+        int previous = scroll_offset;
+        scroll_offset = std::max(0, std::min(max_scroll, scroll_offset + whole));
+        if (streaming) {
+            sync_stream_window();
+            scroll_offset = std::min(scroll_offset, max_scroll);
+        }
+        if (scroll_offset == previous) {
+            scroll_remainder = 0.0f;
+            return false;
+        }
+        return true;
+    }
+    
+    bool at_chapter_end() const {
+        return scroll_offset >= max_scroll && (!streaming || chapter_stream.finished());
+    }
+    
+    int content_height() const {
+        return streaming ? static_cast<int>(chapter_stream.lines_produced()) * stream_line_height() : layout.height;
+    }
+    
+    // Streamed lines are all body text, spaced like body text in a layout
+    int stream_line_height() const {
+        return GPURenderer::line_height(settings.font_size, settings.line_spacing);
+    }
+    
+    void scroll_to_page(size_t page) {
+        scroll_offset = std::min(max_scroll, static_cast<int>(layout.lines[page_first_lines[page]].y));
+    }
+    
+    size_t page_in_chapter() const {
+        if (layout.empty()) return 0;
+        size_t line = layout.line_at_y(scroll_offset);
+        return static_cast<size_t>(std::upper_bound(page_first_lines.begin(), page_first_lines.end(), line) -
+                                   page_first_lines.begin()) - 1;
+    }
+    
+    // Streamed pages are whole multiples of the line height
+    int stream_page_height() const {
+        return std::max(1, settings.page_height / stream_line_height()) * stream_line_height();
+    }
+    
+    // Puts the page holding a streamed line at the top, as the page map pages it
+    void scroll_to_stream_line(size_t line) {
+        size_t lines_per_page = static_cast<size_t>(stream_page_height() / stream_line_height());
+        size_t first = std::min<size_t>(line - line % lines_per_page, INT_MAX / stream_line_height());
+        scroll_offset = static_cast<int>(first) * stream_line_height();
+        sync_stream_window();
+        scroll_offset = std::min(scroll_offset, max_scroll);
+    }
+    
+    // Text offset at the top of the view
+    uint32_t reading_anchor() const {
+        if (scroll_offset == anchor_scroll) return anchor_offset;
+        if (streaming) return chapter_stream.line_offset(static_cast<size_t>(scroll_offset / stream_line_height()));
+        if (layout.empty()) return 0;
+        return layout.lines[std::min(layout.line_at_y(scroll_offset), layout.lines.size() - 1)].offset;
+    }
+    
+    void next_page() {
+        seek_line = NO_SEEK;
+        if (streaming) {
+            // Produce the lines for the next view before clamping
+            chapter_stream.ensure_line((scroll_offset + stream_page_height() + VISIBLE_HEIGHT) / stream_line_height() + 1);
+            update_stream_scroll();
+            if (scroll_offset >= max_scroll && chapter_stream.finished()) {
+                load_spine_item(current_spine + 1, 0);
+                return;
             }
+            scroll_offset = std::min(max_scroll, scroll_offset + stream_page_height());
+            sync_stream_window();
+            return;
         }
         
-        return cleaned;
+        size_t page = page_in_chapter();
+        if (page + 1 < page_first_lines.size()) {
+            scroll_to_page(page + 1);
+        } else {
+            load_spine_item(current_spine + 1, 0);
+        }
+    }
+    
+    void previous_page() {
+        seek_line = NO_SEEK;
+        if (streaming) {
+            if (scroll_offset == 0) {
+                load_spine_item(current_spine - 1, END_OF_DOCUMENT);
+                return;
+            }
+            scroll_offset = std::max(0, scroll_offset - stream_page_height());
+            sync_stream_window();
+            return;
+        }
+        
+        size_t page = page_in_chapter();
+        if (page > 0 && !layout.empty()) {
+            scroll_to_page(page - 1);
+        } else {
+            load_spine_item(current_spine - 1, END_OF_DOCUMENT);
+        }
+    }
+    
+    // Page-map position of the top of the view
+    size_t current_page() const {
+        uint32_t position = 0;
+        if (streaming) {
+            position = static_cast<uint32_t>(scroll_offset / stream_line_height());
+        } else if (!layout.empty()) {
+            position = layout.lines[std::min(layout.line_at_y(scroll_offset), layout.lines.size() - 1)].offset;
+        }
+        return paginator.page_at(current_spine, position);
+    }
+    
+    int current_percentage() const {
+        size_t page_count = paginator.page_count();
+        return page_count ? static_cast<int>(current_page() * 100 / page_count) : 0;
+    }
+    
+    View current_view() const {
+        View view = View();
+        view.document = current_document;
+        view.spine = current_spine;
+        view.scroll = scroll_offset;
+        view.ui = show_ui;
+        view.seeking = seeking();
+        if (streaming) {
+            view.window_start = chapter_stream.window_start();
+            view.window_size = chapter_stream.window().size();
+        }
+        view.pagination = -1;
+        if (show_ui) {
+            view.pagination = paginator.complete() ? static_cast<int>(paginator.page_count()) :
+                              static_cast<int>(paginator.progress() * 100);
+        }
+        return view;
+    }
+    
+    // One slice of the way to seek_line; the view moves once it is streamed
+    void continue_seek() {
+        if (seek_line >= chapter_stream.lines_produced() && !chapter_stream.finished()) {
+            chapter_stream.ensure_line(std::min(seek_line, chapter_stream.lines_produced() + SEEK_SLICE_LINES));
+            if (seek_line >= chapter_stream.lines_produced() && !chapter_stream.finished()) return;
+        }
+        
+        size_t produced = chapter_stream.lines_produced();
+        if (seek_line == STREAM_END) {
+            // The end is shown as a scroll to the bottom, as a shorter chapter's is
+            scroll_offset = static_cast<int>(std::min<size_t>(produced, INT_MAX / stream_line_height())) *
+                            stream_line_height();
+            sync_stream_window();
+            scroll_offset = std::min(scroll_offset, max_scroll);
+        } else {
+            scroll_to_stream_line(std::min(seek_line, produced > 0 ? produced - 1 : 0));
+        }
+        seek_line = NO_SEEK;
+        anchor_offset = chapter_stream.line_offset(static_cast<size_t>(scroll_offset / stream_line_height()));
+        anchor_scroll = scroll_offset;
+    }
+    
+    void sync_stream_window() {
+        // Make sure every line in the visible area is inside the window
+        chapter_stream.ensure_line(scroll_offset / stream_line_height());
+        chapter_stream.ensure_line((scroll_offset + VISIBLE_HEIGHT) / stream_line_height() + 1);
+        update_stream_scroll();
+    }
+    
+    void update_stream_scroll() {
+        // Total length is unknown until the stream ends, so allow one more view
+        int total_height = static_cast<int>(chapter_stream.lines_produced()) * stream_line_height();
+        if (!chapter_stream.finished()) {
+            total_height += VISIBLE_HEIGHT;
+        }
+        max_scroll = std::max(0, total_height - VISIBLE_HEIGHT);
+    }
+    
+    void start_prefetch() {
+        // libzip handles are not shared across threads, so libzip-indexed books do not prefetch
+        if (epub_parser->can_read_concurrently()) {
+            prefetcher.prefetch_around(current_spine);
+        }
+    }
+    
+    void collect_section_marks() {
+        section_marks.clear();
+        marked_anchors = streaming ? chapter_stream.anchors_seen() : 0;
+        
+        // Only entries into this document; the document is already cached,
+        // so resolving them costs anchor lookups and no extra parsing
+        for (uint32_t i : content.toc_entries(current_spine)) {
+            BookContent::Position position;
+            if (!content.resolve_toc_entry(i, position)) continue;
+            
+            // A streamed chapter's anchors are known up to where it has been
+            // read, which is past the top of the view
+            if (position.fragment && !chapter_stream.find_anchor(position.fragment, position.offset)) continue;
+            section_marks.push_back({position.offset, i});
+        }
+    }
+    
+    const char* current_section_title() const {
+        // Last TOC entry that starts at or above the top of the view
+        uint32_t top_offset = reading_anchor();
+        
+        const SectionMark* current = nullptr;
+        for (const auto& mark : section_marks) {
+            if (mark.offset <= top_offset && (!current || mark.offset >= current->offset)) {
+                current = &mark;
+            }
+        }
+        return current ? epub_parser->get_table_of_contents().title(current->toc_index) : nullptr;
     }
 };
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include <psp2/ctrl.h>
 #include "gpu_renderer.h"
+#include "chapter_layout.h"
 #include <vector>
 #include <string>
 
@@ -8,10 +9,13 @@ private:
     int selected_item;
     std::vector<std::string> setting_items;
     GPURenderer* renderer;
+    bool dirty;                         // Changed since the last render
     
     // Settings values
     int font_size;
     int line_spacing;
+    bool justify;
+    bool hyphenate;
     bool auto_scroll;
     int scroll_speed;
     
@@ -21,11 +25,14 @@ public:
         SETTINGS_BACK
     };
     
-    SettingsMenu(GPURenderer* gpu_renderer) : selected_item(0), renderer(gpu_renderer),
-                                            font_size(18), line_spacing(4), auto_scroll(false), scroll_speed(2) {
+    SettingsMenu(GPURenderer* gpu_renderer) : selected_item(0), renderer(gpu_renderer), dirty(true),
+                                            font_size(18), line_spacing(4), justify(true), hyphenate(true), auto_scroll(false),
+                                            scroll_speed(2) {
         setting_items = {
             "Font Size",
             "Line Spacing", 
+            "Justify",
+            "Hyphenation",
             "Auto Scroll",
             "Scroll Speed",
             "Back"
@@ -36,22 +43,26 @@ public:
         // Menu navigation
         if ((ctrl.buttons & SCE_CTRL_UP) && !(last_buttons & SCE_CTRL_UP)) {
             selected_item = (selected_item - 1 + setting_items.size()) % setting_items.size();
+            dirty = true;
         }
         if ((ctrl.buttons & SCE_CTRL_DOWN) && !(last_buttons & SCE_CTRL_DOWN)) {
             selected_item = (selected_item + 1) % setting_items.size();
+            dirty = true;
         }
         
         // Value adjustment
         if ((ctrl.buttons & SCE_CTRL_LEFT) && !(last_buttons & SCE_CTRL_LEFT)) {
             adjust_setting(-1);
+            dirty = true;
         }
         if ((ctrl.buttons & SCE_CTRL_RIGHT) && !(last_buttons & SCE_CTRL_RIGHT)) {
             adjust_setting(1);
+            dirty = true;
         }
         
         // Back to menu
         if ((ctrl.buttons & SCE_CTRL_CROSS) && !(last_buttons & SCE_CTRL_CROSS)) {
-            if (selected_item == 4) { // Back option
+            if (selected_item == 6) { // Back option
                 return SETTINGS_BACK;
             }
         }
@@ -63,7 +74,11 @@ public:
         return SETTINGS_CONTINUE;
     }
     
+    bool needs_render() const { return dirty; }
+    
     void render() {
+        dirty = false;
+        
         // Render title
         renderer->render_text_gpu("Settings", 100, 80, RGBA8(0, 0, 0, 255), 32);
         
@@ -79,7 +94,7 @@ public:
             renderer->render_menu_item(setting_items[i], 150, y_pos, selected);
             
             // Render setting value
-            if (i < 4) { // Don't render value for "Back" option
+            if (i < 6) { // Don't render value for "Back" option
                 std::string value = get_setting_value(i);
                 renderer->render_text_gpu(value, 400, y_pos, RGBA8(0, 0, 0, 255), 20);
             }
@@ -93,9 +108,21 @@ public:
     // Getters for settings values
     int get_font_size() const { return font_size; }
     int get_line_spacing() const { return line_spacing; }
+    bool get_justify() const { return justify; }
+    bool get_hyphenate() const { return hyphenate; }
     bool get_auto_scroll() const { return auto_scroll; }
     int get_scroll_speed() const { return scroll_speed; }
     
+    // What the reader lays books out with; width and page height stay fixed
+    LayoutSettings get_layout_settings() const {
+        LayoutSettings layout;
+        layout.font_size = font_size;
+        layout.line_spacing = line_spacing;
+        layout.justify = justify;
+        layout.hyphenate = hyphenate;
+        return layout;
+    }
+    
 private:
     void adjust_setting(int direction) {
         switch (selected_item) {
@@ -109,10 +136,16 @@ private:
                 if (line_spacing < 0) line_spacing = 0;
                 if (line_spacing > 10) line_spacing = 10;
                 break;
-            case 2: // Auto Scroll
+            case 2: // Justify
+                justify = !justify;
+                break;
+            case 3: // Hyphenation
+                hyphenate = !hyphenate;
+                break;
+            case 4: // Auto Scroll
                 auto_scroll = !auto_scroll;
                 break;
-            case 3: // Scroll Speed
+            case 5: // Scroll Speed
                 scroll_speed += direction;
                 if (scroll_speed < 1) scroll_speed = 1;
                 if (scroll_speed > 10) scroll_speed = 10;
@@ -124,8 +157,10 @@ private:
         switch (index) {
             case 0: return std::to_string(font_size) + "px";
             case 1: return std::to_string(line_spacing) + "px";
-            case 2: return auto_scroll ? "On" : "Off";
-            case 3: return std::to_string(scroll_speed);
+            case 2: return justify ? "On" : "Off";
+            case 3: return hyphenate ? "On" : "Off";
+            case 4: return auto_scroll ? "On" : "Off";
+            case 5: return std::to_string(scroll_speed);
             default: return "";
         }
     }
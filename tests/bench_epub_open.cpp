@@ -0,0 +1,98 @@
+#include "cache_file.h"
+#include "epub_parser.h"
+#include "file_manager.h"
+#include "test_support.h"
+#include "zip_writer.h"
+#include <cstdlib>
+
+// Opening a book cold, parsing the container, OPF and NCX and writing the
+// index cache, against opening it warm from that cache. Each chapter has
+// a manifest item, a spine item and three TOC entries.
+//
+//   bench_epub_open [--quick] [--chapters N]
+
+namespace {
+    
+std::string write_book(int chapter_count) {
+    std::vector<std::string> chapters;
+    std::string ncx = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                      "<ncx xmlns=\"http://www.daisy.org/z3986/2005/ncx/\" version=\"2005-1\"><navMap>\n";
+    int play_order = 0;
+    for (int i = 0; i < chapter_count; ++i) {
+        std::string number = std::to_string(i);
+        chapters.push_back("<html><body><h1 id=\"top\">Chapter " + number + "</h1><p id=\"s1\">One.</p>"
+                           "<p id=\"s2\">Two.</p></body></html>");
+        ncx += "<navPoint id=\"ch" + number + "\" playOrder=\"" + std::to_string(++play_order) + "\">"
+               "<navLabel><text>Chapter " + number + "</text></navLabel><content src=\"ch" + number + ".xhtml\"/>";
+        for (int section = 1; section <= 2; ++section) {
+            std::string id = "s" + std::to_string(section);
+            ncx += "<navPoint id=\"ch" + number + id + "\" playOrder=\"" + std::to_string(++play_order) + "\">"
+                   "<navLabel><text>Section " + id + " &amp; notes</text></navLabel>"
+                   "<content src=\"ch" + number + ".xhtml#" + id + "\"/></navPoint>";
+        }
+        ncx += "</navPoint>\n";
+    }
+    ncx += "</navMap></ncx>\n";
+        
+    ZipWriter zip;
+    add_minimal_book(zip, chapters, true,
+                     "<item id=\"ncx\" href=\"toc.ncx\" media-type=\"application/x-dtbncx+xml\"/>");
+    zip.add("OEBPS/toc.ncx", ncx, true);
+    std::string path = FileManager::EPUB_DIR + "/bench_open_" + std::to_string(chapter_count) + ".epub";
+    CHECK(zip.write(path));
+    return path;
+}
+    
+void run(int chapter_count, int rounds) {
+    std::string path = write_book(chapter_count);
+    std::string cache = cache_file_path(cache_hash(path.data(), path.size()), ".idx");
+        
+    bool cold_parsed = true;
+    double cold = best_seconds(rounds, [&]() {
+        std::remove(cache.c_str());
+        EPUBParser parser;
+        CHECK(parser.open_epub(path));
+        cold_parsed = cold_parsed && !parser.open_stats().index_cached;
+    });
+        
+    bool warm_cached = true;
+    size_t toc_size = 0;
+    double warm = best_seconds(rounds, [&]() {
+        EPUBParser parser;
+        CHECK(parser.open_epub(path));
+        warm_cached = warm_cached && parser.open_stats().index_cached;
+        toc_size = parser.get_table_of_contents().size();
+    });
+    CHECK(cold_parsed);
+    CHECK(warm_cached);
+    CHECK_EQ(toc_size, static_cast<size_t>(chapter_count) * 3);
+        
+    std::vector<char> buffer;
+    read_cache_file(cache, buffer);
+    std::printf("%5d chapters: cold %8.3f ms, warm %8.3f ms (%.1fx), index cache %.1f KB\n", chapter_count,
+                cold * 1000, warm * 1000, cold / warm, buffer.size() / 1024.0);
+}
+    
+} // namespace
+
+int main(int argc, char** argv) {
+    if (!FileManager::initialize_directories()) return 1;
+    
+    bool quick = has_flag(argc, argv, "--quick");
+    int rounds = quick ? 1 : 20;
+    std::vector<int> sizes;
+    std::string requested = flag_value(argc, argv, "--chapters");
+    if (!requested.empty()) {
+        sizes.push_back(std::atoi(requested.c_str()));
+    } else if (quick) {
+        sizes.push_back(20);
+    } else {
+        sizes.push_back(20);
+        sizes.push_back(200);
+        sizes.push_back(2000);
+    }
+    
+    std::printf("Book open, best of %d:\n", rounds);
+    for (int chapter_count : sizes) run(chapter_count, rounds);
+    return test_result();
+}
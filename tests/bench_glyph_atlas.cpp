@@ -0,0 +1,163 @@
+#include "glyph_cache.h"
+#include "test_support.h"
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+// Packing Lato's glyphs for U+0021..U+024F into the atlas, a few sizes at
+// a time: how many fit, how full the pages are and what an add costs.
+// Then a page of text as TextRenderer draws it, every glyph a cache hit
+// queued as a quad, against the vita2d_draw_pixel calls the old path made
+// for its covered pixels.
+//
+//   bench_glyph_atlas [--quick]
+
+namespace {
+    
+const uint32_t FIRST_CODEPOINT = 0x21;
+const uint32_t LAST_CODEPOINT = 0x24F;
+const size_t PAGE_GLYPHS = 2000;
+    
+struct Bitmap {
+    uint32_t codepoint;
+    int width, height, pitch;
+    int left, top, advance_x;
+    std::vector<uint8_t> pixels;
+};
+    
+std::vector<Bitmap> render_glyphs(FT_Face face, int size) {
+    FT_Set_Pixel_Sizes(face, 0, size);
+    std::vector<Bitmap> glyphs;
+    for (uint32_t codepoint = FIRST_CODEPOINT; codepoint <= LAST_CODEPOINT; ++codepoint) {
+        if (!FT_Get_Char_Index(face, codepoint) || FT_Load_Char(face, codepoint, FT_LOAD_RENDER)) continue;
+        FT_GlyphSlot slot = face->glyph;
+        Bitmap bitmap;
+        bitmap.codepoint = codepoint;
+        bitmap.width = slot->bitmap.width;
+        bitmap.height = slot->bitmap.rows;
+        bitmap.pitch = slot->bitmap.pitch;
+        bitmap.left = slot->bitmap_left;
+        bitmap.top = slot->bitmap_top;
+        bitmap.advance_x = static_cast<int>(slot->advance.x >> 6);
+        bitmap.pixels.assign(slot->bitmap.buffer, slot->bitmap.buffer + bitmap.pitch * bitmap.height);
+        glyphs.push_back(bitmap);
+    }
+    return glyphs;
+}
+    
+void pack(FT_Face face, const std::vector<int>& sizes, int rounds) {
+    std::vector<Bitmap> glyphs;
+    std::string names;
+    for (int size : sizes) {
+        std::vector<Bitmap> sized = render_glyphs(face, size);
+        glyphs.insert(glyphs.end(), sized.begin(), sized.end());
+        names += (names.empty() ? "" : "/") + std::to_string(size);
+    }
+        
+    size_t added = 0;
+    size_t pages = 0;
+    size_t area = 0;
+    double seconds = best_seconds(rounds, [&]() {
+        GlyphAtlas atlas;
+        AtlasRegion region;
+        added = 0;
+        area = 0;
+        for (const Bitmap& glyph : glyphs) {
+            if (!atlas.add(glyph.pixels.data(), glyph.width, glyph.height, glyph.pitch, region)) continue;
+            ++added;
+            if (region.width != 0) {
+                area += static_cast<size_t>(region.width + 2 * GlyphAtlas::PADDING) *
+                        (region.height + 2 * GlyphAtlas::PADDING);
+            }
+        }
+        pages = atlas.page_count();
+    });
+    double page_area = static_cast<double>(GlyphAtlas::PAGE_SIZE) * GlyphAtlas::PAGE_SIZE * (pages ? pages : 1);
+    std::printf("  sizes %-18s %5zu of %5zu glyphs, %zu page(s), %.1f%% full, %.0f ns per add\n", names.c_str(),
+                added, glyphs.size(), pages, 100.0 * area / page_area, seconds / glyphs.size() * 1e9);
+}
+    
+// Letters of the license text as lines of a page, drawn through the cache
+void batch_page(FT_Face face, int size, const std::string& text, int rounds) {
+    std::vector<Bitmap> glyphs = render_glyphs(face, size);
+    GlyphCache cache;
+    for (const Bitmap& glyph : glyphs) {
+        cache.insert(0, static_cast<uint16_t>(size), glyph.codepoint, glyph.pixels.data(), glyph.width,
+                     glyph.height, glyph.pitch, glyph.left, glyph.top, glyph.advance_x);
+    }
+        
+    // The old path's calls, one per covered pixel
+    std::vector<size_t> covered(LAST_CODEPOINT + 1, 0);
+    for (const Bitmap& glyph : glyphs) {
+        for (int row = 0; row < glyph.height; ++row) {
+            for (int column = 0; column < glyph.width; ++column) {
+                if (glyph.pixels[row * glyph.pitch + column]) ++covered[glyph.codepoint];
+            }
+        }
+    }
+        
+    QuadBatch batch;
+    size_t draw_pixel_calls = 0;
+    size_t draw_calls = 0;
+    double seconds = best_seconds(rounds, [&]() {
+        cache.begin_batch();
+        batch.clear();
+        draw_pixel_calls = 0;
+        float x = 0;
+        float y = static_cast<float>(size);
+        size_t queued = 0;
+        for (size_t i = 0; queued < PAGE_GLYPHS; i = (i + 1) % text.size()) {
+            uint32_t codepoint = static_cast<uint8_t>(text[i]);
+            if (codepoint < FIRST_CODEPOINT || codepoint > LAST_CODEPOINT) {
+                x += size / 4;
+                if (x > 900) {
+                    x = 0;
+                    y += size * 1.4f;
+                }
+                continue;
+            }
+            const CachedGlyph* glyph = cache.find(0, static_cast<uint16_t>(size), codepoint);
+            if (!glyph) continue;
+            batch.add(glyph->region, x + glyph->left, y - glyph->top);
+            draw_pixel_calls += covered[codepoint];
+            x += glyph->advance_x;
+            ++queued;
+        }
+        draw_calls = 0;
+        for (size_t page = 0; page < batch.page_count(); ++page) {
+            if (!batch.vertices(page).empty()) ++draw_calls;
+        }
+    });
+    CHECK_EQ(batch.quad_count(), PAGE_GLYPHS);
+    std::printf("  size %2d: %zu glyphs queued in %.1f us, %zu draw call(s), was %zu vita2d_draw_pixel calls\n",
+                size, PAGE_GLYPHS, seconds * 1e6, draw_calls, draw_pixel_calls);
+}
+    
+} // namespace
+
+int main(int argc, char** argv) {
+    bool quick = has_flag(argc, argv, "--quick");
+    int rounds = quick ? 1 : 20;
+    
+    FT_Library library;
+    FT_Face face;
+    CHECK(!FT_Init_FreeType(&library));
+    if (FT_New_Face(library, test_data_path("fonts/Lato-Regular.ttf").c_str(), 0, &face)) {
+        std::fprintf(stderr, "Cannot load the test font\n");
+        return 1;
+    }
+    
+    std::printf("Atlas packing, U+%04X..U+%04X, best of %d:\n", FIRST_CODEPOINT, LAST_CODEPOINT, rounds);
+    pack(face, std::vector<int>{14, 18, 24, 32}, rounds);
+    pack(face, std::vector<int>{14, 18, 24, 32, 48, 64, 72}, rounds);
+    
+    std::string text;
+    CHECK(read_file(test_data_path("text/GPL-3.txt"), text));
+    std::printf("A page of text batched, best of %d:\n", rounds);
+    for (int size : {14, 18, 24, 32}) {
+        batch_page(face, size, text, rounds);
+    }
+    
+    FT_Done_Face(face);
+    FT_Done_FreeType(library);
+    return test_result();
+}
@@ -0,0 +1,188 @@
+#include "html_text.h"
+#include "styled_text.h"
+#include "test_support.h"
+#include <cstdlib>
+
+// Throughput of HtmlTextExtractor against the extract_text_from_html the
+// reader used before it, on one chapter: whole, in ChapterStream's 16KB
+// chunks, and with anchors and styles collected as BookContent does. The
+// chapter is synthetic unless --file names an XHTML file.
+//
+//   bench_html_extraction [--quick] [--file chapter.xhtml]
+
+namespace {
+    
+// BookReader::extract_text_from_html as it was, unchanged
+std::string extract_text_from_html(const std::string& html_content) {
+    // Simplified HTML text extraction
+    std::string result;
+    bool in_tag = false;
+    bool in_script = false;
+    bool in_style = false;
+        
+    for (size_t i = 0; i < html_content.length(); ++i) {
+        char c = html_content[i];
+            
+        if (c == '<') {
+            in_tag = true;
+                
+            // Check for script or style tags
+            if (i + 6 < html_content.length() &&
+                html_content.substr(i, 7) == "<script") {
+                in_script = true;
+            } else if (i + 5 < html_content.length() &&
+                      html_content.substr(i, 6) == "<style") {
+                in_style = true;
+            }
+        } else if (c == '>') {
+            in_tag = false;
+                
+            // Check for end of script or style tags
+            if (in_script && i >= 8 && html_content.substr(i - 8, 9) == "</script>") {
+                in_script = false;
+            } else if (in_style && i >= 7 && html_content.substr(i - 7, 8) == "</style>") {
+                in_style = false;
+            }
+                
+            if (!in_script && !in_style) {
+                result += ' '; // Add space between tags
+            }
+        } else if (!in_tag && !in_script && !in_style) {
+            result += c;
+        }
+    }
+        
+    // Clean up multiple spaces and newlines
+    std::string cleaned;
+    bool prev_space = false;
+    for (char c : result) {
+        if (c == ' ' || c == '\n' || c == '\t') {
+            if (!prev_space) {
+                cleaned += ' ';
+                prev_space = true;
+            }
+        } else {
+            cleaned += c;
+            prev_space = false;
+        }
+    }
+        
+    return cleaned;
+}
+    
+// Prose with the markup of a typical novel chapter: headings, paragraphs,
+// emphasis, links, references, and a style and script block per section
+std::string synthetic_chapter(size_t target_size) {
+    static const char* const words[] = {
+        "the", "reader", "turned", "another", "page", "and", "found", "nothing", "but", "silence", "in",
+        "a", "house", "that", "had", "once", "been", "full", "of", "voices", "letters", "unanswered"
+    };
+    const size_t word_count = sizeof(words) / sizeof(words[0]);
+        
+    std::string html = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\">"
+                       "<head><title>Chapter</title></head>\n<body>\n";
+    uint32_t state = 1;
+    for (int section = 0; html.size() < target_size; ++section) {
+        html += "<style type=\"text/css\">p.first { text-indent: 0; } em { font-style: italic; }</style>\n"
+                "<script type=\"text/javascript\">var section = " + std::to_string(section) + ";</script>\n"
+                "<h2 id=\"s" + std::to_string(section) + "\" class=\"chapter-title\">Section " +
+                std::to_string(section) + "</h2>\n";
+        for (int paragraph = 0; paragraph < 12; ++paragraph) {
+            html += paragraph == 0 ? "<p class=\"first\">" : "<p>";
+            for (int word = 0; word < 90; ++word) {
+                state = state * 1103515245u + 12345u;
+                uint32_t pick = state >> 16;
+                if (word > 0) html += ' ';
+                if (pick % 29 == 0) {
+                    html += std::string("<em>") + words[pick % word_count] + "</em>";
+                } else if (pick % 37 == 0) {
+                    html += "&#8220;" + std::string(words[pick % word_count]) + "&#8221;";
+                } else if (pick % 41 == 0) {
+                    html += std::string("<a href=\"notes.xhtml#n") + std::to_string(pick % 100) + "\">" +
+                            words[pick % word_count] + "</a>";
+                } else if (pick % 43 == 0) {
+                    html += "&amp; &mdash;";
+                } else {
+                    html += words[pick % word_count];
+                }
+            }
+            html += ".</p>\n";
+        }
+    }
+    return html + "</body>\n</html>\n";
+}
+    
+void report(const char* name, double seconds, size_t input_size, size_t output_size, double baseline) {
+    double mb_per_second = input_size / 1048576.0 / seconds;
+    std::printf("  %-28s %8.2f ms  %7.1f MB/s  %8zu bytes out", name, seconds * 1000.0, mb_per_second, output_size);
+    if (baseline > 0.0) std::printf("  %5.2fx", baseline / seconds);
+    std::printf("\n");
+}
+    
+} // namespace
+
+int main(int argc, char** argv) {
+    bool quick = has_flag(argc, argv, "--quick");
+    int rounds = quick ? 1 : 7;
+    
+    std::string html;
+    std::string file = flag_value(argc, argv, "--file");
+    if (!file.empty()) {
+        if (!read_file(file, html)) {
+            std::cerr << "Cannot read " << file << std::endl;
+            return 1;
+        }
+    } else {
+        html = synthetic_chapter(quick ? 256 * 1024 : 4 * 1024 * 1024);
+    }
+    std::printf("%.0f KB chapter, best of %d:\n", html.size() / 1024.0, rounds);
+    
+    std::string old_text;
+    double old_seconds = best_seconds(rounds, [&]() { old_text = extract_text_from_html(html); });
+    report("extract_text_from_html", old_seconds, html.size(), old_text.size(), 0.0);
+    
+    // The output string is reused, as BookContent and ChapterStream do
+    HtmlTextExtractor extractor;
+    std::string text;
+    double whole_seconds = best_seconds(rounds, [&]() {
+        text.clear();
+        extractor.reset();
+        extractor.feed(html.data(), html.size(), text);
+        extractor.finish(text);
+    });
+    report("extractor, whole", whole_seconds, html.size(), text.size(), old_seconds);
+    
+    std::string chunked;
+    const size_t chunk_size = 16 * 1024;
+    double chunked_seconds = best_seconds(rounds, [&]() {
+        chunked.clear();
+        extractor.reset();
+        for (size_t at = 0; at < html.size(); at += chunk_size) {
+            extractor.feed(html.data() + at, std::min(chunk_size, html.size() - at), chunked);
+        }
+        extractor.finish(chunked);
+    });
+    report("extractor, 16KB chunks", chunked_seconds, html.size(), chunked.size(), old_seconds);
+    
+    StyledText styled;
+    AnchorIndex anchors;
+    double styled_seconds = best_seconds(rounds, [&]() {
+        styled = StyledText();
+        anchors.clear();
+        extractor.reset();
+        extractor.set_anchor_index(&anchors);
+        extractor.set_styled_output(&styled);
+        extractor.feed(html.data(), html.size(), styled.text);
+        extractor.finish(styled.text);
+        extractor.set_anchor_index(nullptr);
+        extractor.set_styled_output(nullptr);
+    });
+    report("extractor, styles + anchors", styled_seconds, html.size(), styled.text.size(), old_seconds);
+    std::printf("  %zu runs, %zu blocks, %zu anchors, %.1f%% style overhead\n", styled.runs.size(),
+                styled.blocks.size(), anchors.size(),
+                styled.text.empty() ? 0.0 : 100.0 * styled.overhead_bytes() / styled.text.size());
+    
+    bool ok = chunked == text && styled.text == text;
+    if (!ok) std::printf("  extractor output depends on how the input is fed\n");
+    return ok ? 0 : 1;
+}
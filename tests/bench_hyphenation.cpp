@@ -0,0 +1,73 @@
+#include "file_manager.h"
+#include "hyphenator.h"
+#include "test_support.h"
+
+// Words hyphenated per second with the shipped English patterns, over the
+// words of the license texts or of --file, and what loading the patterns
+// costs: compiling the pattern file against reading the packed trie back
+// from CACHE_DIR.
+//
+//   bench_hyphenation [--quick] [--file text.txt]
+
+namespace {
+    
+void add_words(const std::string& text, std::vector<std::string>& words) {
+    std::string word;
+    for (char c : text) {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+            word += c;
+        } else if (!word.empty()) {
+            words.push_back(word);
+            word.clear();
+        }
+    }
+}
+    
+} // namespace
+
+int main(int argc, char** argv) {
+    if (!FileManager::initialize_directories()) return 1;
+    
+    bool quick = has_flag(argc, argv, "--quick");
+    int rounds = quick ? 1 : 10;
+    
+    std::vector<std::string> words;
+    std::string file = flag_value(argc, argv, "--file");
+    std::string text;
+    if (!file.empty()) {
+        if (!read_file(file, text)) {
+            std::fprintf(stderr, "Cannot read %s\n", file.c_str());
+            return 1;
+        }
+        add_words(text, words);
+    } else {
+        for (const char* name : { "text/Apache-2.0.txt", "text/GFDL-1.3.txt", "text/GPL-3.txt", "text/MPL-2.0.txt" }) {
+            CHECK(read_file(test_data_path(name), text));
+            add_words(text, words);
+        }
+    }
+    
+    std::string path = test_data_path("../../assets/hyphenation/en-us.pat");
+    std::string patterns;
+    CHECK(read_file(path, patterns));
+    
+    Hyphenator hyphenator;
+    double compile_seconds = best_seconds(rounds, [&]() { CHECK(hyphenator.compile(patterns.data(), patterns.size())); });
+    CHECK(hyphenator.load(path));
+    double load_seconds = best_seconds(rounds, [&]() { CHECK(hyphenator.load(path)); });
+    std::printf("Patterns, best of %d: %.0f KB source, compiled %.2f ms, cached load %.3f ms, %.0f KB packed\n", rounds,
+                patterns.size() / 1024.0, compile_seconds * 1000, load_seconds * 1000,
+                hyphenator.compiled_bytes() / 1024.0);
+    
+    size_t points = 0;
+    double seconds = best_seconds(rounds, [&]() {
+        uint8_t word_points[Hyphenator::MAX_WORD_LENGTH];
+        points = 0;
+        for (const std::string& word : words) {
+            points += hyphenator.hyphenate(word.data(), word.size(), word_points);
+        }
+    });
+    std::printf("%zu words, best of %d: %.2f ms, %.2f M words/s, %.2f points per word\n", words.size(), rounds,
+                seconds * 1000, words.size() / seconds / 1e6, static_cast<double>(points) / words.size());
+    return test_result();
+}
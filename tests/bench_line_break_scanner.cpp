@@ -0,0 +1,134 @@
+#include "line_break.h"
+#include "test_support.h"
+#include "utf8.h"
+#ifdef HAVE_ICU
+#include <unicode/brkiter.h>
+#include <unicode/unistr.h>
+#include <memory>
+#endif
+
+// LineBreakScanner throughput on Latin and CJK text, decoding included as
+// LineBreaker and ChapterStream do. English spends most of its time in the
+// pair table fast path; Chinese, Japanese and Korean, which UAX #14 breaks
+// between syllables too, have an opportunity at almost every codepoint.
+// Where ICU is installed its line break iterator runs on the same text,
+// UTF-16 conversion not timed, and must find the same number of breaks.
+//
+//   bench_line_break_scanner [--quick]
+
+namespace {
+    
+struct Corpus {
+    const char* name;
+    const char* const* words;
+    size_t count;
+    const char* separator;
+};
+    
+const char* const english[] = { "the", "reader", "turned", "another", "page,", "and", "found", "nothing", "but",
+                                "silence", "in", "a", "well-kept", "house", "that", "had", "once", "been", "full." };
+const char* const chinese[] = { "\xE8\xAF\xBB\xE8\x80\x85", "\xE7\xBF\xBB\xE5\xBC\x80",
+                                "\xE4\xBA\x86\xE5\x8F\xA6\xE4\xB8\x80\xE9\xA1\xB5", "\xEF\xBC\x8C",
+                                "\xE6\x88\xBF\xE5\xAD\x90\xE9\x87\x8C",
+                                "\xE4\xB8\x80\xE7\x89\x87\xE5\xAF\x82\xE9\x9D\x99", "\xE3\x80\x82" };
+const char* const japanese[] = { "\xE8\xAA\xAD\xE8\x80\x85\xE3\x81\xAF",
+                                 "\xE3\x83\x9A\xE3\x83\xBC\xE3\x82\xB8\xE3\x82\x92",
+                                 "\xE3\x82\x81\xE3\x81\x8F\xE3\x81\xA3\xE3\x81\x9F", "\xE3\x80\x81",
+                                 "\xE5\xAE\xB6\xE3\x81\xAE\xE4\xB8\xAD\xE3\x81\xAF",
+                                 "\xE9\x9D\x99\xE3\x81\x8B\xE3\x81\xA0\xE3\x81\xA3\xE3\x81\x9F", "\xE3\x80\x82" };
+const char* const korean[] = { "\xEB\x8F\x85\xEC\x9E\x90\xEB\x8A\x94",
+                               "\xED\x8E\x98\xEC\x9D\xB4\xEC\xA7\x80\xEB\xA5\xBC",
+                               "\xEB\x84\x98\xEA\xB2\xBC\xEB\x8B\xA4.", "\xEC\xA7\x91\xEC\x9D\x80",
+                               "\xEC\xA1\xB0\xEC\x9A\xA9\xED\x96\x88\xEB\x8B\xA4." };
+    
+std::string build_text(const Corpus& corpus, size_t target_size) {
+    std::string text;
+    uint32_t state = 1;
+    while (text.size() < target_size) {
+        state = state * 1103515245u + 12345u;
+        text += corpus.words[(state >> 16) % corpus.count];
+        text += corpus.separator;
+        if ((state >> 8) % 97 == 0) text += '\n';
+    }
+    return text;
+}
+    
+std::string build_mixed(const Corpus* corpora, size_t corpus_count, size_t target_size) {
+    std::string text;
+    uint32_t state = 1;
+    while (text.size() < target_size) {
+        state = state * 1103515245u + 12345u;
+        const Corpus& corpus = corpora[(state >> 24) % corpus_count];
+        for (int word = 0; word < 6; ++word) {
+            state = state * 1103515245u + 12345u;
+            text += corpus.words[(state >> 16) % corpus.count];
+            text += corpus.separator;
+        }
+    }
+    return text;
+}
+    
+bool run(const char* name, const std::string& text, int rounds) {
+    size_t codepoints = 0;
+    size_t breaks = 0;
+    double seconds = best_seconds(rounds, [&]() {
+        LineBreakScanner scanner;
+        Utf8Decoder decoder(text);
+        size_t count = 0;
+        size_t found = 0;
+        while (!decoder.done()) {
+            found += scanner.next(decoder.next()) != LineBreakScanner::NO_BREAK ? 1 : 0;
+            ++count;
+        }
+        codepoints = count;
+        breaks = found;
+    });
+    std::printf("  %-8s %5.0f KB  %7.1f MB/s  %5.1f ns/codepoint  %7zu breaks", name, text.size() / 1024.0,
+                text.size() / 1048576.0 / seconds, seconds * 1e9 / codepoints, breaks);
+        
+#ifdef HAVE_ICU
+    UErrorCode status = U_ZERO_ERROR;
+    std::unique_ptr<icu::BreakIterator> iterator(icu::BreakIterator::createLineInstance(icu::Locale::getRoot(), status));
+    icu::UnicodeString utf16 = icu::UnicodeString::fromUTF8(text);
+    size_t icu_breaks = 0;
+    double icu_seconds = best_seconds(rounds, [&]() {
+        iterator->setText(utf16);
+        size_t found = 0;
+        for (int32_t at = iterator->next(); at != icu::BreakIterator::DONE && at < utf16.length(); at = iterator->next()) {
+            ++found;
+        }
+        icu_breaks = found;
+    });
+    std::printf("   ICU %7.1f MB/s  %7zu breaks, %.2fx the time\n", text.size() / 1048576.0 / icu_seconds,
+                icu_breaks, icu_seconds / seconds);
+    return icu_breaks == breaks;
+#else
+    std::printf("\n");
+    return true;
+#endif
+}
+    
+} // namespace
+
+int main(int argc, char** argv) {
+    bool quick = has_flag(argc, argv, "--quick");
+    int rounds = quick ? 1 : 7;
+    size_t size = quick ? 128 * 1024 : 2 * 1024 * 1024;
+    
+    const Corpus corpora[] = {
+        { "English", english, sizeof(english) / sizeof(english[0]), " " },
+        { "Chinese", chinese, sizeof(chinese) / sizeof(chinese[0]), "" },
+        { "Japanese", japanese, sizeof(japanese) / sizeof(japanese[0]), "" },
+        { "Korean", korean, sizeof(korean) / sizeof(korean[0]), " " },
+    };
+    const size_t corpus_count = sizeof(corpora) / sizeof(corpora[0]);
+    
+    std::printf("Best of %d:\n", rounds);
+    bool ok = true;
+    for (size_t i = 0; i < corpus_count; ++i) {
+        ok = run(corpora[i].name, build_text(corpora[i], size), rounds) && ok;
+    }
+    ok = run("Mixed", build_mixed(corpora, corpus_count, size), rounds) && ok;
+    if (!ok) std::printf("The scanner and ICU found different breaks\n");
+    return ok ? 0 : 1;
+}
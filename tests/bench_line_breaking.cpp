@@ -0,0 +1,198 @@
+#include "line_breaker.h"
+#include "software_renderer.h"
+#include "test_support.h"
+#include <cstdlib>
+
+// Greedy line breaking time against paragraph length and line width, for
+// LineBreaker and the wrap_text_to_width it replaced. The old wrapper built
+// each candidate line as a string and measured it whole, so its cost per
+// word grew with the line; LineBreaker keeps a running width and should
+// cost the same per byte at any length and width. Widths are Lato's at
+// 18px; the old wrapper measures through the same table, one advance per
+// codepoint like vita2d's glyph walk.
+//
+//   bench_line_breaking [--quick]
+
+namespace {
+    
+AdvanceTable* advances = nullptr;
+    
+int get_text_width(const std::string& text, int) {
+    return advances->measure(text.data(), text.size());
+}
+    
+// GPURenderer::wrap_text_to_width before LineBreaker, unchanged
+std::vector<std::string> wrap_text_to_width(const std::string& text, int max_width, int font_size) {
+    std::vector<std::string> lines;
+    std::string current_line;
+    std::string current_word;
+        
+    for (size_t i = 0; i < text.length(); ++i) {
+        char c = text[i];
+            
+        if (c == ' ' || c == '\n' || i == text.length() - 1) {
+            if (i == text.length() - 1 && c != ' ' && c != '\n') {
+                current_word += c;
+            }
+                
+            std::string test_line = current_line.empty() ? current_word : current_line + " " + current_word;
+            int test_width = get_text_width(test_line, font_size);
+                
+            if (test_width <= max_width) {
+                current_line = test_line;
+            } else {
+                if (!current_line.empty()) {
+                    lines.push_back(current_line);
+                    current_line = current_word;
+                } else {
+                    // Handle very long words by breaking them
+                    if (get_text_width(current_word, font_size) > max_width) {
+                        // Break the word character by character
+                        std::string partial_word;
+                        for (char wc : current_word) {
+                            std::string test_partial = partial_word + wc;
+                            if (get_text_width(test_partial, font_size) > max_width) {
+                                if (!partial_word.empty()) {
+                                    lines.push_back(partial_word);
+                                }
+                                partial_word = wc;
+                            } else {
+                                partial_word = test_partial;
+                            }
+                        }
+                        current_line = partial_word;
+                    } else {
+                        lines.push_back(current_word);
+                        current_line.clear();
+                    }
+                }
+            }
+                
+            current_word.clear();
+                
+            if (c == '\n') {
+                lines.push_back(current_line);
+                current_line.clear();
+            }
+        } else {
+            current_word += c;
+        }
+    }
+        
+    if (!current_line.empty()) {
+        lines.push_back(current_line);
+    }
+        
+    return lines;
+}
+    
+// One paragraph of words separated by single spaces, with no hyphens or
+// other break opportunities the old wrapper did not know
+std::string paragraph(size_t words) {
+    static const char* const vocabulary[] = {
+        "the", "reader", "turned", "another", "page", "and", "found", "nothing", "but", "silence", "in", "a",
+        "house", "that", "had", "once", "been", "full", "of", "voices,", "letters", "unanswered.", "Margins"
+    };
+    const size_t vocabulary_size = sizeof(vocabulary) / sizeof(vocabulary[0]);
+    std::string text;
+    uint32_t state = 5;
+    for (size_t i = 0; i < words; ++i) {
+        state = state * 1103515245u + 12345u;
+        if (i > 0) text += ' ';
+        text += vocabulary[(state >> 16) % vocabulary_size];
+    }
+    return text;
+}
+    
+struct Timing {
+    double old_seconds;
+    double new_seconds;
+    size_t lines;
+    bool agree;
+};
+    
+Timing time_both(const std::string& text, int width, int rounds, bool run_old) {
+    Timing timing = { 0.0, 0.0, 0, true };
+    LineBreaker breaker(*advances, width);
+    std::vector<LineSpan> spans;
+    timing.new_seconds = best_seconds(rounds, [&]() {
+        spans.clear();
+        breaker.break_lines(text.data(), text.size(), 0, spans);
+    });
+    timing.lines = spans.size();
+    if (!run_old) return timing;
+        
+    std::vector<std::string> lines;
+    timing.old_seconds = best_seconds(rounds, [&]() { lines = wrap_text_to_width(text, width, 18); });
+    timing.agree = lines.size() == spans.size();
+    for (size_t i = 0; timing.agree && i < lines.size(); ++i) {
+        timing.agree = lines[i] == text.substr(spans[i].offset, spans[i].length);
+    }
+    return timing;
+}
+    
+void print_row(const char* label, const std::string& text, const Timing& timing) {
+    double new_ns = timing.new_seconds * 1e9 / text.size();
+    if (timing.old_seconds > 0.0) {
+        std::printf("  %-26s %9.3f ms %6.1f ns/byte   %9.3f ms %6.1f ns/byte%s\n", label, timing.old_seconds * 1e3,
+                    timing.old_seconds * 1e9 / text.size(), timing.new_seconds * 1e3, new_ns,
+                    timing.agree ? "" : "   (lines differ)");
+    } else {
+        std::printf("  %-26s %9s    %6s           %9.3f ms %6.1f ns/byte\n", label, "-", "", timing.new_seconds * 1e3,
+                    new_ns);
+    }
+}
+    
+} // namespace
+
+int main(int argc, char** argv) {
+    bool quick = has_flag(argc, argv, "--quick");
+    int rounds = quick ? 1 : 7;
+    
+    SoftwareRenderer renderer;
+    if (!renderer.initialize(test_data_path("fonts/Lato-Regular.ttf"))) return 1;
+    advances = &renderer.advance_table(18);
+    bool ok = true;
+    
+    // Scaling with paragraph length: ns/byte should stay flat
+    std::vector<size_t> lengths;
+    if (quick) {
+        lengths.push_back(500);
+        lengths.push_back(4000);
+    } else {
+        size_t all[] = { 500, 2000, 8000, 16000, 64000, 256000 };
+        lengths.assign(all, all + sizeof(all) / sizeof(all[0]));
+    }
+    std::printf("Paragraph length, 860 px lines, best of %d:\n", rounds);
+    std::printf("  %-26s %28s   %28s\n", "", "wrap_text_to_width", "LineBreaker");
+    double first_ns = 0.0;
+    double last_ns = 0.0;
+    for (size_t words : lengths) {
+        std::string text = paragraph(words);
+        Timing timing = time_both(text, 860, rounds, words <= 64000);
+        char label[64];
+        std::snprintf(label, sizeof(label), "%6zu words / %5zu KB", words, text.size() / 1024);
+        print_row(label, text, timing);
+        double ns = timing.new_seconds * 1e9 / text.size();
+        if (first_ns == 0.0) first_ns = ns;
+        last_ns = ns;
+        ok = ok && timing.agree;
+    }
+    std::printf("  LineBreaker ns/byte, longest over shortest: %.2f\n\n", last_ns / first_ns);
+    
+    // Scaling with line width: the old cost grows with words per line
+    std::string text = paragraph(quick ? 2000 : 20000);
+    std::printf("%zu words at growing widths:\n", quick ? static_cast<size_t>(2000) : static_cast<size_t>(20000));
+    int widths[] = { 160, 560, 2240, 4480 };
+    for (int width : widths) {
+        Timing timing = time_both(text, width, rounds, true);
+        char label[64];
+        std::snprintf(label, sizeof(label), "%5d px, %5.1f words/line", width,
+                      (quick ? 2000.0 : 20000.0) / timing.lines);
+        print_row(label, text, timing);
+        ok = ok && timing.agree;
+    }
+    
+    if (!ok) std::printf("The wrappers broke some lines differently\n");
+    return ok ? 0 : 1;
+}
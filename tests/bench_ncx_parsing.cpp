@@ -0,0 +1,269 @@
+#include "epub_parser.h"
+#include "file_manager.h"
+#include "heap_stats.h"
+#include "test_support.h"
+#include "zip_writer.h"
+#include <cstdlib>
+#include <cstring>
+
+#ifdef HAVE_LIBXML2
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#endif
+#ifdef HAVE_TINYXML2
+#include <tinyxml2.h>
+#endif
+
+// Time and heap use of reading a large NCX: the pull parser filling the
+// flat TOC, against DOM parsers filling the nested TOCEntry tree the
+// reader used to build. tinyxml2 is what the reader used; libxml2 stands
+// in for it where tinyxml2 is not installed. All paths read the NCX out
+// of the same deflated book.
+//
+//   bench_ncx_parsing [--quick] [--entries N]
+
+namespace {
+    
+// The TOC as the DOM code built it
+struct DomTocEntry {
+    std::string id;
+    std::string title;
+    std::string content_src;
+    int play_order;
+    std::vector<DomTocEntry> children;
+};
+    
+// navPoints nested up to six levels deep, with titles needing decoding
+std::string synthetic_ncx(int entries) {
+    std::string ncx = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                      "<ncx xmlns=\"http://www.daisy.org/z3986/2005/ncx/\" version=\"2005-1\">\n"
+                      "<head><meta name=\"dtb:uid\" content=\"bench\"/></head>\n"
+                      "<docTitle><text>Benchmark</text></docTitle>\n<navMap>\n";
+    int depth = 0;
+    for (int i = 0; i < entries; ++i) {
+        int wanted = 1 + (i * 7 + i / 5) % 6;
+        if (wanted > depth + 1) wanted = depth + 1;
+        for (; depth >= wanted; --depth) ncx += std::string(depth * 2, ' ') + "</navPoint>\n";
+        std::string number = std::to_string(i + 1);
+        ncx += std::string(wanted * 2, ' ') + "<navPoint id=\"np-" + number + "\" playOrder=\"" + number + "\">"
+               "<navLabel><text>Section " + number + " &amp; its &#8220;notes&#8221;</text></navLabel>"
+               "<content src=\"text/chapter" + std::to_string(i / 40) + ".xhtml#s" + number + "\"/>\n";
+        depth = wanted;
+    }
+    for (; depth > 0; --depth) ncx += std::string(depth * 2, ' ') + "</navPoint>\n";
+    return ncx + "</navMap>\n</ncx>\n";
+}
+    
+size_t count_dom_entries(const std::vector<DomTocEntry>& entries) {
+    size_t count = entries.size();
+    for (const DomTocEntry& entry : entries) count += count_dom_entries(entry.children);
+    return count;
+}
+    
+#ifdef HAVE_LIBXML2
+    
+char* counted_strdup(const char* text) {
+    size_t length = std::strlen(text) + 1;
+    char* copy = static_cast<char*>(heap_stats_malloc(length));
+    if (copy) std::memcpy(copy, text, length);
+    return copy;
+}
+    
+xmlNode* child_element(xmlNode* node, const char* name) {
+    for (xmlNode* child = node ? node->children : nullptr; child; child = child->next) {
+        if (child->type == XML_ELEMENT_NODE && std::strcmp(reinterpret_cast<const char*>(child->name), name) == 0) {
+            return child;
+        }
+    }
+    return nullptr;
+}
+    
+xmlNode* next_element(xmlNode* node, const char* name) {
+    for (node = node->next; node; node = node->next) {
+        if (node->type == XML_ELEMENT_NODE && std::strcmp(reinterpret_cast<const char*>(node->name), name) == 0) {
+            return node;
+        }
+    }
+    return nullptr;
+}
+    
+// Attribute text without xmlGetProp's copy, like tinyxml2's Attribute()
+const char* attribute(xmlNode* node, const char* name) {
+    for (xmlAttr* attr = node->properties; attr; attr = attr->next) {
+        if (std::strcmp(reinterpret_cast<const char*>(attr->name), name) == 0 && attr->children) {
+            return reinterpret_cast<const char*>(attr->children->content);
+        }
+    }
+    return nullptr;
+}
+    
+DomTocEntry libxml2_nav_point(xmlNode* nav_point) {
+    DomTocEntry entry;
+    const char* id = attribute(nav_point, "id");
+    const char* play_order = attribute(nav_point, "playOrder");
+    if (id) entry.id = id;
+    entry.play_order = play_order ? std::atoi(play_order) : 0;
+        
+    xmlNode* text = child_element(child_element(nav_point, "navLabel"), "text");
+    if (text && text->children && text->children->content) {
+        entry.title = reinterpret_cast<const char*>(text->children->content);
+    }
+    xmlNode* content = child_element(nav_point, "content");
+    const char* src = content ? attribute(content, "src") : nullptr;
+    if (src) entry.content_src = src;
+        
+    for (xmlNode* child = child_element(nav_point, "navPoint"); child; child = next_element(child, "navPoint")) {
+        DomTocEntry child_entry = libxml2_nav_point(child);
+        if (!child_entry.title.empty()) entry.children.push_back(child_entry);
+    }
+    return entry;
+}
+    
+bool libxml2_parse(EPUBParser& parser, std::vector<DomTocEntry>& toc) {
+    std::string content = parser.get_content("toc.ncx");
+    xmlDoc* document = xmlReadMemory(content.data(), static_cast<int>(content.size()), nullptr, nullptr,
+                                     XML_PARSE_NONET);
+    if (!document) return false;
+        
+    toc.clear();
+    xmlNode* nav_map = child_element(xmlDocGetRootElement(document), "navMap");
+    for (xmlNode* point = child_element(nav_map, "navPoint"); point; point = next_element(point, "navPoint")) {
+        DomTocEntry entry = libxml2_nav_point(point);
+        if (!entry.title.empty()) toc.push_back(entry);
+    }
+    xmlFreeDoc(document);
+    return nav_map != nullptr;
+}
+    
+#endif // HAVE_LIBXML2
+    
+#ifdef HAVE_TINYXML2
+    
+// The reader's parse_ncx and parse_nav_point before the pull parser
+DomTocEntry tinyxml2_nav_point(tinyxml2::XMLElement* nav_point) {
+    DomTocEntry entry;
+    const char* id = nav_point->Attribute("id");
+    const char* play_order = nav_point->Attribute("playOrder");
+    if (id) entry.id = id;
+    entry.play_order = play_order ? std::atoi(play_order) : 0;
+        
+    tinyxml2::XMLElement* label = nav_point->FirstChildElement("navLabel");
+    tinyxml2::XMLElement* text = label ? label->FirstChildElement("text") : nullptr;
+    if (text && text->GetText()) entry.title = text->GetText();
+    tinyxml2::XMLElement* content = nav_point->FirstChildElement("content");
+    if (content && content->Attribute("src")) entry.content_src = content->Attribute("src");
+        
+    for (tinyxml2::XMLElement* child = nav_point->FirstChildElement("navPoint"); child;
+         child = child->NextSiblingElement("navPoint")) {
+        DomTocEntry child_entry = tinyxml2_nav_point(child);
+        if (!child_entry.title.empty()) entry.children.push_back(child_entry);
+    }
+    return entry;
+}
+    
+bool tinyxml2_parse(EPUBParser& parser, std::vector<DomTocEntry>& toc) {
+    std::string content = parser.get_content("toc.ncx");
+    tinyxml2::XMLDocument document;
+    if (document.Parse(content.c_str()) != tinyxml2::XML_SUCCESS) return false;
+    tinyxml2::XMLElement* ncx = document.FirstChildElement("ncx");
+    tinyxml2::XMLElement* nav_map = ncx ? ncx->FirstChildElement("navMap") : nullptr;
+    if (!nav_map) return false;
+        
+    toc.clear();
+    for (tinyxml2::XMLElement* point = nav_map->FirstChildElement("navPoint"); point;
+         point = point->NextSiblingElement("navPoint")) {
+        DomTocEntry entry = tinyxml2_nav_point(point);
+        if (!entry.title.empty()) toc.push_back(entry);
+    }
+    return true;
+}
+    
+#endif // HAVE_TINYXML2
+    
+void report(const char* name, double seconds, size_t allocations, size_t peak_bytes, size_t entries) {
+    std::printf("  %-12s %8.2f ms %9zu allocations %9.1f KB peak %7zu entries\n", name, seconds * 1000,
+                allocations, peak_bytes / 1024.0, entries);
+}
+    
+// The first parse with the heap counted, then the best of rounds for time
+template <typename Parse>
+void measure(const char* name, int rounds, Parse parse) {
+    size_t baseline = heap_stats.live_bytes;
+    heap_stats_reset();
+    size_t entries = parse();
+    size_t allocations = heap_stats.allocations;
+    size_t peak = heap_stats_peak_since(baseline);
+    double seconds = best_seconds(rounds, parse);
+    report(name, seconds, allocations, peak, entries);
+}
+    
+bool run(int entries, int rounds) {
+    std::string ncx = synthetic_ncx(entries);
+    ZipWriter zip;
+    std::vector<std::string> chapters(1, "<html><body><p>Text</p></body></html>");
+        
+    // Not in the manifest, so opening the book leaves the NCX unread and
+    // the first parse below starts from empty buffers
+    add_minimal_book(zip, chapters, true);
+    zip.add("OEBPS/toc.ncx", ncx, true);
+    std::string path = FileManager::EPUB_DIR + "/bench_ncx_" + std::to_string(entries) + ".epub";
+    if (!zip.write(path)) return false;
+        
+    EPUBParser parser;
+    if (!parser.open_epub(path)) return false;
+    std::printf("%d entries, %.0f KB NCX:\n", entries, ncx.size() / 1024.0);
+        
+    size_t pull_entries = 0;
+    measure("pull", rounds, [&]() {
+        parser.parse_ncx("OEBPS/toc.ncx");
+        return pull_entries = parser.get_table_of_contents().size();
+    });
+    bool agree = pull_entries == static_cast<size_t>(entries);
+        
+#ifdef HAVE_LIBXML2
+    std::vector<DomTocEntry> libxml2_toc;
+    measure("libxml2 DOM", rounds, [&]() {
+        libxml2_parse(parser, libxml2_toc);
+        return count_dom_entries(libxml2_toc);
+    });
+    agree = agree && count_dom_entries(libxml2_toc) == pull_entries;
+#endif
+#ifdef HAVE_TINYXML2
+    std::vector<DomTocEntry> tinyxml2_toc;
+    measure("tinyxml2 DOM", rounds, [&]() {
+        tinyxml2_parse(parser, tinyxml2_toc);
+        return count_dom_entries(tinyxml2_toc);
+    });
+    agree = agree && count_dom_entries(tinyxml2_toc) == pull_entries;
+#endif
+        
+    if (!agree) std::printf("  parsers disagree on the entry count\n");
+    return agree;
+}
+    
+} // namespace
+
+int main(int argc, char** argv) {
+#ifdef HAVE_LIBXML2
+    xmlMemSetup(heap_stats_free, heap_stats_malloc, heap_stats_realloc, counted_strdup);
+    xmlInitParser();
+#endif
+    if (!FileManager::initialize_directories()) return 1;
+    
+    bool quick = has_flag(argc, argv, "--quick");
+    int rounds = quick ? 1 : 5;
+    std::vector<int> sizes;
+    std::string requested = flag_value(argc, argv, "--entries");
+    if (!requested.empty()) {
+        sizes.push_back(std::atoi(requested.c_str()));
+    } else if (quick) {
+        sizes.push_back(500);
+    } else {
+        sizes.push_back(3000);
+        sizes.push_back(10000);
+    }
+    
+    bool ok = true;
+    for (int entries : sizes) ok = run(entries, rounds) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,223 @@
+#include "file_manager.h"
+#include "hyphenator.h"
+#include "line_breaker.h"
+#include "software_renderer.h"
+#include "test_support.h"
+#include <cmath>
+
+// Greedy against optimal-fit breaking on real paragraphs, at the widths
+// MAX_LINE_WORDS and MAX_OPTIMAL_WORDS were chosen for. For each breaker:
+// time per byte and for the slowest paragraph, the demerits break_optimal
+// minimizes, the rms space adjustment (slack per space, in space widths)
+// and how many lines stretch their spaces past twice their width. Then
+// how close the corpus comes to the two limits, and the worst case they
+// allow: a MAX_OPTIMAL_WORDS paragraph of the shortest words.
+// Widths are Lato's at 18px; the text is tests/data/text unless --file
+// names a plain text file with blank lines between paragraphs.
+//
+//   bench_optimal_breaking [--quick] [--file book.txt]
+
+namespace {
+    
+const char* const CORPUS[] = { "GPL-3.txt", "GFDL-1.3.txt", "Apache-2.0.txt", "MPL-2.0.txt" };
+    
+// Lines joined, runs of white space collapsed to one space
+void split_paragraphs(const std::string& text, std::vector<std::string>& paragraphs) {
+    std::string paragraph;
+    size_t line_start = 0;
+    while (line_start < text.size()) {
+        size_t line_end = text.find('\n', line_start);
+        if (line_end == std::string::npos) line_end = text.size();
+        bool blank = true;
+        for (size_t i = line_start; i < line_end; ++i) {
+            char c = text[i];
+            if (c == ' ' || c == '\t' || c == '\r') {
+                if (!paragraph.empty() && paragraph[paragraph.size() - 1] != ' ') paragraph += ' ';
+            } else {
+                paragraph += c;
+                blank = false;
+            }
+        }
+        if (!paragraph.empty() && paragraph[paragraph.size() - 1] != ' ') paragraph += ' ';
+        if (blank && !paragraph.empty()) {
+            paragraph.erase(paragraph.size() - 1);
+            paragraphs.push_back(paragraph);
+            paragraph.clear();
+        }
+        line_start = line_end + 1;
+    }
+    if (!paragraph.empty()) {
+        paragraph.erase(paragraph.size() - 1);
+        paragraphs.push_back(paragraph);
+    }
+}
+    
+size_t count_spaces(const std::string& text, const LineSpan& span) {
+    size_t spaces = 0;
+    for (uint32_t i = span.offset; i < span.offset + span.length; ++i) {
+        if (text[i] == ' ') ++spaces;
+    }
+    return spaces;
+}
+    
+struct Quality {
+    double demerits;
+    double adjustment_squares;  // Sum over spaced lines of (slack per space / space width)^2
+    size_t spaced_lines;
+    size_t loose_lines;         // Spaces past twice their width
+    size_t lines;
+    size_t most_words;          // Widest line, in words
+};
+    
+// Costs a paragraph's lines as find_breaks does, without the fitness
+// class demerits; the last line is set ragged and costs nothing. Badness
+// is capped at TeX's 10000 here, so the odd line that cannot be set, such
+// as one holding a long URL, does not swamp the total.
+void add_quality(const std::string& text, const std::vector<LineSpan>& spans, int max_width, int space_width,
+                 Quality& quality) {
+    for (size_t i = 0; i < spans.size(); ++i) {
+        size_t spaces = count_spaces(text, spans[i]);
+        quality.most_words = std::max(quality.most_words, spaces + 1);
+        ++quality.lines;
+        if (i + 1 == spans.size()) continue;
+            
+        int slack = max_width - spans[i].width;
+        double stretch = static_cast<double>(space_width) * (spaces > 0 ? spaces : 1);
+        double ratio = slack < 0 ? slack * 3 / stretch : slack * 2 / stretch;
+        double badness = std::min(10000.0, 100 * std::fabs(ratio * ratio * ratio));
+        quality.demerits += (10 + badness) * (10 + badness) + (spans[i].hyphen ? 50 * 50 : 0);
+        if (spaces == 0) continue;
+            
+        double adjustment = static_cast<double>(slack) / spaces / space_width;
+        quality.adjustment_squares += adjustment * adjustment;
+        ++quality.spaced_lines;
+        if (adjustment > 1.0) ++quality.loose_lines;
+    }
+}
+    
+struct Result {
+    double seconds;
+    double worst_seconds;
+    Quality quality;
+};
+    
+Result run(const std::vector<std::string>& paragraphs, AdvanceTable& advances, int width,
+           const Hyphenator* hyphenator, bool optimal, int rounds) {
+    LineBreaker breaker(advances, width, hyphenator);
+    std::vector<LineSpan> spans;
+    Result result = { 0.0, 0.0, Quality() };
+    for (const std::string& paragraph : paragraphs) {
+        double seconds = best_seconds(rounds, [&]() {
+            spans.clear();
+            if (optimal) {
+                breaker.break_optimal(paragraph.data(), paragraph.size(), 0, spans);
+            } else {
+                breaker.break_lines(paragraph.data(), paragraph.size(), 0, spans);
+            }
+        });
+        result.seconds += seconds;
+        result.worst_seconds = std::max(result.worst_seconds, seconds);
+        add_quality(paragraph, spans, width, advances.advance(' '), result.quality);
+    }
+    return result;
+}
+    
+// The longest paragraph break_optimal takes, of one- and two-letter words
+// so that short lines still hold dozens, against one word more, which
+// goes to greedy. The slowest of a sweep of widths is reported.
+void worst_case(AdvanceTable& advances, int rounds) {
+    static const char* const short_words[] = { "a", "ab", "i" };
+    std::printf("\nWorst case, slowest width from 300 to 1200 px:\n");
+    size_t counts[] = { LineBreaker::MAX_OPTIMAL_WORDS, LineBreaker::MAX_OPTIMAL_WORDS + 1 };
+    for (size_t words : counts) {
+        std::string paragraph;
+        uint32_t state = 1;
+        for (size_t i = 0; i < words; ++i) {
+            state = state * 1103515245u + 12345u;
+            if (i > 0) paragraph += ' ';
+            paragraph += short_words[(state >> 16) % 3];
+        }
+            
+        double worst = 0.0;
+        int worst_width = 0;
+        std::vector<LineSpan> spans;
+        for (int width = 300; width <= 1200; width += 50) {
+            LineBreaker breaker(advances, width);
+            double seconds = best_seconds(rounds, [&]() {
+                spans.clear();
+                breaker.break_optimal(paragraph.data(), paragraph.size(), 0, spans);
+            });
+            if (seconds > worst) {
+                worst = seconds;
+                worst_width = width;
+            }
+        }
+        std::printf("  %5zu words  %8.3f ms at %4d px  %s\n", words, worst * 1e3, worst_width,
+                    words > LineBreaker::MAX_OPTIMAL_WORDS ? "(greedy)" : "");
+    }
+}
+    
+} // namespace
+
+int main(int argc, char** argv) {
+    bool quick = has_flag(argc, argv, "--quick");
+    int rounds = quick ? 1 : 5;
+    
+    std::vector<std::string> paragraphs;
+    size_t bytes = 0;
+    std::string file = flag_value(argc, argv, "--file");
+    std::vector<std::string> files;
+    if (!file.empty()) {
+        files.push_back(file);
+    } else {
+        for (const char* name : CORPUS) files.push_back(test_data_path(std::string("text/") + name));
+    }
+    for (const std::string& path : files) {
+        std::string text;
+        if (!read_file(path, text)) {
+            std::cerr << "Cannot read " << path << std::endl;
+            return 1;
+        }
+        split_paragraphs(text, paragraphs);
+    }
+    size_t most_words = 0;
+    for (const std::string& paragraph : paragraphs) {
+        bytes += paragraph.size();
+        size_t words = 1;
+        for (char c : paragraph) words += c == ' ' ? 1 : 0;
+        most_words = std::max(most_words, words);
+    }
+    
+    SoftwareRenderer renderer;
+    if (!renderer.initialize(test_data_path("fonts/Lato-Regular.ttf"))) return 1;
+    AdvanceTable& advances = renderer.advance_table(18);
+    FileManager::initialize_directories();
+    Hyphenator hyphenator;
+    if (!hyphenator.load(test_data_path("../../assets/hyphenation/en-us.pat"))) return 1;
+    
+    std::printf("%zu paragraphs, %.0f KB, longest %zu words (cap %zu), best of %d:\n", paragraphs.size(),
+                bytes / 1024.0, most_words, LineBreaker::MAX_OPTIMAL_WORDS, rounds);
+    std::printf("  width  breaker            ns/byte  worst para    demerits  rms space adj  lines >2x  "
+                "most words/line\n");
+    int widths[] = { 860, 560, 300 };
+    bool ok = true;
+    for (int width : widths) {
+        for (int mode = 0; mode < 4; ++mode) {
+            bool optimal = mode % 2 == 1;
+            const Hyphenator* used = mode >= 2 ? &hyphenator : nullptr;
+            Result result = run(paragraphs, advances, width, used, optimal, rounds);
+            const Quality& quality = result.quality;
+            char name[32];
+            std::snprintf(name, sizeof(name), "%s%s", optimal ? "optimal" : "greedy", used ? ", hyphens" : "");
+            std::printf("  %5d  %-17s %8.1f  %7.1f us  %10.3g  %13.3f  %9zu  %15zu\n", width, name,
+                        result.seconds * 1e9 / bytes, result.worst_seconds * 1e6, quality.demerits,
+                        quality.spaced_lines ? std::sqrt(quality.adjustment_squares / quality.spaced_lines) : 0.0,
+                        quality.loose_lines, quality.most_words);
+            ok = ok && quality.most_words < LineBreaker::MAX_LINE_WORDS;
+        }
+    }
+    if (!ok) std::printf("Some line holds MAX_LINE_WORDS words or more; the window may cut its breaks short\n");
+    
+    worst_case(advances, rounds);
+    return ok ? 0 : 1;
+}
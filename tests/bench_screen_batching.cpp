@@ -0,0 +1,135 @@
+#include "file_manager.h"
+#include "gpu_renderer.h"
+#include "test_support.h"
+#include "zip_writer.h"
+#include "ui/menu.cpp"
+#include "ui/reader.cpp"
+#include "ui/settings.cpp"
+#include "epub/navigation.cpp"
+
+// Draw calls per screen: each screen draws frames as the main loop does,
+// through GPURenderer into a RecordingBackend, and the backend's report
+// gives the commands recorded against the batches and calls submitted.
+// The reader's first frame also fills the page cache, which later frames
+// blit. Its tiles need the app's fonts, so pages are drawn by GPURenderer.
+//
+//   bench_screen_batching [--quick]
+
+namespace {
+    
+const int LIBRARY_BOOKS = 16;
+    
+std::string chapter(uint32_t seed) {
+    static const char* const words[] = { "the", "reader", "turned", "another", "page", "and", "found", "nothing",
+                                         "but", "silence", "in", "a", "well-kept", "house" };
+    std::string text = "<html><body><h1>Chapter</h1>\n";
+    uint32_t state = seed;
+    for (int paragraph = 0; paragraph < 40; ++paragraph) {
+        text += "<p>";
+        for (int word = 0; word < 60; ++word) {
+            state = state * 1103515245u + 12345u;
+            const char* next = words[(state >> 16) % (sizeof(words) / sizeof(words[0]))];
+            if (word % 17 == 5) {
+                text += std::string("<em>") + next + "</em> ";
+            } else if (word % 23 == 11) {
+                text += std::string("<strong>") + next + "</strong> ";
+            } else {
+                text += std::string(next) + " ";
+            }
+        }
+        text += "</p>\n";
+    }
+    return text + "</body></html>";
+}
+    
+std::string write_library() {
+    std::string first;
+    for (int book = 0; book < LIBRARY_BOOKS; ++book) {
+        std::vector<std::string> chapters;
+        chapters.push_back(chapter(book * 2 + 1));
+        chapters.push_back(chapter(book * 2 + 2));
+        ZipWriter zip;
+        add_minimal_book(zip, chapters, true);
+        char name[32];
+        std::snprintf(name, sizeof(name), "/library-%02d.epub", book);
+        std::string path = FileManager::EPUB_DIR + name;
+        CHECK(zip.write(path));
+        if (book == 0) first = path;
+    }
+    return first;
+}
+    
+SceCtrlData press(unsigned int buttons) {
+    SceCtrlData ctrl = SceCtrlData();
+    ctrl.buttons = buttons;
+    ctrl.lx = ctrl.ly = ctrl.rx = ctrl.ry = 128;
+    return ctrl;
+}
+    
+// Times frames of draw, then counts one; prepare runs before each
+template <typename Draw, typename Prepare>
+void measure(GPURenderer& renderer, RecordingBackend& recording, const char* screen, int rounds, Draw draw,
+             Prepare prepare) {
+    auto frame = [&]() {
+        prepare();
+        renderer.begin_frame();
+        draw();
+        renderer.end_frame();
+    };
+    double seconds = best_seconds(rounds, frame);
+        
+    recording.reset();
+    frame();
+    const GPURenderer::FrameStats& frame_stats = renderer.frame_stats();
+    DisplayList::Stats stats = { frame_stats.commands, frame_stats.batches, frame_stats.draw_calls };
+    const RecordingBackend::Counts& counts = recording.counts();
+    CHECK_EQ(counts.fill_batches + counts.line_batches + counts.texture_batches + counts.text_draws,
+             stats.draw_calls);
+    CHECK(stats.batches <= stats.commands);
+        
+    std::printf("%8.1f us  ", seconds * 1e6);
+    recording.report(std::cout, screen, stats);
+}
+    
+} // namespace
+
+int main(int argc, char** argv) {
+    bool quick = has_flag(argc, argv, "--quick");
+    int rounds = quick ? 1 : 50;
+    
+    FileManager::initialize_directories();
+    std::string book_path = write_library();
+    
+    GPURenderer renderer;
+    CHECK(renderer.initialize());
+    RecordingBackend recording;
+    renderer.set_display_backend(&recording);
+    
+    MainMenu main_menu(&renderer);
+    SettingsMenu settings_menu(&renderer);
+    BookList book_list(&renderer);
+    EPUBParser parser;
+    CHECK(parser.open_epub(book_path));
+    BookReader reader(&renderer, &parser);
+    reader.apply_settings(settings_menu.get_layout_settings());
+    CHECK(reader.open_book(book_path));
+    
+    auto nothing = []() {};
+    auto uncached = [&]() { renderer.invalidate_page_cache(); };
+    std::printf("Frame time, best of %d, and what it drew:\n", rounds);
+    measure(renderer, recording, "main menu", rounds, [&]() { main_menu.render(); }, nothing);
+    measure(renderer, recording, "settings", rounds, [&]() { settings_menu.render(); }, nothing);
+    measure(renderer, recording, "book list", rounds, [&]() { book_list.render(); }, nothing);
+    measure(renderer, recording, "reader page, first frame", rounds, [&]() { reader.render(); }, uncached);
+    measure(renderer, recording, "reader page", rounds, [&]() { reader.render(); }, nothing);
+    
+    // Triangle shows the overlay
+    reader.update(press(SCE_CTRL_TRIANGLE), 0);
+    reader.update(press(0), SCE_CTRL_TRIANGLE);
+    measure(renderer, recording, "reader page + overlay", rounds, [&]() { reader.render(); }, nothing);
+    
+    reader.close_book();
+    parser.close();
+    renderer.cleanup();
+    return test_result();
+}
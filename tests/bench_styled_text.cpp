@@ -0,0 +1,136 @@
+#include "html_text.h"
+#include "styled_text.h"
+#include "test_support.h"
+
+// What keeping styles costs on top of the plain text: bytes of runs,
+// blocks and styles per byte of extracted text, and extraction time with
+// a styled output against without. Synthetic chapters range from plain
+// prose to emphasis every few words; files given on the command line are
+// measured together, fed in 4KB chunks.
+//
+//   bench_styled_text [--quick] [chapter.xhtml ...]
+
+namespace {
+    
+// Paragraphs of prose with a heading per section; one word in every
+// emphasis_every is emphasised, alternating italic and bold
+std::string synthetic_chapter(size_t target_size, int emphasis_every) {
+    static const char* const words[] = {
+        "the", "reader", "turned", "another", "page", "and", "found", "nothing", "but", "silence", "in",
+        "a", "house", "that", "had", "once", "been", "full", "of", "voices", "letters", "unanswered"
+    };
+    const size_t word_count = sizeof(words) / sizeof(words[0]);
+        
+    std::string html = "<html><body>\n";
+    uint32_t state = 1;
+    int emphasis = 0;
+    for (int section = 0; html.size() < target_size; ++section) {
+        html += "<h2 id=\"s" + std::to_string(section) + "\">Section " + std::to_string(section) + "</h2>\n";
+        for (int paragraph = 0; paragraph < 12; ++paragraph) {
+            html += "<p>";
+            for (int word = 0; word < 90; ++word) {
+                state = state * 1103515245u + 12345u;
+                const char* next = words[(state >> 16) % word_count];
+                if (word > 0) html += ' ';
+                if (emphasis_every > 0 && (state >> 8) % emphasis_every == 0) {
+                    html += (++emphasis % 2) ? std::string("<em>") + next + "</em>" :
+                                               std::string("<b>") + next + "</b>";
+                } else {
+                    html += next;
+                }
+            }
+            html += ".</p>\n";
+        }
+    }
+    return html + "</body></html>\n";
+}
+    
+struct Totals {
+    size_t text;
+    size_t runs;
+    size_t blocks;
+    size_t styles;
+    size_t overhead;
+        
+    Totals() : text(0), runs(0), blocks(0), styles(0), overhead(0) {}
+};
+    
+void extract(const std::string& html, StyledText* styled, std::string& text, HtmlTextExtractor& extractor) {
+    const size_t chunk_size = 4 * 1024;
+    extractor.reset();
+    extractor.set_styled_output(styled);
+    for (size_t at = 0; at < html.size(); at += chunk_size) {
+        extractor.feed(html.data() + at, std::min(chunk_size, html.size() - at), text);
+    }
+    extractor.finish(text);
+    extractor.set_styled_output(nullptr);
+}
+    
+void measure(const char* name, const std::vector<std::string>& chapters, int rounds) {
+    HtmlTextExtractor extractor;
+    std::string plain;
+    double plain_seconds = best_seconds(rounds, [&]() {
+        for (const std::string& html : chapters) {
+            plain.clear();
+            extract(html, nullptr, plain, extractor);
+        }
+    });
+        
+    Totals totals;
+    StyledText styled;
+    double styled_seconds = best_seconds(rounds, [&]() {
+        totals = Totals();
+        for (const std::string& html : chapters) {
+            styled.clear();
+            extract(html, &styled, styled.text, extractor);
+            styled.shrink_to_fit();
+            totals.text += styled.text.size();
+            totals.runs += styled.runs.size();
+            totals.blocks += styled.blocks.size();
+            totals.styles += styled.style_count();
+            totals.overhead += styled.overhead_bytes();
+        }
+    });
+        
+    // The last chapter both ways, to check styles change nothing in the text
+    plain.clear();
+    extract(chapters.back(), nullptr, plain, extractor);
+    CHECK(plain == styled.text);
+        
+    double text = totals.text ? static_cast<double>(totals.text) : 1.0;
+    std::printf("  %-22s %8zu bytes of text %7zu runs %6zu blocks %4zu styles\n", name, totals.text, totals.runs,
+                totals.blocks, totals.styles);
+    std::printf("  %-22s runs %.4f, blocks %.4f bytes per text byte, %.1f%% overhead, time %+.1f%%\n", "",
+                totals.runs * sizeof(StyledText::Run) / text, totals.blocks * sizeof(StyledText::Block) / text,
+                100.0 * totals.overhead / text, 100.0 * (styled_seconds - plain_seconds) / plain_seconds);
+}
+    
+} // namespace
+
+int main(int argc, char** argv) {
+    bool quick = has_flag(argc, argv, "--quick");
+    int rounds = quick ? 1 : 7;
+    
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        std::string html;
+        if (argv[i][0] == '-') continue;
+        if (!read_file(argv[i], html)) {
+            std::fprintf(stderr, "Cannot read %s\n", argv[i]);
+            return 1;
+        }
+        files.push_back(html);
+    }
+    
+    std::printf("Styled output against plain, best of %d:\n", rounds);
+    if (!files.empty()) {
+        measure((std::to_string(files.size()) + " files").c_str(), files, rounds);
+        return test_result();
+    }
+    
+    size_t size = quick ? 128 * 1024 : 2 * 1024 * 1024;
+    measure("plain prose", std::vector<std::string>(1, synthetic_chapter(size, 0)), rounds);
+    measure("emphasis 1 in 30", std::vector<std::string>(1, synthetic_chapter(size, 30)), rounds);
+    measure("emphasis 1 in 5", std::vector<std::string>(1, synthetic_chapter(size, 5)), rounds);
+    return test_result();
+}
@@ -0,0 +1,128 @@
+#include "utf8.h"
+#include "test_support.h"
+#include "utf8_reference.h"
+
+// Decode throughput of Utf8Decoder on text in different scripts, against
+// the byte-at-a-time reference decoder. English is almost all ASCII runs,
+// where ascii_prefix and the word-at-a-time paths pay off; Russian and
+// Chinese are mostly multi-byte; the mixed text switches script every few
+// words. On ARM builds ascii_prefix takes its NEON path.
+//
+//   bench_utf8_decoding [--quick]
+
+namespace {
+    
+struct Corpus {
+    const char* name;
+    const char* const* words;
+    size_t count;
+};
+    
+const char* const english[] = { "the", "reader", "turned", "another", "page,", "and", "found", "nothing",
+                                "but", "silence", "in", "a", "house", "that", "had", "once", "been", "full." };
+const char* const french[] = { "l\xC3\xA9t\xC3\xA9", "pr\xC3\xA8s", "de", "la", "for\xC3\xAAt", "o\xC3\xB9",
+                               "na\xC3\xAFve", "fa\xC3\xA7" "ade", "\xC2\xAB" "bient\xC3\xB4t\xC2\xBB", "et",
+                               "le", "c\xC5\x93ur", "\xC3\xA9tait", "ferm\xC3\xA9." };
+const char* const russian[] = { "\xD1\x87\xD0\xB8\xD1\x82\xD0\xB0\xD1\x82\xD0\xB5\xD0\xBB\xD1\x8C",
+                                "\xD0\xBF\xD0\xB5\xD1\x80\xD0\xB5\xD0\xB2\xD0\xB5\xD1\x80\xD0\xBD\xD1\x83\xD0\xBB",
+                                "\xD1\x81\xD1\x82\xD1\x80\xD0\xB0\xD0\xBD\xD0\xB8\xD1\x86\xD1\x83",
+                                "\xD0\xB8", "\xD0\xB2", "\xD0\xB4\xD0\xBE\xD0\xBC\xD0\xB5",
+                                "\xD0\xB1\xD1\x8B\xD0\xBB\xD0\xBE", "\xD1\x82\xD0\xB8\xD1\x85\xD0\xBE." };
+const char* const chinese[] = { "\xE8\xAF\xBB\xE8\x80\x85", "\xE7\xBF\xBB\xE5\xBC\x80",
+                                "\xE4\xBA\x86\xE5\x8F\xA6\xE4\xB8\x80\xE9\xA1\xB5",
+                                "\xEF\xBC\x8C", "\xE6\x88\xBF\xE5\xAD\x90\xE9\x87\x8C",
+                                "\xE4\xB8\x80\xE7\x89\x87\xE5\xAF\x82\xE9\x9D\x99", "\xE3\x80\x82" };
+    
+std::string build_text(const Corpus* corpora, size_t corpus_count, size_t target_size) {
+    std::string text;
+    uint32_t state = 1;
+    while (text.size() < target_size) {
+        state = state * 1103515245u + 12345u;
+        const Corpus& corpus = corpora[(state >> 24) % corpus_count];
+        for (int word = 0; word < 6; ++word) {
+            state = state * 1103515245u + 12345u;
+            text += corpus.words[(state >> 16) % corpus.count];
+            text += ' ';
+        }
+        if ((state >> 8) % 17 == 0) text += "\xF0\x9F\x98\x80 ";      // Emoji now and then
+    }
+    return text;
+}
+    
+void report(const char* name, double seconds, size_t bytes, size_t codepoints, double baseline) {
+    std::printf("    %-18s %7.1f MB/s  %7.1f M codepoints/s", name, bytes / 1048576.0 / seconds,
+                codepoints / 1e6 / seconds);
+    if (baseline > 0.0) std::printf("  %5.2fx", baseline / seconds);
+    std::printf("\n");
+}
+    
+bool run(const char* name, const std::string& text, int rounds) {
+    std::vector<uint32_t> codepoints(text.size());
+    size_t count = 0;
+    std::printf("  %s, %.0f KB:\n", name, text.size() / 1024.0);
+        
+    uint32_t checksum = 0;
+    double reference_seconds = best_seconds(rounds, [&]() {
+        uint32_t sum = 0;
+        size_t i = 0;
+        while (i < text.size()) sum += reference_utf8_next(text.data(), text.size(), i);
+        checksum = sum;
+    });
+        
+    count = Utf8Decoder::decode(text.data(), text.size(), &codepoints[0]);
+    report("reference", reference_seconds, text.size(), count, 0.0);
+        
+    uint32_t next_checksum = 0;
+    double next_seconds = best_seconds(rounds, [&]() {
+        uint32_t sum = 0;
+        Utf8Decoder decoder(text);
+        while (!decoder.done()) sum += decoder.next();
+        next_checksum = sum;
+    });
+    report("next()", next_seconds, text.size(), count, reference_seconds);
+        
+    double decode_seconds = best_seconds(rounds, [&]() {
+        count = Utf8Decoder::decode(text.data(), text.size(), &codepoints[0]);
+    });
+    report("decode()", decode_seconds, text.size(), count, reference_seconds);
+        
+    bool valid = false;
+    double valid_seconds = best_seconds(rounds, [&]() { valid = Utf8Decoder::is_valid(text.data(), text.size()); });
+    report("is_valid()", valid_seconds, text.size(), count, reference_seconds);
+        
+    std::string sanitized;
+    double sanitize_seconds = best_seconds(rounds, [&]() {
+        Utf8Decoder::sanitize(text.data(), text.size(), sanitized);
+    });
+    report("sanitize()", sanitize_seconds, text.size(), count, reference_seconds);
+        
+    uint32_t decode_checksum = 0;
+    for (size_t i = 0; i < count; ++i) decode_checksum += codepoints[i];
+    bool ok = valid && sanitized == text && next_checksum == checksum && decode_checksum == checksum;
+    if (!ok) std::printf("    decoders disagree\n");
+    return ok;
+}
+    
+} // namespace
+
+int main(int argc, char** argv) {
+    bool quick = has_flag(argc, argv, "--quick");
+    int rounds = quick ? 1 : 7;
+    size_t size = quick ? 256 * 1024 : 4 * 1024 * 1024;
+    
+    const Corpus corpora[] = {
+        { "English", english, sizeof(english) / sizeof(english[0]) },
+        { "French", french, sizeof(french) / sizeof(french[0]) },
+        { "Russian", russian, sizeof(russian) / sizeof(russian[0]) },
+        { "Chinese", chinese, sizeof(chinese) / sizeof(chinese[0]) },
+    };
+    const size_t corpus_count = sizeof(corpora) / sizeof(corpora[0]);
+    
+    std::printf("Best of %d:\n", rounds);
+    bool ok = true;
+    for (size_t i = 0; i < corpus_count; ++i) {
+        ok = run(corpora[i].name, build_text(&corpora[i], 1, size), rounds) && ok;
+    }
+    ok = run("Mixed", build_text(corpora, corpus_count, size), rounds) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+#include "file_manager.h"
+#include <algorithm>
+#include <cerrno>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// FileManager on POSIX for the host tests. Everything lives under
+// host_data/ in the directory the test runs in.
+const std::string FileManager::EPUB_DIR = "host_data/books";
+const std::string FileManager::CONFIG_DIR = "host_data/config";
+const std::string FileManager::CACHE_DIR = "host_data/cache";
+const std::string FileManager::CERT_DIR = "host_data/certs";
+
+bool FileManager::initialize_directories() {
+    bool success = create_directory("host_data");
+    success &= create_directory(EPUB_DIR);
+    success &= create_directory(CONFIG_DIR);
+    success &= create_directory(CACHE_DIR);
+    success &= create_directory(CERT_DIR);
+    return success;
+}
+
+bool FileManager::create_directory(const std::string& path) {
+    return mkdir(path.c_str(), 0777) == 0 || errno == EEXIST;
+}
+
+std::vector<std::string> FileManager::list_epub_files() {
+    std::vector<std::string> files;
+    DIR* dir = opendir(EPUB_DIR.c_str());
+    if (!dir) return files;
+    
+    while (struct dirent* entry = readdir(dir)) {
+        std::string filename = entry->d_name;
+        if (filename[0] != '.' && filename.length() > 5 && filename.substr(filename.length() - 5) == ".epub") {
+            files.push_back(EPUB_DIR + "/" + filename);
+        }
+    }
+    closedir(dir);
+    
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+bool FileManager::check_free_space(size_t) {
+    return true;
+}
+
+bool FileManager::file_exists(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0;
+}
+
+size_t FileManager::get_file_size(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 ? static_cast<size_t>(info.st_size) : 0;
+}
+
+uint64_t FileManager::get_file_mtime(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 ? static_cast<uint64_t>(info.st_mtime) : 0;
+}
+
+bool FileManager::delete_file(const std::string& path) {
+    return remove(path.c_str()) == 0;
+}
+
+std::string FileManager::get_epub_metadata(const std::string& path) {
+    size_t last_slash = path.find_last_of('/');
+    std::string filename = last_slash == std::string::npos ? path : path.substr(last_slash + 1);
+    if (filename.length() > 5 && filename.substr(filename.length() - 5) == ".epub") {
+        filename = filename.substr(0, filename.length() - 5);
+    }
+    return filename;
+}
+
+bool FileManager::create_directory_recursive(const std::string& path) {
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        if (!create_directory(path.substr(0, slash))) return false;
+    }
+    return create_directory(path);
+}
@@ -0,0 +1,85 @@
+#ifndef HEAP_STATS_H
+#define HEAP_STATS_H
+
+#include <malloc.h>
+#include <cstdlib>
+#include <new>
+
+// Counts heap use by replacing the global operator new and delete.
+// Include it in exactly one file of a benchmark. Other allocators, such as
+// libxml2's, can report through heap_stats_malloc and its siblings.
+
+struct HeapStats {
+    size_t allocations;
+    size_t live_bytes;
+    size_t peak_bytes;
+};
+
+static HeapStats heap_stats = {0, 0, 0};
+
+inline void heap_stats_reset() {
+    heap_stats.allocations = 0;
+    heap_stats.peak_bytes = heap_stats.live_bytes;
+}
+
+// Peak bytes above what was live at the last reset
+inline size_t heap_stats_peak_since(size_t baseline) {
+    return heap_stats.peak_bytes > baseline ? heap_stats.peak_bytes - baseline : 0;
+}
+
+inline void heap_stats_add(void* block) {
+    if (!block) return;
+    ++heap_stats.allocations;
+    heap_stats.live_bytes += malloc_usable_size(block);
+    if (heap_stats.live_bytes > heap_stats.peak_bytes) heap_stats.peak_bytes = heap_stats.live_bytes;
+}
+
+inline void heap_stats_remove(void* block) {
+    if (block) heap_stats.live_bytes -= malloc_usable_size(block);
+}
+
+inline void* heap_stats_malloc(size_t size) {
+    void* block = std::malloc(size);
+    heap_stats_add(block);
+    return block;
+}
+
+inline void heap_stats_free(void* block) {
+    heap_stats_remove(block);
+    std::free(block);
+}
+
+inline void* heap_stats_realloc(void* block, size_t size) {
+    heap_stats_remove(block);
+    void* moved = std::realloc(block, size);
+    heap_stats_add(moved ? moved : block);
+    return moved;
+}
+
+void* operator new(size_t size) {
+    void* block = heap_stats_malloc(size ? size : 1);
+    if (!block) throw std::bad_alloc();
+    return block;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* block) noexcept {
+    heap_stats_free(block);
+}
+
+void operator delete[](void* block) noexcept {
+    heap_stats_free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    heap_stats_free(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+    heap_stats_free(block);
+}
+
+#endif // HEAP_STATS_H
@@ -0,0 +1,32 @@
+#ifndef PSP2_CTRL_H
+#define PSP2_CTRL_H
+
+#include <cstdint>
+
+// Host stand-in for the controller types the UI screens read. Input is
+// built by the caller; nothing is sampled.
+
+typedef enum SceCtrlButtons {
+    SCE_CTRL_SELECT = 0x00000001,
+    SCE_CTRL_START = 0x00000008,
+    SCE_CTRL_UP = 0x00000010,
+    SCE_CTRL_RIGHT = 0x00000020,
+    SCE_CTRL_DOWN = 0x00000040,
+    SCE_CTRL_LEFT = 0x00000080,
+    SCE_CTRL_LTRIGGER = 0x00000100,
+    SCE_CTRL_RTRIGGER = 0x00000200,
+    SCE_CTRL_TRIANGLE = 0x00001000,
+    SCE_CTRL_CIRCLE = 0x00002000,
+    SCE_CTRL_CROSS = 0x00004000,
+    SCE_CTRL_SQUARE = 0x00008000
+} SceCtrlButtons;
+
+typedef struct SceCtrlData {
+    uint64_t timeStamp;
+    unsigned int buttons;
+    unsigned char lx, ly;           // Sticks, 128 at rest
+    unsigned char rx, ry;
+    uint8_t reserved[16];
+} SceCtrlData;
+
+#endif // PSP2_CTRL_H
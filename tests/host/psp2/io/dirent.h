@@ -0,0 +1,7 @@
+#ifndef PSP2_IO_DIRENT_H
+#define PSP2_IO_DIRENT_H
+
+// Host stand-in: file_manager.h includes this, but the host FileManager
+// is written against POSIX and needs nothing from it
+
+#endif // PSP2_IO_DIRENT_H
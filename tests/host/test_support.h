@@ -0,0 +1,111 @@
+#ifndef TEST_SUPPORT_H
+#define TEST_SUPPORT_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Tests are plain executables: CHECK reports a failure and carries on, and
+// main returns test_result() so ctest sees any failure. Benchmarks take
+// --quick, which ctest passes, to run a single short round.
+
+static int test_failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+            ++test_failures; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    do { \
+        if (!((actual) == (expected))) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQ(" #actual ", " #expected ") failed: got " \
+                      << (actual) << ", expected " << (expected) << std::endl; \
+            ++test_failures; \
+        } \
+    } while (0)
+
+inline int test_result() {
+    if (test_failures) {
+        std::cerr << test_failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// TEST_DATA_DIR is tests/data, set by tests/CMakeLists.txt
+inline std::string test_data_path(const std::string& name) {
+    return std::string(TEST_DATA_DIR) + "/" + name;
+}
+
+inline bool read_file(const std::string& path, std::string& contents) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file) return false;
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+inline bool has_flag(int argc, char** argv, const char* flag) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], flag) == 0) return true;
+    }
+    return false;
+}
+
+// Value of "--name value", or fallback
+inline std::string flag_value(int argc, char** argv, const char* flag, const std::string& fallback = "") {
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::strcmp(argv[i], flag) == 0) return argv[i + 1];
+    }
+    return fallback;
+}
+
+// Best of a few runs of body, in seconds
+template <typename Body>
+double best_seconds(int rounds, Body body) {
+    double best = 1e30;
+    for (int i = 0; i < rounds; ++i) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        body();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (seconds < best) best = seconds;
+    }
+    return best;
+}
+
+// A binary PPM as written by SoftwareCanvas::write_ppm, three bytes a pixel
+struct PpmImage {
+    int width;
+    int height;
+    std::vector<uint8_t> rgb;
+};
+
+inline bool read_ppm(const std::string& path, PpmImage& image) {
+    std::string contents;
+    if (!read_file(path, contents)) return false;
+    
+    int max_value = 0;
+    int header_length = 0;
+    if (std::sscanf(contents.c_str(), "P6 %d %d %d%n", &image.width, &image.height, &max_value, &header_length) != 3 ||
+        max_value != 255) {
+        return false;
+    }
+    size_t start = static_cast<size_t>(header_length) + 1;      // One whitespace byte ends the header
+    size_t size = static_cast<size_t>(image.width) * image.height * 3;
+    if (contents.size() < start + size) return false;
+    image.rgb.assign(contents.begin() + start, contents.begin() + start + size);
+    return true;
+}
+
+#endif // TEST_SUPPORT_H
@@ -0,0 +1,64 @@
+#ifndef UTF8_REFERENCE_H
+#define UTF8_REFERENCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A byte-at-a-time UTF-8 decoder to check Utf8Decoder against. It reads
+// the sequence length from the lead byte and rejects overlong forms,
+// surrogates and values past U+10FFFF by the decoded value, where
+// Utf8Decoder narrows the second byte's range instead. Like Utf8Decoder,
+// a malformed sequence gives U+FFFD and consumes one byte.
+
+inline uint32_t reference_utf8_next(const char* data, size_t length, size_t& i) {
+    uint8_t lead = static_cast<uint8_t>(data[i]);
+    size_t count;
+    uint32_t codepoint;
+    uint32_t minimum;
+    if (lead < 0x80) {
+        ++i;
+        return lead;
+    } else if ((lead & 0xE0) == 0xC0) {
+        count = 2;
+        codepoint = lead & 0x1F;
+        minimum = 0x80;
+    } else if ((lead & 0xF0) == 0xE0) {
+        count = 3;
+        codepoint = lead & 0x0F;
+        minimum = 0x800;
+    } else if ((lead & 0xF8) == 0xF0) {
+        count = 4;
+        codepoint = lead & 0x07;
+        minimum = 0x10000;
+    } else {
+        ++i;
+        return 0xFFFD;
+    }
+    
+    bool valid = i + count <= length;
+    for (size_t k = 1; valid && k < count; ++k) {
+        uint8_t byte = static_cast<uint8_t>(data[i + k]);
+        valid = (byte & 0xC0) == 0x80;
+        codepoint = (codepoint << 6) | (byte & 0x3F);
+    }
+    valid = valid && codepoint >= minimum && codepoint <= 0x10FFFF && (codepoint < 0xD800 || codepoint > 0xDFFF);
+    if (!valid) {
+        ++i;
+        return 0xFFFD;
+    }
+    i += count;
+    return codepoint;
+}
+
+inline std::vector<uint32_t> reference_utf8_decode(const std::string& text) {
+    std::vector<uint32_t> codepoints;
+    size_t i = 0;
+    while (i < text.size()) {
+        codepoints.push_back(reference_utf8_next(text.data(), text.size(), i));
+    }
+    return codepoints;
+}
+
+#endif // UTF8_REFERENCE_H
@@ -0,0 +1,76 @@
+#ifndef VITA2D_H
+#define VITA2D_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Host stand-in for the vita2d calls the reader makes. Nothing is drawn;
+// textures are plain memory and fonts measure every codepoint at half the
+// font size, so layout is deterministic without the Vita's font.
+
+typedef struct vita2d_texture vita2d_texture;
+typedef struct vita2d_font vita2d_font;
+
+typedef struct vita2d_texture_vertex {
+    float x, y, z;
+    float u, v;
+} vita2d_texture_vertex;
+
+typedef struct vita2d_color_vertex {
+    float x, y, z;
+    unsigned int color;
+} vita2d_color_vertex;
+
+typedef enum SceGxmPrimitiveType {
+    SCE_GXM_PRIMITIVE_TRIANGLES,
+    SCE_GXM_PRIMITIVE_LINES
+} SceGxmPrimitiveType;
+
+typedef enum SceGxmTextureFormat {
+    SCE_GXM_TEXTURE_FORMAT_A8B8G8R8,
+    SCE_GXM_TEXTURE_FORMAT_U8_R111
+} SceGxmTextureFormat;
+
+#define SCE_GXM_SCENE_FRAGMENT_SET_DEPENDENCY 0x00000001u
+#define SCE_GXM_SCENE_VERTEX_WAIT_FOR_DEPENDENCY 0x00000002u
+
+#define RGBA8(r, g, b, a) ((((a) & 0xFF) << 24) | (((b) & 0xFF) << 16) | (((g) & 0xFF) << 8) | (((r) & 0xFF) << 0))
+
+int vita2d_init();
+int vita2d_fini();
+void vita2d_set_clear_color(unsigned int color);
+void vita2d_clear_screen();
+void vita2d_start_drawing();
+void vita2d_start_drawing_advanced(vita2d_texture* target, unsigned int flags);
+void vita2d_end_drawing();
+void vita2d_swap_buffers();
+void vita2d_wait_rendering_done();
+
+void vita2d_enable_clipping();
+void vita2d_disable_clipping();
+void vita2d_set_clip_rectangle(int x_min, int y_min, int x_max, int y_max);
+
+// Bump allocated from a fixed pool that is reset when a frame starts
+void* vita2d_pool_memalign(unsigned int size, unsigned int alignment);
+void vita2d_draw_array(SceGxmPrimitiveType mode, const vita2d_color_vertex* vertices, size_t count);
+void vita2d_draw_array_textured(const vita2d_texture* texture, SceGxmPrimitiveType mode,
+                                const vita2d_texture_vertex* vertices, size_t count, unsigned int color);
+
+vita2d_texture* vita2d_create_empty_texture_format(unsigned int width, unsigned int height, SceGxmTextureFormat format);
+vita2d_texture* vita2d_create_empty_texture_rendertarget(unsigned int width, unsigned int height,
+                                                         SceGxmTextureFormat format);
+void vita2d_free_texture(vita2d_texture* texture);
+void* vita2d_texture_get_datap(const vita2d_texture* texture);
+unsigned int vita2d_texture_get_stride(const vita2d_texture* texture);
+unsigned int vita2d_texture_get_width(const vita2d_texture* texture);
+unsigned int vita2d_texture_get_height(const vita2d_texture* texture);
+
+// Loading fails for missing files, like the real call
+vita2d_font* vita2d_load_font_file(const char* filename);
+vita2d_font* vita2d_load_default_font();
+void vita2d_free_font(vita2d_font* font);
+int vita2d_font_draw_text(vita2d_font* font, int x, int y, unsigned int color, unsigned int size, const char* text);
+int vita2d_font_text_width(vita2d_font* font, unsigned int size, const char* text);
+int vita2d_font_text_height(vita2d_font* font, unsigned int size, const char* text);
+
+#endif // VITA2D_H
@@ -0,0 +1,114 @@
+#include <vita2d.h>
+#include <cstdio>
+#include <vector>
+
+struct vita2d_texture {
+    unsigned int width;
+    unsigned int height;
+    unsigned int stride;
+    std::vector<uint8_t> pixels;
+};
+
+struct vita2d_font {
+    int unused;
+};
+
+namespace {
+    
+const size_t POOL_SIZE = 1024 * 1024;
+    
+alignas(16) uint8_t pool[POOL_SIZE];
+size_t pool_used = 0;
+    
+vita2d_texture* create_texture(unsigned int width, unsigned int height, SceGxmTextureFormat format) {
+    vita2d_texture* texture = new vita2d_texture();
+    texture->width = width;
+    texture->height = height;
+    texture->stride = width * (format == SCE_GXM_TEXTURE_FORMAT_U8_R111 ? 1 : 4);
+    texture->pixels.assign(static_cast<size_t>(texture->stride) * height, 0);
+    return texture;
+}
+    
+// Widest line, in codepoints; continuation bytes do not start one
+void measure(const char* text, int& columns, int& lines) {
+    columns = 0;
+    lines = 1;
+    int current = 0;
+    for (const unsigned char* p = reinterpret_cast<const unsigned char*>(text); *p; ++p) {
+        if (*p == '\n') {
+            ++lines;
+            current = 0;
+        } else if ((*p & 0xC0) != 0x80) {
+            ++current;
+        }
+        if (current > columns) columns = current;
+    }
+}
+    
+}
+
+int vita2d_init() { return 1; }
+int vita2d_fini() { return 1; }
+void vita2d_set_clear_color(unsigned int) {}
+void vita2d_clear_screen() {}
+void vita2d_start_drawing() { pool_used = 0; }
+void vita2d_start_drawing_advanced(vita2d_texture*, unsigned int) { pool_used = 0; }
+void vita2d_end_drawing() {}
+void vita2d_swap_buffers() {}
+void vita2d_wait_rendering_done() {}
+
+void vita2d_enable_clipping() {}
+void vita2d_disable_clipping() {}
+void vita2d_set_clip_rectangle(int, int, int, int) {}
+
+void* vita2d_pool_memalign(unsigned int size, unsigned int alignment) {
+    size_t start = (pool_used + alignment - 1) / alignment * alignment;
+    if (start + size > POOL_SIZE) return nullptr;
+    pool_used = start + size;
+    return pool + start;
+}
+
+void vita2d_draw_array(SceGxmPrimitiveType, const vita2d_color_vertex*, size_t) {}
+void vita2d_draw_array_textured(const vita2d_texture*, SceGxmPrimitiveType, const vita2d_texture_vertex*, size_t,
+                                unsigned int) {}
+
+vita2d_texture* vita2d_create_empty_texture_format(unsigned int width, unsigned int height, SceGxmTextureFormat format) {
+    return create_texture(width, height, format);
+}
+
+vita2d_texture* vita2d_create_empty_texture_rendertarget(unsigned int width, unsigned int height,
+                                                         SceGxmTextureFormat format) {
+    return create_texture(width, height, format);
+}
+
+void vita2d_free_texture(vita2d_texture* texture) { delete texture; }
+void* vita2d_texture_get_datap(const vita2d_texture* texture) { return const_cast<uint8_t*>(&texture->pixels[0]); }
+unsigned int vita2d_texture_get_stride(const vita2d_texture* texture) { return texture->stride; }
+unsigned int vita2d_texture_get_width(const vita2d_texture* texture) { return texture->width; }
+unsigned int vita2d_texture_get_height(const vita2d_texture* texture) { return texture->height; }
+
+vita2d_font* vita2d_load_font_file(const char* filename) {
+    FILE* file = std::fopen(filename, "rb");
+    if (!file) return nullptr;
+    std::fclose(file);
+    return new vita2d_font();
+}
+
+vita2d_font* vita2d_load_default_font() { return new vita2d_font(); }
+void vita2d_free_font(vita2d_font* font) { delete font; }
+
+int vita2d_font_draw_text(vita2d_font* font, int, int, unsigned int, unsigned int size, const char* text) {
+    return vita2d_font_text_width(font, size, text);
+}
+
+int vita2d_font_text_width(vita2d_font*, unsigned int size, const char* text) {
+    int columns, lines;
+    measure(text, columns, lines);
+    return columns * static_cast<int>(size / 2);
+}
+
+int vita2d_font_text_height(vita2d_font*, unsigned int size, const char* text) {
+    int columns, lines;
+    measure(text, columns, lines);
+    return lines * static_cast<int>(size);
+}
@@ -0,0 +1,35 @@
+#ifndef ZIP_H
+#define ZIP_H
+
+#include <cstdint>
+
+// Host stand-in for the few libzip calls EPUBParser makes on its fallback
+// path. Opening always fails, so host tests only exercise the direct reader.
+
+typedef int64_t zip_int64_t;
+typedef uint64_t zip_uint64_t;
+typedef struct zip zip_t;
+typedef struct zip_file zip_file_t;
+
+typedef struct zip_stat {
+    zip_uint64_t valid;
+    const char* name;
+    zip_uint64_t size;
+    zip_uint64_t comp_size;
+    uint16_t comp_method;
+} zip_stat_t;
+
+#define ZIP_RDONLY 16
+#define ZIP_CM_STORE 0
+#define ZIP_CM_DEFLATE 8
+#define ZIP_STAT_NAME 0x0001u
+
+inline zip_t* zip_open(const char*, int, int*) { return nullptr; }
+inline int zip_close(zip_t*) { return 0; }
+inline zip_int64_t zip_get_num_entries(zip_t*, int) { return -1; }
+inline int zip_stat_index(zip_t*, zip_uint64_t, int, zip_stat_t*) { return -1; }
+inline zip_file_t* zip_fopen_index(zip_t*, zip_uint64_t, int) { return nullptr; }
+inline zip_int64_t zip_fread(zip_file_t*, void*, zip_uint64_t) { return -1; }
+inline int zip_fclose(zip_file_t*) { return 0; }
+
+#endif // ZIP_H
@@ -0,0 +1,158 @@
+#ifndef ZIP_WRITER_H
+#define ZIP_WRITER_H
+
+#include <zlib.h>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Builds small ZIP archives in memory for the host tests: stored or
+// deflated members, a central directory and an end record, no ZIP64. A
+// member's central local-header offset can be overridden to craft broken
+// archives.
+class ZipWriter {
+public:
+    void add(const std::string& name, const std::string& data, bool deflate,
+             uint32_t central_offset_override = NO_OVERRIDE) {
+        Member member;
+        member.name = name;
+        member.size = static_cast<uint32_t>(data.size());
+        member.crc = static_cast<uint32_t>(crc32(0, reinterpret_cast<const Bytef*>(data.data()),
+                                                 static_cast<uInt>(data.size())));
+        member.method = deflate ? 8 : 0;
+        member.local_offset = static_cast<uint32_t>(bytes.size());
+        member.central_offset = central_offset_override == NO_OVERRIDE ? member.local_offset :
+                                central_offset_override;
+        std::string stored = deflate ? raw_deflate(data) : data;
+        member.compressed_size = static_cast<uint32_t>(stored.size());
+        
+        put_u32(0x04034b50);
+        put_u16(20);
+        put_u16(0);
+        put_u16(member.method);
+        put_u32(0);                 // Time and date
+        put_u32(member.crc);
+        put_u32(member.compressed_size);
+        put_u32(member.size);
+        put_u16(static_cast<uint16_t>(name.size()));
+        put_u16(4);                 // An extra field the central copy does not have
+        bytes += name;
+        put_u32(0);
+        bytes += stored;
+        members.push_back(member);
+    }
+    
+    // The finished archive
+    std::string finish() {
+        uint32_t cd_offset = static_cast<uint32_t>(bytes.size());
+        for (const Member& member : members) {
+            put_u32(0x02014b50);
+            put_u16(20);
+            put_u16(20);
+            put_u16(0);
+            put_u16(member.method);
+            put_u32(0);
+            put_u32(member.crc);
+            put_u32(member.compressed_size);
+            put_u32(member.size);
+            put_u16(static_cast<uint16_t>(member.name.size()));
+            put_u16(0);
+            put_u16(0);
+            put_u16(0);
+            put_u16(0);
+            put_u32(0);
+            put_u32(member.central_offset);
+            bytes += member.name;
+        }
+        uint32_t cd_size = static_cast<uint32_t>(bytes.size()) - cd_offset;
+        put_u32(0x06054b50);
+        put_u16(0);
+        put_u16(0);
+        put_u16(static_cast<uint16_t>(members.size()));
+        put_u16(static_cast<uint16_t>(members.size()));
+        put_u32(cd_size);
+        put_u32(cd_offset);
+        put_u16(0);
+        return bytes;
+    }
+    
+    bool write(const std::string& path) {
+        std::string archive = finish();
+        FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file) return false;
+        bool written = std::fwrite(archive.data(), 1, archive.size(), file) == archive.size();
+        return std::fclose(file) == 0 && written;
+    }
+    
+    static std::string raw_deflate(const std::string& data) {
+        z_stream stream;
+        stream.zalloc = Z_NULL;
+        stream.zfree = Z_NULL;
+        stream.opaque = Z_NULL;
+        deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+        std::string out(deflateBound(&stream, static_cast<uLong>(data.size())), '\0');
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        stream.avail_in = static_cast<uInt>(data.size());
+        stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+        stream.avail_out = static_cast<uInt>(out.size());
+        deflate(&stream, Z_FINISH);
+        out.resize(stream.total_out);
+        deflateEnd(&stream);
+        return out;
+    }
+    
+    static const uint32_t NO_OVERRIDE = 0xFFFFFFFFu;
+    
+private:
+    struct Member {
+        std::string name;
+        uint32_t size;
+        uint32_t compressed_size;
+        uint32_t crc;
+        uint16_t method;
+        uint32_t local_offset;
+        uint32_t central_offset;
+    };
+    
+    std::string bytes;
+    std::vector<Member> members;
+    
+    void put_u16(uint16_t value) {
+        bytes += static_cast<char>(value & 0xFF);
+        bytes += static_cast<char>(value >> 8);
+    }
+    void put_u32(uint32_t value) {
+        put_u16(static_cast<uint16_t>(value & 0xFFFF));
+        put_u16(static_cast<uint16_t>(value >> 16));
+    }
+};
+
+// Container, package and the given chapters under OEBPS/, the chapters
+// deflated when deflate is set. Chapter i is ch<i>.xhtml.
+inline void add_minimal_book(ZipWriter& zip, const std::vector<std::string>& chapters, bool deflate,
+                             const std::string& extra_manifest = "") {
+    zip.add("mimetype", "application/epub+zip", false);
+    zip.add("META-INF/container.xml",
+            "<?xml version=\"1.0\"?><container version=\"1.0\" "
+            "xmlns=\"urn:oasis:names:tc:opendocument:xmlns:container\"><rootfiles>"
+            "<rootfile full-path=\"OEBPS/content.opf\" media-type=\"application/oebps-package+xml\"/>"
+            "</rootfiles></container>", false);
+    
+    std::string manifest;
+    std::string spine;
+    for (size_t i = 0; i < chapters.size(); ++i) {
+        std::string id = "ch" + std::to_string(i);
+        manifest += "<item id=\"" + id + "\" href=\"" + id + ".xhtml\" media-type=\"application/xhtml+xml\"/>";
+        spine += "<itemref idref=\"" + id + "\"/>";
+    }
+    zip.add("OEBPS/content.opf",
+            "<?xml version=\"1.0\"?><package xmlns=\"http://www.idpf.org/2007/opf\" version=\"2.0\">"
+            "<manifest>" + manifest + extra_manifest + "</manifest><spine toc=\"ncx\">" + spine +
+            "</spine></package>", true);
+    for (size_t i = 0; i < chapters.size(); ++i) {
+        zip.add("OEBPS/ch" + std::to_string(i) + ".xhtml", chapters[i], deflate);
+    }
+}
+
+#endif // ZIP_WRITER_H
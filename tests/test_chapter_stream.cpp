@@ -0,0 +1,222 @@
+#include "chapter_stream.h"
+#include "content_model.h"
+#include "file_manager.h"
+#include "gpu_renderer.h"
+#include "test_support.h"
+#include "zip_writer.h"
+
+// Anchors in a chapter too large for BookContent: the TOC entry leaves the
+// fragment to the reader, whose ChapterStream collects anchors while it
+// streams and maps them to lines. Offsets must match what extracting the
+// whole document gives.
+
+namespace {
+    
+const int SECTIONS = 100;
+    
+std::string section_id(int section) {
+    return "s" + std::to_string(section);
+}
+    
+std::string oversized_chapter() {
+    std::string text = "<html><body>";
+    uint32_t state = 7;
+    for (int section = 0; section < SECTIONS; ++section) {
+        text += "<h2 id=\"" + section_id(section) + "\">Section " + std::to_string(section) + "</h2>\n";
+        for (int paragraph = 0; paragraph < 40; ++paragraph) {
+            text += "<p>Paragraph";
+            for (int word = 0; word < 40; ++word) {
+                state = state * 1103515245u + 12345u;
+                text += " " + std::to_string(state >> 12);
+            }
+            text += ".</p>\n";
+        }
+    }
+    return text + "</body></html>";
+}
+    
+std::string toc_ncx() {
+    const char* sources[] = { "ch0.xhtml#intro", "ch1.xhtml", "ch1.xhtml#s10", "ch1.xhtml#s90", "ch1.xhtml#missing" };
+    std::string ncx = "<?xml version=\"1.0\"?><ncx xmlns=\"http://www.daisy.org/z3986/2005/ncx/\"><navMap>";
+    for (size_t i = 0; i < sizeof(sources) / sizeof(sources[0]); ++i) {
+        ncx += "<navPoint id=\"np" + std::to_string(i) + "\"><navLabel><text>Entry " + std::to_string(i) +
+               "</text></navLabel><content src=\"" + sources[i] + "\"/></navPoint>";
+    }
+    return ncx + "</navMap></ncx>";
+}
+    
+void extract(const std::string& html, std::string& text, AnchorIndex& anchors) {
+    HtmlTextExtractor extractor;
+    extractor.set_anchor_index(&anchors);
+    extractor.feed(html.data(), html.size(), text);
+    extractor.finish(text);
+}
+    
+void test_toc_fragments(EPUBParser& parser) {
+    BookContent content(&parser);
+    content.reset();
+    CHECK(!content.is_oversized(0));
+    CHECK(content.is_oversized(1));
+        
+    // Held documents resolve their fragments themselves
+    BookContent::Position position;
+    CHECK(content.resolve_toc_entry(0, position));
+    CHECK_EQ(position.spine_index, 0);
+    CHECK(position.offset > 0);
+    CHECK(position.fragment == nullptr);
+        
+    CHECK(content.resolve_toc_entry(1, position));
+    CHECK_EQ(position.spine_index, 1);
+    CHECK(position.fragment == nullptr);
+        
+    // Streamed ones pass the fragment on, without loading the document
+    CHECK(content.resolve_toc_entry(3, position));
+    CHECK_EQ(position.spine_index, 1);
+    CHECK_EQ(position.offset, 0u);
+    CHECK(position.fragment && std::string(position.fragment) == "s90");
+    CHECK_EQ(content.documents_loaded(), 1u);
+        
+    // Entries by the document they point into, in TOC order
+    std::vector<uint32_t> entries(content.toc_entries(1).begin(), content.toc_entries(1).end());
+    CHECK_EQ(content.toc_entries(0).end() - content.toc_entries(0).begin(), 1);
+    CHECK_EQ(*content.toc_entries(0).begin(), 0u);
+    CHECK_EQ(entries.size(), 4u);
+    for (size_t i = 0; i < entries.size(); ++i) CHECK_EQ(entries[i], i + 1);
+    CHECK(content.toc_entries(2).begin() == content.toc_entries(2).end());
+    CHECK(content.toc_entries(3).begin() == content.toc_entries(3).end());
+}
+    
+void test_stream_anchors(EPUBParser& parser, GPURenderer& renderer, const std::string& html) {
+    std::string text;
+    AnchorIndex expected;
+    extract(html, text, expected);
+        
+    ChapterStream stream(&parser, &renderer);
+    CHECK(stream.open("ch1.xhtml", 600, 20, false));
+    uint32_t offset = 0;
+    CHECK(!stream.find_anchor("s0", offset));
+    CHECK_EQ(stream.anchors_seen(), 0u);
+        
+    // Streaming to a late anchor passes the earlier ones
+    CHECK(stream.seek_anchor(section_id(90), offset));
+    uint32_t expected_offset = 0;
+    CHECK(expected.find(section_id(90), expected_offset));
+    CHECK_EQ(offset, expected_offset);
+    CHECK(stream.find_anchor(section_id(10), offset));
+    CHECK(!stream.find_anchor(section_id(99), offset));
+    CHECK(stream.anchors_seen() < static_cast<size_t>(SECTIONS));
+        
+    // The anchor's line is the one the heading starts
+    size_t line = stream.seek_offset(expected_offset);
+    CHECK(stream.ensure_line(line + 1));
+    CHECK(stream.line_offset(line) <= expected_offset);
+    CHECK(stream.line_offset(line + 1) > expected_offset);
+    CHECK(line >= stream.window_start());
+    CHECK(stream.window()[line - stream.window_start()] == "Section 90");
+    CHECK(text.compare(expected_offset, 10, "Section 90") == 0);
+        
+    // A missing anchor reads to the end, after which every offset is known
+    CHECK(!stream.seek_anchor("missing", offset));
+    CHECK(stream.finished());
+    CHECK_EQ(stream.anchors_seen(), static_cast<size_t>(SECTIONS));
+    for (int section = 0; section < SECTIONS; ++section) {
+        CHECK(stream.find_anchor(section_id(section), offset));
+        CHECK(expected.find(section_id(section), expected_offset));
+        CHECK_EQ(offset, expected_offset);
+    }
+        
+    // Anchors outlive a restart, and a known miss streams nothing
+    CHECK(stream.ensure_line(0));
+    size_t produced = stream.lines_produced();
+    CHECK(!stream.seek_anchor("missing", offset));
+    CHECK_EQ(stream.lines_produced(), produced);
+    CHECK(stream.seek_anchor(section_id(20), offset));
+    CHECK_EQ(stream.lines_produced(), produced);
+        
+    // Seeking back behind the window restarts and lands on the same line
+    line = stream.seek_offset(offset);
+    CHECK(stream.window()[line - stream.window_start()] == "Section 20");
+    CHECK(stream.ensure_line(0));
+    CHECK_EQ(stream.seek_offset(offset), line);
+        
+    // Another chapter starts with no anchors
+    stream.close();
+    CHECK(stream.open("ch0.xhtml", 600, 20, false));
+    CHECK(!stream.find_anchor(section_id(10), offset));
+    CHECK(stream.seek_anchor("intro", offset));
+    CHECK(!stream.seek_anchor(section_id(10), offset));
+}
+    
+// One paragraph several times MAX_PARAGRAPH_BYTES long, with the odd word
+// wider than a line
+std::string long_paragraph_chapter() {
+    std::string text = "<html><body><p>";
+    uint32_t state = 5;
+    while (text.size() < 4 * ChapterStream::MAX_PARAGRAPH_BYTES) {
+        state = state * 1103515245u + 12345u;
+        text += (state >> 16) % 50 == 0 ? std::string(90, 'w') : std::to_string(state >> 12);
+        text += ' ';
+    }
+    return text + "</p><p>Last paragraph.</p></body></html>";
+}
+    
+// Streamed lines are LineBreaker's lines for the whole extracted text
+void test_lines_match_breaker(EPUBParser& parser, GPURenderer& renderer, const std::string& href,
+                              const std::string& html) {
+    std::string text;
+    AnchorIndex anchors;
+    extract(html, text, anchors);
+    std::vector<LineSpan> spans;
+    LineBreaker breaker(renderer.advance_table(20), 600);
+    breaker.break_lines(text.data(), text.size(), 0, spans);
+        
+    ChapterStream stream(&parser, &renderer);
+    CHECK(stream.open(href, 600, 20, false));
+    size_t line = 0;
+    size_t mismatches = 0;
+    for (; stream.ensure_line(line); ++line) {
+        if (line >= spans.size()) break;
+        const std::string& streamed = stream.window()[line - stream.window_start()];
+        if (streamed != text.substr(spans[line].offset, spans[line].length) ||
+            stream.line_offset(line) != spans[line].offset) {
+            ++mismatches;
+        }
+    }
+    CHECK_EQ(mismatches, 0u);
+    CHECK_EQ(line, spans.size());
+    CHECK(stream.finished());
+    CHECK_EQ(stream.lines_produced(), spans.size());
+}
+    
+} // namespace
+
+int main() {
+    FileManager::initialize_directories();
+    
+    std::vector<std::string> chapters;
+    chapters.push_back("<html><body><p>Opening words.</p><h1 id=\"intro\">Introduction</h1></body></html>");
+    chapters.push_back(oversized_chapter());
+    chapters.push_back(long_paragraph_chapter());
+    CHECK(chapters[1].size() > BookContent::MAX_DOCUMENT_SIZE);
+    
+    ZipWriter zip;
+    add_minimal_book(zip, chapters, true, "<item id=\"ncx\" href=\"toc.ncx\" media-type=\"application/x-dtbncx+xml\"/>");
+    zip.add("OEBPS/toc.ncx", toc_ncx(), true);
+    std::string path = FileManager::EPUB_DIR + "/anchors.epub";
+    CHECK(zip.write(path));
+    
+    EPUBParser parser;
+    CHECK(parser.open_epub(path));
+    CHECK_EQ(parser.get_table_of_contents().size(), 5u);
+    
+    GPURenderer renderer;
+    CHECK(renderer.initialize());
+    
+    test_toc_fragments(parser);
+    test_stream_anchors(parser, renderer, chapters[1]);
+    test_lines_match_breaker(parser, renderer, "ch1.xhtml", chapters[1]);
+    test_lines_match_breaker(parser, renderer, "ch2.xhtml", chapters[2]);
+    
+    renderer.cleanup();
+    return test_result();
+}
@@ -0,0 +1,242 @@
+#include "epub_parser.h"
+#include "file_manager.h"
+#include "test_support.h"
+#include "zip_writer.h"
+#include <thread>
+
+// EPUBParser reads members straight from the file: only the central
+// directory is held in memory, stored members are read and deflated ones
+// inflated a chunk at a time. Archives are built by ZipWriter.
+
+namespace {
+    
+std::string chapter_text(int paragraphs, int seed) {
+    // Pseudo-random numbers keep deflate from shrinking it to nothing
+    std::string text = "<html><body>";
+    uint32_t state = static_cast<uint32_t>(seed);
+    for (int i = 0; i < paragraphs; ++i) {
+        text += "<p>Paragraph";
+        for (int word = 0; word < 8; ++word) {
+            state = state * 1103515245u + 12345u;
+            text += " " + std::to_string(state >> 12);
+        }
+        text += ".</p>\n";
+    }
+    return text + "</body></html>";
+}
+    
+std::string book_path(const std::string& name) {
+    return FileManager::EPUB_DIR + "/" + name;
+}
+    
+std::string read_stream(EPUBParser& parser, EPUBParser::EntryStream& stream, const std::string& href, size_t chunk) {
+    if (!parser.open_stream(href, stream)) return "<open failed>";
+    std::string text;
+    std::vector<char> buffer(chunk);
+    while (!stream.finished()) {
+        size_t got = stream.read(&buffer[0], buffer.size());
+        if (got == 0) break;
+        text.append(&buffer[0], got);
+    }
+    return stream.has_error() ? "<read failed>" : text;
+}
+    
+std::string read_stream(EPUBParser& parser, const std::string& href, size_t chunk) {
+    EPUBParser::EntryStream stream;
+    return read_stream(parser, stream, href, chunk);
+}
+    
+void test_reads(bool deflate) {
+    // Large enough that a deflated chapter spans many 16KB input chunks
+    std::vector<std::string> chapters;
+    chapters.push_back(chapter_text(3, 1));
+    chapters.push_back(chapter_text(6000, 2));
+    chapters.push_back("");
+        
+    ZipWriter zip;
+    add_minimal_book(zip, chapters, deflate);
+    std::string path = book_path(deflate ? "deflated.epub" : "stored.epub");
+    CHECK(zip.write(path));
+        
+    EPUBParser parser;
+    CHECK(parser.open_epub(path));
+    CHECK(parser.can_read_concurrently());
+    CHECK_EQ(parser.get_spine().size(), chapters.size());
+        
+    for (size_t i = 0; i < chapters.size(); ++i) {
+        std::string href = "ch" + std::to_string(i) + ".xhtml";
+        CHECK(parser.get_content(href) == chapters[i]);
+        CHECK(read_stream(parser, href, 1000) == chapters[i]);
+        CHECK(read_stream(parser, href, 64 * 1024) == chapters[i]);
+    }
+        
+    // A stream reopened after the end, or halfway, starts clean
+    EPUBParser::EntryStream reused;
+    for (int round = 0; round < 2; ++round) {
+        for (size_t i = 0; i < chapters.size(); ++i) {
+            CHECK(read_stream(parser, reused, "ch" + std::to_string(i) + ".xhtml", 1000) == chapters[i]);
+        }
+    }
+    char partial[100];
+    CHECK(parser.open_stream("ch1.xhtml", reused));
+    CHECK_EQ(reused.read(partial, sizeof(partial)), sizeof(partial));
+    CHECK(read_stream(parser, reused, "ch1.xhtml", 1000) == chapters[1]);
+        
+    // The same buffer serves both sizes without reallocating downward
+    std::vector<char> buffer;
+    EPUBParser::EntryView view;
+    CHECK(parser.get_content_view("ch1.xhtml", buffer, view));
+    CHECK(std::string(view.data, view.size) == chapters[1]);
+    CHECK(parser.get_content_view("ch0.xhtml", buffer, view));
+    CHECK(std::string(view.data, view.size) == chapters[0]);
+    CHECK(!parser.get_content_view("missing.xhtml", buffer, view));
+        
+    // Streams have their own handles and whole reads lock, so threads may mix
+    std::string streamed[2];
+    std::thread workers[2];
+    for (int t = 0; t < 2; ++t) {
+        workers[t] = std::thread([&parser, &streamed, t]() {
+            for (int round = 0; round < 20 && streamed[t].empty(); ++round) {
+                streamed[t] = read_stream(parser, "ch1.xhtml", 4096 + t * 333);
+            }
+        });
+    }
+    int whole_reads_ok = 0;
+    for (int round = 0; round < 20; ++round) {
+        whole_reads_ok += parser.get_content("ch1.xhtml") == chapters[1];
+    }
+    for (int t = 0; t < 2; ++t) {
+        workers[t].join();
+        CHECK(streamed[t] == chapters[1]);
+    }
+    CHECK_EQ(whole_reads_ok, 20);
+        
+    parser.close();
+    CHECK(parser.find_entry("OEBPS/ch0.xhtml") == nullptr);
+    CHECK(!parser.can_read_concurrently());
+        
+    // A closed parser opens the next book as if new
+    CHECK(parser.open_epub(path));
+    CHECK(parser.get_content("ch0.xhtml") == chapters[0]);
+}
+    
+// A central record pointing near 4GB must fail cleanly: with 32-bit size_t
+// the old offset + header check wrapped around and passed
+void test_offset_past_end() {
+    std::vector<std::string> chapters(1, chapter_text(3, 3));
+    ZipWriter zip;
+    add_minimal_book(zip, chapters, false);
+    zip.add("OEBPS/broken.xhtml", chapter_text(2, 4), false, 0xFFFFFFF0u);
+    zip.add("OEBPS/broken_deflated.xhtml", chapter_text(2, 5), true, 0xFFFFFFE0u);
+    std::string path = book_path("bad_offset.epub");
+    CHECK(zip.write(path));
+        
+    EPUBParser parser;
+    CHECK(parser.open_epub(path));
+    CHECK(parser.get_content("ch0.xhtml") == chapters[0]);
+        
+    // With libzip as the only way in and no libzip on the host, both fail
+    const EPUBParser::ZipEntry* entry = parser.find_entry("OEBPS/broken.xhtml");
+    CHECK(entry && entry->local_offset == EPUBParser::LIBZIP_ONLY);
+    CHECK(parser.get_content("broken.xhtml").empty());
+    CHECK(parser.get_content("broken_deflated.xhtml").empty());
+    EPUBParser::EntryStream stream;
+    CHECK(!parser.open_stream("broken.xhtml", stream));
+}
+    
+// A local header that is not where the central directory says
+void test_bad_local_header() {
+    std::vector<std::string> chapters(1, chapter_text(3, 6));
+    ZipWriter zip;
+    add_minimal_book(zip, chapters, true);
+    zip.add("OEBPS/shifted.xhtml", chapter_text(2, 7), false, 3);
+    std::string path = book_path("bad_header.epub");
+    CHECK(zip.write(path));
+        
+    EPUBParser parser;
+    CHECK(parser.open_epub(path));
+    CHECK(parser.get_content("ch0.xhtml") == chapters[0]);
+    CHECK(parser.get_content("shifted.xhtml").empty());
+    CHECK_EQ(read_stream(parser, "shifted.xhtml", 1000), std::string("<open failed>"));
+}
+    
+// Corrupt deflate data is an error, never a short or garbage chapter
+void test_corrupt_deflate() {
+    std::vector<std::string> chapters(1, chapter_text(400, 8));
+    ZipWriter zip;
+    add_minimal_book(zip, chapters, true);
+    std::string archive = zip.finish();
+        
+    // Flip bytes in the middle of the chapter's compressed data
+    size_t name = archive.find("OEBPS/ch0.xhtml");
+    CHECK(name != std::string::npos);
+    for (size_t i = name + 100; i < name + 140; ++i) {
+        archive[i] = static_cast<char>(archive[i] ^ 0x5A);
+    }
+    std::string path = book_path("corrupt.epub");
+    FILE* file = std::fopen(path.c_str(), "wb");
+    CHECK(file != nullptr);
+    if (!file) return;
+    std::fwrite(archive.data(), 1, archive.size(), file);
+    std::fclose(file);
+        
+    EPUBParser parser;
+    CHECK(parser.open_epub(path));
+    CHECK(parser.get_content("ch0.xhtml").empty());
+    std::string streamed = read_stream(parser, "ch0.xhtml", 1000);
+    CHECK(streamed != chapters[0]);
+}
+    
+// Central directory sizes that the member cannot hold are refused before
+// anything is allocated for them
+void test_implausible_size() {
+    std::vector<std::string> chapters(1, chapter_text(3, 9));
+    ZipWriter zip;
+    add_minimal_book(zip, chapters, true);
+    zip.add("OEBPS/huge.xhtml", chapter_text(2, 10), false);
+    zip.add("OEBPS/bomb.xhtml", chapter_text(2, 11), true);
+    zip.add("OEBPS/capped.xhtml", std::string(64 * 1024, 'x'), true);
+    std::string archive = zip.finish();
+        
+    // Rewrite the uncompressed size in each member's central record
+    const char* names[] = { "OEBPS/huge.xhtml", "OEBPS/bomb.xhtml", "OEBPS/capped.xhtml" };
+    const uint32_t sizes[] = { 0xF0000000u, 20 * 1024 * 1024, 40 * 1024 * 1024 };
+    for (int i = 0; i < 3; ++i) {
+        size_t name = archive.rfind(names[i]);
+        CHECK(name != std::string::npos && name >= 46);
+        for (int byte = 0; byte < 4; ++byte) {
+            archive[name - 46 + 24 + byte] = static_cast<char>((sizes[i] >> (8 * byte)) & 0xFF);
+        }
+    }
+    std::string path = book_path("bad_size.epub");
+    FILE* file = std::fopen(path.c_str(), "wb");
+    CHECK(file != nullptr);
+    if (!file) return;
+    std::fwrite(archive.data(), 1, archive.size(), file);
+    std::fclose(file);
+        
+    EPUBParser parser;
+    CHECK(parser.open_epub(path));
+    CHECK(parser.get_content("ch0.xhtml") == chapters[0]);
+    std::vector<char> buffer;
+    EPUBParser::EntryView view;
+    for (int i = 0; i < 3; ++i) {
+        const EPUBParser::ZipEntry* entry = parser.find_entry(names[i]);
+        CHECK(entry && entry->size == sizes[i]);
+        CHECK(!parser.get_content_view(names[i] + 6, buffer, view));
+    }
+    CHECK(buffer.capacity() < 1024 * 1024);
+}
+    
+} // namespace
+
+int main() {
+    CHECK(FileManager::initialize_directories());
+    test_reads(false);
+    test_reads(true);
+    test_offset_past_end();
+    test_bad_local_header();
+    test_corrupt_deflate();
+    test_implausible_size();
+    return test_result();
+}
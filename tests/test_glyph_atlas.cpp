@@ -0,0 +1,299 @@
+#include "glyph_atlas.h"
+#include "test_support.h"
+#include <algorithm>
+#include <random>
+
+// Rectangles packed into atlas pages never overlap, borders included, and
+// room given back is merged with its neighbours and reused. Glyph pixels
+// read back exactly inside a clear 1 px border, and only the rows written
+// since the last upload are reported dirty.
+
+namespace {
+    
+struct Placed {
+    int x, y, width, height;
+};
+    
+// Marks each rectangle on a page-sized grid; false if two share a pixel or
+// one leaves the page
+bool disjoint(const std::vector<Placed>& placed, int page_width, int page_height) {
+    std::vector<uint8_t> taken(static_cast<size_t>(page_width) * page_height, 0);
+    for (const Placed& rect : placed) {
+        if (rect.x < 0 || rect.y < 0 || rect.x + rect.width > page_width || rect.y + rect.height > page_height) {
+            return false;
+        }
+        for (int row = rect.y; row < rect.y + rect.height; ++row) {
+            for (int column = rect.x; column < rect.x + rect.width; ++column) {
+                if (taken[row * page_width + column]++) return false;
+            }
+        }
+    }
+    return true;
+}
+    
+void test_packer_no_overlaps() {
+    const int size = 256;
+    ShelfPacker packer(size, size);
+    std::mt19937 random(7);
+    std::vector<Placed> placed;
+        
+    // Fill with glyph-like rectangles of a few heights, then churn: give
+    // back half at random and fill again
+    for (int round = 0; round < 4; ++round) {
+        int refused = 0;
+        while (refused < 50) {
+            Placed rect = {0, 0, 3 + static_cast<int>(random() % 20), 8 + static_cast<int>(random() % 4) * 6};
+            if (packer.pack(rect.width, rect.height, rect.x, rect.y)) {
+                placed.push_back(rect);
+            } else {
+                ++refused;
+            }
+        }
+        CHECK(disjoint(placed, size, size));
+        CHECK(packer.used_height() <= size);
+            
+        std::shuffle(placed.begin(), placed.end(), random);
+        for (size_t i = placed.size() / 2; i < placed.size(); ++i) {
+            packer.release(placed[i].x, placed[i].y, placed[i].width);
+        }
+        placed.resize(placed.size() / 2);
+    }
+    CHECK(placed.size() > 100);
+        
+    // Everything given back leaves the page empty
+    for (const Placed& rect : placed) {
+        packer.release(rect.x, rect.y, rect.width);
+    }
+    CHECK_EQ(packer.used_height(), 0);
+    int x, y;
+    CHECK(packer.pack(size, size, x, y));
+    CHECK(!packer.pack(1, 1, x, y));
+    CHECK(!packer.pack(size + 1, 1, x, y));
+}
+    
+void test_packer_release_merges() {
+    ShelfPacker packer(100, 100);
+    int x[4], y[4];
+    for (int i = 0; i < 4; ++i) {
+        CHECK(packer.pack(10, 10, x[i], y[i]));
+        CHECK_EQ(x[i], i * 10);
+        CHECK_EQ(y[i], 0);
+    }
+        
+    // A wider rectangle fits only once both neighbours' room is merged
+    packer.release(x[0], y[0], 10);
+    packer.release(x[1], y[1], 10);
+    int wide_x, wide_y;
+    CHECK(packer.pack(20, 10, wide_x, wide_y));
+    CHECK_EQ(wide_x, 0);
+    CHECK_EQ(wide_y, 0);
+        
+    // Room between two freed slots joins both
+    packer.release(wide_x, wide_y, 20);
+    packer.release(x[2], y[2], 10);
+    CHECK(packer.pack(30, 10, wide_x, wide_y));
+    CHECK_EQ(wide_x, 0);
+        
+    // What reaches the end of the shelf goes back to it, and the empty
+    // shelf back to the page
+    packer.release(x[3], y[3], 10);
+    int next_x, next_y;
+    CHECK(packer.pack(5, 10, next_x, next_y));
+    CHECK_EQ(next_x, 30);
+    packer.release(next_x, next_y, 5);
+    packer.release(wide_x, wide_y, 30);
+    CHECK_EQ(packer.used_height(), 0);
+        
+    // A slot is reused only by rectangles no taller than its shelf, and
+    // what is left of it stays free
+    CHECK(packer.pack(10, 10, x[0], y[0]));
+    CHECK(packer.pack(10, 10, x[1], y[1]));
+    packer.release(x[0], y[0], 10);
+    CHECK(packer.pack(4, 12, next_x, next_y));
+    CHECK_EQ(next_y, 10);
+    CHECK(packer.pack(4, 8, next_x, next_y));
+    CHECK_EQ(next_x, 0);
+    CHECK_EQ(next_y, 0);
+    CHECK(packer.pack(6, 8, next_x, next_y));
+    CHECK_EQ(next_x, 4);
+    CHECK_EQ(next_y, 0);
+}
+    
+// A bitmap whose every pixel is nonzero and tells where it came from
+std::vector<uint8_t> glyph_bitmap(int width, int height, int pitch, int seed) {
+    std::vector<uint8_t> bitmap(static_cast<size_t>(pitch) * height, 0);
+    for (int row = 0; row < height; ++row) {
+        for (int column = 0; column < width; ++column) {
+            bitmap[row * pitch + column] = static_cast<uint8_t>(1 + (seed * 31 + row * 7 + column) % 255);
+        }
+    }
+    return bitmap;
+}
+    
+// The glyph's pixels read back, with the border around it clear
+bool reads_back(const GlyphAtlas& atlas, const AtlasRegion& region, const std::vector<uint8_t>& bitmap, int pitch) {
+    const uint8_t* pixels = atlas.page_pixels(region.page);
+    const int padding = GlyphAtlas::PADDING;
+    for (int row = -padding; row < region.height + padding; ++row) {
+        for (int column = -padding; column < region.width + padding; ++column) {
+            uint8_t value = pixels[(region.y + row) * GlyphAtlas::PAGE_SIZE + region.x + column];
+            bool inside = row >= 0 && row < region.height && column >= 0 && column < region.width;
+            if (value != (inside ? bitmap[row * pitch + column] : 0)) return false;
+        }
+    }
+    return true;
+}
+    
+void test_atlas_pixels() {
+    const int page_size = GlyphAtlas::PAGE_SIZE;
+    const int padding = GlyphAtlas::PADDING;
+    const float scale = 1.0f / page_size;
+    GlyphAtlas atlas;
+    std::mt19937 random(11);
+        
+    // Until every page is full
+    std::vector<AtlasRegion> regions;
+    std::vector<std::vector<uint8_t>> bitmaps;
+    std::vector<int> pitches;
+    for (;;) {
+        int width = 4 + static_cast<int>(random() % 30);
+        int height = 6 + static_cast<int>(random() % 36);
+        int pitch = width + static_cast<int>(random() % 3);
+        std::vector<uint8_t> bitmap = glyph_bitmap(width, height, pitch, static_cast<int>(regions.size()));
+        AtlasRegion region;
+        if (!atlas.add(bitmap.data(), width, height, pitch, region)) break;
+        CHECK_EQ(region.width, width);
+        CHECK_EQ(region.height, height);
+        CHECK_EQ(region.u0, region.x * scale);
+        CHECK_EQ(region.v1, (region.y + height) * scale);
+        regions.push_back(region);
+        bitmaps.push_back(bitmap);
+        pitches.push_back(pitch);
+    }
+    CHECK_EQ(atlas.page_count(), GlyphAtlas::MAX_PAGES);
+    CHECK(regions.size() > 1000);
+        
+    // Give back a third and fill the room with smaller glyphs, which must
+    // not show what was there before
+    std::vector<size_t> live;
+    for (size_t i = 0; i < regions.size(); ++i) {
+        if (i % 3 == 0) {
+            atlas.release(regions[i]);
+        } else {
+            live.push_back(i);
+        }
+    }
+    for (int added = 0; added < 200; ++added) {
+        int width = 2 + static_cast<int>(random() % 8);
+        int height = 4 + static_cast<int>(random() % 10);
+        std::vector<uint8_t> bitmap = glyph_bitmap(width, height, width, static_cast<int>(regions.size()));
+        AtlasRegion region;
+        if (!atlas.add(bitmap.data(), width, height, width, region)) break;
+        live.push_back(regions.size());
+        regions.push_back(region);
+        bitmaps.push_back(bitmap);
+        pitches.push_back(width);
+    }
+    CHECK(live.size() > regions.size() * 2 / 3);
+        
+    std::vector<std::vector<Placed>> padded(atlas.page_count());
+    size_t wrong = 0;
+    for (size_t i : live) {
+        const AtlasRegion& region = regions[i];
+        Placed rect = {region.x - padding, region.y - padding, region.width + 2 * padding, region.height + 2 * padding};
+        padded[region.page].push_back(rect);
+        if (!reads_back(atlas, region, bitmaps[i], pitches[i])) ++wrong;
+    }
+    CHECK_EQ(wrong, 0u);
+    for (const std::vector<Placed>& page : padded) {
+        CHECK(disjoint(page, page_size, page_size));
+    }
+        
+    // Blank glyphs take no room
+    AtlasRegion blank;
+    CHECK(atlas.add(nullptr, 0, 12, 0, blank));
+    CHECK_EQ(blank.width, 0);
+    atlas.release(blank);
+}
+    
+void test_dirty_rows() {
+    GlyphAtlas atlas;
+    std::vector<uint8_t> bitmap = glyph_bitmap(10, 20, 10, 1);
+    AtlasRegion first, second;
+    CHECK(atlas.add(bitmap.data(), 10, 20, 10, first));
+    CHECK(atlas.add(bitmap.data(), 10, 12, 10, second));
+        
+    // Both glyphs with their borders, then nothing until the next add
+    int first_row = -1, end_row = -1;
+    CHECK(atlas.take_dirty_rows(0, first_row, end_row));
+    CHECK_EQ(first_row, 0);
+    CHECK_EQ(end_row, 22);
+    CHECK(!atlas.take_dirty_rows(0, first_row, end_row));
+        
+    // A glyph opening a new shelf marks its rows only
+    std::vector<uint8_t> tall = glyph_bitmap(10, 60, 10, 2);
+    AtlasRegion third;
+    CHECK(atlas.add(tall.data(), 10, 60, 10, third));
+    CHECK(atlas.take_dirty_rows(0, first_row, end_row));
+    CHECK_EQ(first_row, third.y - GlyphAtlas::PADDING);
+    CHECK_EQ(end_row, third.y + 60 + GlyphAtlas::PADDING);
+    CHECK_EQ(first_row, 22);
+        
+    // Releasing writes nothing; room reused from it is written again
+    atlas.release(second);
+    CHECK(!atlas.take_dirty_rows(0, first_row, end_row));
+    AtlasRegion reused;
+    CHECK(atlas.add(bitmap.data(), 6, 10, 10, reused));
+    CHECK_EQ(reused.y, second.y);
+    CHECK(atlas.take_dirty_rows(0, first_row, end_row));
+    CHECK_EQ(first_row, 0);
+    CHECK_EQ(end_row, 12);
+        
+    // Cleared pages are uploaded whole
+    atlas.clear();
+    CHECK(atlas.take_dirty_rows(0, first_row, end_row));
+    CHECK_EQ(first_row, 0);
+    CHECK_EQ(end_row, GlyphAtlas::PAGE_SIZE);
+    for (int i = 0; i < GlyphAtlas::PAGE_SIZE; ++i) {
+        if (atlas.page_pixels(0)[i * GlyphAtlas::PAGE_SIZE + i] != 0) {
+            CHECK(false);
+            break;
+        }
+    }
+}
+    
+void test_quad_batch() {
+    GlyphAtlas atlas;
+    std::vector<uint8_t> bitmap = glyph_bitmap(8, 10, 8, 3);
+    AtlasRegion region, blank;
+    CHECK(atlas.add(bitmap.data(), 8, 10, 8, region));
+    region.page = 2;
+        
+    QuadBatch batch;
+    batch.add(region, 100, 50);
+    batch.add(blank, 0, 0);
+    CHECK_EQ(batch.quad_count(), 1u);
+    CHECK_EQ(batch.page_count(), 3u);
+    CHECK(batch.vertices(0).empty());
+    const std::vector<QuadVertex>& vertices = batch.vertices(2);
+    CHECK_EQ(vertices.size(), QuadBatch::VERTICES_PER_QUAD);
+    CHECK_EQ(vertices[4].x, 108.0f);
+    CHECK_EQ(vertices[4].y, 60.0f);
+    CHECK_EQ(vertices[4].u, region.u1);
+    CHECK_EQ(vertices[0].v, region.v0);
+        
+    batch.clear();
+    CHECK(batch.empty());
+    CHECK(batch.vertices(2).empty());
+}
+    
+} // namespace
+
+int main() {
+    test_packer_no_overlaps();
+    test_packer_release_merges();
+    test_atlas_pixels();
+    test_dirty_rows();
+    test_quad_batch();
+    return test_result();
+}
@@ -0,0 +1,164 @@
+#include "glyph_cache.h"
+#include "test_support.h"
+
+// GlyphCache evicts in CLOCK order, sparing once each glyph used since the
+// hand last passed, and never a glyph of the current batch. It keeps to its
+// byte budget, except to hold a batch that needs more, and a glyph that
+// finds no room is not cached at all. A full atlas is made room in by
+// evicting from a shelf tall enough for the new glyph.
+
+namespace {
+    
+const uint16_t FACE = 0;
+const uint16_t SIZE = 16;
+    
+const CachedGlyph* insert(GlyphCache& cache, uint32_t codepoint, int width, int height) {
+    std::vector<uint8_t> bitmap(static_cast<size_t>(width) * height, 0xFF);
+    return cache.insert(FACE, SIZE, codepoint, bitmap.data(), width, height, width, 1, height, width + 2);
+}
+    
+bool cached(GlyphCache& cache, uint32_t codepoint) {
+    return cache.find(FACE, SIZE, codepoint) != nullptr;
+}
+    
+void test_clock_order() {
+    GlyphCache cache(1024 * 1024, 4);
+    for (uint32_t codepoint = 'a'; codepoint <= 'd'; ++codepoint) {
+        CHECK(insert(cache, codepoint, 10, 10));
+    }
+        
+    // Every glyph was used since the hand last passed, so a full turn
+    // spares them all once and the oldest goes
+    cache.begin_batch();
+    CHECK(insert(cache, 'e', 10, 10));
+    CHECK_EQ(cache.stats().evictions, 1u);
+        
+    // 'b' is used again and spared; 'c' is next
+    CHECK(cached(cache, 'b'));
+    cache.begin_batch();
+    CHECK(insert(cache, 'f', 10, 10));
+    cache.begin_batch();
+    CHECK(!cached(cache, 'a'));
+    CHECK(cached(cache, 'b'));
+    CHECK(!cached(cache, 'c'));
+    CHECK(cached(cache, 'd'));
+    CHECK(cached(cache, 'e'));
+    CHECK(cached(cache, 'f'));
+        
+    // Lookups count whatever they find
+    const GlyphCache::Stats& stats = cache.stats();
+    CHECK_EQ(stats.hits, 5u);
+    CHECK_EQ(stats.misses, 2u);
+    CHECK_EQ(stats.evictions, 2u);
+    CHECK_EQ(stats.glyphs, 4u);
+    CHECK_EQ(stats.bytes, 400u);
+}
+    
+void test_byte_budget() {
+    GlyphCache cache(300, 16);
+    for (uint32_t codepoint = 'a'; codepoint <= 'c'; ++codepoint) {
+        CHECK(insert(cache, codepoint, 10, 10));
+    }
+    CHECK_EQ(cache.stats().bytes, 300u);
+    CHECK_EQ(cache.stats().evictions, 0u);
+        
+    // Past the budget the oldest goes
+    cache.begin_batch();
+    CHECK(insert(cache, 'd', 10, 10));
+    CHECK_EQ(cache.stats().bytes, 300u);
+    CHECK_EQ(cache.stats().glyphs, 3u);
+    CHECK_EQ(cache.stats().evictions, 1u);
+    CHECK(!cached(cache, 'a'));
+        
+    // Blank glyphs cost nothing
+    CHECK(insert(cache, ' ', 0, 0));
+    CHECK_EQ(cache.stats().bytes, 300u);
+    CHECK_EQ(cache.stats().evictions, 1u);
+        
+    // clear() drops the glyphs, not the counters
+    cache.clear();
+    CHECK_EQ(cache.stats().glyphs, 0u);
+    CHECK_EQ(cache.stats().bytes, 0u);
+    CHECK_EQ(cache.stats().evictions, 1u);
+    CHECK(!cached(cache, 'b'));
+}
+    
+void test_pinned_batch() {
+    // A batch needing more than the budget keeps all of it
+    GlyphCache cache(200, 3);
+    for (uint32_t codepoint = 'a'; codepoint <= 'c'; ++codepoint) {
+        CHECK(insert(cache, codepoint, 10, 10));
+    }
+    CHECK_EQ(cache.stats().bytes, 300u);
+    CHECK_EQ(cache.stats().evictions, 0u);
+        
+    // Out of entries with every one in use, the glyph is not cached
+    CHECK(!insert(cache, 'd', 10, 10));
+    CHECK(!cached(cache, 'd'));
+    CHECK_EQ(cache.stats().glyphs, 3u);
+        
+    // The next batch goes back under the budget
+    cache.begin_batch();
+    CHECK(insert(cache, 'd', 10, 10));
+    CHECK_EQ(cache.stats().bytes, 200u);
+    CHECK_EQ(cache.stats().evictions, 2u);
+}
+    
+// Each atlas page as a 100-row shelf holding a tall and a short glyph, then
+// two 408-row glyphs down to the bottom
+void fill_atlas(GlyphCache& cache) {
+    const int half = GlyphAtlas::PAGE_SIZE / 2 - 2 * GlyphAtlas::PADDING;
+    for (uint32_t page = 0; page < GlyphAtlas::MAX_PAGES; ++page) {
+        CHECK(insert(cache, 0x100 + page, half, 100));
+        CHECK(insert(cache, 0x200 + page, half, 60));
+        CHECK(insert(cache, 0x300 + page, half, 408));
+        CHECK(insert(cache, 0x400 + page, half, 408));
+    }
+    CHECK_EQ(cache.atlas().page_count(), GlyphAtlas::MAX_PAGES);
+}
+    
+void test_full_atlas() {
+    const int half = GlyphAtlas::PAGE_SIZE / 2 - 2 * GlyphAtlas::PADDING;
+    GlyphCache cache(16 * 1024 * 1024, 64);
+    fill_atlas(cache);
+    const GlyphCache::Stats& stats = cache.stats();
+    size_t glyphs = stats.glyphs;
+    size_t bytes = stats.bytes;
+        
+    // Nothing can go while the batch uses every glyph, and a glyph with no
+    // room gives its entry back
+    CHECK(!insert(cache, 'x', half, 90));
+    CHECK_EQ(stats.glyphs, glyphs);
+    CHECK_EQ(stats.bytes, bytes);
+    CHECK(!cached(cache, 'x'));
+        
+    // With the tall glyphs in use, the 60-row glyph beside one makes room
+    // for 90 rows, its shelf being 100 tall; no 408-row glyph goes
+    cache.begin_batch();
+    for (uint32_t page = 0; page < GlyphAtlas::MAX_PAGES; ++page) {
+        CHECK(cached(cache, 0x100 + page));
+    }
+    const CachedGlyph* glyph = insert(cache, 'x', half, 90);
+    CHECK(glyph != nullptr);
+    CHECK_EQ(stats.evictions, 1u);
+    CHECK(!cached(cache, 0x200));
+    for (uint32_t page = 0; page < GlyphAtlas::MAX_PAGES; ++page) {
+        CHECK(cached(cache, 0x300 + page));
+        CHECK(cached(cache, 0x400 + page));
+    }
+    if (glyph) {
+        CHECK_EQ(glyph->region.page, 0);
+        CHECK_EQ(glyph->region.height, 90);
+        CHECK_EQ(glyph->advance_x, half + 2);
+    }
+}
+    
+} // namespace
+
+int main() {
+    test_clock_order();
+    test_byte_budget();
+    test_pinned_batch();
+    test_full_atlas();
+    return test_result();
+}
@@ -0,0 +1,161 @@
+#include "html_text.h"
+#include "styled_text.h"
+#include "test_support.h"
+
+// HtmlTextExtractor output must not depend on how the input is split:
+// ChapterStream feeds 16KB chunks where BookContent feeds whole documents,
+// and both must agree on text, anchors, runs and blocks. Each document in
+// the corpus is fed whole and at every split size from 1 byte up.
+
+namespace {
+    
+struct Extracted {
+    std::string text;
+    std::vector<std::string> anchor_names;
+    std::vector<uint32_t> anchor_offsets;
+    std::vector<StyledText::Run> runs;
+    std::vector<StyledText::Block> blocks;
+};
+    
+Extracted extract(const std::string& html, size_t chunk, const std::vector<std::string>& names) {
+    HtmlTextExtractor extractor;
+    AnchorIndex anchors;
+    StyledText styled;
+    extractor.set_anchor_index(&anchors);
+    extractor.set_styled_output(&styled);
+    for (size_t at = 0; at < html.size(); at += chunk) {
+        extractor.feed(html.data() + at, std::min(chunk, html.size() - at), styled.text);
+    }
+    extractor.finish(styled.text);
+        
+    Extracted result;
+    result.text = styled.text;
+    for (const std::string& name : names) {
+        uint32_t offset = 0xFFFFFFFF;
+        if (anchors.find(name, offset)) {
+            result.anchor_names.push_back(name);
+            result.anchor_offsets.push_back(offset);
+        }
+    }
+    result.runs = styled.runs;
+    result.blocks = styled.blocks;
+    return result;
+}
+    
+bool same_runs(const std::vector<StyledText::Run>& a, const std::vector<StyledText::Run>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].offset != b[i].offset || a[i].length != b[i].length || a[i].style != b[i].style) return false;
+    }
+    return true;
+}
+    
+bool same_blocks(const std::vector<StyledText::Block>& a, const std::vector<StyledText::Block>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].offset != b[i].offset || a[i].kind != b[i].kind) return false;
+    }
+    return true;
+}
+    
+// Spaces next to breaks, references and tags at every boundary
+const char* const corpus[] = {
+    "<p>word </p><p>next</p>",
+    "<p>word <br/>after</p>",
+    "<p>one  two\n\tthree   </p>\n\n<p>  four</p>",
+    "<h1 id=\"top\">Title </h1>\n<p>Text <em>in <b>bold</b> </em> and <a id=\"mid\">anchor</a> </p>",
+    "<p>a &amp; b &#x263A; &#9731; &copy; &bogus; &#x; &#xZZ; &amp</p>",
+    "<p>before <span> </span> <i>after</i></p>",
+    "<html><head><title>T</title><style>p { color: red; }</style></head>"
+    "<body><script>var a = '<p>';</script><p>visible <!-- hidden <p> --> text</p></body></html>",
+    "<div><p>nested <q>quote</q> </p> </div><div> <a name=\"end\"> </a>end</div>",
+    "text with no markup and a trailing space ",
+    "<p>tab\tbefore&nbsp;break<br>\n</p><h2 id=\"h\"> spaced heading </h2>",
+    "<!DOCTYPE html><p>a<!-- x > y --->b<!---->c<!-- -- > -->d<!-x>e</p>",
+};
+    
+const char* const anchor_names[] = { "top", "mid", "end", "h" };
+    
+std::string generated_chapter() {
+    std::string html = "<html><body>";
+    uint32_t state = 3;
+    for (int section = 0; section < 40; ++section) {
+        html += "<h3 id=\"g" + std::to_string(section) + "\">Part " + std::to_string(section) + " </h3>\n";
+        for (int paragraph = 0; paragraph < 6; ++paragraph) {
+            html += "<p>";
+            for (int word = 0; word < 30; ++word) {
+                state = state * 1103515245u + 12345u;
+                switch ((state >> 16) % 9) {
+                    case 0: html += "<em>slanted</em> "; break;
+                    case 1: html += "&ldquo;quoted&rdquo; "; break;
+                    case 2: html += "line<br/> "; break;
+                    case 3: html += " <b> bold </b> "; break;
+                    default: html += "word" + std::to_string(state % 100) + " "; break;
+                }
+            }
+            html += " </p>\n";
+        }
+    }
+    return html + "</body></html>";
+}
+    
+void check_splits(const std::string& html, size_t max_chunk) {
+    std::vector<std::string> names(anchor_names, anchor_names + sizeof(anchor_names) / sizeof(anchor_names[0]));
+    for (int section = 0; section < 40; ++section) names.push_back("g" + std::to_string(section));
+        
+    Extracted whole = extract(html, html.size() + 1, names);
+    for (size_t chunk = 1; chunk <= max_chunk; ++chunk) {
+        Extracted split = extract(html, chunk, names);
+        bool same = split.text == whole.text && split.anchor_names == whole.anchor_names &&
+                    split.anchor_offsets == whole.anchor_offsets && same_runs(split.runs, whole.runs) &&
+                    same_blocks(split.blocks, whole.blocks);
+        if (!same) {
+            std::cerr << "Split at " << chunk << " bytes differs for: " << html.substr(0, 60) << std::endl;
+            CHECK(same);
+            return;
+        }
+    }
+}
+    
+std::string plain(const std::string& html) {
+    std::vector<std::string> names;
+    return extract(html, html.size() + 1, names).text;
+}
+    
+void test_expected_text() {
+    CHECK_EQ(plain("<p>word </p><p>next</p>"), std::string("word\nnext\n"));
+    CHECK_EQ(plain("<p>word <br/>after</p>"), std::string("word\nafter\n"));
+    CHECK_EQ(plain("<p>a  b</p>"), std::string("a b\n"));
+    CHECK_EQ(plain("<p>x &amp; y</p>"), std::string("x & y\n"));
+    CHECK_EQ(plain("<p>z <em>w</em> </p>"), std::string("z w\n"));
+    CHECK_EQ(plain("trailing "), std::string("trailing "));
+        
+    // Comments end at "-->" only, whatever '>' they hold
+    CHECK_EQ(plain("<p>a<!-- a > b -->c</p>"), std::string("ac\n"));
+    CHECK_EQ(plain("<p>a<!-- <p>x</p> - -> --- >-->c</p>"), std::string("ac\n"));
+    CHECK_EQ(plain("<p>a<!---->b<!-- x --->c</p>"), std::string("abc\n"));
+        
+    // Anchors point at the text after them, across a collapsed space
+    std::vector<std::string> names(1, "a");
+    Extracted spaced = extract("<p>one <span id=\"a\"></span>two</p>", 1000, names);
+    CHECK_EQ(spaced.anchor_offsets.size(), 1u);
+    if (!spaced.anchor_offsets.empty()) CHECK_EQ(spaced.text.substr(spaced.anchor_offsets[0]), std::string("two\n"));
+    Extracted broken = extract("<p>one <span id=\"a\"></span></p><p>two</p>", 1000, names);
+    CHECK_EQ(broken.text, std::string("one\ntwo\n"));
+    if (!broken.anchor_offsets.empty()) CHECK_EQ(broken.text.substr(broken.anchor_offsets[0]), std::string("two\n"));
+}
+    
+} // namespace
+
+int main() {
+    test_expected_text();
+    for (const char* html : corpus) check_splits(html, std::string(html).size());
+    check_splits(generated_chapter(), 64);
+    
+    // The chunk sizes the readers use
+    std::string chapter = generated_chapter();
+    for (int repeat = 0; repeat < 3; ++repeat) chapter += chapter;
+    std::vector<std::string> names;
+    CHECK(extract(chapter, 16 * 1024, names).text == extract(chapter, chapter.size(), names).text);
+    return test_result();
+}
@@ -0,0 +1,147 @@
+#include "cache_file.h"
+#include "file_manager.h"
+#include "hyphenator.h"
+#include "test_support.h"
+#include <cstring>
+
+// Hyphenation points for words whose TeX hyphenation is known, from the
+// shipped patterns and from small pattern sets. The packed trie read back
+// from CACHE_DIR must hyphenate exactly as the one just compiled, and a
+// changed pattern file must be compiled again.
+
+namespace {
+    
+std::string hyphenated(const Hyphenator& hyphenator, const std::string& word) {
+    uint8_t points[Hyphenator::MAX_WORD_LENGTH];
+    size_t count = hyphenator.hyphenate(word.data(), word.size(), points);
+    std::string result;
+    size_t last = 0;
+    for (size_t i = 0; i < count; ++i) {
+        result += word.substr(last, points[i] - last) + "-";
+        last = points[i];
+    }
+    return result + word.substr(last);
+}
+    
+std::string patterns_path() {
+    return test_data_path("../../assets/hyphenation/en-us.pat");
+}
+    
+// Every run of letters in the license texts
+std::vector<std::string> corpus_words() {
+    std::vector<std::string> words;
+    for (const char* name : { "text/GPL-3.txt", "text/MPL-2.0.txt" }) {
+        std::string text;
+        CHECK(read_file(test_data_path(name), text));
+        std::string word;
+        for (char c : text) {
+            if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+                word += c;
+            } else if (!word.empty()) {
+                words.push_back(word);
+                word.clear();
+            }
+        }
+    }
+    return words;
+}
+    
+void test_known_words(const Hyphenator& hyphenator) {
+    CHECK_EQ(hyphenated(hyphenator, "algorithm"), std::string("al-go-rithm"));
+    CHECK_EQ(hyphenated(hyphenator, "computer"), std::string("com-puter"));
+    CHECK_EQ(hyphenated(hyphenator, "table"), std::string("ta-ble"));
+    CHECK_EQ(hyphenated(hyphenator, "encyclopedia"), std::string("en-cy-clo-pe-dia"));
+    CHECK_EQ(hyphenated(hyphenator, "supercalifragilisticexpialidocious"),
+             std::string("su-per-cal-ifrag-ilis-tic-ex-pi-ali-do-cious"));
+        
+    // Exceptions override the patterns, including with no break at all
+    CHECK_EQ(hyphenated(hyphenator, "academies"), std::string("acad-e-mies"));
+    CHECK_EQ(hyphenated(hyphenator, "associate"), std::string("as-so-ciate"));
+    CHECK_EQ(hyphenated(hyphenator, "present"), std::string("present"));
+        
+    // Case and surrounding punctuation do not matter; short words stay whole
+    CHECK_EQ(hyphenated(hyphenator, "Algorithm,"), std::string("Al-go-rithm,"));
+    CHECK_EQ(hyphenated(hyphenator, "\"table\""), std::string("\"ta-ble\""));
+    CHECK_EQ(hyphenated(hyphenator, "read"), std::string("read"));
+    CHECK_EQ(hyphenated(hyphenator, "caf\xc3\xa9s"), std::string("caf\xc3\xa9s"));
+}
+    
+void test_small_patterns() {
+    Hyphenator hyphenator;
+    const char* source = "# comment\nhy3ph\nhe2n\nhena4\nhen5at\n1na\nn2at\n1tio\n2io\no2n\nta-ble\n";
+    CHECK(hyphenator.compile(source, std::strlen(source)));
+    CHECK(hyphenator.ready());
+    CHECK_EQ(hyphenated(hyphenator, "hyphenation"), std::string("hy-phen-ation"));
+    CHECK_EQ(hyphenated(hyphenator, "table"), std::string("ta-ble"));
+        
+    // The edges keep LEFT_MIN and RIGHT_MIN letters, and long words stay whole
+    CHECK_EQ(hyphenated(hyphenator, "hyph"), std::string("hyph"));
+    std::string long_word(Hyphenator::MAX_WORD_LENGTH, 'a');
+    CHECK_EQ(hyphenated(hyphenator, long_word + "hyphenation"), long_word + "hyphenation");
+        
+    // Anything but patterns and exceptions is refused
+    Hyphenator bad;
+    CHECK(!bad.compile("hy3ph\nhy+ph\n", 12));
+    CHECK(!bad.ready());
+    CHECK(!bad.compile("# only a comment\n", 17));
+}
+    
+void test_cache_round_trip(const std::vector<std::string>& words) {
+    // A copy of the shipped patterns, so it can be changed
+    std::string patterns;
+    CHECK(read_file(patterns_path(), patterns));
+    std::string path = FileManager::CACHE_DIR + "/test-patterns.pat";
+    CHECK(write_cache_file(path, patterns));
+    std::string cache = cache_file_path(cache_hash(path.data(), path.size()), ".hyph");
+    std::remove(cache.c_str());
+        
+    Hyphenator compiled;
+    CHECK(compiled.load(path));
+    std::vector<char> cached_blob;
+    CHECK(read_cache_file(cache, cached_blob));
+    CHECK_EQ(cached_blob.size(), compiled.compiled_bytes());
+        
+    Hyphenator loaded;
+    CHECK(loaded.load(path));
+    CHECK_EQ(loaded.fingerprint(), compiled.fingerprint());
+    size_t differing = 0;
+    for (const std::string& word : words) {
+        if (hyphenated(loaded, word) != hyphenated(compiled, word)) ++differing;
+    }
+    CHECK_EQ(differing, 0u);
+        
+    // Patterns that change the file are picked up, not the stale cache
+    CHECK(write_cache_file(path, patterns + "\nal5go\n"));
+    Hyphenator changed;
+    CHECK(changed.load(path));
+    CHECK(changed.fingerprint() != compiled.fingerprint());
+    CHECK_EQ(hyphenated(changed, "algorithm"), std::string("al-go-rithm"));
+        
+    // A cache for the file as it is, but cut short, is compiled again
+    CHECK(read_cache_file(cache, cached_blob));
+    std::string damaged(cached_blob.begin(), cached_blob.begin() + cached_blob.size() / 2);
+    CHECK(write_cache_file(cache, damaged));
+    Hyphenator recompiled;
+    CHECK(recompiled.load(path));
+    CHECK_EQ(recompiled.fingerprint(), changed.fingerprint());
+        
+    std::remove(path.c_str());
+    std::remove(cache.c_str());
+}
+    
+} // namespace
+
+int main() {
+    FileManager::initialize_directories();
+    
+    Hyphenator shipped;
+    CHECK(shipped.load(patterns_path()));
+    CHECK(shipped.ready());
+    test_known_words(shipped);
+    test_small_patterns();
+    
+    std::vector<std::string> words = corpus_words();
+    CHECK(words.size() > 1000);
+    test_cache_round_trip(words);
+    return test_result();
+}
@@ -0,0 +1,148 @@
+#include "cache_file.h"
+#include "epub_parser.h"
+#include "file_manager.h"
+#include "test_support.h"
+#include "zip_writer.h"
+
+// The index cache lets a reopened book skip the container, OPF and NCX.
+// A book opened from it must read back exactly as a parsed one, and a
+// cache file that is cut short, damaged, from another version or for an
+// older copy of the book must be ignored and the book parsed again.
+
+namespace {
+    
+const char* const NCX =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<ncx xmlns=\"http://www.daisy.org/z3986/2005/ncx/\" version=\"2005-1\"><navMap>"
+    "<navPoint id=\"one\" playOrder=\"1\"><navLabel><text>One &amp; only</text></navLabel>"
+    "<content src=\"ch0.xhtml\"/>"
+    "<navPoint id=\"one-a\" playOrder=\"2\"><navLabel><text>Part a</text></navLabel>"
+    "<content src=\"ch0.xhtml#a\"/></navPoint>"
+    "<navPoint id=\"one-b\" playOrder=\"3\"><navLabel><text>Part b</text></navLabel>"
+    "<content src=\"ch1.xhtml#b\"/></navPoint></navPoint>"
+    "<navPoint id=\"two\" playOrder=\"4\"><navLabel><text>Two</text></navLabel>"
+    "<content src=\"ch2.xhtml\"/></navPoint>"
+    "</navMap></ncx>\n";
+    
+std::string write_book(const std::string& name, int chapter_count) {
+    std::vector<std::string> chapters;
+    for (int i = 0; i < chapter_count; ++i) {
+        chapters.push_back("<html><body><p id=\"a\">Chapter " + std::to_string(i) + "</p></body></html>");
+    }
+    ZipWriter zip;
+    add_minimal_book(zip, chapters, true,
+                     "<item id=\"ncx\" href=\"toc.ncx\" media-type=\"application/x-dtbncx+xml\"/>");
+    zip.add("OEBPS/toc.ncx", NCX, true);
+    std::string path = FileManager::EPUB_DIR + "/" + name;
+    CHECK(zip.write(path));
+    return path;
+}
+    
+std::string cache_path(const std::string& book) {
+    return cache_file_path(cache_hash(book.data(), book.size()), ".idx");
+}
+    
+// Everything the cache holds, as text to compare
+std::string describe(const EPUBParser& parser) {
+    std::string text;
+    const EPUBParser::Manifest& manifest = parser.get_manifest();
+    for (size_t i = 0; i < manifest.size(); ++i) {
+        text += std::string("item ") + manifest.id(i) + " " + manifest.href(i) + " " + manifest.media_type(i) + " " +
+                std::to_string(manifest.type(i)) + "\n";
+    }
+    for (const EPUBParser::SpineItem& item : parser.get_spine()) {
+        text += "spine " + std::to_string(item.manifest_index) + (item.linear ? "" : " nonlinear") + "\n";
+    }
+    const EPUBParser::TableOfContents& toc = parser.get_table_of_contents();
+    for (size_t i = 0; i < toc.size(); ++i) {
+        const EPUBParser::TOCEntry& entry = toc.entry(i);
+        text += std::string("toc ") + toc.id(i) + " " + toc.title(i) + " " + toc.content_src(i) + " " +
+                std::to_string(entry.play_order) + " " + std::to_string(entry.parent) + " " +
+                std::to_string(entry.first_child) + " " + std::to_string(entry.next_sibling) + "\n";
+    }
+    for (size_t i = 0; i < toc.top_level_count(); ++i) {
+        text += "root " + std::to_string(toc.top_level(i)) + "\n";
+    }
+    return text;
+}
+    
+// Opens the book, checks it reads as expected and returns whether the cache was used
+bool open_cached(const std::string& path, const std::string& expected) {
+    EPUBParser parser;
+    CHECK(parser.open_epub(path));
+    CHECK_EQ(describe(parser), expected);
+    return parser.open_stats().index_cached;
+}
+    
+// Rewrites the cache file through edit
+template <typename Edit>
+void edit_cache(const std::string& path, Edit edit) {
+    std::vector<char> buffer;
+    CHECK(read_cache_file(cache_path(path), buffer));
+    std::string data(buffer.begin(), buffer.end());
+    edit(data);
+    CHECK(write_cache_file(cache_path(path), data));
+}
+    
+void put_u32(std::string& data, size_t at, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        data[at + i] = static_cast<char>((value >> (i * 8)) & 0xFF);
+    }
+}
+    
+} // namespace
+
+int main() {
+    FileManager::initialize_directories();
+    
+    std::string path = write_book("index_cache.epub", 3);
+    std::remove(cache_path(path).c_str());
+    
+    // Parsed, then read back from the cache as the same book
+    std::string expected;
+    {
+        EPUBParser parser;
+        CHECK(parser.open_epub(path));
+        CHECK(!parser.open_stats().index_cached);
+        CHECK_EQ(parser.get_table_of_contents().size(), 4u);
+        expected = describe(parser);
+    }
+    CHECK(open_cached(path, expected));
+    
+    // Cut short anywhere
+    std::vector<char> whole;
+    CHECK(read_cache_file(cache_path(path), whole));
+    for (size_t length : { static_cast<size_t>(2), static_cast<size_t>(12), whole.size() / 2, whole.size() - 1 }) {
+        edit_cache(path, [&](std::string& data) { data.resize(length); });
+        CHECK(!open_cached(path, expected));
+        CHECK(open_cached(path, expected));
+    }
+    
+    // A TOC link past the end of the table
+    edit_cache(path, [](std::string& data) { put_u32(data, data.size() - 4, 1000); });
+    CHECK(!open_cached(path, expected));
+    CHECK(open_cached(path, expected));
+    
+    // Trailing bytes
+    edit_cache(path, [](std::string& data) { data += '\0'; });
+    CHECK(!open_cached(path, expected));
+    CHECK(open_cached(path, expected));
+    
+    // Another version, or another size or path in the fingerprint
+    edit_cache(path, [](std::string& data) { put_u32(data, 4, 0xFFFF); });
+    CHECK(!open_cached(path, expected));
+    edit_cache(path, [](std::string& data) { data[8] ^= 1; });
+    CHECK(!open_cached(path, expected));
+    edit_cache(path, [](std::string& data) { data[data.find("index_cache.epub")] = 'X'; });
+    CHECK(!open_cached(path, expected));
+    CHECK(open_cached(path, expected));
+    
+    // The book rewritten with another chapter is parsed again
+    write_book("index_cache.epub", 4);
+    EPUBParser parser;
+    CHECK(parser.open_epub(path));
+    CHECK(!parser.open_stats().index_cached);
+    CHECK_EQ(parser.get_spine().size(), 4u);
+    
+    return test_result();
+}
@@ -0,0 +1,329 @@
+#include "line_break.h"
+#include "test_support.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#ifdef HAVE_ICU
+#include <unicode/brkiter.h>
+#include <unicode/uchar.h>
+#include <unicode/unistr.h>
+#include <memory>
+#endif
+
+// LineBreakScanner against UAX #14, so that regenerating the tables or
+// touching the rules cannot change where lines break unnoticed. Cases are
+// in LineBreakTest.txt's notation, "×" for no break and "÷" for a break
+// before each codepoint; --file runs the UCD's LineBreakTest.txt itself.
+// Where ICU is installed, every codepoint's class and the breaks of random
+// strings of every class are checked against ICU's, which implements the
+// same Unicode version as the generated tables.
+//
+//   test_line_break [--file LineBreakTest.txt]
+
+namespace {
+    
+const char* const CLASS_NAMES[] = { "OP", "CL", "CP", "QU", "GL", "NS", "EX", "SY", "IS", "PR", "PO", "NU", "AL",
+                                    "HL", "ID", "IN", "HY", "BA", "BB", "B2", "ZW", "CB", "WJ", "H2", "H3", "JL",
+                                    "JV", "JT", "RI", "EB", "EM", "CM", "ZWJ", "SP", "BK", "CR", "LF", "NL" };
+    
+struct Case {
+    std::vector<uint32_t> codepoints;
+    std::vector<bool> breaks;   // Before each codepoint after the first
+};
+    
+// "× 0041 ÷ 0020 × 0042 ÷", comments after '#'
+bool parse_case(const std::string& line, Case& parsed) {
+    parsed.codepoints.clear();
+    parsed.breaks.clear();
+    std::string text = line.substr(0, line.find('#'));
+    bool pending_break = false;
+    bool have_mark = false;
+    size_t i = 0;
+    while (i < text.size()) {
+        if (text.compare(i, 2, "\xC3\x97") == 0) {
+            pending_break = false;
+            have_mark = true;
+            i += 2;
+        } else if (text.compare(i, 2, "\xC3\xB7") == 0) {
+            pending_break = true;
+            have_mark = true;
+            i += 2;
+        } else if (std::isxdigit(static_cast<unsigned char>(text[i]))) {
+            size_t end = i;
+            while (end < text.size() && std::isxdigit(static_cast<unsigned char>(text[end]))) ++end;
+            if (!parsed.codepoints.empty()) parsed.breaks.push_back(pending_break);
+            parsed.codepoints.push_back(static_cast<uint32_t>(std::strtoul(text.substr(i, end - i).c_str(), nullptr, 16)));
+            have_mark = false;
+            i = end;
+        } else {
+            ++i;
+        }
+    }
+    return !parsed.codepoints.empty() && have_mark;
+}
+    
+std::vector<bool> scan(const std::vector<uint32_t>& codepoints) {
+    LineBreakScanner scanner;
+    std::vector<bool> breaks;
+    for (size_t i = 0; i < codepoints.size(); ++i) {
+        bool allowed = scanner.next(codepoints[i]) != LineBreakScanner::NO_BREAK;
+        if (i > 0) breaks.push_back(allowed);
+    }
+    return breaks;
+}
+    
+std::string describe(const std::vector<uint32_t>& codepoints, const std::vector<bool>& breaks) {
+    std::string text;
+    char hex[16];
+    for (size_t i = 0; i < codepoints.size(); ++i) {
+        if (i > 0) text += breaks[i - 1] ? " \xC3\xB7 " : " \xC3\x97 ";
+        std::snprintf(hex, sizeof(hex), "%04X %s", codepoints[i], CLASS_NAMES[LineBreakScanner::classify(codepoints[i])]);
+        text += hex;
+    }
+    return text;
+}
+    
+bool check_case(const Case& expected) {
+    std::vector<bool> breaks = scan(expected.codepoints);
+    if (breaks == expected.breaks) return true;
+    std::cerr << "expected " << describe(expected.codepoints, expected.breaks) << std::endl
+              << "     got " << describe(expected.codepoints, breaks) << std::endl;
+    return false;
+}
+    
+// Opening brackets of East Asian width F, W or H, from ICU 72
+const uint32_t WIDE_OPENING[] = { 0x2329, 0x3008, 0x300A, 0x300C, 0x300E, 0x3010, 0x3014, 0x3016, 0x3018, 0x301A,
+                                  0x301D, 0xFE17, 0xFE35, 0xFE37, 0xFE39, 0xFE3B, 0xFE3D, 0xFE3F, 0xFE41, 0xFE43,
+                                  0xFE47, 0xFE59, 0xFE5B, 0xFE5D, 0xFF08, 0xFF3B, 0xFF5B, 0xFF5F, 0xFF62 };
+    
+bool wide_opening(uint32_t codepoint) {
+    const uint32_t* end = WIDE_OPENING + sizeof(WIDE_OPENING) / sizeof(WIDE_OPENING[0]);
+    return std::find(WIDE_OPENING, end, codepoint) != end;
+}
+    
+// What the scanner leaves out, as line_break.h lists: LB25's lookahead
+// past an opening bracket, LB30's exception for wide opening brackets, and
+// ICU's break before IS after spaces when a digit follows. Marks are
+// attached to what they follow first, as LB9 and LB10 do. SA scripts,
+// which break by dictionary, are never generated.
+bool known_exception(const std::vector<uint32_t>& codepoints) {
+    std::vector<uint8_t> classes;
+    std::vector<uint32_t> bases;
+    for (uint32_t codepoint : codepoints) {
+        uint8_t cls = LineBreakScanner::classify(codepoint);
+        if (cls == LB_CM || cls == LB_ZWJ) {
+            uint8_t last = classes.empty() ? LB_SP : classes.back();
+            if (last != LB_SP && last != LB_ZW && last < LB_BK) continue;
+            cls = LB_AL;
+        }
+        classes.push_back(cls);
+        bases.push_back(codepoint);
+    }
+    for (size_t i = 0; i + 1 < classes.size(); ++i) {
+        uint8_t cls = classes[i];
+        uint8_t next = classes[i + 1];
+        if ((cls == LB_PR || cls == LB_PO) && next == LB_OP) return true;
+        if ((cls == LB_AL || cls == LB_HL || cls == LB_NU) && wide_opening(bases[i + 1])) return true;
+        if (cls == LB_SP && next == LB_IS && i + 2 < classes.size() && classes[i + 2] == LB_NU) return true;
+    }
+    return false;
+}
+    
+// One case per rule the scanner implements, in the order of UAX #14
+const char* const RULE_CASES[] = {
+    "\xC3\x97 0041 \xC3\x97 000D \xC3\x97 000A \xC3\xB7 0042 \xC3\xB7",                    // LB4, LB5
+    "\xC3\x97 0041 \xC3\x97 2028 \xC3\xB7 0020 \xC3\xB7 0042 \xC3\xB7",                    // LB4, LB18 after it
+    "\xC3\x97 0041 \xC3\x97 0020 \xC3\x97 200B \xC3\xB7 0042 \xC3\xB7",                    // LB7, LB8
+    "\xC3\x97 200D \xC3\x97 2E3A \xC3\xB7",                                                // LB8a at the start
+    "\xC3\x97 0061 \xC3\x97 200D \xC3\x97 4E00 \xC3\xB7",                                  // LB8a
+    "\xC3\x97 0061 \xC3\x97 0301 \xC3\x97 0062 \xC3\xB7",                                  // LB9
+    "\xC3\x97 0020 \xC3\xB7 0301 \xC3\xB7",                                                // LB10
+    "\xC3\x97 0061 \xC3\x97 2060 \xC3\x97 0062 \xC3\xB7",                                  // LB11
+    "\xC3\x97 0061 \xC3\x97 00A0 \xC3\x97 0062 \xC3\xB7",                                  // LB12
+    "\xC3\x97 0061 \xC3\x97 0020 \xC3\x97 0021 \xC3\xB7",                                  // LB13
+    "\xC3\x97 0020 \xC3\x97 0029 \xC3\xB7",                                                // LB13 after leading spaces
+    "\xC3\x97 0028 \xC3\x97 0020 \xC3\x97 0061 \xC3\xB7",                                  // LB14
+    "\xC3\x97 0022 \xC3\x97 0020 \xC3\x97 0028 \xC3\xB7",                                  // LB15
+    "\xC3\x97 0029 \xC3\x97 0020 \xC3\x97 3001 \xC3\xB7",                                  // LB16
+    "\xC3\x97 2014 \xC3\x97 0020 \xC3\x97 2014 \xC3\xB7",                                  // LB17
+    "\xC3\x97 0061 \xC3\x97 0020 \xC3\xB7 0062 \xC3\xB7",                                  // LB18
+    "\xC3\x97 0020 \xC3\xB7 0062 \xC3\xB7",                                                // LB18 after leading spaces
+    "\xC3\x97 0061 \xC3\x97 0022 \xC3\x97 0062 \xC3\xB7",                                  // LB19
+    "\xC3\x97 0061 \xC3\xB7 FFFC \xC3\xB7 0062 \xC3\xB7",                                  // LB20
+    "\xC3\x97 05D0 \xC3\x97 002D \xC3\xB7 FFFC \xC3\xB7",                                  // LB20 before LB21a
+    "\xC3\x97 002D \xC3\x97 0061 \xC3\xB7",                                                // LB20a
+    "\xC3\x97 002D \xC3\xB7 05D0 \xC3\xB7",                                                // LB20a, letters only
+    "\xC3\x97 00A0 \xC3\x97 002D \xC3\xB7 0061 \xC3\xB7",                                  // LB20a, not after GL
+    "\xC3\x97 0061 \xC3\x97 002D \xC3\xB7 0062 \xC3\xB7",                                  // LB21
+    "\xC3\x97 05D0 \xC3\x97 002D \xC3\x97 4E00 \xC3\xB7",                                  // LB21a
+    "\xC3\x97 0061 \xC3\x97 2024 \xC3\xB7",                                                // LB22
+    "\xC3\x97 0061 \xC3\x97 0031 \xC3\xB7",                                                // LB23
+    "\xC3\x97 0024 \xC3\x97 0031 \xC3\x97 002C \xC3\x97 0030 \xC3\x97 0025 \xC3\xB7",      // LB25
+    "\xC3\x97 0031 \xC3\x97 0029 \xC3\x97 0025 \xC3\xB7",                                  // LB25, closed number
+    "\xC3\x97 002F \xC3\xB7 0031 \xC3\xB7",                                                // LB25, SY outside a number
+    "\xC3\x97 0031 \xC3\x97 002F \xC3\x97 0032 \xC3\xB7",                                  // LB25, SY inside one
+    "\xC3\x97 1100 \xC3\x97 AC00 \xC3\x97 11A8 \xC3\xB7 1100 \xC3\xB7",                    // LB26, LB27
+    "\xC3\x97 0061 \xC3\x97 0028 \xC3\xB7",                                                // LB30
+    "\xC3\x97 1F1E6 \xC3\x97 1F1E8 \xC3\xB7 1F1E6 \xC3\xB7",                               // LB30a
+    "\xC3\x97 1F466 \xC3\x97 1F3FB \xC3\xB7",                                              // LB30b
+    "\xC3\x97 4E00 \xC3\xB7 4E8C \xC3\x97 3002 \xC3\xB7",                                  // LB31
+};
+    
+void test_rule_cases() {
+    for (const char* line : RULE_CASES) {
+        Case parsed;
+        CHECK(parse_case(line, parsed));
+        CHECK(check_case(parsed));
+    }
+}
+    
+// Generated tables, a few codepoints per class
+void test_classes() {
+    CHECK_EQ(LineBreakScanner::classify('a'), LB_AL);
+    CHECK_EQ(LineBreakScanner::classify(' '), LB_SP);
+    CHECK_EQ(LineBreakScanner::classify('-'), LB_HY);
+    CHECK_EQ(LineBreakScanner::classify(0x00AD), LB_BA);
+    CHECK_EQ(LineBreakScanner::classify(0x05D0), LB_HL);
+    CHECK_EQ(LineBreakScanner::classify(0x3001), LB_CL);
+    CHECK_EQ(LineBreakScanner::classify(0x3041), LB_NS);        // CJ, resolved by LB1
+    CHECK_EQ(LineBreakScanner::classify(0x4E00), LB_ID);
+    CHECK_EQ(LineBreakScanner::classify(0x0E01), LB_AL);        // SA, resolved by LB1
+    CHECK_EQ(LineBreakScanner::classify(0x0E31), LB_CM);
+    CHECK_EQ(LineBreakScanner::classify(0xAC00), LB_H2);
+    CHECK_EQ(LineBreakScanner::classify(0x1F1E6), LB_RI);
+    CHECK_EQ(LineBreakScanner::classify(0x1F3FB), LB_EM);
+    CHECK_EQ(LineBreakScanner::classify(0x20000), LB_ID);       // Unassigned in the ideograph planes
+    CHECK_EQ(LineBreakScanner::classify(0x10FFFF), LB_AL);
+}
+    
+bool run_test_file(const std::string& path) {
+    std::string contents;
+    if (!read_file(path, contents)) {
+        std::cerr << "Cannot read " << path << std::endl;
+        return false;
+    }
+    size_t passed = 0;
+    size_t failed = 0;
+    size_t skipped = 0;
+    size_t start = 0;
+    while (start < contents.size()) {
+        size_t end = contents.find('\n', start);
+        if (end == std::string::npos) end = contents.size();
+        Case parsed;
+        if (parse_case(contents.substr(start, end - start), parsed)) {
+            if (known_exception(parsed.codepoints)) {
+                ++skipped;
+            } else if (check_case(parsed)) {
+                ++passed;
+            } else {
+                ++failed;
+            }
+        }
+        start = end + 1;
+    }
+    std::printf("%s: %zu passed, %zu failed, %zu skipped as known exceptions\n", path.c_str(), passed, failed, skipped);
+    return failed == 0;
+}
+    
+#ifdef HAVE_ICU
+    
+const char* icu_class_name(uint32_t codepoint) {
+    int value = u_getIntPropertyValue(static_cast<UChar32>(codepoint), UCHAR_LINE_BREAK);
+    const char* name = u_getPropertyValueName(UCHAR_LINE_BREAK, value, U_SHORT_PROPERTY_NAME);
+    std::string cls = name ? name : "XX";
+        
+    // LB1, as tools/gen_line_break_tables.py resolves it
+    if (cls == "AI" || cls == "SG" || cls == "XX") return "AL";
+    if (cls == "SA") {
+        int8_t category = u_charType(static_cast<UChar32>(codepoint));
+        return category == U_NON_SPACING_MARK || category == U_COMBINING_SPACING_MARK ? "CM" : "AL";
+    }
+    if (cls == "CJ") return "NS";
+    return name;
+}
+    
+void test_icu_classes() {
+    size_t differ = 0;
+    for (uint32_t codepoint = 0; codepoint < 0x110000; ++codepoint) {
+        const char* expected = icu_class_name(codepoint);
+        const char* actual = CLASS_NAMES[LineBreakScanner::classify(codepoint)];
+        if (std::strcmp(expected, actual) != 0 && ++differ <= 10) {
+            std::fprintf(stderr, "U+%04X is %s, ICU says %s\n", codepoint, actual, expected);
+        }
+    }
+    CHECK_EQ(differ, 0u);
+}
+    
+std::vector<bool> icu_breaks(icu::BreakIterator& iterator, const std::vector<uint32_t>& codepoints) {
+    icu::UnicodeString text;
+    for (uint32_t codepoint : codepoints) text.append(static_cast<UChar32>(codepoint));
+    iterator.setText(text);
+    std::vector<bool> breaks(codepoints.size() - 1, false);
+    for (int32_t at = iterator.next(); at != icu::BreakIterator::DONE && at < text.length(); at = iterator.next()) {
+        breaks[text.countChar32(0, at) - 1] = true;
+    }
+    return breaks;
+}
+    
+// The rule cases, then random strings over a sample of every class, SA
+// excepted, against ICU's line break iterator
+void test_icu_breaks() {
+    UErrorCode status = U_ZERO_ERROR;
+    std::unique_ptr<icu::BreakIterator> iterator(icu::BreakIterator::createLineInstance(icu::Locale::getRoot(), status));
+    CHECK(U_SUCCESS(status));
+    if (U_FAILURE(status)) return;
+        
+    for (const char* line : RULE_CASES) {
+        Case parsed;
+        if (parse_case(line, parsed) && icu_breaks(*iterator, parsed.codepoints) != parsed.breaks) {
+            std::cerr << "ICU disagrees with the case " << describe(parsed.codepoints, parsed.breaks) << std::endl;
+            CHECK(false);
+        }
+    }
+        
+    std::vector<std::vector<uint32_t> > samples(LB_NL + 1);
+    for (uint32_t codepoint = 0; codepoint < 0x30000; ++codepoint) {
+        int value = u_getIntPropertyValue(static_cast<UChar32>(codepoint), UCHAR_LINE_BREAK);
+        if (value == U_LB_COMPLEX_CONTEXT || value == U_LB_SURROGATE || value == U_LB_UNKNOWN) continue;
+        std::vector<uint32_t>& sample = samples[LineBreakScanner::classify(codepoint)];
+        if (sample.size() < 2 || (sample.size() < 12 && codepoint % 7 == 0)) sample.push_back(codepoint);
+    }
+        
+    uint32_t state = 1;
+    size_t compared = 0;
+    size_t differ = 0;
+    for (int round = 0; round < 100000; ++round) {
+        state = state * 1103515245u + 12345u;
+        size_t length = 2 + (state >> 16) % 7;
+        std::vector<uint32_t> codepoints;
+        while (codepoints.size() < length) {
+            state = state * 1103515245u + 12345u;
+            const std::vector<uint32_t>& sample = samples[(state >> 16) % samples.size()];
+            state = state * 1103515245u + 12345u;
+            if (!sample.empty()) codepoints.push_back(sample[(state >> 16) % sample.size()]);
+        }
+        if (known_exception(codepoints)) continue;
+            
+        ++compared;
+        Case expected = { codepoints, icu_breaks(*iterator, codepoints) };
+        if (!check_case(expected) && ++differ >= 10) break;
+    }
+    CHECK_EQ(differ, 0u);
+    CHECK(compared > 90000);
+}
+    
+#endif // HAVE_ICU
+    
+} // namespace
+
+int main(int argc, char** argv) {
+    test_classes();
+    test_rule_cases();
+#ifdef HAVE_ICU
+    test_icu_classes();
+    test_icu_breaks();
+#endif
+    std::string file = flag_value(argc, argv, "--file");
+    if (!file.empty()) CHECK(run_test_file(file));
+    return test_result();
+}
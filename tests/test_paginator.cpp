@@ -0,0 +1,147 @@
+#include "paginator.h"
+#include "content_model.h"
+#include "file_manager.h"
+#include "gpu_renderer.h"
+#include "test_support.h"
+#include "zip_writer.h"
+#include <dirent.h>
+#include <thread>
+
+// Page maps of a book with a held chapter between two oversized ones. The
+// oversized chapters take many STEP_LINES slices, and their page counts
+// must match what streaming each chapter in one go gives. A second start
+// must load the same map from the cache.
+
+namespace {
+    
+std::string oversized_chapter(uint32_t seed) {
+    std::string text = "<html><body>";
+    uint32_t state = seed;
+    for (int paragraph = 0; paragraph < 5000; ++paragraph) {
+        text += "<p>Paragraph";
+        for (int word = 0; word < 40; ++word) {
+            state = state * 1103515245u + 12345u;
+            text += " " + std::to_string(state >> 12);
+        }
+        text += ".</p>\n";
+    }
+    return text + "</body></html>";
+}
+    
+// Cached page maps from earlier runs would skip the pagination under test
+void remove_cached_page_maps() {
+    DIR* dir = opendir(FileManager::CACHE_DIR.c_str());
+    if (!dir) return;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > 6 && name.compare(name.size() - 6, 6, ".pages") == 0) {
+            FileManager::delete_file(FileManager::CACHE_DIR + "/" + name);
+        }
+    }
+    closedir(dir);
+}
+    
+void wait_until_complete(Paginator& paginator) {
+    for (int i = 0; i < 6000 && !paginator.complete(); ++i) {
+        paginator.step();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(paginator.complete());
+}
+    
+size_t streamed_lines(EPUBParser& parser, GPURenderer& renderer, const std::string& href,
+                      const LayoutSettings& settings) {
+    ChapterStream stream(&parser, &renderer);
+    CHECK(stream.open(href, settings.max_width, settings.font_size, settings.hyphenate));
+    while (stream.ensure_line(stream.lines_produced())) {
+    }
+    return stream.lines_produced();
+}
+    
+size_t spine_pages(const Paginator& paginator, int32_t spine_index) {
+    size_t pages = 0;
+    int32_t index = 0;
+    uint32_t position = 0;
+    for (size_t page = 0; paginator.locate(page, index, position); ++page) {
+        if (index == spine_index) ++pages;
+    }
+    return pages;
+}
+    
+} // namespace
+
+int main() {
+    FileManager::initialize_directories();
+    remove_cached_page_maps();
+    
+    std::vector<std::string> chapters;
+    chapters.push_back(oversized_chapter(3));
+    chapters.push_back("<html><body><p>A short chapter.</p></body></html>");
+    chapters.push_back(oversized_chapter(11));
+    CHECK(chapters[0].size() > BookContent::MAX_DOCUMENT_SIZE);
+    
+    ZipWriter zip;
+    add_minimal_book(zip, chapters, true);
+    std::string path = FileManager::EPUB_DIR + "/paginate.epub";
+    CHECK(zip.write(path));
+    
+    EPUBParser parser;
+    CHECK(parser.open_epub(path));
+    GPURenderer renderer;
+    CHECK(renderer.initialize());
+    BookContent content(&parser);
+    content.reset();
+    CHECK(content.is_oversized(0));
+    CHECK(!content.is_oversized(1));
+    CHECK(content.is_oversized(2));
+    
+    LayoutSettings settings;
+    size_t lines_per_page = settings.page_height / GPURenderer::line_height(settings.font_size, settings.line_spacing);
+    size_t first_lines = streamed_lines(parser, renderer, "ch0.xhtml", settings);
+    size_t last_lines = streamed_lines(parser, renderer, "ch2.xhtml", settings);
+    CHECK(first_lines > 4 * Paginator::STEP_LINES);
+    CHECK(last_lines > 4 * Paginator::STEP_LINES);
+    
+    Paginator paginator(&parser, &content, &renderer);
+    paginator.start(path, settings);
+    wait_until_complete(paginator);
+    size_t first_pages = (first_lines + lines_per_page - 1) / lines_per_page;
+    size_t last_pages = (last_lines + lines_per_page - 1) / lines_per_page;
+    CHECK_EQ(spine_pages(paginator, 0), first_pages);
+    CHECK_EQ(spine_pages(paginator, 1), 1u);
+    CHECK_EQ(spine_pages(paginator, 2), last_pages);
+    CHECK_EQ(paginator.page_count(), first_pages + 1 + last_pages);
+    
+    // Held chapters are paginated from a document that is not kept
+    CHECK_EQ(content.documents_loaded(), 0u);
+    CHECK(content.cached_document(1) == nullptr);
+    
+    // Streamed pages start at even lines
+    int32_t spine_index = -1;
+    uint32_t position = 0;
+    CHECK(paginator.locate(first_pages + 2, spine_index, position));
+    CHECK_EQ(spine_index, 2);
+    CHECK_EQ(position, static_cast<uint32_t>(lines_per_page));
+    CHECK_EQ(paginator.page_at(2, position + 1), first_pages + 2);
+    
+    // A restart mid-chapter reopens the stream, and the result is cached
+    size_t page_count = paginator.page_count();
+    remove_cached_page_maps();
+    paginator.start(path, settings);
+    paginator.step();
+    paginator.start(path, settings);
+    wait_until_complete(paginator);
+    CHECK_EQ(paginator.page_count(), page_count);
+    
+    Paginator cached(&parser, &content, &renderer);
+    cached.start(path, settings);
+    CHECK(cached.complete());
+    CHECK(cached.stats().from_cache);
+    CHECK(!paginator.stats().from_cache);
+    CHECK_EQ(cached.page_count(), page_count);
+    
+    paginator.stop();
+    cached.stop();
+    renderer.cleanup();
+    return test_result();
+}
@@ -0,0 +1,114 @@
+#include "file_manager.h"
+#include "gpu_renderer.h"
+#include "test_support.h"
+#include "zip_writer.h"
+#include "ui/reader.cpp"
+#include <thread>
+
+// Jumps into an oversized chapter: the reader opens it at the top and
+// streams towards the target a slice per update, so no single update
+// wraps the whole chapter. The view must then show the page the page map
+// has for the target, and any page turn on the way cancels the jump.
+
+namespace {
+    
+std::string oversized_chapter() {
+    std::string text = "<html><body>";
+    uint32_t state = 13;
+    for (int paragraph = 0; paragraph < 5000; ++paragraph) {
+        text += "<p>Paragraph";
+        for (int word = 0; word < 40; ++word) {
+            state = state * 1103515245u + 12345u;
+            text += " " + std::to_string(state >> 12);
+        }
+        text += ".</p>\n";
+    }
+    return text + "</body></html>";
+}
+    
+SceCtrlData press(unsigned int buttons) {
+    SceCtrlData ctrl = SceCtrlData();
+    ctrl.buttons = buttons;
+    ctrl.lx = ctrl.ly = ctrl.rx = ctrl.ry = 128;
+    return ctrl;
+}
+    
+// Updates until the reader has reached its target; returns the updates taken
+int finish_seek(BookReader& reader) {
+    int updates = 0;
+    while (reader.seeking() && updates < 100000) {
+        reader.update(press(0), 0);
+        ++updates;
+    }
+    CHECK(!reader.seeking());
+    return updates;
+}
+    
+} // namespace
+
+int main() {
+    FileManager::initialize_directories();
+    
+    std::vector<std::string> chapters;
+    chapters.push_back(oversized_chapter());
+    chapters.push_back("<html><body><p>A short chapter.</p></body></html>");
+    CHECK(chapters[0].size() > BookContent::MAX_DOCUMENT_SIZE);
+    
+    ZipWriter zip;
+    add_minimal_book(zip, chapters, true);
+    std::string path = FileManager::EPUB_DIR + "/reader.epub";
+    CHECK(zip.write(path));
+    
+    EPUBParser parser;
+    CHECK(parser.open_epub(path));
+    GPURenderer renderer;
+    CHECK(renderer.initialize());
+    BookReader reader(&renderer, &parser);
+    CHECK(reader.open_book(path));
+    
+    // The last page is the short chapter's, once the page map is done
+    bool paginated = false;
+    for (int i = 0; i < 6000 && !(paginated = reader.jump_to_percentage(100)); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(paginated);
+    size_t last_page = reader.page();
+    CHECK(last_page > 100);
+    
+    // Only held chapters count as chapter switches
+    CHECK_EQ(reader.reader_stats().prefetch_hits + reader.reader_stats().prefetch_misses, 1u);
+    
+    // Back into the oversized chapter lands at its end, many slices on
+    reader.update(press(SCE_CTRL_LEFT), 0);
+    CHECK(reader.seeking());
+    CHECK_EQ(reader.page(), 0u);
+    CHECK(finish_seek(reader) > 10);
+    CHECK(reader.page() + 3 > last_page);
+    reader.update(press(SCE_CTRL_RIGHT), 0);
+    CHECK_EQ(reader.page(), last_page);
+    
+    // Page map positions inside it too
+    CHECK(reader.jump_to_percentage(50));
+    CHECK(reader.seeking());
+    finish_seek(reader);
+    CHECK_EQ(reader.page(), (last_page + 1) * 50 / 100);
+    
+    // Turning a page on the way gives up the jump
+    CHECK(reader.jump_to_percentage(90));
+    CHECK(reader.seeking());
+    reader.update(press(SCE_CTRL_RIGHT), 0);
+    CHECK(!reader.seeking());
+    CHECK_EQ(reader.page(), 1u);
+    
+    // A settings change lays the view out again, and is counted
+    LayoutSettings larger;
+    larger.font_size += 4;
+    reader.apply_settings(larger);
+    CHECK_EQ(reader.reader_stats().relayouts, 1u);
+    CHECK(reader.reader_stats().last_relayout_ms > 0.0);
+    
+    reader.close_book();
+    parser.close();
+    renderer.cleanup();
+    return test_result();
+}
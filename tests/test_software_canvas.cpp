@@ -0,0 +1,144 @@
+#include "software_canvas.h"
+#include "test_support.h"
+#include <cmath>
+#include <random>
+
+// blend_span runs NEON or SSE2 where the build has them and must give the
+// same bytes as blend_span_scalar everywhere. The scalar kernel is checked
+// against the rounding it documents; the SIMD one against the scalar one
+// over every coverage, awkward lengths and unaligned starts.
+
+namespace {
+    
+uint32_t rounded_blend(uint32_t pixel, uint32_t color, uint8_t coverage) {
+    double weight = std::floor(coverage * (color >> 24) / 255.0 + 0.5);
+    if (weight == 0) return pixel;
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        double source = shift == 24 ? 255 : (color >> shift) & 0xFF;
+        double target = (pixel >> shift) & 0xFF;
+        uint32_t channel = static_cast<uint32_t>(std::floor((source * weight + target * (255 - weight)) / 255 + 0.5));
+        result |= channel << shift;
+    }
+    return result;
+}
+    
+void test_scalar_rounding() {
+    std::mt19937 random(1);
+    const uint32_t colors[] = {0xFF000000u, 0xFFFFFFFFu, 0x80336699u, 0x01FF00FFu, 0xFE102030u};
+    for (uint32_t color : colors) {
+        for (int coverage = 0; coverage < 256; ++coverage) {
+            uint32_t pixel = random();
+            uint32_t blended = pixel;
+            uint8_t mask = static_cast<uint8_t>(coverage);
+            SoftwareCanvas::blend_span_scalar(&blended, &mask, 1, color);
+            CHECK_EQ(blended, rounded_blend(pixel, color, mask));
+        }
+    }
+}
+    
+void test_kernels_agree() {
+    std::mt19937 random(2);
+    std::vector<uint32_t> pixels(300);
+    std::vector<uint8_t> coverage(300);
+    int mismatches = 0;
+    for (int round = 0; round < 2000; ++round) {
+        for (size_t i = 0; i < pixels.size(); ++i) pixels[i] = random();
+        for (size_t i = 0; i < coverage.size(); ++i) {
+            // Mostly the extremes, as glyph masks are
+            int pick = random() % 4;
+            coverage[i] = pick == 0 ? 0 : pick == 1 ? 255 : static_cast<uint8_t>(random());
+        }
+        uint32_t color = random();
+        if (round % 3 == 0) color |= 0xFF000000u;
+        size_t start = random() % 16;
+        size_t count = random() % (pixels.size() - start);
+            
+        std::vector<uint32_t> simd = pixels;
+        std::vector<uint32_t> scalar = pixels;
+        SoftwareCanvas::blend_span(simd.data() + start, coverage.data() + start, count, color);
+        SoftwareCanvas::blend_span_scalar(scalar.data() + start, coverage.data() + start, count, color);
+        if (simd != scalar) ++mismatches;
+    }
+    CHECK_EQ(mismatches, 0);
+        
+    // Every coverage against every channel value of one color
+    std::vector<uint8_t> ramp(256 * 256);
+    std::vector<uint32_t> targets(ramp.size());
+    for (size_t i = 0; i < ramp.size(); ++i) {
+        ramp[i] = static_cast<uint8_t>(i >> 8);
+        uint32_t value = i & 0xFF;
+        targets[i] = value | (value << 8) | (value << 16) | (value << 24);
+    }
+    for (uint32_t alpha : {1u, 127u, 128u, 254u, 255u}) {
+        uint32_t color = (alpha << 24) | 0x00C08040u;
+        std::vector<uint32_t> simd = targets;
+        std::vector<uint32_t> scalar = targets;
+        SoftwareCanvas::blend_span(simd.data(), ramp.data(), ramp.size(), color);
+        SoftwareCanvas::blend_span_scalar(scalar.data(), ramp.data(), ramp.size(), color);
+        CHECK(simd == scalar);
+    }
+}
+    
+void draw_shapes(SoftwareCanvas& canvas) {
+    canvas.clear(0xFFFFFFFFu);
+    canvas.fill_rect(10, 10, 60, 40, 0xFF3050D0u);
+    canvas.fill_rect(-20, 90, 50, 50, 0xFF20A040u);         // Off the left and bottom edges
+    canvas.fill_rect(40, 30, 60, 50, 0x80FF0000u);          // Translucent, over the first
+    canvas.draw_line(0, 0, 159, 119, 0xFF000000u);
+    canvas.draw_line(159, 0, 0, 119, 0x80000000u);
+    canvas.draw_line(80, -10, 80, 130, 0xFF0000FFu);
+        
+    // A coverage ramp, like an antialiased edge, clipped on the right
+    std::vector<uint8_t> mask(48 * 16);
+    for (int y = 0; y < 16; ++y) {
+        for (int x = 0; x < 48; ++x) {
+            mask[y * 48 + x] = static_cast<uint8_t>(std::min(255, x * 6 + y * 4));
+        }
+    }
+    canvas.set_clip_rect(0, 0, 140, 120);
+    canvas.blend_mask(mask.data(), 48, 100, 90, 48, 16, 0xFF000000u);
+    canvas.blend_mask(mask.data(), 48, 100, 60, 48, 16, 0xC00060FFu);
+    canvas.clear_clip_rect();
+}
+    
+// No fonts are involved, so the image is the same on every host
+void test_shapes_golden(bool update) {
+    SoftwareCanvas canvas(160, 120);
+    draw_shapes(canvas);
+        
+    std::string golden_path = test_data_path("golden/canvas_shapes.ppm");
+    if (update) {
+        CHECK(canvas.write_ppm(golden_path));
+        return;
+    }
+        
+    PpmImage golden;
+    CHECK(read_ppm(golden_path, golden));
+    CHECK_EQ(golden.width, canvas.width());
+    CHECK_EQ(golden.height, canvas.height());
+    if (golden.width != canvas.width() || golden.height != canvas.height()) return;
+        
+    int differing = 0;
+    for (int y = 0; y < canvas.height(); ++y) {
+        for (int x = 0; x < canvas.width(); ++x) {
+            uint32_t pixel = canvas.row(y)[x];
+            const uint8_t* expected = &golden.rgb[(static_cast<size_t>(y) * golden.width + x) * 3];
+            if ((pixel & 0xFF) != expected[0] || ((pixel >> 8) & 0xFF) != expected[1] ||
+                ((pixel >> 16) & 0xFF) != expected[2]) {
+                ++differing;
+            }
+        }
+    }
+    CHECK_EQ(differing, 0);
+    if (differing) canvas.write_ppm("canvas_shapes.actual.ppm");
+}
+    
+} // namespace
+
+int main(int argc, char** argv) {
+    test_scalar_rounding();
+    test_kernels_agree();
+    test_shapes_golden(has_flag(argc, argv, "--update"));
+    return test_result();
+}
@@ -0,0 +1,153 @@
+#include "software_renderer.h"
+#include "test_support.h"
+#include <algorithm>
+#include <cstdlib>
+
+// A laid-out page drawn with the test font, compared against a golden
+// image. FreeType versions differ slightly in their antialiasing, so a few
+// pixels may be off by a little; placement, justification and hyphens
+// going wrong move far more than that.
+
+namespace {
+    
+const int PAGE_WIDTH = 400;
+const int PAGE_HEIGHT = 320;
+    
+StyledText sample_text() {
+    StyledText text;
+    TextStyle body = {0, 0};
+    TextStyle heading = {0, 1};
+    TextStyle italic = {STYLE_ITALIC, 0};
+        
+    const char* title = "Chapter One";
+    const char* lead = "It was the best of times, it was the worst of times, it was the age of wisdom, ";
+    const char* emphasis = "it was the age of foolishness, ";
+    const char* rest = "it was the epoch of belief, it was the epoch of incredulity.";
+    const char* second = "There were a king with a large jaw and a queen with a plain face, on the throne of England.";
+        
+    text.add_block(0, BLOCK_HEADING);
+    text.text = title;
+    text.text += '\n';
+    text.add_run(0, static_cast<uint32_t>(text.text.size()), text.intern_style(heading));
+        
+    text.add_block(static_cast<uint32_t>(text.text.size()), BLOCK_PARAGRAPH);
+    const char* pieces[] = {lead, emphasis, rest};
+    const TextStyle* styles[] = {&body, &italic, &body};
+    for (int i = 0; i < 3; ++i) {
+        uint32_t offset = static_cast<uint32_t>(text.text.size());
+        text.text += pieces[i];
+        text.add_run(offset, static_cast<uint32_t>(text.text.size()) - offset, text.intern_style(*styles[i]));
+    }
+    text.text += '\n';
+    text.add_run(static_cast<uint32_t>(text.text.size()) - 1, 1, text.intern_style(body));
+        
+    uint32_t offset = static_cast<uint32_t>(text.text.size());
+    text.add_block(offset, BLOCK_PARAGRAPH);
+    text.text += second;
+    text.add_run(offset, static_cast<uint32_t>(text.text.size()) - offset, text.intern_style(body));
+    return text;
+}
+    
+// GPURenderer::layout_styled_text without the hyphenator: headings ragged,
+// paragraphs justified with the optimal-fit breaker
+void layout_text(SoftwareRenderer& renderer, const StyledText& text, int max_width, int font_size,
+                 ChapterLayout& layout) {
+    const int line_spacing = 6;
+    layout.clear();
+    layout.font_size = font_size;
+        
+    std::vector<LineSpan> spans;
+    int y = 0;
+    for (size_t b = 0; b < text.blocks.size(); ++b) {
+        size_t start = text.blocks[b].offset;
+        size_t end = b + 1 < text.blocks.size() ? text.blocks[b + 1].offset : text.text.size();
+        while (end > start && text.text[end - 1] == '\n') --end;
+        if (!layout.lines.empty()) y += font_size + line_spacing;
+            
+        uint8_t kind = text.blocks[b].kind;
+        int size = ChapterLayout::block_font_size(kind, font_size);
+        bool justify = kind == BLOCK_PARAGRAPH;
+        spans.clear();
+        LineBreaker breaker(renderer.advance_table(size), max_width);
+        if (justify) {
+            breaker.break_optimal(text.text.data() + start, end - start, static_cast<uint32_t>(start), spans);
+        } else {
+            breaker.break_lines(text.text.data() + start, end - start, static_cast<uint32_t>(start), spans);
+        }
+        for (const LineSpan& span : spans) {
+            bool stretch = justify && !LineBreaker::ends_paragraph(text.text.data(), end, span);
+            int16_t slack = stretch ? static_cast<int16_t>(max_width - span.width) : 0;
+            TextLine line = { span.offset, span.length, y, 0, slack, kind,
+                              static_cast<uint8_t>(size + line_spacing), span.hyphen };
+            layout.lines.push_back(line);
+            y += size + line_spacing;
+        }
+    }
+    layout.height = y;
+}
+    
+void draw_page(SoftwareRenderer& renderer) {
+    StyledText text = sample_text();
+    ChapterLayout layout;
+    layout_text(renderer, text, PAGE_WIDTH - 100, 16, layout);
+    CHECK(layout.lines.size() >= 6);
+        
+    renderer.clear_screen();
+    renderer.render_chapter_layout(text, layout, 0);
+    renderer.render_progress_bar(50, PAGE_HEIGHT - 24, PAGE_WIDTH - 100, 8, 0.4f, SoftwareRenderer::BLACK,
+                                 SoftwareRenderer::WHITE);
+}
+    
+void test_page_golden(bool update) {
+    SoftwareRenderer renderer(PAGE_WIDTH, PAGE_HEIGHT);
+    CHECK(renderer.initialize(test_data_path("fonts/Lato-Regular.ttf")));
+    draw_page(renderer);
+        
+    // Drawing the same page again hits the glyph cache and gives the same image
+    uint64_t first = renderer.canvas().checksum();
+    draw_page(renderer);
+    CHECK_EQ(renderer.canvas().checksum(), first);
+    CHECK(renderer.cache_stats().hits > 0);
+        
+    std::string golden_path = test_data_path("golden/renderer_page.ppm");
+    if (update) {
+        CHECK(renderer.canvas().write_ppm(golden_path));
+        return;
+    }
+        
+    PpmImage golden;
+    CHECK(read_ppm(golden_path, golden));
+    CHECK_EQ(golden.width, PAGE_WIDTH);
+    CHECK_EQ(golden.height, PAGE_HEIGHT);
+    if (golden.width != PAGE_WIDTH || golden.height != PAGE_HEIGHT) return;
+        
+    // Ink is what matters: count pixels that moved by more than a shade
+    int differing = 0;
+    int inked = 0;
+    const SoftwareCanvas& canvas = renderer.canvas();
+    for (int y = 0; y < PAGE_HEIGHT; ++y) {
+        for (int x = 0; x < PAGE_WIDTH; ++x) {
+            uint32_t pixel = canvas.row(y)[x];
+            const uint8_t* expected = &golden.rgb[(static_cast<size_t>(y) * PAGE_WIDTH + x) * 3];
+            int distance = 0;
+            for (int c = 0; c < 3; ++c) {
+                distance = std::max(distance, std::abs(static_cast<int>((pixel >> (c * 8)) & 0xFF) - expected[c]));
+            }
+            if (distance > 48) ++differing;
+            if (expected[0] < 128) ++inked;
+        }
+    }
+    CHECK(inked > 1000);
+    CHECK(differing <= inked / 100);
+    if (differing) {
+        std::cout << differing << " of " << inked << " inked pixels differ from the golden image" << std::endl;
+        canvas.write_ppm("renderer_page.actual.ppm");
+    }
+}
+    
+} // namespace
+
+int main(int argc, char** argv) {
+    test_page_golden(has_flag(argc, argv, "--update"));
+    return test_result();
+}
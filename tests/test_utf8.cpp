@@ -0,0 +1,203 @@
+#include "utf8.h"
+#include "test_support.h"
+#include "utf8_reference.h"
+
+// Utf8Decoder against a byte-at-a-time reference: every scalar value
+// round-trips, each kind of ill-formed sequence decodes to U+FFFD one byte
+// at a time, and every decoding path agrees on random input. ascii_prefix
+// is checked with the first non-ASCII byte at each position of blocks up
+// to 80 bytes, which covers both sides of the 16-byte NEON step on ARM
+// builds and the 8-byte step everywhere.
+
+namespace {
+    
+std::string bytes(std::initializer_list<int> values) {
+    std::string text;
+    for (int value : values) text += static_cast<char>(value);
+    return text;
+}
+    
+std::vector<uint32_t> decode_next(const std::string& text) {
+    std::vector<uint32_t> codepoints;
+    Utf8Decoder decoder(text);
+    while (!decoder.done()) codepoints.push_back(decoder.next());
+    return codepoints;
+}
+    
+std::vector<uint32_t> decode_bulk(const std::string& text) {
+    std::vector<uint32_t> codepoints(text.size() + 1);
+    codepoints.resize(Utf8Decoder::decode(text.data(), text.size(), &codepoints[0]));
+    return codepoints;
+}
+    
+std::string encode_all(const std::vector<uint32_t>& codepoints) {
+    std::string text;
+    char buffer[4];
+    for (uint32_t codepoint : codepoints) text.append(buffer, Utf8Decoder::encode(codepoint, buffer));
+    return text;
+}
+    
+// Every path must give the reference's codepoints; valid input must also
+// pass is_valid and come back unchanged from sanitize and encode
+void check_paths(const std::string& text) {
+    std::vector<uint32_t> expected = reference_utf8_decode(text);
+    CHECK(decode_next(text) == expected);
+    CHECK(decode_bulk(text) == expected);
+        
+    // A literal U+FFFD is well-formed; one the reference made up is not
+    bool valid = true;
+    for (size_t i = 0; i < text.size();) {
+        size_t start = i;
+        uint32_t codepoint = reference_utf8_next(text.data(), text.size(), i);
+        if (codepoint == Utf8Decoder::REPLACEMENT_CHARACTER && i - start == 1) valid = false;
+    }
+    CHECK_EQ(Utf8Decoder::is_valid(text.data(), text.size()), valid);
+        
+    std::string sanitized;
+    Utf8Decoder::sanitize(text.data(), text.size(), sanitized);
+    CHECK(sanitized == encode_all(expected));
+    CHECK(Utf8Decoder::is_valid(sanitized.data(), sanitized.size()));
+}
+    
+void test_round_trip() {
+    size_t failures = 0;
+    char buffer[4];
+    for (uint32_t codepoint = 0; codepoint <= 0x10FFFF; ++codepoint) {
+        if (codepoint >= 0xD800 && codepoint <= 0xDFFF) continue;
+        size_t length = Utf8Decoder::encode(codepoint, buffer);
+        size_t expected_length = codepoint < 0x80 ? 1 : codepoint < 0x800 ? 2 : codepoint < 0x10000 ? 3 : 4;
+        Utf8Decoder decoder(buffer, length);
+        size_t at = 0;
+        bool ok = length == expected_length && decoder.next() == codepoint && decoder.done() &&
+                  Utf8Decoder::sequence_length(buffer, length) == length &&
+                  reference_utf8_next(buffer, length, at) == codepoint && at == length &&
+                  Utf8Decoder::incomplete_suffix(buffer, length) == 0;
+        for (size_t cut = 1; ok && cut < length; ++cut) {
+            ok = Utf8Decoder::incomplete_suffix(buffer, cut) == cut && Utf8Decoder::sequence_length(buffer, cut) == 0;
+        }
+        if (!ok && failures++ < 5) std::cerr << "Round trip failed for U+" << std::hex << codepoint << std::dec << std::endl;
+    }
+    CHECK_EQ(failures, 0u);
+        
+    // Surrogates and values past the last scalar value cannot be encoded
+    CHECK_EQ(Utf8Decoder::encode(0xD800, buffer), 3u);
+    CHECK(std::string(buffer, 3) == "\xEF\xBF\xBD");
+    CHECK_EQ(Utf8Decoder::encode(0x110000, buffer), 3u);
+    CHECK(std::string(buffer, 3) == "\xEF\xBF\xBD");
+}
+    
+void test_ill_formed() {
+    const uint32_t R = Utf8Decoder::REPLACEMENT_CHARACTER;
+    struct Case {
+        std::string text;
+        std::vector<uint32_t> expected;
+    };
+    const Case cases[] = {
+        { bytes({0x80}), {R} },                                     // Lone continuation
+        { bytes({0xBF, 0x41}), {R, 'A'} },
+        { bytes({0xC0, 0x80}), {R, R} },                            // Overlong NUL
+        { bytes({0xC1, 0xBF}), {R, R} },
+        { bytes({0xE0, 0x80, 0x80}), {R, R, R} },                   // Overlong 3-byte
+        { bytes({0xE0, 0x9F, 0xBF}), {R, R, R} },
+        { bytes({0xF0, 0x80, 0x80, 0x80}), {R, R, R, R} },          // Overlong 4-byte
+        { bytes({0xF0, 0x8F, 0xBF, 0xBF}), {R, R, R, R} },
+        { bytes({0xED, 0xA0, 0x80}), {R, R, R} },                   // High surrogate
+        { bytes({0xED, 0xBF, 0xBF}), {R, R, R} },                   // Low surrogate
+        { bytes({0xED, 0x9F, 0xBF}), {0xD7FF} },                    // Just below
+        { bytes({0xF4, 0x90, 0x80, 0x80}), {R, R, R, R} },          // Past U+10FFFF
+        { bytes({0xF4, 0x8F, 0xBF, 0xBF}), {0x10FFFF} },
+        { bytes({0xF5, 0x80, 0x80, 0x80}), {R, R, R, R} },          // Lead bytes never used
+        { bytes({0xF8, 0x88, 0x80, 0x80, 0x80}), {R, R, R, R, R} },
+        { bytes({0xFE, 0xFF}), {R, R} },
+        { bytes({0xC3}), {R} },                                     // Cut short at the end
+        { bytes({0xE2, 0x82}), {R, R} },
+        { bytes({0xF0, 0x9F, 0x98}), {R, R, R} },
+        { bytes({0xC3, 0x41}), {R, 'A'} },                          // Cut short by ASCII
+        { bytes({0xE2, 0x41, 0x82, 0xAC}), {R, 'A', R, R} },
+        { bytes({0xF0, 0x9F, 0x98, 0x41}), {R, R, R, 'A'} },
+        { bytes({0xC3, 0xA9, 0xC3}), {0xE9, R} },
+    };
+    for (const Case& c : cases) {
+        CHECK(reference_utf8_decode(c.text) == c.expected);
+        CHECK(decode_next(c.text) == c.expected);
+        CHECK(decode_bulk(c.text) == c.expected);
+        check_paths(c.text);
+            
+        // Behind ASCII runs long enough for the word-at-a-time paths
+        for (size_t pad = 1; pad <= 33; pad += 8) {
+            std::string padded = std::string(pad, 'x') + c.text + std::string(pad, 'y');
+            std::vector<uint32_t> expected(pad, 'x');
+            expected.insert(expected.end(), c.expected.begin(), c.expected.end());
+            expected.insert(expected.end(), pad, 'y');
+            CHECK(decode_bulk(padded) == expected);
+            CHECK(decode_next(padded) == expected);
+        }
+    }
+}
+    
+void test_ascii_prefix() {
+    // Offsets into the buffer vary the alignment of each load
+    std::vector<char> buffer(96 + 16, 'a');
+    for (size_t offset = 0; offset < 16; ++offset) {
+        for (size_t length = 0; length <= 80; ++length) {
+            const char* data = &buffer[offset];
+            CHECK_EQ(Utf8Decoder::ascii_prefix(data, length), length);
+            for (size_t at = 0; at < length; ++at) {
+                for (int high : {0x80, 0xC3, 0xFF}) {
+                    buffer[offset + at] = static_cast<char>(high);
+                    size_t prefix = Utf8Decoder::ascii_prefix(data, length);
+                    buffer[offset + at] = 'a';
+                    if (prefix != at) {
+                        std::cerr << "ascii_prefix(" << length << ") with byte " << high << " at " << at
+                                  << " gave " << prefix << std::endl;
+                        CHECK_EQ(prefix, at);
+                        return;
+                    }
+                }
+            }
+        }
+    }
+}
+    
+void test_random() {
+    // Mostly well-formed mixed-script text with some corrupted bytes
+    const uint32_t samples[] = { 'a', 'Z', ' ', 0xE9, 0x3B1, 0x416, 0x5D0, 0x627, 0x915, 0x3042, 0x4E2D, 0xAC00,
+                                 0xFF01, 0x1F600, 0x10348, 0x10FFFF, 0x7FF, 0x800, 0xFFFF, 0x10000 };
+    const size_t sample_count = sizeof(samples) / sizeof(samples[0]);
+    uint32_t state = 12345;
+    for (int round = 0; round < 2000; ++round) {
+        std::vector<uint32_t> codepoints;
+        state = state * 1103515245u + 12345u;
+        size_t count = (state >> 16) % 60;
+        for (size_t i = 0; i < count; ++i) {
+            state = state * 1103515245u + 12345u;
+            uint32_t pick = state >> 8;
+            codepoints.push_back(pick % 3 == 0 ? 'a' + pick % 26 : samples[pick % sample_count]);
+        }
+        std::string text = encode_all(codepoints);
+        CHECK(decode_bulk(text) == codepoints);
+        CHECK(Utf8Decoder::is_valid(text.data(), text.size()));
+            
+        // Corrupt, drop or cut bytes and compare with the reference
+        for (int damage = 0; damage < 3 && !text.empty(); ++damage) {
+            state = state * 1103515245u + 12345u;
+            size_t at = (state >> 8) % text.size();
+            switch ((state >> 4) % 3) {
+                case 0: text[at] = static_cast<char>(state >> 24); break;
+                case 1: text.erase(at, 1); break;
+                default: text.resize(at); break;
+            }
+            check_paths(text);
+        }
+    }
+}
+    
+} // namespace
+
+int main() {
+    test_round_trip();
+    test_ill_formed();
+    test_ascii_prefix();
+    test_random();
+    return test_result();
+}
@@ -0,0 +1,103 @@
+#include "xml_pull_parser.h"
+#include "epub_parser.h"
+#include "file_manager.h"
+#include "test_support.h"
+#include "zip_writer.h"
+
+namespace {
+    
+std::string decoded(const char* text) {
+    std::string out;
+    XmlPullParser::append_decoded(text, text + std::strlen(text), out);
+    return out;
+}
+    
+void test_references() {
+    CHECK_EQ(decoded("a &lt;b&gt; &amp; &quot;c&quot; &apos;d&apos;"), std::string("a <b> & \"c\" 'd'"));
+    CHECK_EQ(decoded("&#65;&#x42;&#X43;"), std::string("ABC"));
+    CHECK_EQ(decoded("&#x1F600;"), std::string("\xF0\x9F\x98\x80"));
+    CHECK_EQ(decoded("&#233;t&#xE9;"), std::string("\xC3\xA9t\xC3\xA9"));
+        
+    // Not characters: kept as written, never turned into U+0000 or cut short
+    const char* verbatim[] = {"&#;", "&#x;", "&#X;", "&#xZZ;", "&#12ab;", "&#0;", "&#x0;", "&#x110000;",
+                              "&nbsp;", "&unknown;"};
+    for (const char* reference : verbatim) {
+        std::string out = decoded(reference);
+        CHECK_EQ(out, std::string(reference));
+        CHECK(out.find('\0') == std::string::npos);
+    }
+        
+    // Ampersands that start no reference
+    CHECK_EQ(decoded("fish & chips"), std::string("fish & chips"));
+    CHECK_EQ(decoded("a&b"), std::string("a&b"));
+    CHECK_EQ(decoded("x &verylongnamehere; y"), std::string("x &verylongnamehere; y"));
+}
+    
+void test_events() {
+    const char* xml = "<?xml version=\"1.0\"?><!-- c --><ncx:a id=\"x&#x;\" n='1'><b/>t&amp;u<![CDATA[<raw>]]></ncx:a>";
+    XmlPullParser parser(xml, std::strlen(xml));
+        
+    CHECK_EQ(parser.next(), XmlPullParser::EVENT_START_ELEMENT);
+    CHECK(parser.name_is("a"));
+    std::string value;
+    CHECK(parser.attribute("id", value));
+    CHECK_EQ(value, std::string("x&#x;"));
+    CHECK(parser.attribute_equals("n", "1"));
+    CHECK(!parser.attribute("missing", value));
+        
+    CHECK_EQ(parser.next(), XmlPullParser::EVENT_START_ELEMENT);
+    CHECK(parser.name_is("b"));
+    CHECK_EQ(parser.depth(), 2);
+    CHECK_EQ(parser.next(), XmlPullParser::EVENT_END_ELEMENT);
+        
+    std::string text;
+    CHECK_EQ(parser.next(), XmlPullParser::EVENT_TEXT);
+    parser.append_text(text);
+    CHECK_EQ(parser.next(), XmlPullParser::EVENT_TEXT);
+    parser.append_text(text);
+    CHECK_EQ(text, std::string("t&u<raw>"));
+        
+    CHECK_EQ(parser.next(), XmlPullParser::EVENT_END_ELEMENT);
+    CHECK_EQ(parser.next(), XmlPullParser::EVENT_END_DOCUMENT);
+}
+    
+// Titles go into the TOC's pooled strings, which are NUL-terminated, so a
+// reference decoded to U+0000 used to truncate them
+void test_toc_titles() {
+    std::string ncx =
+        "<?xml version=\"1.0\"?><ncx xmlns=\"http://www.daisy.org/z3986/2005/ncx/\"><navMap>"
+        "<navPoint id=\"n1\" playOrder=\"1\"><navLabel><text>One &#x; two &#xZZ; three</text></navLabel>"
+        "<content src=\"ch0.xhtml\"/>"
+        "<navPoint id=\"n2\" playOrder=\"2\"><navLabel><text>Caf&#xE9; &amp; more</text></navLabel>"
+        "<content src=\"ch0.xhtml#s&#0;\"/></navPoint>"
+        "</navPoint></navMap></ncx>";
+        
+    ZipWriter zip;
+    std::vector<std::string> chapters(1, "<html><body><p>Text</p></body></html>");
+    add_minimal_book(zip, chapters, true,
+                     "<item id=\"ncx\" href=\"toc.ncx\" media-type=\"application/x-dtbncx+xml\"/>");
+    zip.add("OEBPS/toc.ncx", ncx, true);
+    std::string path = FileManager::EPUB_DIR + "/ncx_references.epub";
+    CHECK(zip.write(path));
+        
+    EPUBParser parser;
+    CHECK(parser.open_epub(path));
+    CHECK(parser.parse_ncx("OEBPS/toc.ncx"));
+    const EPUBParser::TableOfContents& toc = parser.get_table_of_contents();
+    CHECK_EQ(toc.size(), 2u);
+    if (toc.size() != 2) return;
+    CHECK_EQ(std::string(toc.title(0)), std::string("One &#x; two &#xZZ; three"));
+    CHECK_EQ(std::string(toc.title(1)), std::string("Caf\xC3\xA9 & more"));
+    CHECK_EQ(std::string(toc.content_src(1)), std::string("ch0.xhtml#s&#0;"));
+    CHECK_EQ(toc.entry(1).parent, 0);
+}
+    
+} // namespace
+
+int main() {
+    CHECK(FileManager::initialize_directories());
+    test_references();
+    test_events();
+    test_toc_titles();
+    return test_result();
+}
@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+"""Generates src/epub/line_break_tables.cpp from the UCD's LineBreak.txt.
+
+    tools/gen_line_break_tables.py LineBreak.txt > src/epub/line_break_tables.cpp
+
+Writes the two-level codepoint -> class tables and the class pair table
+that LineBreakScanner reads. LB1 is resolved here, so the tables only hold
+classes the scanner handles. The class order must match LineBreakClass in
+include/line_break.h. Run test_line_break afterwards, with ICU installed
+and --file LineBreakTest.txt from the same UCD version.
+"""
+
+import re
+import sys
+
+# Pair table classes first, in the order of the table's rows and columns;
+# the rest are handled by the scanner before it looks at a pair
+PAIR_CLASSES = ['OP', 'CL', 'CP', 'QU', 'GL', 'NS', 'EX', 'SY', 'IS', 'PR', 'PO', 'NU', 'AL', 'HL',
+                'ID', 'IN', 'HY', 'BA', 'BB', 'B2', 'ZW', 'CB', 'WJ', 'H2', 'H3', 'JL', 'JV', 'JT',
+                'RI', 'EB', 'EM']
+CLASSES = PAIR_CLASSES + ['CM', 'ZWJ', 'SP', 'BK', 'CR', 'LF', 'NL']
+
+BLOCK_SHIFT = 7
+CODEPOINTS = 0x110000
+
+PROHIBITED, INDIRECT, DIRECT = 0, 1, 2
+
+
+def resolve(cls, category):
+    # LB1, as for text whose language is not known
+    if cls in ('AI', 'SG', 'XX'):
+        return 'AL'
+    if cls == 'SA':
+        return 'CM' if category in ('Mn', 'Mc') else 'AL'
+    if cls == 'CJ':
+        return 'NS'
+    return cls
+
+
+def read_classes(path):
+    classes = ['XX'] * CODEPOINTS
+    categories = [''] * CODEPOINTS
+    line_pattern = re.compile(r'^([0-9A-F]+)(?:\.\.([0-9A-F]+))?\s*;\s*(\w+)\s*(?:#\s*(\w\w))?')
+    with open(path, encoding='utf-8') as source:
+        for line in source:
+            # Unlisted codepoints take the @missing defaults from the header
+            missing = line.startswith('# @missing:')
+            if missing:
+                line = line[len('# @missing:'):].strip()
+            match = line_pattern.match(line)
+            if not match:
+                continue
+            first = int(match.group(1), 16)
+            last = int(match.group(2), 16) if match.group(2) else first
+            for codepoint in range(first, last + 1):
+                classes[codepoint] = match.group(3)
+                categories[codepoint] = match.group(4) or ''
+    return [resolve(cls, category) for cls, category in zip(classes, categories)]
+
+
+def breaks_after_spaces(a, b):
+    """Whether A SP+ B may break after the spaces: the rules that see
+    through spaces, then LB18."""
+    if b == 'ZW': return False                                          # LB7
+    if a == 'ZW': return True                                           # LB8
+    if b == 'WJ': return False                                          # LB11
+    if b in ('CL', 'CP', 'EX', 'IS', 'SY'): return False                # LB13
+    if a == 'OP': return False                                          # LB14
+    if a == 'QU' and b == 'OP': return False                            # LB15
+    if a in ('CL', 'CP') and b == 'NS': return False                    # LB16
+    if a == 'B2' and b == 'B2': return False                            # LB17
+    return True                                                         # LB18
+
+
+def breaks_between(a, b):
+    """Whether A B may break, the rules in order."""
+    if b == 'ZW': return False                                          # LB7
+    if a == 'ZW': return True                                           # LB8
+    if b == 'WJ' or a == 'WJ': return False                             # LB11
+    if a == 'GL': return False                                          # LB12
+    if b == 'GL' and a not in ('BA', 'HY'): return False                # LB12a
+    if b in ('CL', 'CP', 'EX', 'IS', 'SY'): return False                # LB13
+    if a == 'OP': return False                                          # LB14
+    if a == 'QU' and b == 'OP': return False                            # LB15
+    if a in ('CL', 'CP') and b == 'NS': return False                    # LB16
+    if a == 'B2' and b == 'B2': return False                            # LB17
+    if a == 'QU' or b == 'QU': return False                             # LB19
+    if a == 'CB' or b == 'CB': return True                              # LB20
+    if b in ('BA', 'HY', 'NS') or a == 'BB': return False               # LB21
+    if a == 'SY' and b == 'HL': return False                            # LB21b
+    if b == 'IN': return False                                          # LB22
+    alphabetic = ('AL', 'HL')
+    if (a in alphabetic and b == 'NU') or (a == 'NU' and b in alphabetic): return False         # LB23
+    if (a == 'PR' and b in ('ID', 'EB', 'EM')) or (a in ('ID', 'EB', 'EM') and b == 'PO'):   # LB23a
+        return False
+    if (a in ('PR', 'PO') and b in alphabetic) or (a in alphabetic and b in ('PR', 'PO')):   # LB24
+        return False
+    # LB25, as pairs. A closing bracket keeps a following PO or PR only at
+    # the end of a number, which the scanner tracks.
+    if (a, b) in (('NU', 'PO'), ('NU', 'PR'), ('PO', 'OP'), ('PO', 'NU'), ('PR', 'OP'), ('PR', 'NU'),
+                  ('HY', 'NU'), ('IS', 'NU'), ('NU', 'NU'), ('SY', 'NU')):
+        return False
+    if a == 'JL' and b in ('JL', 'JV', 'H2', 'H3'): return False        # LB26
+    if a in ('JV', 'H2') and b in ('JV', 'JT'): return False
+    if a in ('JT', 'H3') and b == 'JT': return False
+    hangul = ('JL', 'JV', 'JT', 'H2', 'H3')
+    if (a in hangul and b == 'PO') or (a == 'PR' and b in hangul): return False              # LB27
+    if a in alphabetic and b in alphabetic: return False                # LB28
+    if a == 'IS' and b in alphabetic: return False                      # LB29
+    if (a in alphabetic + ('NU',) and b == 'OP') or (a == 'CP' and b in alphabetic + ('NU',)):  # LB30
+        return False
+    if a == 'RI' and b == 'RI': return False                            # LB30a; the scanner counts pairs
+    if a == 'EB' and b == 'EM': return False                            # LB30b
+    return True                                                         # LB31
+
+
+def pair_action(a, b):
+    """PROHIBITED: no break even with spaces between. INDIRECT: a break
+    only after spaces. DIRECT: a break either way."""
+    if breaks_between(a, b):
+        return DIRECT
+    return INDIRECT if breaks_after_spaces(a, b) else PROHIBITED
+
+
+def emit_array(out, declaration, values, per_line):
+    out.write(declaration + ' = {\n')
+    for i in range(0, len(values), per_line):
+        out.write('    ' + ', '.join(str(v) for v in values[i:i + per_line]) + ',\n')
+    out.write('};\n')
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.stderr.write('usage: gen_line_break_tables.py LineBreak.txt\n')
+        return 1
+
+    with open(sys.argv[1], encoding='utf-8') as source:
+        version = source.readline().strip('# \n')
+    class_ids = [CLASSES.index(cls) for cls in read_classes(sys.argv[1])]
+
+    # Identical blocks are stored once
+    block_size = 1 << BLOCK_SHIFT
+    blocks = []
+    block_ids = {}
+    index = []
+    for start in range(0, CODEPOINTS, block_size):
+        block = tuple(class_ids[start:start + block_size])
+        if block not in block_ids:
+            block_ids[block] = len(blocks)
+            blocks.append(block)
+        index.append(block_ids[block])
+    if len(blocks) > 0x100:
+        sys.stderr.write('%d distinct blocks do not fit a byte index; raise BLOCK_SHIFT\n' % len(blocks))
+        return 1
+
+    out = sys.stdout
+    out.write('// Generated by tools/gen_line_break_tables.py from %s; do not edit.\n' % version)
+    out.write('// %d blocks of %d classes, %d bytes in all.\n\n' %
+              (len(blocks), block_size, len(blocks) * block_size + len(index) + len(PAIR_CLASSES) ** 2))
+    out.write('#include "line_break.h"\n\n')
+    out.write('static_assert(LineBreakScanner::BLOCK_SHIFT == %d, "tables were generated for another block size");\n' %
+              BLOCK_SHIFT)
+    out.write('static_assert(LB_PAIR_CLASSES == %d && LB_NL == %d, "tables were generated for other classes");\n\n' %
+              (len(PAIR_CLASSES), CLASSES.index('NL')))
+    emit_array(out, 'const uint8_t LineBreakScanner::CLASS_INDEX[%d]' % len(index), index, 24)
+    out.write('\n')
+    emit_array(out, 'const uint8_t LineBreakScanner::CLASS_BLOCKS[%d]' % (len(blocks) * block_size),
+               [cls for block in blocks for cls in block], 32)
+    out.write('\n// Rows are the class before the break, columns the class after it:\n')
+    out.write('// %d is prohibited, %d indirect (only after spaces), %d direct\n' % (PROHIBITED, INDIRECT, DIRECT))
+    out.write('const uint8_t LineBreakScanner::PAIR_ACTIONS[LB_PAIR_CLASSES][LB_PAIR_CLASSES] = {\n')
+    out.write('    //' + ''.join('%3s' % cls for cls in PAIR_CLASSES) + '\n')
+    for a in PAIR_CLASSES:
+        row = ', '.join(str(pair_action(a, b)) for b in PAIR_CLASSES)
+        out.write('    { %s },  // %s\n' % (row, a))
+    out.write('};\n')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())